@@ -11,6 +11,8 @@ import tempfile
 import re
 import configparser
 import argparse
+import gzip
+import hashlib
 
 # Skip script if PlatformIO target is erase, or clean
 pio_targets = os.environ.get('PIOENV', '') + ' ' + ' '.join(sys.argv)
@@ -18,9 +20,18 @@ if any(x in pio_targets for x in ['erase', 'clean', 'buildfs', 'uploadfs']):
 	print('embed_assets.py: Skipping script for erase/clean target.')
 	sys.exit(0)
 
+# Add force parameter via environment variable or command line
+parser = argparse.ArgumentParser()
+parser.add_argument('--force', action='store_true', help='Force regeneration of all .inc files')
+# The host tests (test/CMakeLists.txt) only need the JSON defaults and the
+# timezone table, and keep them out of the source tree
+parser.add_argument('--data-only', action='store_true', help='Only embed the JSON assets and the timezone table (no npm tools needed)')
+parser.add_argument('--out-dir', help='Directory for the .inc files (default: src/inc)')
+args, unknown = parser.parse_known_args()
+
 # Use project root as base (PlatformIO sets cwd to project root)
 ASSET_DIR = os.path.join(os.getcwd(), 'src/assets')
-OUT_DIR = os.path.join(os.getcwd(), 'src/inc')
+OUT_DIR = args.out_dir or os.path.join(os.getcwd(), 'src/inc')
 
 # Ensure output directory exists
 os.makedirs(OUT_DIR, exist_ok=True)
@@ -58,8 +69,9 @@ def ensure_terser():
 		subprocess.check_call(['npm', 'install', 'terser@5.44.1'])
 		print('terser installed.')
 
-ensure_html_minifier()
-ensure_terser()
+if not args.data_only:
+	ensure_html_minifier()
+	ensure_terser()
 
 
 # Add config.json as config_default.inc (no minification)
@@ -71,7 +83,6 @@ ASSETS = [
 	('config.html', 'config_html.inc'),
 	('config.js', 'config_js.inc'),
 	('config.json', 'config_default.inc'),
-	('timezones.json', 'timezones_json.inc'),
 	('presets.json', 'presets_json.inc'),
 ]
 
@@ -128,6 +139,9 @@ def minify_asset(infile, ext, do_minify=True):
 	with open(infile, 'r', encoding='utf-8') as f:
 		return f.read()
 
+# Per-asset size report: (name, source bytes, embedded bytes)
+SIZE_REPORT = []
+
 def to_inc(infile, outfile, do_minify=True):
 	try:
 		infile_path = os.path.join(ASSET_DIR, infile)
@@ -159,10 +173,17 @@ def to_inc(infile, outfile, do_minify=True):
 				print(f"ERROR: Terser minification failed for {infile}: {e}", file=sys.stderr)
 				sys.exit(1)
 		minified = minify_asset(infile_path, ext, do_minify)
-		with tempfile.NamedTemporaryFile('w+', delete=False, encoding='utf-8', suffix=ext) as tmp:
-			tmp.write(minified)
+		# JSON assets are parsed by the firmware and stay plain; pages are served
+		# gzip-encoded. mtime=0 keeps the output (and its ETag) reproducible.
+		is_json = ext == '.json'
+		payload = minified.encode('utf-8')
+		if not is_json:
+			payload = gzip.compress(payload, compresslevel=9, mtime=0)
+		with tempfile.NamedTemporaryFile('wb', delete=False, suffix=ext) as tmp:
+			tmp.write(payload)
 			tmp.flush()
 			tmp_path = tmp.name
+		SIZE_REPORT.append((infile, os.path.getsize(infile_path), len(payload)))
 		with tempfile.NamedTemporaryFile('w+', delete=False, encoding='utf-8', suffix='.inc') as xxd_tmp:
 			subprocess.run(['xxd', '-i', '-n', var_name, tmp_path], stdout=xxd_tmp, check=True)
 			xxd_tmp.flush()
@@ -186,7 +207,6 @@ def to_inc(infile, outfile, do_minify=True):
 		array_decl = array_match.group(1)
 		len_decl = len_match.group(1)
 		# If the file is a .json, do not use PROGMEM even for ESP8266/AVR
-		is_json = ext == '.json'
 		if is_json:
 			branch = f"const unsigned char {var_name}[] = {array_decl[array_decl.find('{'):array_decl.find('};')+2]}\n{len_decl.replace('static ', '')}\n"
 			with open(outfile_path, 'w', encoding='utf-8') as out:
@@ -194,9 +214,12 @@ def to_inc(infile, outfile, do_minify=True):
 		else:
 			branch_esp = f"#if defined(ESP8266) || defined(ARDUINO_ARCH_AVR)\nconst unsigned char {var_name}[] PROGMEM = {array_decl[array_decl.find('{'):array_decl.find('};')+2]}\n{len_decl.replace('static ', '')}\n"
 			branch_else = f"#else\nconst unsigned char {var_name}[] = {array_decl[array_decl.find('{'):array_decl.find('};')+2]}\n{len_decl.replace('static ', '')}\n#endif\n"
+			# Strong validator: hash of the exact bytes that are served
+			etag = hashlib.sha256(payload).hexdigest()[:16]
 			with open(outfile_path, 'w', encoding='utf-8') as out:
 				out.write(branch_esp)
 				out.write(branch_else)
+				out.write(f'const char {var_name}_etag[] = "\\"{etag}\\"";\n')
 		os.remove(xxd_tmp_path)
 		os.remove(tmp_path)
 		print(f'Success: {outfile_path}')
@@ -206,6 +229,74 @@ def to_inc(infile, outfile, do_minify=True):
 		return False
 
 
+# POSIX TZ offset "[+-]hh[:mm[:ss]]" -> seconds (POSIX counts west of UTC)
+def parse_posix_offset(text):
+	m = re.match(r'([+-]?)(\d{1,3})(?::(\d{2}))?(?::(\d{2}))?', text)
+	if not m:
+		raise ValueError(f'bad offset in {text!r}')
+	secs = int(m.group(2)) * 3600 + int(m.group(3) or 0) * 60 + int(m.group(4) or 0)
+	return (-secs if m.group(1) == '-' else secs), text[m.end():]
+
+def parse_posix_rule(text):
+	m = re.match(r'M(\d{1,2})\.(\d)\.(\d)(?:/(.*))?$', text)
+	if not m:
+		raise ValueError(f'unsupported DST rule {text!r} (only Mm.w.d is supported)')
+	time = 7200
+	if m.group(4):
+		time, rest = parse_posix_offset(m.group(4))
+		if rest:
+			raise ValueError(f'bad rule time in {text!r}')
+	return (int(m.group(1)), int(m.group(2)), int(m.group(3)), time)
+
+# "STDoff[DST[off][,start,end]]" -> (std, dst, hasDst, start, end), offsets in seconds east of UTC
+def parse_posix_tz(posix):
+	name_re = re.compile(r'<[^>]+>|[A-Za-z]{3,}')
+	m = name_re.match(posix)
+	if not m:
+		raise ValueError(f'bad zone name in {posix!r}')
+	west, rest = parse_posix_offset(posix[m.end():])
+	std = -west
+	if not rest:
+		return (std, std, False, (0, 0, 0, 0), (0, 0, 0, 0))
+	m = name_re.match(rest)
+	if not m:
+		raise ValueError(f'bad DST name in {posix!r}')
+	rest = rest[m.end():]
+	dst = std + 3600
+	if rest and rest[0] != ',':
+		west, rest = parse_posix_offset(rest)
+		dst = -west
+	rules = rest.lstrip(',').split(',')
+	if len(rules) != 2:
+		raise ValueError(f'DST zone without start/end rules: {posix!r}')
+	return (std, dst, True, parse_posix_rule(rules[0]), parse_posix_rule(rules[1]))
+
+# Precompile timezones.json into a C table (see src/timezone.h)
+def generate_timezone_table(force=False):
+	import json
+	src_path = os.path.join(ASSET_DIR, 'timezones.json')
+	out_path = os.path.join(OUT_DIR, 'timezones_table.inc')
+	if not asset_needs_update(src_path, out_path, force=force):
+		print('Skipping unchanged asset: timezones.json')
+		return True
+	try:
+		with open(src_path, 'r', encoding='utf-8') as f:
+			zones = json.load(f)
+		lines = ['// Generated by scripts/embed_assets.py from src/assets/timezones.json, do not edit', 'const TimezoneInfo TIMEZONES[] = {']
+		for zone in zones:
+			std, dst, has_dst, start, end = parse_posix_tz(zone['posix'])
+			lines.append(f'\t{{"{zone["name"]}", {std}, {dst}, {"true" if has_dst else "false"}, {{{start[0]}, {start[1]}, {start[2]}, {start[3]}}}, {{{end[0]}, {end[1]}, {end[2]}, {end[3]}}}}},')
+		lines.append('};')
+		lines.append('const size_t TIMEZONE_COUNT = sizeof(TIMEZONES) / sizeof(TIMEZONES[0]);')
+		with open(out_path, 'w', encoding='utf-8') as out:
+			out.write('\n'.join(lines) + '\n')
+		print(f'Success: {out_path} ({len(zones)} zones)')
+		return True
+	except Exception as e:
+		print(f'ERROR: Failed to generate timezone table: {e}', file=sys.stderr)
+		return False
+
+
 minify_opt = os.environ.get('PLATFORMIO_MINIFY')
 if minify_opt is None:
 	config = configparser.ConfigParser()
@@ -216,14 +307,12 @@ do_minify = minify_opt.lower() in ('1', 'true', 'yes', 'on')
 
 
 
-# Add force parameter via environment variable or command line
-parser = argparse.ArgumentParser()
-parser.add_argument('--force', action='store_true', help='Force regeneration of all .inc files')
-args, unknown = parser.parse_known_args()
 force = args.force or os.environ.get('EMBED_ASSETS_FORCE', '0') in ('1', 'true', 'yes', 'on')
 
 all_ok = True
 for src, dst in ASSETS:
+	if args.data_only and not src.endswith('.json'):
+		continue
 	src_path = os.path.join(ASSET_DIR, src)
 	inc_path = os.path.join(OUT_DIR, dst)
 	if asset_needs_update(src_path, inc_path, force=force):
@@ -236,6 +325,13 @@ for src, dst in ASSETS:
 		all_ok = all_ok and ok
 	else:
 		print(f'Skipping unchanged asset: {src}')
+all_ok = generate_timezone_table(force=force) and all_ok
+if SIZE_REPORT:
+	total_src = sum(r[1] for r in SIZE_REPORT)
+	total_out = sum(r[2] for r in SIZE_REPORT)
+	for name, src_size, out_size in SIZE_REPORT:
+		print(f'  {name:<16} {src_size:>8} -> {out_size:>8} bytes (saved {src_size - out_size})')
+	print(f'  {"total":<16} {total_src:>8} -> {total_out:>8} bytes (saved {total_src - total_out})')
 if all_ok:
 	print('Web assets embedded as .inc files.')
 else:
@@ -0,0 +1,112 @@
+#!/usr/bin/env python3
+"""Build a delta patch that turns one firmware image into another.
+
+Usage: make_delta.py OLD.bin NEW.bin OUT.patch.gz
+
+The patch format is described in src/delta.h; the device applies it while it
+downloads. Matching follows bsdiff: exact 8-byte seeds are extended forward
+while most bytes still agree, so code that only moved (shifted addresses,
+changed literals) becomes a diff region of mostly zero bytes, which gzip
+shrinks to almost nothing. Bytes with no usable match become extra data.
+"""
+
+import gzip
+import hashlib
+import struct
+import sys
+
+DELTA_MAGIC = 0x50444744  # "DGDP"
+DELTA_VERSION = 1
+SEED = 8            # bytes that must match exactly to start a region
+MIN_MATCH = 24      # shorter regions cost more in records than they save
+MAX_GAP = 128       # stop extending after this many bytes without gain
+
+
+def index_seeds(old):
+    """Last position of every SEED-byte string in the old image."""
+    seeds = {}
+    for i in range(0, len(old) - SEED + 1):
+        seeds[old[i:i + SEED]] = i
+    return seeds
+
+
+def extend(old, new, o, n):
+    """Length of the approximate match at old[o:], new[n:] (bsdiff scoring)."""
+    limit = min(len(old) - o, len(new) - n)
+    same = best_same = best_len = 0
+    i = 0
+    while i < limit:
+        if old[o + i] == new[n + i]:
+            same += 1
+        i += 1
+        if same * 2 - i > best_same * 2 - best_len:
+            best_same, best_len = same, i
+        elif i - best_len > MAX_GAP:
+            break
+    return best_len
+
+
+def find_regions(old, new):
+    """(new start, old start, length) of the diff regions, in new order."""
+    seeds = index_seeds(old)
+    regions = []
+    pos = 0
+    last_delta = 0  # old - new offset of the previous region
+    while pos <= len(new) - SEED:
+        candidates = []
+        # Prefer continuing the previous alignment, then the indexed seed
+        if 0 <= pos + last_delta <= len(old) - SEED:
+            candidates.append(pos + last_delta)
+        seeded = seeds.get(new[pos:pos + SEED])
+        if seeded is not None:
+            candidates.append(seeded)
+        best_len, best_old = 0, 0
+        for o in candidates:
+            if old[o:o + SEED] != new[pos:pos + SEED]:
+                continue
+            length = extend(old, new, o, pos)
+            if length > best_len:
+                best_len, best_old = length, o
+        if best_len < MIN_MATCH:
+            pos += 1
+            continue
+        regions.append((pos, best_old, best_len))
+        last_delta = best_old - pos
+        pos += best_len
+    return regions
+
+
+def build_patch(old, new):
+    out = bytearray(struct.pack('<IHHII', DELTA_MAGIC, DELTA_VERSION, 0, len(old), len(new)))
+    out += hashlib.sha256(old).digest()
+
+    regions = find_regions(old, new)
+    # A leading record without diff bytes carries the extra data before the
+    # first region and seeks to where that region starts in the old image
+    first_new, first_old = (regions[0][0], regions[0][1]) if regions else (len(new), 0)
+    out += struct.pack('<IIi', 0, first_new, first_old)
+    out += new[:first_new]
+    for i, (n, o, length) in enumerate(regions):
+        extra_end, next_old = (regions[i + 1][0], regions[i + 1][1]) if i + 1 < len(regions) else (len(new), o + length)
+        out += struct.pack('<IIi', length, extra_end - (n + length), next_old - (o + length))
+        out += bytes((new[n + k] - old[o + k]) & 0xFF for k in range(length))
+        out += new[n + length:extra_end]
+    return bytes(out)
+
+
+def main(argv):
+    if len(argv) != 4:
+        print(__doc__.strip().splitlines()[2], file=sys.stderr)
+        return 2
+    with open(argv[1], 'rb') as f:
+        old = f.read()
+    with open(argv[2], 'rb') as f:
+        new = f.read()
+    patch = build_patch(old, new)
+    with open(argv[3], 'wb') as f:
+        f.write(gzip.compress(patch, 9, mtime=0))
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv))
@@ -182,6 +182,136 @@ function loadEffects() {
     }
 });
 
+// Binary WebSocket protocol (see src/ws_protocol.h)
+const WS_PROTOCOL_VERSION = 1;
+const WS_MSG = { STATE: 0x01, PREVIEW: 0x02, HELLO: 0x10, POWER: 0x11, BRIGHTNESS: 0x12, EFFECT: 0x13, PARAMS: 0x14, PRESET: 0x15, TRANSITION: 0x16, PREVIEW_SUBSCRIBE: 0x17 };
+const WS_FIELD = { POWER: 1, BRIGHTNESS: 2, EFFECT: 4, PRESET: 8, PARAMS: 16, TRANSITION: 32, CLOCK: 64 };
+
+// Packed 0xRRGGBBWW <-> #RRGGBB / #RRGGBBWW, matching parse_hex_rgbw/format_hex_rgbw
+function rgbwHexToU32(hex) {
+    hex = (hex || '').replace(/^#/, '');
+    if (hex.length === 6) hex += '00';
+    const v = parseInt(hex, 16);
+    return isNaN(v) ? 0 : v >>> 0;
+}
+
+function u32ToRgbwHex(v) {
+    const hex = (v >>> 0).toString(16).padStart(8, '0').toUpperCase();
+    return '#' + (hex.endsWith('00') ? hex.slice(0, 6) : hex);
+}
+
+function minutesToHHMM(m) {
+    if (m === 0xFFFF) return 'N/A';
+    return `${String(Math.floor(m / 60)).padStart(2, '0')}:${String(m % 60).padStart(2, '0')}`;
+}
+
+// Decode a WS_MSG_STATE into a partial state object with the JSON field names
+function decodeWsState(buffer) {
+    const view = new DataView(buffer);
+    if (view.byteLength < 4 || view.getUint8(0) !== WS_PROTOCOL_VERSION || view.getUint8(1) !== WS_MSG.STATE) return null;
+    const mask = view.getUint16(2, true);
+    let pos = 4;
+    const delta = {};
+    try {
+        if (mask & WS_FIELD.POWER) delta.power = view.getUint8(pos++) !== 0;
+        if (mask & WS_FIELD.BRIGHTNESS) delta.brightness = view.getUint8(pos++);
+        if (mask & WS_FIELD.EFFECT) delta.effect = view.getUint8(pos++);
+        if (mask & WS_FIELD.PRESET) delta.preset = view.getUint8(pos++);
+        if (mask & WS_FIELD.PARAMS) {
+            const speed = view.getUint8(pos++);
+            const intensity = view.getUint8(pos++);
+            const count = view.getUint8(pos++);
+            const colors = [];
+            for (let i = 0; i < count; i++, pos += 4) colors.push(u32ToRgbwHex(view.getUint32(pos, true)));
+            delta.params = { speed, intensity, colors };
+        }
+        if (mask & WS_FIELD.TRANSITION) { delta.transitionTime = view.getUint32(pos, true); pos += 4; }
+        if (mask & WS_FIELD.CLOCK) {
+            const sod = view.getUint32(pos, true);
+            if (sod !== 0xFFFFFFFF) {
+                delta.time = `${String(Math.floor(sod / 3600)).padStart(2, '0')}:${String(Math.floor(sod / 60) % 60).padStart(2, '0')}:${String(sod % 60).padStart(2, '0')}`;
+            }
+            delta.sunrise = minutesToHHMM(view.getUint16(pos + 4, true));
+            delta.sunset = minutesToHHMM(view.getUint16(pos + 6, true));
+        }
+    } catch (e) {
+        console.error('[WS] Truncated binary state:', e);
+        return null;
+    }
+    return delta;
+}
+
+// Live preview: apply WS_MSG_PREVIEW run/skip tokens (see src/preview.h) onto the last frame
+let previewPixels = new Uint8ClampedArray(0);
+
+function applyPreviewFrame(buffer) {
+    const bytes = new Uint8Array(buffer);
+    if (bytes.length < 7) return;
+    const keyframe = (bytes[2] & 1) !== 0;
+    const count = bytes[3] | (bytes[4] << 8);
+    if (previewPixels.length !== count * 4) {
+        // Deltas against a frame we never saw are useless; wait for the next keyframe
+        if (!keyframe) return;
+        previewPixels = new Uint8ClampedArray(count * 4);
+    }
+    let p = 0;
+    for (let pos = 7; pos + 5 <= bytes.length; pos += 5) {
+        p += bytes[pos];
+        for (let i = 0; i < bytes[pos + 1] && p < count; i++, p++) {
+            previewPixels[p * 4] = bytes[pos + 2];
+            previewPixels[p * 4 + 1] = bytes[pos + 3];
+            previewPixels[p * 4 + 2] = bytes[pos + 4];
+            previewPixels[p * 4 + 3] = 255;
+        }
+    }
+    const canvas = document.getElementById('previewCanvas');
+    if (!canvas || count === 0) return;
+    if (canvas.width !== count) canvas.width = count;
+    canvas.getContext('2d').putImageData(new ImageData(previewPixels, count, 1), 0, 0);
+}
+
+function setPreviewEnabled(enabled) {
+    const canvas = document.getElementById('previewCanvas');
+    if (canvas && canvas.style) canvas.style.display = enabled ? '' : 'none';
+    previewPixels = new Uint8ClampedArray(0);
+    if (wsBinaryReady()) wsSendCommand(WS_MSG.PREVIEW_SUBSCRIBE, [enabled ? 1 : 0]);
+}
+
+function mergeStateDelta(base, delta) {
+    return { ...base, ...delta };
+}
+
+function wsBinaryReady() {
+    return ws && ws.readyState === WebSocket.OPEN;
+}
+
+function wsSendCommand(type, bytes) {
+    ws.send(new Uint8Array([WS_PROTOCOL_VERSION, type, ...bytes]));
+}
+
+function u32Bytes(v) {
+    return [v & 0xFF, (v >>> 8) & 0xFF, (v >>> 16) & 0xFF, (v >>> 24) & 0xFF];
+}
+
+// Encode sendState() updates as binary commands; returns false if a field has no command
+function sendStateBinary(updates) {
+    const known = ['brightness', 'transitionTime', 'power', 'effect', 'params'];
+    if (!Object.keys(updates).every(k => known.includes(k))) return false;
+    // Same order as the REST handler applies them
+    if ('brightness' in updates) wsSendCommand(WS_MSG.BRIGHTNESS, [Number(updates.brightness) & 0xFF]);
+    if ('transitionTime' in updates) wsSendCommand(WS_MSG.TRANSITION, u32Bytes(Number(updates.transitionTime)));
+    if ('power' in updates) wsSendCommand(WS_MSG.POWER, [updates.power ? 1 : 0]);
+    if ('effect' in updates) wsSendCommand(WS_MSG.EFFECT, [Number(updates.effect) & 0xFF]);
+    if ('params' in updates) {
+        const params = { ...(currentState.params || {}), ...updates.params };
+        const colors = Array.isArray(params.colors) ? params.colors.slice(0, 8) : [];
+        const bytes = [Number(params.speed) & 0xFF, Number(params.intensity) & 0xFF, colors.length];
+        colors.forEach(c => bytes.push(...u32Bytes(rgbwHexToU32(c))));
+        wsSendCommand(WS_MSG.PARAMS, bytes);
+    }
+    return true;
+}
+
 // WebSocket Connection
 function initializeWebSocket() {
     let wsUrl;
@@ -193,9 +323,15 @@ function initializeWebSocket() {
         wsUrl = `${wsProtocol}//${window.location.host}/ws`;
     }
     ws = new WebSocket(wsUrl);
+    ws.binaryType = 'arraybuffer';
 
     ws.onopen = () => {
         console.log('[WS] Connected');
+        // Switch this connection to binary state deltas
+        ws.send(new Uint8Array([WS_PROTOCOL_VERSION, WS_MSG.HELLO]));
+        // Subscriptions are per connection; restore the preview after a reconnect
+        const previewToggle = document.getElementById('previewToggle');
+        if (previewToggle && previewToggle.checked) setPreviewEnabled(true);
         const statusIndicator = document.getElementById('statusIndicator');
         if (statusIndicator && statusIndicator.style) statusIndicator.style.color = '#00cc88';
         if (reconnectInterval) {
@@ -205,6 +341,15 @@ function initializeWebSocket() {
     };
 
     ws.onmessage = (event) => {
+        if (event.data instanceof ArrayBuffer) {
+            if (new Uint8Array(event.data)[1] === WS_MSG.PREVIEW) {
+                applyPreviewFrame(event.data);
+                return;
+            }
+            const delta = decodeWsState(event.data);
+            if (delta) updateState(mergeStateDelta(currentState, delta));
+            return;
+        }
         console.log('[WS] Message:', event.data);
         try {
             const data = JSON.parse(event.data);
@@ -413,6 +558,11 @@ function setupEventListeners() {
             sendState({ power: e.target.checked });
         });
     }
+    // Live preview toggle (opt-in stream, off by default)
+    const previewToggle = document.getElementById('previewToggle');
+    if (previewToggle) {
+        previewToggle.addEventListener('change', (e) => setPreviewEnabled(e.target.checked));
+    }
     // Brightness slider (percent 0–100%)
     const brightnessSlider = document.getElementById('brightnessSlider');
     if (brightnessSlider) {
@@ -578,6 +728,7 @@ function setupEventListeners() {
 
 // Send state update to server
 function sendState(updates) {
+    if (wsBinaryReady() && sendStateBinary(updates)) return;
     fetch(BASE_URL + '/api/state', {
         method: 'POST',
         headers: {
@@ -674,6 +825,12 @@ function displayPresets() {
 }
 
 function applyPreset(presetId) {
+    if (wsBinaryReady()) {
+        wsSendCommand(WS_MSG.PRESET, [presetId & 0xFF]);
+        currentState.preset = presetId;
+        displayPresets();
+        return;
+    }
     fetch(BASE_URL + '/api/preset', {
         method: 'POST',
         headers: {
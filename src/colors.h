@@ -37,6 +37,15 @@ inline uint32_t parse_hex_rgbw(const char* hexstr) {
   return pack_rgbw(r, g, b, w);
 }
 
+// Formatting: "#RRGGBB" when the white channel is unused, "#RRGGBBWW" otherwise
+inline void format_hex_rgbw(uint32_t color, char* out, size_t size) {
+  if ((color & 0xFF) == 0) {
+    snprintf(out, size, "#%06X", (unsigned int)(color >> 8));
+  } else {
+    snprintf(out, size, "#%08X", (unsigned int)color);
+  }
+}
+
 // Math
 inline void scale_rgbw_brightness(uint8_t in_r, uint8_t in_g, uint8_t in_b, uint8_t in_w, uint8_t brightness, uint8_t &out_r, uint8_t &out_g, uint8_t &out_b, uint8_t &out_w) {
   out_r = (uint8_t)ceilf((float)in_r * brightness / 255.0f);
@@ -2,100 +2,206 @@
 using std::vector;
 
 #include "inc/config_default.inc"
-#include "inc/timezones_json.inc"
 #include "config.h"
 
 #include <vector>
 #include <LittleFS.h>
 #include <ArduinoJson.h>
 #include "debug.h"
+#include "json_stream.h"
+#include "timezone.h"
+#include "record_io.h"
+#include "persistence.h"
 
 #define FILESYSTEM LittleFS
 
-// Serialize the current configuration to a JSON string for API
-String Configuration::toJsonString() {
-    StaticJsonDocument<4096> doc;
-    JsonObject ledObj = doc.createNestedObject("led");
-    ledObj["pin"] = led.pin;
-    ledObj["count"] = led.count;
-    ledObj["type"] = led.type;
-    ledObj["colorOrder"] = led.colorOrder;
-    ledObj["relayPin"] = led.relayPin;
-    ledObj["relayActiveHigh"] = led.relayActiveHigh;
-
-    JsonObject safetyObj = doc.createNestedObject("safety");
-    safetyObj["minTransitionTime"] = safety.minTransitionTime;
-    safetyObj["maxBrightness"] = hexToPercent(safety.maxBrightness);
-
-    JsonObject timeObj = doc.createNestedObject("time");
-    timeObj["ntpServer"] = time.ntpServer;
-    timeObj["timezone"] = time.timezone;
-    timeObj["latitude"] = time.latitude;
-    timeObj["longitude"] = time.longitude;
-    timeObj["dstEnabled"] = time.dstEnabled;
-
-    JsonObject netObj = doc.createNestedObject("network");
-    netObj["hostname"] = network.hostname;
-    netObj["apPassword"] = network.apPassword;
-    netObj["ssid"] = network.ssid;
-
-    JsonObject tObj = doc.createNestedObject("transitionTimes");
-    tObj["powerOn"] = transitionTimes.powerOn;
-    tObj["schedule"] = transitionTimes.schedule;
-    tObj["manual"] = transitionTimes.manual;
-    tObj["effect"] = transitionTimes.effect;
-
-    JsonArray timersArray = doc.createNestedArray("timers");
-    for (size_t i = 0; i < timers.size(); i++) {
-        const auto& t = timers[i];
-        JsonObject timerObj = timersArray.createNestedObject();
-        timerObj["id"] = i;
-        timerObj["enabled"] = t.enabled;
-        timerObj["type"] = t.type;
-        timerObj["hour"] = t.hour;
-        timerObj["minute"] = t.minute;
-        timerObj["presetId"] = t.presetId;
-        timerObj["brightness"] = hexToPercent(t.brightness);
+static void timerToJson(const Timer& t, size_t id, JsonObject timerObj) {
+    timerObj["id"] = id;
+    timerObj["enabled"] = t.enabled;
+    timerObj["type"] = t.type;
+    timerObj["hour"] = t.hour;
+    timerObj["minute"] = t.minute;
+    timerObj["presetId"] = t.presetId;
+    timerObj["brightness"] = hexToPercent(t.brightness);
+}
+
+// GET /api/timers only lists timers that are enabled or have been set up
+static bool timerIsListed(const Timer& t) {
+    bool isActive = t.enabled || t.hour != 0 || t.minute != 0;
+#ifdef TIMER_NAME_SUPPORT
+    isActive = isActive || (t.name && t.name[0] != '\0');
+#endif
+    return isActive;
+}
+
+// Serialize the configuration for the API one section (or timer) at a time
+bool Configuration::writeJsonFragment(JsonStreamState& state, char* buf, size_t size, size_t& len) {
+    enum { LED, SAFETY, TIME, NETWORK, TRANSITIONS, TIMERS_OPEN, FIRST_TIMER };
+    StaticJsonDocument<384> doc;
+    switch (state.index) {
+        case LED:
+            doc["pin"] = led.pin;
+            doc["count"] = led.count;
+            doc["type"] = led.type;
+            doc["colorOrder"] = led.colorOrder;
+            doc["relayPin"] = led.relayPin;
+            doc["relayActiveHigh"] = led.relayActiveHigh;
+            len = serializeJsonFragment(buf, size, "{\"led\":", doc);
+            return true;
+        case SAFETY:
+            doc["minTransitionTime"] = safety.minTransitionTime;
+            doc["maxBrightness"] = hexToPercent(safety.maxBrightness);
+            len = serializeJsonFragment(buf, size, ",\"safety\":", doc);
+            return true;
+        case TIME:
+            doc["ntpServer"] = time.ntpServer;
+            doc["timezone"] = time.timezone;
+            doc["latitude"] = time.latitude;
+            doc["longitude"] = time.longitude;
+            doc["dstEnabled"] = time.dstEnabled;
+            len = serializeJsonFragment(buf, size, ",\"time\":", doc);
+            return true;
+        case NETWORK:
+            doc["hostname"] = network.hostname;
+            doc["apPassword"] = network.apPassword;
+            doc["ssid"] = network.ssid;
+            len = serializeJsonFragment(buf, size, ",\"network\":", doc);
+            return true;
+        case TRANSITIONS:
+            doc["powerOn"] = transitionTimes.powerOn;
+            doc["schedule"] = transitionTimes.schedule;
+            doc["manual"] = transitionTimes.manual;
+            doc["effect"] = transitionTimes.effect;
+            len = serializeJsonFragment(buf, size, ",\"transitionTimes\":", doc);
+            return true;
+        case TIMERS_OPEN:
+            len = strlcpy(buf, ",\"timers\":[", size);
+            return true;
     }
-    String output;
-    serializeJson(doc, output);
-    return output;
+    size_t i = state.index - FIRST_TIMER;
+    if (i < timers.size()) {
+        timerToJson(timers[i], i, doc.to<JsonObject>());
+        len = serializeJsonItem(state, buf, size, doc);
+        return true;
+    }
+    return closeJsonStream(state, "]}", buf, size, len);
 }
-// Ensure filesystem is mounted before any file operation
-static bool ensureFilesystemMounted() {
-    static bool mounted = false;
-    if (!mounted) {
-        if (!FILESYSTEM.begin()) {
-            if (!FILESYSTEM.format()) {
-                return false;
-            }
-            if (!FILESYSTEM.begin()) {
-                return false;
-            }
-        }
-        mounted = true;
+
+bool Configuration::writeTimersJsonFragment(JsonStreamState& state, char* buf, size_t size, size_t& len) {
+    if (state.index == 0) {
+        len = strlcpy(buf, "{\"timers\":[", size);
+        return true;
     }
-    return true;
+    size_t i = state.index - 1;
+    if (i < timers.size()) {
+        if (!timerIsListed(timers[i])) return true;
+        StaticJsonDocument<256> doc;
+        timerToJson(timers[i], i, doc.to<JsonObject>());
+        len = serializeJsonItem(state, buf, size, doc);
+        return true;
+    }
+    return closeJsonStream(state, "]}", buf, size, len);
 }
 
-// Recursively merge src into dst, filling missing/null fields from src
-void mergeJson(JsonVariant dst, JsonVariantConst src) {
-    JsonObject dstObj = dst.as<JsonObject>();
-    JsonObjectConst srcObj = src.as<JsonObjectConst>();
-    if (srcObj.isNull() || dstObj.isNull()) return;
-    for (JsonPairConst kv : srcObj) {
-        const char* key = kv.key().c_str();
-        if (!dstObj.containsKey(key) || dstObj[key].isNull()) {
-            dstObj[key] = kv.value();
-        } else if (kv.value().is<JsonObjectConst>() && dstObj[key].is<JsonObject>()) {
-            mergeJson(dstObj[key], kv.value());
-        }
+// Binary record in CONFIG_FILE; bump the version when appending fields
+#define CONFIG_RECORD_MAGIC 0x46434744  // "DGCF"
+#define CONFIG_RECORD_VERSION 1
+
+static void encodeConfig(const Configuration& c, RecordWriter& w) {
+    w.u8(c.led.pin);
+    w.u16(c.led.count);
+    w.str(c.led.type);
+    w.str(c.led.colorOrder);
+    w.u32((uint32_t)c.led.relayPin);
+    w.u8(c.led.relayActiveHigh);
+
+    w.u32(c.safety.minTransitionTime);
+    w.u8(c.safety.maxBrightness);
+
+    w.u32(c.transitionTimes.powerOn);
+    w.u32(c.transitionTimes.schedule);
+    w.u32(c.transitionTimes.manual);
+    w.u32(c.transitionTimes.effect);
+
+    w.str(c.network.hostname);
+    w.str(c.network.apPassword);
+    w.str(c.network.ssid);
+    w.str(c.network.password);
+
+    w.str(c.time.ntpServer);
+    w.str(c.time.timezone);
+    w.f64(c.time.latitude);
+    w.f64(c.time.longitude);
+    w.u8(c.time.dstEnabled);
+
+    w.u8((uint8_t)c.timers.size());
+    for (const Timer& t : c.timers) {
+        w.u8(t.enabled);
+        w.u8((uint8_t)t.type);
+        w.u8(t.hour);
+        w.u8(t.minute);
+        w.u8(t.presetId);
+        w.u8(t.brightness);
     }
 }
 
+// Fields missing from an older record keep whatever value they had
+static void decodeConfig(Configuration& c, RecordReader& r) {
+    uint8_t flag;
+    uint32_t value;
+    r.u8(c.led.pin);
+    r.u16(c.led.count);
+    r.str(c.led.type);
+    r.str(c.led.colorOrder);
+    if (r.u32(value)) c.led.relayPin = (int32_t)value;
+    if (r.u8(flag)) c.led.relayActiveHigh = flag;
+
+    r.u32(c.safety.minTransitionTime);
+    r.u8(c.safety.maxBrightness);
+
+    r.u32(c.transitionTimes.powerOn);
+    r.u32(c.transitionTimes.schedule);
+    r.u32(c.transitionTimes.manual);
+    r.u32(c.transitionTimes.effect);
+
+    r.str(c.network.hostname);
+    r.str(c.network.apPassword);
+    r.str(c.network.ssid);
+    r.str(c.network.password);
+
+    r.str(c.time.ntpServer);
+    r.str(c.time.timezone);
+    r.f64(c.time.latitude);
+    r.f64(c.time.longitude);
+    if (r.u8(flag)) c.time.dstEnabled = flag;
+
+    uint8_t count;
+    if (r.u8(count)) {
+        std::vector<Timer> timers;
+        timers.reserve(count);
+        for (uint8_t i = 0; i < count; ++i) {
+            Timer t;
+            uint8_t type;
+            if (!r.u8(flag) || !r.u8(type) || !r.u8(t.hour) || !r.u8(t.minute) ||
+                !r.u8(t.presetId) || !r.u8(t.brightness)) break;
+            t.enabled = flag;
+            t.type = (TimerType)type;
+            timers.push_back(t);
+        }
+        c.timers = timers;
+    }
+}
 
+static bool readFile(const char* path, std::vector<uint8_t>& data) {
+    File file = FILESYSTEM.open(path, "r");
+    if (!file) return false;
+    data.resize(file.size());
+    size_t got = data.empty() ? 0 : file.read(data.data(), data.size());
+    file.close();
+    return got == data.size() && !data.empty();
+}
 
-// Loads config file and converts percent to hex for internal use
+// Loads a JSON file into doc (legacy config import)
 bool Configuration::loadFromFile(const char* path, JsonDocument& doc) {
     if (!ensureFilesystemMounted()) return false;
     File file = FILESYSTEM.open(path, "r");
@@ -110,157 +216,80 @@ bool Configuration::loadFromFile(const char* path, JsonDocument& doc) {
     return true;
 }
 
+// Factory defaults from the embedded config_default.inc (percent at this boundary)
+bool Configuration::loadDefaults() {
+    DynamicJsonDocument doc(2048);
+    if (deserializeJson(doc, web_config_default, web_config_default_len)) return false;
+    partialUpdate(doc.as<JsonObject>());
+    return true;
+}
 
-// Saves config file, converting hex to percent for human-readable storage
-bool Configuration::saveToFile(const char* path, const JsonDocument& doc) {
-    if (!ensureFilesystemMounted()) return false;
-    File file = FILESYSTEM.open(path, "w");
-    if (!file) {
+// A config.json on the filesystem (written by older firmware, or uploaded by
+// hand) is applied on top of the current settings, then removed
+bool Configuration::importLegacyFile() {
+    if (!FILESYSTEM.exists(LEGACY_CONFIG_FILE)) return false;
+    DynamicJsonDocument doc(2048);
+    if (!loadFromFile(LEGACY_CONFIG_FILE, doc)) {
+        debugPrintln("[Config] Ignoring unreadable " LEGACY_CONFIG_FILE);
         return false;
     }
-    size_t written = serializeJson(doc, file);
-    file.flush();
-    file.close();
-    delay(10);
-    return written > 0;
+    partialUpdate(doc.as<JsonObject>());
+    debugPrintln("[Config] Imported " LEGACY_CONFIG_FILE);
+    return true;
 }
 
+bool Configuration::writeRecord() {
+    RecordWriter writer(CONFIG_RECORD_MAGIC, CONFIG_RECORD_VERSION);
+    encodeConfig(*this, writer);
+    const std::vector<uint8_t>& record = writer.seal();
+    return writeFileAtomic(CONFIG_FILE, record.data(), record.size());
+}
 
 bool Configuration::load() {
-    // Load defaults from config_default.inc
-    StaticJsonDocument<2048> doc;
-    StaticJsonDocument<2048> defaultsDoc;
-    DeserializationError errDefault = deserializeJson(defaultsDoc, web_config_default, web_config_default_len);
-    if (errDefault) {
-        setDefaults();
-        return false;
-    }
+    if (!ensureFilesystemMounted()) return false;
 
-    bool updated = false;
-    bool loadedFromFile = loadFromFile(CONFIG_FILE, doc);
-    if (!loadedFromFile) {
-        doc = defaultsDoc;
-        updated = true;
-    } else {
-        // Deep merge: fill missing/null fields from defaults
-        mergeJson(doc, defaultsDoc);
-        saveToFile(CONFIG_FILE, doc);
-        updated = true;
+    // A current record holds every field, so the usual boot never touches JSON
+    std::vector<uint8_t> data;
+    RecordReader reader;
+    uint16_t version = 0;
+    bool haveRecord = readFile(CONFIG_FILE, data) &&
+                      reader.open(data.data(), data.size(), CONFIG_RECORD_MAGIC, version);
+    if (!haveRecord || version < CONFIG_RECORD_VERSION) {
+        if (!loadDefaults()) return false;
     }
+    if (haveRecord) decodeConfig(*this, reader);
+    bool imported = importLegacyFile();
+    markAllChanged();
 
-    // (copy the field assignment logic from before, but now doc is always complete)
-    // LED Configuration
-    if (doc.containsKey("led")) {
-        JsonObject ledObj = doc["led"];
-        led.pin = ledObj["pin"];
-        led.count = ledObj["count"];
-        led.type = ledObj["type"].as<String>();
-        led.colorOrder = ledObj["colorOrder"].as<String>();
-        led.relayPin = ledObj["relayPin"];
-        led.relayActiveHigh = ledObj["relayActiveHigh"];
+    if (haveRecord && version >= CONFIG_RECORD_VERSION && !imported) {
+        _savedGeneration = gen.configFile();
+        return true;
     }
-    // Safety Configuration
-    if (doc.containsKey("safety")) {
-        JsonObject safetyObj = doc["safety"];
-        safety.minTransitionTime = safetyObj["minTransitionTime"];
-        int percent = safetyObj["maxBrightness"];
-        safety.maxBrightness = percentToHex(percent);
-    }
-    // Transition Times
-    if (doc.containsKey("transitionTimes")) {
-        JsonObject tObj = doc["transitionTimes"];
-        transitionTimes.powerOn = tObj["powerOn"];
-        transitionTimes.schedule = tObj["schedule"];
-        transitionTimes.manual = tObj["manual"];
-        transitionTimes.effect = tObj["effect"];
-    }
-    // Network Configuration
-    if (doc.containsKey("network")) {
-        JsonObject netObj = doc["network"];
-        if (netObj.containsKey("hostname")) network.hostname = netObj["hostname"].as<String>();
-        if (netObj.containsKey("apPassword")) network.apPassword = netObj["apPassword"].as<String>();
-        if (netObj.containsKey("ssid")) network.ssid = netObj["ssid"].as<String>();
-        if (netObj.containsKey("password")) network.password = netObj["password"].as<String>();
-    }
-    // Time Configuration
-    if (doc.containsKey("time")) {
-        JsonObject timeObj = doc["time"];
-        time.ntpServer = timeObj["ntpServer"].as<String>();
-        time.timezone = timeObj["timezone"].as<String>();
-        time.latitude = timeObj["latitude"].as<double>();
-        time.longitude = timeObj["longitude"].as<double>();
-        time.dstEnabled = timeObj["dstEnabled"];
-    }
-    // Timers
-    if (doc.containsKey("timers")) {
-        JsonArray timersArray = doc["timers"];
-        loadTimersFromJson(timersArray);
-    }
-
-    if (updated) {
-        saveToFile(CONFIG_FILE, doc);
+    // First boot, an older schema or an imported JSON file: rewrite the record
+    if (writeRecord()) {
+        _savedGeneration = gen.configFile();
+        if (imported) FILESYSTEM.remove(LEGACY_CONFIG_FILE);
     }
     return true;
 }
 
 bool Configuration::save() {
-    StaticJsonDocument<2048> doc;
-
-    // LED Configuration
-    JsonObject ledObj = doc.createNestedObject("led");
-    ledObj["pin"] = led.pin;
-    ledObj["count"] = led.count;
-    ledObj["type"] = led.type;
-    ledObj["colorOrder"] = led.colorOrder;
-    ledObj["relayPin"] = led.relayPin;
-    ledObj["relayActiveHigh"] = led.relayActiveHigh;
-
-    // Safety Configuration
-    JsonObject safetyObj = doc.createNestedObject("safety");
-    safetyObj["minTransitionTime"] = safety.minTransitionTime;
-    safetyObj["maxBrightness"] = hexToPercent(safety.maxBrightness);
-
-    // Transition Times
-    JsonObject tObj = doc.createNestedObject("transitionTimes");
-    tObj["powerOn"] = transitionTimes.powerOn;
-    tObj["schedule"] = transitionTimes.schedule;
-    tObj["manual"] = transitionTimes.manual;
-    tObj["effect"] = transitionTimes.effect;
-
-    // Network Configuration
-    JsonObject netObj = doc.createNestedObject("network");
-    netObj["hostname"] = network.hostname;
-    netObj["apPassword"] = network.apPassword;
-    netObj["ssid"] = network.ssid;
-    // DO NOT return password in API response (omit in API, but save to file)
-    netObj["password"] = network.password;
-
-    // Time Configuration
-    JsonObject timeObj = doc.createNestedObject("time");
-    timeObj["ntpServer"] = time.ntpServer;
-    timeObj["timezone"] = time.timezone;
-    timeObj["latitude"] = time.latitude;
-    timeObj["longitude"] = time.longitude;
-    timeObj["dstEnabled"] = time.dstEnabled;
-
-    // Timers
-    JsonArray timersArray = doc.createNestedArray("timers");
-    for (size_t i = 0; i < timers.size(); i++) {
-        JsonObject timerObj = timersArray.createNestedObject();
-        timerObj["enabled"] = timers[i].enabled;
-        timerObj["type"] = timers[i].type;
-        timerObj["hour"] = timers[i].hour;
-        timerObj["minute"] = timers[i].minute;
-        timerObj["presetId"] = timers[i].presetId;
-        timerObj["brightness"] = hexToPercent(timers[i].brightness);
-    }
-
-    return saveToFile(CONFIG_FILE, doc);
+    // Nothing to write if no persisted section changed since the last save
+    uint32_t fileGeneration = gen.configFile();
+    if (fileGeneration == _savedGeneration) return true;
+    bool ok = writeRecord();
+    if (ok) _savedGeneration = fileGeneration;
+    return ok;
 }
 
 // Update only fields present in the received JSON (partial update)
 // Example usage: config.partialUpdate(docFromFrontend);
 void Configuration::partialUpdate(const JsonObject& update) {
+    LEDConfig prevLed = led;
+    SafetyConfig prevSafety = safety;
+    TransitionTimesConfig prevTransitionTimes = transitionTimes;
+    NetworkConfig prevNetwork = network;
+    TimeConfig prevTime = time;
     if (update.containsKey("led")) {
         JsonObject ledObj = update["led"];
         if (ledObj.containsKey("pin")) led.pin = ledObj["pin"];
@@ -306,7 +335,7 @@ void Configuration::partialUpdate(const JsonObject& update) {
     }
     if (update.containsKey("timers")) {
         JsonArray timersArray = update["timers"];
-        timers.clear();
+        std::vector<Timer> newTimers;
         for (size_t i = 0; i < timersArray.size(); i++) {
             JsonObject timerObj = timersArray[i];
             Timer t;
@@ -318,9 +347,25 @@ void Configuration::partialUpdate(const JsonObject& update) {
             // Convert percent to hex at config boundary
             uint8_t percent = timerObj["brightness"] | 100;
             t.brightness = percentToHex(percent);
-            timers.push_back(t);
+            newTimers.push_back(t);
         }
+        updateField(timers, newTimers, gen.timers);
     }
+    if (!(led == prevLed)) ++gen.led;
+    if (!(safety == prevSafety)) ++gen.safety;
+    if (!(transitionTimes == prevTransitionTimes)) ++gen.transitionTimes;
+    if (!(network == prevNetwork)) ++gen.network;
+    if (!(time == prevTime)) ++gen.time;
+}
+
+// Bump every section, used whenever the whole configuration is replaced
+void Configuration::markAllChanged() {
+    ++gen.led;
+    ++gen.safety;
+    ++gen.transitionTimes;
+    ++gen.network;
+    ++gen.time;
+    ++gen.timers;
 }
 
 // Factory reset: delete config file and restore defaults
@@ -329,81 +374,70 @@ bool Configuration::factoryReset() {
     if (FILESYSTEM.exists(CONFIG_FILE)) {
         ok = FILESYSTEM.remove(CONFIG_FILE);
     }
+    if (FILESYSTEM.exists(LEGACY_CONFIG_FILE)) {
+        ok = FILESYSTEM.remove(LEGACY_CONFIG_FILE) && ok;
+    }
+    // An enabled curve would otherwise keep overriding the default timers
+    if (FILESYSTEM.exists(PHOTOPERIOD_FILE)) {
+        ok = FILESYSTEM.remove(PHOTOPERIOD_FILE) && ok;
+    }
+    if (FILESYSTEM.exists(STATE_FILE)) {
+        ok = FILESYSTEM.remove(STATE_FILE) && ok;
+    }
+    photoperiod = PhotoperiodConfig();
+    ++gen.photoperiod;
+    // Built-in presets are imported again at the next boot
+    presetStore.reset();
     setDefaults();
     save();
     return ok;
 }
 
-// Helper to load timers from a JsonArray
-void Configuration::loadTimersFromJson(JsonArray timersArray) {
-    timers.clear();
-    for (size_t i = 0; i < timersArray.size(); i++) {
-        JsonObject timerObj = timersArray[i];
-        Timer t;
-        t.enabled = timerObj["enabled"];
-        t.type = (TimerType)timerObj["type"];
-        t.hour = timerObj["hour"];
-        t.minute = timerObj["minute"];
-        t.presetId = timerObj["presetId"];
-        t.brightness = percentToHex(timerObj["brightness"] | 100);
-        timers.push_back(t);
-    }
-}
-
 void Configuration::setDefaults() {
     led = LEDConfig();
     safety = SafetyConfig();
     network = NetworkConfig();
     time = TimeConfig();
+    timers.clear();
 
-    // Initialize timers from web_config_default
-    StaticJsonDocument<2048> defaultsDoc;
-    DeserializationError errDefault = deserializeJson(defaultsDoc, web_config_default, web_config_default_len);
-    if (!errDefault && defaultsDoc.containsKey("timers")) {
-        JsonArray timersArray = defaultsDoc["timers"];
-        loadTimersFromJson(timersArray);
-    }
-    savePresets(presets);
+    // Every section from config_default.inc, not just the timers
+    loadDefaults();
+    markAllChanged();
 }
 
 
 
 // Update location from GPS data
 void Configuration::updateLocationFromGPS(float lat, float lon, bool valid) {
+    if (time.latitude == lat && time.longitude == lon) return;
     time.latitude = lat;
     time.longitude = lon;
+    ++gen.time;
 }
 
-// Get timezone offset in seconds (stub, needs library for real implementation)
-int Configuration::getTimezoneOffsetSeconds() {
-    // Use embedded timezone JSON asset for lookup, and add DST if enabled
-    StaticJsonDocument<4096> tzDoc;
-    DeserializationError err = deserializeJson(tzDoc, web_timezones_json, web_timezones_json_len);
-    if (err) return 0;
-    for (JsonObject tz : tzDoc.as<JsonArray>()) {
-        if (tz["name"] == time.timezone) {
-            double offset = tz["offset"];
-            int offsetSeconds = (int)(offset * 3600);
-            // Add 1 hour if DST is enabled
-            if (time.dstEnabled) {
-                offsetSeconds += 3600;
-            }
-            return offsetSeconds;
-        }
+// UTC offset in seconds at utcEpoch, from the precompiled zone table (timezone.h)
+int Configuration::getTimezoneOffsetSeconds(uint32_t utcEpoch) {
+    // Zone lookup only when the time section changed; the offset itself is
+    // reused until the next DST transition (or the clock steps backwards)
+    if (_tzGeneration != gen.time) {
+        _tzGeneration = gen.time;
+        _tz = findTimezone(time.timezone.c_str());
+        _tzValidFrom = 1;
+        _tzValidUntil = 0;
+    }
+    if (!_tz) return 0;
+    if (utcEpoch < _tzValidFrom || utcEpoch >= _tzValidUntil) {
+        _tzOffset = timezoneOffsetAt(*_tz, time.dstEnabled, utcEpoch, _tzValidUntil);
+        _tzValidFrom = utcEpoch;
     }
-    return 0;
+    return _tzOffset;
 }
 
-// Return a vector of all timezone names from the embedded asset
 std::vector<String> Configuration::getSupportedTimezones() {
     std::vector<String> timezones;
-    StaticJsonDocument<4096> tzDoc;
-    DeserializationError err = deserializeJson(tzDoc, web_timezones_json, web_timezones_json_len);
-    if (err) return timezones;
-    for (JsonObject tz : tzDoc.as<JsonArray>()) {
-        if (tz.containsKey("name")) {
-            timezones.push_back(tz["name"].as<String>());
-        }
+    timezones.reserve(TIMEZONE_COUNT);
+    for (size_t i = 0; i < TIMEZONE_COUNT; ++i) {
+        timezones.push_back(TIMEZONES[i].name);
     }
     return timezones;
 }
@@ -4,10 +4,13 @@
 #include <Arduino.h>
 #include <ArduinoJson.h>
 #include <vector>
+#include <array>
+#include <type_traits>
 
 // LED Configuration
 #define MAX_LED_COUNT 512
 #define FRAMES_PER_SECOND 60
+#define MAX_EFFECT_COLORS 8
 
 // Safety Defaults
 #define ABSOLUTE_MIN_TRANSITION 2000      // Hardware minimum 2 seconds
@@ -16,12 +19,57 @@
 // NTP Configuration
 #define NTP_UPDATE_INTERVAL 14400000  // 4 hours
 #define NTP_RETRY_INTERVAL 300000     // 5 minutes
+#define NTP_FIRST_SYNC_INTERVAL 10000 // until the first network sync (ms)
+#define NTP_TIMEOUT 1500              // reply wait before a request counts as lost (ms)
+#define NTP_SLEW_LIMIT 2000           // larger corrections step the clock (ms)
+#define NTP_SLEW_DIVISOR 100          // slew by 1 ms per this many ms of uptime
+
+// WiFi connection management
+#define WIFI_CONNECT_TIMEOUT 30000    // one association attempt (ms)
+#define WIFI_BACKOFF_MIN 1000         // first retry after a failed attempt (ms)
+#define WIFI_BACKOFF_MAX 300000       // retry interval cap; doubles up to this (ms)
+#define WIFI_AP_FALLBACK_ATTEMPTS 2   // failed attempts before the setup AP opens
+
+// WebSocket state broadcasts are coalesced and flushed at most this often (ms)
+#ifndef WS_BROADCAST_INTERVAL
+#define WS_BROADCAST_INTERVAL 50
+#endif
+
+// Live LED preview (opt-in WebSocket stream)
+#ifndef PREVIEW_PIXELS
+#define PREVIEW_PIXELS 64             // Strip is downsampled to this many RGB pixels
+#endif
+#ifndef PREVIEW_INTERVAL
+#define PREVIEW_INTERVAL 100          // Minimum time between preview frames (ms)
+#endif
+#ifndef PREVIEW_FRAME_SHARE
+#define PREVIEW_FRAME_SHARE 10        // Max share of loop time spent on the preview (%)
+#endif
+#define PREVIEW_KEYFRAME_INTERVAL 50  // Full frame every N preview frames
+
+// Largest POST body the web server accepts (bytes); bigger requests get 413
+#ifndef MAX_REQUEST_BODY
+#define MAX_REQUEST_BODY 8192
+#endif
+
+// Deferred flash writes (see persistence.h)
+#define PERSIST_DEBOUNCE 2000         // a changed section is written after this long without edits (ms)
+#define PERSIST_MAX_DELAY 10000       // ...or this long after its first unsaved edit (ms)
+#define PERSIST_EPOCH_INTERVAL 3600   // the wall clock saved with the state is refreshed this often (s)
 
 // File Paths
-#define CONFIG_FILE "/config.json"
-#define PRESET_FILE "/presets.json"
+#define CONFIG_FILE "/config.bin"          // binary record, see record_io.h
+#define LEGACY_CONFIG_FILE "/config.json"  // imported at boot, then removed
+#define PRESET_STORE_FILE "/presets.bin"      // fixed-size slots, see presets.h
+#define LEGACY_PRESET_FILE "/presets.json"    // imported at first boot, then removed
+#define PHOTOPERIOD_FILE "/photoperiod.json"
+#define STATE_FILE "/state.bin"            // last applied state and wall clock, see persistence.h
 
 // Limits
+#define MAX_PRESETS 255               // preset ids 0-254
+#define PRESET_CACHE_SIZE 4           // decoded presets kept in RAM
+#define PRESET_NAME_MAX 40            // longer names are cut to fit a preset slot
+#define FRAME_CACHE_SIZE 3            // rendered static-effect frames kept in RAM (4 bytes per LED each)
 
 
 // Presets now use effect index directly (uint8_t)
@@ -41,6 +89,14 @@ struct LEDConfig {
     String colorOrder;
     int relayPin;
     bool relayActiveHigh; // true: HIGH=on, false: LOW=on
+    bool operator==(const LEDConfig& other) const {
+        return pin == other.pin &&
+                count == other.count &&
+                type == other.type &&
+                colorOrder == other.colorOrder &&
+                relayPin == other.relayPin &&
+                relayActiveHigh == other.relayActiveHigh;
+    }
 };
 
 
@@ -59,12 +115,22 @@ struct TransitionTimesConfig {
     uint32_t schedule;
     uint32_t manual;
     uint32_t effect;
+    bool operator==(const TransitionTimesConfig& other) const {
+        return powerOn == other.powerOn &&
+                schedule == other.schedule &&
+                manual == other.manual &&
+                effect == other.effect;
+    }
 };
 
 struct SafetyConfig {
     uint32_t minTransitionTime;
     uint8_t maxBrightness; // internal (0-255)
     // For config file/API: use percent, convert at boundaries
+    bool operator==(const SafetyConfig& other) const {
+        return minTransitionTime == other.minTransitionTime &&
+                maxBrightness == other.maxBrightness;
+    }
 };
 
 struct NetworkConfig {
@@ -72,6 +138,12 @@ struct NetworkConfig {
     String apPassword;
     String ssid;
     String password;
+    bool operator==(const NetworkConfig& other) const {
+        return hostname == other.hostname &&
+                apPassword == other.apPassword &&
+                ssid == other.ssid &&
+                password == other.password;
+    }
 };
 
 struct TimeConfig {
@@ -80,14 +152,38 @@ struct TimeConfig {
     double latitude;
     double longitude;
     bool dstEnabled;
+    bool operator==(const TimeConfig& other) const {
+        return ntpServer == other.ntpServer &&
+                timezone == other.timezone &&
+                latitude == other.latitude &&
+                longitude == other.longitude &&
+                dstEnabled == other.dstEnabled;
+    }
 };
 
+// Packed RGBW colors (0xRRGGBBWW); hex strings only exist at the JSON boundary
 struct EffectParams {
     uint8_t speed = 255; // internal (1–255)
     uint8_t intensity = 128;
-    std::vector<String> colors = {"#000000", "#000000"};
+    uint8_t colorCount = 2;
+    std::array<uint32_t, MAX_EFFECT_COLORS> colors = {};
     bool reverse = false;
+
+    bool colorsEqual(const EffectParams& other) const {
+        if (colorCount != other.colorCount) return false;
+        for (size_t i = 0; i < colorCount; ++i) {
+            if (colors[i] != other.colors[i]) return false;
+        }
+        return true;
+    }
+    bool operator==(const EffectParams& other) const {
+        return speed == other.speed &&
+                intensity == other.intensity &&
+                reverse == other.reverse &&
+                colorsEqual(other);
+    }
 };
+static_assert(std::is_trivially_copyable<EffectParams>::value, "EffectParams must stay trivially copyable");
 
 struct Timer {
     bool enabled = false;
@@ -114,6 +210,69 @@ struct Preset {
     bool enabled = true;
 };
 
+// Photoperiod curve: per-channel intensity keyframes over the local day,
+// interpolated every frame instead of stepping through timers
+#ifndef MAX_PHOTOPERIOD_KEYFRAMES
+#define MAX_PHOTOPERIOD_KEYFRAMES 32
+#endif
+#define PHOTOPERIOD_CHANNELS 4  // R, G, B, W
+
+enum PhotoperiodInterpolation : uint8_t {
+    PHOTOPERIOD_LINEAR = 0,
+    PHOTOPERIOD_CUBIC = 1     // monotone (no overshoot between keyframes)
+};
+
+struct PhotoperiodKeyframe {
+    uint16_t minute = 0;  // minute of the local day (0-1439)
+    std::array<uint16_t, PHOTOPERIOD_CHANNELS> level = {};  // internal 16-bit (0-65535)
+    bool operator==(const PhotoperiodKeyframe& other) const {
+        return minute == other.minute && level == other.level;
+    }
+};
+
+struct PhotoperiodConfig {
+    bool enabled = false;
+    PhotoperiodInterpolation interpolation = PHOTOPERIOD_CUBIC;
+    std::vector<PhotoperiodKeyframe> keyframes;  // sorted by minute, no duplicates
+    bool operator==(const PhotoperiodConfig& other) const {
+        return enabled == other.enabled &&
+                interpolation == other.interpolation &&
+                keyframes == other.keyframes;
+    }
+};
+
+
+// Monotonic change counters per config section; compare against a cached copy
+// instead of diffing strings or vectors
+struct ConfigGenerations {
+    uint32_t led = 0;
+    uint32_t safety = 0;
+    uint32_t transitionTimes = 0;
+    uint32_t network = 0;
+    uint32_t time = 0;
+    uint32_t timers = 0;
+    uint32_t presets = 0;
+    uint32_t photoperiod = 0;
+    uint32_t total() const {
+        return led + safety + transitionTimes + network + time + timers + presets + photoperiod;
+    }
+    // Sections persisted in CONFIG_FILE (presets and photoperiod have their own files)
+    uint32_t configFile() const {
+        return led + safety + transitionTimes + network + time + timers;
+    }
+};
+
+// Assign a field and bump its generation only when the value actually changes
+template<typename T>
+inline bool updateField(T& field, const T& value, uint32_t& generation) {
+    if (field == value) return false;
+    field = value;
+    ++generation;
+    return true;
+}
+
+struct TimezoneInfo; // timezone.h
+struct JsonStreamState; // json_stream.h
 
 // Global Configuration Class
 
@@ -124,32 +283,46 @@ public:
     TransitionTimesConfig transitionTimes;
     NetworkConfig network;
     TimeConfig time;
-    std::vector<Preset> presets;
-
-    size_t getPresetCount() const { return presets.size(); }
     std::vector<Timer> timers;
+    PhotoperiodConfig photoperiod;
+    ConfigGenerations gen;
 
     bool load();
     bool save();
     bool factoryReset();
     void setDefaults();
 
-    // Serialize config to JSON string for API
-    String toJsonString();
+    // Streaming JSON for the API, one fragment per call (see json_stream.h)
+    bool writeJsonFragment(JsonStreamState& state, char* buf, size_t size, size_t& len);
+    bool writeTimersJsonFragment(JsonStreamState& state, char* buf, size_t size, size_t& len);
 
     // GPS and timezone helpers
     void updateLocationFromGPS(float lat, float lon, bool valid);
-    int getTimezoneOffsetSeconds(); // Returns offset in seconds for current timezone
+    // UTC offset in seconds at the given instant, with the zone's DST rules if dstEnabled
+    int getTimezoneOffsetSeconds(uint32_t utcEpoch);
     std::vector<String> getSupportedTimezones();
 
-    bool saveToFile(const char* path, const JsonDocument& doc);
-    bool loadFromFile(const char* path, JsonDocument& doc); // <-- move to public
+    bool loadFromFile(const char* path, JsonDocument& doc);
 
     // Partial update from JSON (only update fields present)
     void partialUpdate(const JsonObject& update);
 
-    // Helper to load timers from a JsonArray
-    void loadTimersFromJson(JsonArray timersArray);
+    // Bump every section generation (whole config replaced)
+    void markAllChanged();
+
+private:
+    bool loadDefaults();
+    bool importLegacyFile();
+    bool writeRecord();
+
+    uint32_t _savedGeneration = 0; // gen.configFile() last written to CONFIG_FILE
+
+    // Resolved timezone, refreshed when gen.time moves or a DST transition passes
+    const TimezoneInfo* _tz = nullptr;
+    uint32_t _tzGeneration = UINT32_MAX;
+    int32_t _tzOffset = 0;
+    uint32_t _tzValidFrom = 1;
+    uint32_t _tzValidUntil = 0;
 };
 
 #endif
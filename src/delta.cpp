@@ -0,0 +1,124 @@
+#include "delta.h"
+#include <string.h>
+#include <algorithm>
+
+#define DELTA_CONTROL_SIZE 12
+
+static uint32_t getLe32(const uint8_t* p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+void DeltaPatcher::begin(DeltaSourceReader source, size_t sourceSize, InflateSink out) {
+    _source = source;
+    _out = out;
+    _sourceSize = sourceSize;
+    _error = nullptr;
+    _state = HEADER;
+    _fieldLen = 0;
+    _targetSize = 0;
+    _written = 0;
+    _sourcePos = 0;
+}
+
+bool DeltaPatcher::fail(const char* error) {
+    _error = error;
+    _state = FAILED;
+    return false;
+}
+
+bool DeltaPatcher::checkSource(const uint8_t expected[SHA256_DIGEST_SIZE]) {
+    Sha256 sha;
+    for (size_t offset = 0; offset < _patchSourceSize; offset += sizeof(_buf)) {
+        size_t n = std::min(sizeof(_buf), (size_t)_patchSourceSize - offset);
+        if (!_source(offset, _buf, n)) return false;
+        sha.update(_buf, n);
+    }
+    uint8_t digest[SHA256_DIGEST_SIZE];
+    sha.finish(digest);
+    return memcmp(digest, expected, SHA256_DIGEST_SIZE) == 0;
+}
+
+bool DeltaPatcher::parseHeader() {
+    if (getLe32(_field) != DELTA_MAGIC) return fail("Not a delta patch");
+    if ((_field[4] | (_field[5] << 8)) != DELTA_VERSION) return fail("Unsupported delta version");
+    _patchSourceSize = getLe32(_field + 8);
+    _targetSize = getLe32(_field + 12);
+    // Reading the whole source once costs far less than flashing a target
+    // built from the wrong one
+    if (_patchSourceSize > _sourceSize || !checkSource(_field + 16)) {
+        return fail("Delta is for a different firmware");
+    }
+    _state = CONTROL;
+    return true;
+}
+
+// Moves past finished parts of the current record
+void DeltaPatcher::nextRecord() {
+    if (_state == DIFF && _diffLeft == 0) _state = EXTRA;
+    if (_state == EXTRA && _extraLeft == 0) {
+        int64_t pos = (int64_t)_sourcePos + _seek;
+        if (pos < 0 || pos > (int64_t)_patchSourceSize) {
+            fail("Delta seeks outside the source image");
+            return;
+        }
+        _sourcePos = (uint32_t)pos;
+        _state = CONTROL;
+    }
+    if (_state == CONTROL && _written == _targetSize) _state = DONE;
+}
+
+bool DeltaPatcher::write(const uint8_t* data, size_t len) {
+    if (_state == FAILED) return false;
+    while (len > 0 && _state != DONE) {
+        switch (_state) {
+            case HEADER:
+            case CONTROL: {
+                size_t size = _state == HEADER ? DELTA_HEADER_SIZE : DELTA_CONTROL_SIZE;
+                size_t n = std::min(size - _fieldLen, len);
+                memcpy(_field + _fieldLen, data, n);
+                _fieldLen += n;
+                data += n;
+                len -= n;
+                if (_fieldLen < size) break;
+                _fieldLen = 0;
+                if (_state == HEADER) {
+                    if (!parseHeader()) return false;
+                } else {
+                    _diffLeft = getLe32(_field);
+                    _extraLeft = getLe32(_field + 4);
+                    _seek = (int32_t)getLe32(_field + 8);
+                    if ((uint64_t)_written + _diffLeft + _extraLeft > _targetSize) return fail("Delta overruns the target size");
+                    if ((uint64_t)_sourcePos + _diffLeft > _patchSourceSize) return fail("Delta reads past the source image");
+                    _state = DIFF;
+                }
+                break;
+            }
+            case DIFF: {
+                size_t n = std::min(std::min(len, sizeof(_buf)), (size_t)_diffLeft);
+                if (!_source(_sourcePos, _buf, n)) return fail("Source image read failed");
+                for (size_t i = 0; i < n; ++i) _buf[i] += data[i];
+                if (!_out(_buf, n)) return fail("Image write failed");
+                _sourcePos += n;
+                _written += n;
+                _diffLeft -= n;
+                data += n;
+                len -= n;
+                break;
+            }
+            case EXTRA: {
+                size_t n = std::min(len, (size_t)_extraLeft);
+                if (!_out(data, n)) return fail("Image write failed");
+                _written += n;
+                _extraLeft -= n;
+                data += n;
+                len -= n;
+                break;
+            }
+            default:
+                break;
+        }
+        nextRecord();
+        if (_state == FAILED) return false;
+    }
+    return true;
+}
@@ -0,0 +1,67 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <functional>
+#include "inflate.h"
+#include "sha256.h"
+
+// Delta patches against the running firmware (made by scripts/make_delta.py),
+// applied as the patch streams in. Layout, little-endian:
+//
+//   header:  u32 magic "DGDP", u16 version, u16 reserved,
+//            u32 source size, u32 target size, u8[32] source SHA-256
+//   records: u32 diff length, u32 extra length, i32 seek, then
+//            diff length bytes  -- added bytewise to the source at the read position
+//            extra length bytes -- copied as they are
+//            after which the read position moves by diff length + seek
+//
+// Records are interleaved rather than kept in three streams as in bsdiff, so
+// the target comes out strictly in order: only a small source buffer is
+// needed, never the whole patch. The usual transport is gzip on top, where
+// the mostly-zero diff bytes shrink to almost nothing.
+
+#define DELTA_MAGIC 0x50444744  // "DGDP"
+#define DELTA_VERSION 1
+#define DELTA_HEADER_SIZE 48
+
+// Reads `len` bytes of the running image at `offset`
+typedef std::function<bool(size_t offset, uint8_t* buf, size_t len)> DeltaSourceReader;
+
+class DeltaPatcher {
+public:
+    // `sourceSize` is how much of the running image the reader can supply
+    void begin(DeltaSourceReader source, size_t sourceSize, InflateSink out);
+    // Next piece of the (uncompressed) patch. The first call that completes
+    // the header hashes the source and fails unless it is the one the patch
+    // was made from, before any output is produced.
+    bool write(const uint8_t* data, size_t len);
+    // True once the whole target was produced
+    bool done() const { return _state == DONE; }
+
+    // Known once the header was read, 0 before
+    uint32_t targetSize() const { return _targetSize; }
+    const char* error() const { return _error; }
+
+private:
+    enum State : uint8_t { HEADER, CONTROL, DIFF, EXTRA, DONE, FAILED };
+    bool fail(const char* error);
+    bool parseHeader();
+    bool checkSource(const uint8_t expected[SHA256_DIGEST_SIZE]);
+    void nextRecord();
+
+    DeltaSourceReader _source;
+    InflateSink _out;
+    const char* _error = nullptr;
+    State _state = FAILED;
+    size_t _sourceSize = 0;       // readable part of the running image
+    uint32_t _patchSourceSize = 0;
+    uint32_t _targetSize = 0;
+    uint32_t _written = 0;
+    uint32_t _sourcePos = 0;
+    uint32_t _diffLeft = 0;
+    uint32_t _extraLeft = 0;
+    int32_t _seek = 0;
+    uint8_t _field[DELTA_HEADER_SIZE];  // header or control record being collected
+    size_t _fieldLen = 0;
+    uint8_t _buf[256];
+};
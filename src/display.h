@@ -10,4 +10,6 @@
 #define TFT_DRIVER ST7735S
 
 void setup_display();
+// Advances the boot splash without blocking; true once it has finished
+bool display_splash_step();
 void display_status(const char* preset, bool power, const char* ip);
@@ -7,9 +7,10 @@
 #include "effects.h"
 #include "colors.h"
 #include "transition.h"
+#include "sim_clock.h"
 
 // === Global externs and variables ===
-extern std::array<uint32_t, 8> color;
+extern std::array<uint32_t, MAX_EFFECT_COLORS> color;
 extern SystemState state;
 extern EffectParams transitionPrevParams;
 extern PendingTransitionState pendingTransition;
@@ -59,26 +60,22 @@ void effect_solid() {
     (*g_effectBuffer)[i] = pack_rgbw(r, g, b, w);
   }
 }
-REGISTER_EFFECT(0, "Solid", effect_solid)
+REGISTER_STATIC_EFFECT(0, "Solid", effect_solid)
 
 void effect_sunrise() {
   if (!g_effectBuffer) return;
-  size_t colorCount = state.params.colors.size();
+  size_t colorCount = state.params.colorCount;
   if (colorCount < 2) {
     for (size_t i = 0; i < g_ledCount; ++i) (*g_effectBuffer)[i] = 0;
     return;
   }
-  // Prepare palette
-  std::vector<uint32_t> stops;
-  for (size_t i = 0; i < colorCount; ++i) {
-    const char* cstr = state.params.colors[i].c_str();
-    stops.push_back((uint32_t)strtoul(cstr + (cstr[0] == '#' ? 1 : 0), nullptr, 16));
-  }
+  // Palette stops come straight from the packed params
+  const auto& stops = state.params.colors;
   // Persistent pixel buffer for blending
   static std::vector<uint32_t> blendBuffer;
   if (blendBuffer.size() != g_ledCount) blendBuffer.assign(g_ledCount, stops[0]);
   // Timing and speed
-  uint32_t now = millis();
+  uint32_t now = controlMillis();
   uint8_t speed = state.params.speed > 0 ? state.params.speed : 50;
   uint8_t intensity = state.params.intensity > 0 ? state.params.intensity : 255;
   // Intensity modifier: scale blendSpeed
@@ -113,14 +110,10 @@ REGISTER_EFFECT(1, "Sunrise", effect_sunrise)
 void effect_sunset() {
   if (!g_effectBuffer) return;
   if (g_ledCount == 0) return;
-  size_t colorCount = state.params.colors.size();
-  std::vector<uint32_t> stops;
-  for (size_t i = 0; i < colorCount; ++i) {
-    const char* cstr = state.params.colors[i].c_str();
-    stops.push_back((uint32_t)strtoul(cstr + (cstr[0] == '#' ? 1 : 0), nullptr, 16));
-  }
+  size_t colorCount = state.params.colorCount;
+  const auto& stops = state.params.colors;
   // Calculate counter based on speed
-  uint32_t now = millis();
+  uint32_t now = controlMillis();
   uint8_t speed = state.params.speed > 0 ? state.params.speed : 50;
   uint8_t intensity = state.params.intensity > 0 ? state.params.intensity : 255;
   uint32_t counter = 0;
@@ -184,7 +177,7 @@ void effect_moonlight() {
   // Highlight color: brighter blue/cyan
   uint8_t highR = 40, highG = 120, highB = 255, highW = 0;
 
-  uint32_t now = millis();
+  uint32_t now = controlMillis();
   // Map speed param (1-255) to a practical, visible range
   uint8_t userSpeed = state.params.speed > 0 ? state.params.speed : 30;
   // At speed=1: 1 cycle per 8s; at speed=255: 1 cycle per 1s
@@ -258,18 +251,17 @@ void effect_lightning() {
     return (rngSeed & 0xFFFFFF) / float(0xFFFFFF);
   };
 
-  uint32_t now = millis();
+  uint32_t now = controlMillis();
   // Use preset colors: first is base, last is flash, middle (if present) is highlight
   uint8_t baseR = 0, baseG = 0, baseB = 0, baseW = 0;
   uint8_t flashR = 0, flashG = 0, flashB = 0, flashW = 0;
   const auto& colors = state.params.colors;
-  if (colors.size() > 0) {
-    uint32_t c = (uint32_t)strtoul(colors[0].c_str() + (colors[0][0] == '#' ? 1 : 0), nullptr, 16);
-    unpack_rgbw(c, baseR, baseG, baseB, baseW);
+  size_t colorCount = state.params.colorCount;
+  if (colorCount > 0) {
+    unpack_rgbw(colors[0], baseR, baseG, baseB, baseW);
   }
-  if (colors.size() > 1) {
-    uint32_t c = (uint32_t)strtoul(colors[colors.size()-1].c_str() + (colors[colors.size()-1][0] == '#' ? 1 : 0), nullptr, 16);
-    unpack_rgbw(c, flashR, flashG, flashB, flashW);
+  if (colorCount > 1) {
+    unpack_rgbw(colors[colorCount - 1], flashR, flashG, flashB, flashW);
   }
 
   // Recalculate delay immediately if speed changes
@@ -359,10 +351,10 @@ void effect_lightning() {
 REGISTER_EFFECT(4, "Lightning", effect_lightning)
 
 // === Core rendering function ===
-void renderEffectToBuffer(uint8_t effectId, const EffectParams& params, std::vector<uint32_t>& buffer, size_t ledCount, const std::array<uint32_t, 8>& colors, size_t colorCount, uint8_t brightness) {
+void renderEffectToBuffer(uint8_t effectId, const EffectParams& params, std::vector<uint32_t>& buffer, size_t ledCount, const std::array<uint32_t, MAX_EFFECT_COLORS>& colors, size_t colorCount, uint8_t brightness) {
   // Save current global state
   auto old_state = state;
-  std::array<uint32_t, 8> old_color = color;
+  std::array<uint32_t, MAX_EFFECT_COLORS> old_color = color;
   uint8_t old_brightness = state.brightness;
   std::vector<uint32_t>* old_g_effectBuffer = g_effectBuffer;
   size_t old_g_ledCount = g_ledCount;
@@ -370,7 +362,7 @@ void renderEffectToBuffer(uint8_t effectId, const EffectParams& params, std::vec
   // Set globals to requested values
   state.params = params;
   state.brightness = brightness;
-  for (size_t i = 0; i < 8; ++i) color[i] = (i < colorCount) ? colors[i] : 0;
+  for (size_t i = 0; i < MAX_EFFECT_COLORS; ++i) color[i] = (i < colorCount) ? colors[i] : 0;
   g_effectBuffer = &buffer;
   g_ledCount = ledCount;
 
@@ -390,6 +382,10 @@ void renderEffectToBuffer(uint8_t effectId, const EffectParams& params, std::vec
 
 }
 
+bool isEffectTimeInvariant(uint8_t effectId) {
+  return effectId < effectRegistry.size() && effectRegistry[effectId].timeInvariant;
+}
+
 uint32_t getEffectDelayMs(const EffectParams& params) {
   uint8_t speed = params.speed > 0 ? params.speed : 50; // Default to 50 if not set
   // Map speed (1-100) to delay (fast: 10ms, slow: 200ms)
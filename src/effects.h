@@ -10,7 +10,7 @@
 #include "state.h"
 
 // Render the given effect and params into a buffer (does not update LEDs)
-void renderEffectToBuffer(uint8_t effectId, const EffectParams& params, std::vector<uint32_t>& buffer, size_t ledCount, const std::array<uint32_t, 8>& colors, size_t colorCount, uint8_t brightness);
+void renderEffectToBuffer(uint8_t effectId, const EffectParams& params, std::vector<uint32_t>& buffer, size_t ledCount, const std::array<uint32_t, MAX_EFFECT_COLORS>& colors, size_t colorCount, uint8_t brightness);
 
 
 // All effect frame generators now take no parameters and use global buffer/ledCount
@@ -19,9 +19,13 @@ struct EffectRegistryEntry {
 	uint8_t id;
 	const char* name;
 	EffectFrameGen fn;
+	bool timeInvariant;  // output depends only on params, brightness and LED count
 };
 extern std::vector<EffectRegistryEntry> effectRegistry;
 
+// True for effects registered with REGISTER_STATIC_EFFECT; their frames can be cached
+bool isEffectTimeInvariant(uint8_t effectId);
+
 struct PendingTransitionState {
 	uint8_t effect = 0;
 	EffectParams params;
@@ -31,7 +35,7 @@ struct PendingTransitionState {
 // Centralized effect speed to delay mapping
 uint32_t getEffectDelayMs(const EffectParams& params);
 
-extern std::array<uint32_t, 8> color;
+extern std::array<uint32_t, MAX_EFFECT_COLORS> color;
 extern size_t colorCount;
 extern void* strip;
 
@@ -46,15 +50,18 @@ void updatePixelCount();
 #endif
 
 
-// Registration helper macro for effect frame generators
-#define REGISTER_EFFECT(id, name, fn) \
+// Registration helper macros for effect frame generators. Use the static
+// variant only for effects that never read the clock or keep state between frames.
+#define REGISTER_EFFECT_ENTRY(id, name, fn, timeInvariant) \
 	namespace { \
 		struct fn##_registrar { \
 			fn##_registrar() { \
-				effectRegistry.push_back({id, name, fn}); \
+				effectRegistry.push_back({id, name, fn, timeInvariant}); \
 			}\
 		} \
 		fn##_registrar_instance; \
 	}
+#define REGISTER_EFFECT(id, name, fn) REGISTER_EFFECT_ENTRY(id, name, fn, false)
+#define REGISTER_STATIC_EFFECT(id, name, fn) REGISTER_EFFECT_ENTRY(id, name, fn, true)
 
 #endif // EFFECTS_H
@@ -0,0 +1,94 @@
+#include "frame_cache.h"
+#include "effects.h"
+#include <algorithm>
+
+// FNV-1a over every input the frame depends on; sameKey() still compares the
+// fields, so a collision costs a render, never a wrong frame
+static uint32_t fnv1a(uint32_t hash, uint32_t value, size_t bytes) {
+    for (size_t i = 0; i < bytes; ++i) {
+        hash ^= (uint8_t)(value >> (8 * i));
+        hash *= 16777619UL;
+    }
+    return hash;
+}
+
+uint32_t FrameCache::keyHash(uint8_t effectId, const EffectParams& params, size_t ledCount, size_t colorCount, uint8_t brightness) {
+    uint32_t hash = 2166136261UL;
+    hash = fnv1a(hash, effectId, 1);
+    hash = fnv1a(hash, brightness, 1);
+    hash = fnv1a(hash, (uint32_t)ledCount, 2);
+    hash = fnv1a(hash, params.speed, 1);
+    hash = fnv1a(hash, params.intensity, 1);
+    hash = fnv1a(hash, params.reverse, 1);
+    hash = fnv1a(hash, params.colorCount, 1);
+    for (size_t i = 0; i < colorCount && i < MAX_EFFECT_COLORS; ++i) {
+        hash = fnv1a(hash, params.colors[i], 4);
+    }
+    return hash;
+}
+
+bool FrameCache::sameKey(const Entry& entry, uint8_t effectId, const EffectParams& params, size_t ledCount, size_t colorCount, uint8_t brightness) {
+    if (entry.effect != effectId || entry.brightness != brightness || entry.frame.size() != ledCount) return false;
+    if (entry.colorCount != colorCount) return false;
+    const EffectParams& p = entry.params;
+    if (p.speed != params.speed || p.intensity != params.intensity || p.reverse != params.reverse || p.colorCount != params.colorCount) return false;
+    for (size_t i = 0; i < colorCount && i < MAX_EFFECT_COLORS; ++i) {
+        if (p.colors[i] != params.colors[i]) return false;
+    }
+    return true;
+}
+
+void FrameCache::render(uint8_t effectId, const EffectParams& params, std::vector<uint32_t>& buffer, size_t ledCount, size_t colorCount, uint8_t brightness) {
+    if (!isEffectTimeInvariant(effectId)) {
+        ++_uncached;
+        renderEffectToBuffer(effectId, params, buffer, ledCount, params.colors, colorCount, brightness);
+        return;
+    }
+
+    uint32_t hash = keyHash(effectId, params, ledCount, colorCount, brightness);
+    Entry* victim = &_entries[0];
+    for (Entry& entry : _entries) {
+        if (entry.used && entry.hash == hash && sameKey(entry, effectId, params, ledCount, colorCount, brightness)) {
+            ++_hits;
+            entry.lastUse = ++_useCounter;
+            std::copy(entry.frame.begin(), entry.frame.end(), buffer.begin());
+            return;
+        }
+        if (!entry.used) {
+            if (victim->used) victim = &entry;
+        } else if (victim->used && entry.lastUse < victim->lastUse) {
+            victim = &entry;
+        }
+    }
+
+    ++_misses;
+    // The victim's buffer is reused, so a steady LED count does not allocate
+    victim->used = true;
+    victim->hash = hash;
+    victim->effect = effectId;
+    victim->brightness = brightness;
+    victim->colorCount = colorCount;
+    victim->params = params;
+    victim->frame.assign(ledCount, 0);
+    victim->lastUse = ++_useCounter;
+    renderEffectToBuffer(effectId, params, victim->frame, ledCount, params.colors, colorCount, brightness);
+    std::copy(victim->frame.begin(), victim->frame.end(), buffer.begin());
+}
+
+void FrameCache::writeStats(JsonObject obj) const {
+    size_t entries = 0;
+    size_t bytes = 0;
+    for (const Entry& entry : _entries) {
+        if (!entry.used) continue;
+        ++entries;
+        bytes += entry.frame.size() * sizeof(uint32_t);
+    }
+    uint32_t lookups = _hits + _misses;
+    obj["hits"] = _hits;
+    obj["misses"] = _misses;
+    obj["hitRate"] = lookups ? (uint32_t)((uint64_t)_hits * 100 / lookups) : 0;
+    obj["uncached"] = _uncached;
+    obj["entries"] = entries;
+    obj["capacity"] = FRAME_CACHE_SIZE;
+    obj["bytes"] = bytes;
+}
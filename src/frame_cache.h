@@ -0,0 +1,40 @@
+#pragma once
+#include <vector>
+#include <ArduinoJson.h>
+#include "config.h"
+
+// Rendered frames of time-invariant effects (see REGISTER_STATIC_EFFECT),
+// keyed by effect, params, LED count and brightness. A transition to or from
+// a static preset then blends cached buffers instead of re-running the effect
+// every frame. Entries are replaced least recently used first.
+class FrameCache {
+public:
+    // Same contract as renderEffectToBuffer() with the colors taken from
+    // params; time-varying effects are rendered directly
+    void render(uint8_t effectId, const EffectParams& params, std::vector<uint32_t>& buffer, size_t ledCount, size_t colorCount, uint8_t brightness);
+
+    // Counters for GET /api/perf
+    void writeStats(JsonObject obj) const;
+
+private:
+    struct Entry {
+        bool used = false;
+        uint32_t hash = 0;
+        uint8_t effect = 0;
+        uint8_t brightness = 0;
+        size_t colorCount = 0;
+        EffectParams params;
+        std::vector<uint32_t> frame;
+        uint32_t lastUse = 0;
+    };
+    static uint32_t keyHash(uint8_t effectId, const EffectParams& params, size_t ledCount, size_t colorCount, uint8_t brightness);
+    static bool sameKey(const Entry& entry, uint8_t effectId, const EffectParams& params, size_t ledCount, size_t colorCount, uint8_t brightness);
+
+    Entry _entries[FRAME_CACHE_SIZE];
+    uint32_t _useCounter = 0;
+    uint32_t _hits = 0;
+    uint32_t _misses = 0;
+    uint32_t _uncached = 0;
+};
+
+extern FrameCache frameCache;
@@ -0,0 +1,393 @@
+#include "inflate.h"
+#include "record_io.h"
+#include <new>
+#include <stdlib.h>
+#include <string.h>
+
+// gzip header flags (RFC 1952)
+#define GZ_FLAG_HCRC 0x02
+#define GZ_FLAG_EXTRA 0x04
+#define GZ_FLAG_NAME 0x08
+#define GZ_FLAG_COMMENT 0x10
+
+// Base values and extra bits for length symbols 257-285 and distance symbols 0-29 (RFC 1951)
+static const uint16_t LENGTH_BASE[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+static const uint8_t LENGTH_EXTRA[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+static const uint16_t DIST_BASE[30] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+static const uint8_t DIST_EXTRA_BITS[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+// Order in which code length code lengths are sent
+static const uint8_t CODE_LENGTH_ORDER[19] = {
+    16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+
+bool GzipInflater::begin(InflateSink sink) {
+    end();
+    _window = new (std::nothrow) uint8_t[INFLATE_WINDOW_SIZE];
+    if (!_window) {
+        _state = FAILED;
+        _error = "Not enough memory to inflate";
+        return false;
+    }
+    _sink = sink;
+    _error = nullptr;
+    _state = GZ_HEADER;
+    _bitBuf = 0;
+    _bitCount = 0;
+    _windowPos = _flushed = 0;
+    _total = 0;
+    _crc = 0;
+    _index = 0;
+    _lastBlock = false;
+    return true;
+}
+
+void GzipInflater::end() {
+    delete[] _window;
+    _window = nullptr;
+}
+
+bool GzipInflater::need(unsigned n) {
+    while (_bitCount < n) {
+        if (_inPos == _inLen) return false;
+        _bitBuf |= (uint32_t)_in[_inPos++] << _bitCount;
+        _bitCount += 8;
+    }
+    return true;
+}
+
+uint32_t GzipInflater::take(unsigned n) {
+    uint32_t v = _bitBuf & ((1UL << n) - 1);
+    _bitBuf >>= n;
+    _bitCount -= n;
+    return v;
+}
+
+// Canonical Huffman decode one bit at a time; -1 when input ran out, -2 for an unused code
+int GzipInflater::decode(const Huffman& h) {
+    int code = 0, first = 0, index = 0;
+    for (int len = 1; len < 16; ++len) {
+        if (!need(1)) return -1;
+        code |= take(1);
+        int count = h.count[len];
+        if (code - count < first) return h.symbol[index + (code - first)];
+        index += count;
+        first = (first + count) << 1;
+        code <<= 1;
+    }
+    return -2;
+}
+
+// Returns 0 for a complete code, >0 if incomplete, <0 if over-subscribed
+int GzipInflater::build(Huffman& h, const uint8_t* lengths, size_t n) {
+    memset(h.count, 0, sizeof(h.count));
+    for (size_t s = 0; s < n; ++s) h.count[lengths[s]]++;
+    if (h.count[0] == n) return 0;
+    int left = 1;
+    for (int len = 1; len < 16; ++len) {
+        left <<= 1;
+        left -= h.count[len];
+        if (left < 0) return left;
+    }
+    uint16_t offs[16];
+    offs[1] = 0;
+    for (int len = 1; len < 15; ++len) offs[len + 1] = offs[len] + h.count[len];
+    for (size_t s = 0; s < n; ++s) {
+        if (lengths[s]) h.symbol[offs[lengths[s]]++] = (uint16_t)s;
+    }
+    return left;
+}
+
+GzipInflater::Step GzipInflater::fail(const char* error) {
+    _error = error;
+    return STEP_FAIL;
+}
+
+GzipInflater::State GzipInflater::nextHeaderState() {
+    _index = 0;
+    if (_flags & GZ_FLAG_EXTRA) { _flags &= ~GZ_FLAG_EXTRA; return GZ_EXTRA_LEN; }
+    if (_flags & GZ_FLAG_NAME) { _flags &= ~GZ_FLAG_NAME; return GZ_NAME; }
+    if (_flags & GZ_FLAG_COMMENT) { _flags &= ~GZ_FLAG_COMMENT; return GZ_COMMENT; }
+    if (_flags & GZ_FLAG_HCRC) { _flags &= ~GZ_FLAG_HCRC; return GZ_HCRC; }
+    return BLOCK_HEADER;
+}
+
+void GzipInflater::startBlocks(bool fixed) {
+    if (fixed) {
+        size_t s = 0;
+        for (; s < 144; ++s) _lengths[s] = 8;
+        for (; s < 256; ++s) _lengths[s] = 9;
+        for (; s < 280; ++s) _lengths[s] = 7;
+        for (; s < 288; ++s) _lengths[s] = 8;
+        build(_lenCode, _lengths, 288);
+        for (s = 0; s < 30; ++s) _lengths[s] = 5;
+        build(_distCode, _lengths, 30);
+    }
+    _state = LITLEN;
+}
+
+void GzipInflater::endBlock() {
+    if (!_lastBlock) {
+        _state = BLOCK_HEADER;
+        return;
+    }
+    // The trailer starts on a byte boundary
+    take(_bitCount % 8);
+    _index = 0;
+    _state = TRAILER;
+}
+
+bool GzipInflater::flush() {
+    if (_windowPos == _flushed) return true;
+    const uint8_t* data = _window + _flushed;
+    size_t len = _windowPos - _flushed;
+    _crc = recordCrc32(data, len, _crc);
+    _flushed = _windowPos;
+    if (_windowPos == INFLATE_WINDOW_SIZE) _windowPos = _flushed = 0;
+    return _sink(data, len);
+}
+
+bool GzipInflater::emit(uint8_t b) {
+    _window[_windowPos++] = b;
+    ++_total;
+    return _windowPos < INFLATE_WINDOW_SIZE || flush();
+}
+
+GzipInflater::Step GzipInflater::step() {
+    switch (_state) {
+        case GZ_HEADER: {
+            // ID1 ID2 CM FLG MTIME(4) XFL OS
+            if (!need(8)) return STEP_MORE;
+            uint8_t b = (uint8_t)take(8);
+            if ((_index == 0 && b != 0x1F) || (_index == 1 && b != 0x8B)) return fail("Not a gzip stream");
+            if (_index == 2 && b != 8) return fail("Unsupported gzip compression method");
+            if (_index == 3) _flags = b;
+            if (++_index == 10) _state = nextHeaderState();
+            return STEP_OK;
+        }
+        case GZ_EXTRA_LEN:
+            if (!need(16)) return STEP_MORE;
+            _remaining = (uint16_t)take(16);
+            _state = GZ_EXTRA;
+            return STEP_OK;
+        case GZ_EXTRA:
+            if (_remaining == 0) { _state = nextHeaderState(); return STEP_OK; }
+            if (!need(8)) return STEP_MORE;
+            take(8);
+            --_remaining;
+            return STEP_OK;
+        case GZ_NAME:
+        case GZ_COMMENT:
+            if (!need(8)) return STEP_MORE;
+            if (take(8) == 0) _state = nextHeaderState();
+            return STEP_OK;
+        case GZ_HCRC:
+            if (!need(16)) return STEP_MORE;
+            take(16);
+            _state = nextHeaderState();
+            return STEP_OK;
+
+        case BLOCK_HEADER: {
+            if (!need(3)) return STEP_MORE;
+            _lastBlock = take(1);
+            uint32_t type = take(2);
+            if (type == 0) {
+                take(_bitCount % 8);
+                _state = STORED_LEN;
+            } else if (type == 1) {
+                startBlocks(true);
+            } else if (type == 2) {
+                _state = TABLE_COUNTS;
+            } else {
+                return fail("Invalid deflate block type");
+            }
+            return STEP_OK;
+        }
+        case STORED_LEN:
+            if (!need(16)) return STEP_MORE;
+            _remaining = (uint16_t)take(16);
+            _state = STORED_NLEN;
+            return STEP_OK;
+        case STORED_NLEN:
+            if (!need(16)) return STEP_MORE;
+            if ((uint16_t)take(16) != (uint16_t)~_remaining) return fail("Corrupt stored block");
+            _state = STORED_COPY;
+            return STEP_OK;
+        case STORED_COPY: {
+            // Bytes copied here are final, so the step only reports MORE
+            // (which rolls back) when it had nothing at all to copy
+            bool copied = false;
+            while (_remaining > 0) {
+                if (_bitCount >= 8) {
+                    if (!emit((uint8_t)take(8))) return fail("Image write failed");
+                } else if (_inPos < _inLen) {
+                    if (!emit(_in[_inPos++])) return fail("Image write failed");
+                } else {
+                    return copied ? STEP_OK : STEP_MORE;
+                }
+                --_remaining;
+                copied = true;
+            }
+            endBlock();
+            return STEP_OK;
+        }
+
+        case TABLE_COUNTS:
+            if (!need(14)) return STEP_MORE;
+            _litCount = (uint16_t)take(5) + 257;
+            _distCount = (uint16_t)take(5) + 1;
+            _codeCount = (uint16_t)take(4) + 4;
+            if (_litCount > 286 || _distCount > 30) return fail("Corrupt deflate table");
+            _index = 0;
+            _state = TABLE_CODE_LENGTHS;
+            return STEP_OK;
+        case TABLE_CODE_LENGTHS:
+            if (!need(3)) return STEP_MORE;
+            _lengths[CODE_LENGTH_ORDER[_index++]] = (uint8_t)take(3);
+            if (_index == _codeCount) {
+                for (; _index < 19; ++_index) _lengths[CODE_LENGTH_ORDER[_index]] = 0;
+                if (build(_lenCode, _lengths, 19) != 0) return fail("Corrupt deflate table");
+                _index = 0;
+                _state = TABLE_LENGTHS;
+            }
+            return STEP_OK;
+        case TABLE_LENGTHS: {
+            int symbol = decode(_lenCode);
+            if (symbol == -1) return STEP_MORE;
+            if (symbol < 0) return fail("Corrupt deflate table");
+            uint8_t length = 0;
+            size_t repeat = 1;
+            if (symbol < 16) {
+                length = (uint8_t)symbol;
+            } else if (symbol == 16) {
+                if (_index == 0) return fail("Corrupt deflate table");
+                if (!need(2)) return STEP_MORE;
+                length = _lengths[_index - 1];
+                repeat = 3 + take(2);
+            } else if (symbol == 17) {
+                if (!need(3)) return STEP_MORE;
+                repeat = 3 + take(3);
+            } else {
+                if (!need(7)) return STEP_MORE;
+                repeat = 11 + take(7);
+            }
+            if (_index + repeat > (size_t)(_litCount + _distCount)) return fail("Corrupt deflate table");
+            while (repeat--) _lengths[_index++] = length;
+            if (_index < _litCount + _distCount) return STEP_OK;
+
+            if (_lengths[256] == 0) return fail("Deflate block without end code");
+            // Incomplete codes are only allowed for a single code length (RFC 1951 3.2.7)
+            int err = build(_lenCode, _lengths, _litCount);
+            if (err < 0 || (err > 0 && _litCount - _lenCode.count[0] != 1)) return fail("Corrupt deflate table");
+            err = build(_distCode, _lengths + _litCount, _distCount);
+            if (err < 0 || (err > 0 && _distCount - _distCode.count[0] != 1)) return fail("Corrupt deflate table");
+            startBlocks(false);
+            return STEP_OK;
+        }
+
+        case LITLEN: {
+            int symbol = decode(_lenCode);
+            if (symbol == -1) return STEP_MORE;
+            if (symbol < 0) return fail("Corrupt deflate data");
+            if (symbol < 256) {
+                if (!emit((uint8_t)symbol)) return fail("Image write failed");
+                return STEP_OK;
+            }
+            if (symbol == 256) {
+                endBlock();
+                return STEP_OK;
+            }
+            symbol -= 257;
+            if (symbol >= 29) return fail("Corrupt deflate data");
+            if (!need(LENGTH_EXTRA[symbol])) return STEP_MORE;
+            _matchLength = LENGTH_BASE[symbol] + (uint16_t)take(LENGTH_EXTRA[symbol]);
+            _state = DISTANCE;
+            return STEP_OK;
+        }
+        case DISTANCE: {
+            int symbol = decode(_distCode);
+            if (symbol == -1) return STEP_MORE;
+            if (symbol < 0 || symbol >= 30) return fail("Corrupt deflate data");
+            _distSymbol = (uint8_t)symbol;
+            _state = DIST_EXTRA;
+            return STEP_OK;
+        }
+        case DIST_EXTRA: {
+            if (!need(DIST_EXTRA_BITS[_distSymbol])) return STEP_MORE;
+            size_t distance = DIST_BASE[_distSymbol] + take(DIST_EXTRA_BITS[_distSymbol]);
+            if (distance > _total) return fail("Deflate distance too far back");
+            // The window is a ring; history before a flush is still in it
+            size_t from = (_windowPos + INFLATE_WINDOW_SIZE - distance) % INFLATE_WINDOW_SIZE;
+            for (uint16_t i = 0; i < _matchLength; ++i) {
+                if (!emit(_window[from])) return fail("Image write failed");
+                from = (from + 1) % INFLATE_WINDOW_SIZE;
+            }
+            _state = LITLEN;
+            return STEP_OK;
+        }
+
+        case TRAILER:
+            // CRC-32 and size of the uncompressed data, little-endian
+            if (!need(8)) return STEP_MORE;
+            _trailer[_index++] = (uint8_t)take(8);
+            if (_index < 8) return STEP_OK;
+            if (!flush()) return fail("Image write failed");
+            {
+                uint32_t crc = 0, size = 0;
+                for (int i = 3; i >= 0; --i) {
+                    crc = (crc << 8) | _trailer[i];
+                    size = (size << 8) | _trailer[4 + i];
+                }
+                if (crc != _crc) return fail("gzip CRC mismatch");
+                if (size != _total) return fail("gzip size mismatch");
+            }
+            _state = DONE;
+            return STEP_OK;
+
+        default:
+            return STEP_MORE;
+    }
+}
+
+bool GzipInflater::write(const uint8_t* data, size_t len) {
+    if (_state == FAILED) return false;
+    _in = data;
+    _inLen = len;
+    _inPos = 0;
+    while (_state != DONE) {
+        size_t pos = _inPos;
+        uint32_t bitBuf = _bitBuf;
+        unsigned bitCount = _bitCount;
+        Step result = step();
+        if (result == STEP_FAIL) {
+            _state = FAILED;
+            return false;
+        }
+        if (result == STEP_MORE) {
+            // Undo the partial step and keep its bytes for the next piece.
+            // No step needs more than 20 bits, so this stays below 32.
+            _inPos = pos;
+            _bitBuf = bitBuf;
+            _bitCount = bitCount;
+            while (_inPos < _inLen) {
+                _bitBuf |= (uint32_t)_in[_inPos++] << _bitCount;
+                _bitCount += 8;
+            }
+            break;
+        }
+    }
+    _in = nullptr;
+    // Hand over what this piece produced rather than waiting for a full window
+    if (!flush()) {
+        _error = "Image write failed";
+        _state = FAILED;
+        return false;
+    }
+    return true;
+}
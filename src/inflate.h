@@ -0,0 +1,94 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <functional>
+
+#define INFLATE_WINDOW_SIZE 32768  // farthest back a deflate match can reach
+
+// Receives inflated bytes in order; returning false stops the stream
+typedef std::function<bool(const uint8_t* data, size_t len)> InflateSink;
+
+// Push-style gzip decoder: the .gz arrives in arbitrary pieces (HTTP upload
+// chunks, socket reads) and comes out through the sink as it is decoded.
+// RAM is the 32 KB history window plus about 1.5 KB of tables, whatever the
+// image size. Decoding is split into steps of at most 20 bits; when a piece
+// ends inside a step, the step is rolled back and its few bytes are kept in
+// the bit buffer until the next write().
+class GzipInflater {
+public:
+    GzipInflater() = default;
+    ~GzipInflater() { end(); }
+    GzipInflater(const GzipInflater&) = delete;
+    GzipInflater& operator=(const GzipInflater&) = delete;
+
+    // Allocates the window; false when there is not enough heap
+    bool begin(InflateSink sink);
+    // Decodes the next piece of the stream. False on corrupt input or when
+    // the sink refuses data; the inflater then stays failed until begin().
+    bool write(const uint8_t* data, size_t len);
+    // True once the trailer was read and its CRC-32 and size matched
+    bool done() const { return _state == DONE; }
+    // Frees the window
+    void end();
+
+    const char* error() const { return _error; }
+    uint32_t outputSize() const { return _total; }
+
+private:
+    enum State : uint8_t {
+        GZ_HEADER, GZ_EXTRA_LEN, GZ_EXTRA, GZ_NAME, GZ_COMMENT, GZ_HCRC,
+        BLOCK_HEADER, STORED_LEN, STORED_NLEN, STORED_COPY,
+        TABLE_COUNTS, TABLE_CODE_LENGTHS, TABLE_LENGTHS,
+        LITLEN, DISTANCE, DIST_EXTRA,
+        TRAILER, DONE, FAILED
+    };
+    enum Step : uint8_t { STEP_OK, STEP_MORE, STEP_FAIL };
+    struct Huffman {
+        uint16_t count[16];  // codes of each bit length
+        uint16_t* symbol;    // symbols ordered by code
+    };
+
+    bool need(unsigned n);
+    uint32_t take(unsigned n);
+    int decode(const Huffman& h);
+    static int build(Huffman& h, const uint8_t* lengths, size_t n);
+    Step step();
+    Step fail(const char* error);
+    State nextHeaderState();
+    void startBlocks(bool fixed);
+    void endBlock();
+    bool emit(uint8_t b);
+    bool flush();
+
+    InflateSink _sink;
+    const char* _error = nullptr;
+    State _state = FAILED;
+
+    const uint8_t* _in = nullptr;
+    size_t _inLen = 0;
+    size_t _inPos = 0;
+    uint32_t _bitBuf = 0;
+    unsigned _bitCount = 0;
+
+    uint8_t* _window = nullptr;
+    size_t _windowPos = 0;   // next byte to write
+    size_t _flushed = 0;     // bytes before this went to the sink
+    uint32_t _total = 0;
+    uint32_t _crc = 0;
+
+    uint16_t _lenSymbols[288];
+    uint16_t _distSymbols[30];
+    Huffman _lenCode = {{}, _lenSymbols};
+    Huffman _distCode = {{}, _distSymbols};
+    uint8_t _lengths[288 + 30];
+    uint16_t _litCount = 0;
+    uint16_t _distCount = 0;
+    uint16_t _codeCount = 0;
+    uint16_t _index = 0;        // position within a header, table or trailer
+    uint16_t _remaining = 0;    // stored bytes or header field bytes left
+    uint16_t _matchLength = 0;
+    uint8_t _distSymbol = 0;
+    uint8_t _flags = 0;
+    bool _lastBlock = false;
+    uint8_t _trailer[8];
+};
@@ -0,0 +1,50 @@
+#include "json_stream.h"
+#include "debug.h"
+
+size_t JsonStreamWriter::fill(uint8_t* buffer, size_t maxLen) {
+    size_t written = 0;
+    while (written < maxLen && !_done) {
+        if (_fragmentPos == _fragmentLen) {
+            _fragmentPos = 0;
+            _fragmentLen = 0;
+            bool more = _producer(_state, _fragment, sizeof(_fragment), _fragmentLen);
+            ++_state.index;
+            if (!more) {
+                _done = true;
+                break;
+            }
+            continue;
+        }
+        size_t n = _fragmentLen - _fragmentPos;
+        if (n > maxLen - written) n = maxLen - written;
+        memcpy(buffer + written, _fragment + _fragmentPos, n);
+        _fragmentPos += n;
+        written += n;
+    }
+    return written;
+}
+
+size_t serializeJsonFragment(char* buf, size_t size, const char* prefix, const JsonDocument& doc) {
+    size_t prefixLen = strlen(prefix);
+    if (prefixLen + 4 >= size) return 0;
+    memcpy(buf, prefix, prefixLen);
+    if (prefixLen + measureJson(doc) >= size) {
+        debugPrintln("[JSON] Fragment too large, replaced by null");
+        memcpy(buf + prefixLen, "null", 4);
+        return prefixLen + 4;
+    }
+    return prefixLen + serializeJson(doc, buf + prefixLen, size - prefixLen);
+}
+
+size_t serializeJsonItem(JsonStreamState& state, char* buf, size_t size, const JsonDocument& doc) {
+    size_t len = serializeJsonFragment(buf, size, state.listed == 0 ? "" : ",", doc);
+    if (len) ++state.listed;
+    return len;
+}
+
+bool closeJsonStream(JsonStreamState& state, const char* closing, char* buf, size_t size, size_t& len) {
+    if (state.closed) return false;
+    state.closed = true;
+    len = strlcpy(buf, closing, size);
+    return true;
+}
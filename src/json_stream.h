@@ -0,0 +1,50 @@
+#pragma once
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <functional>
+
+// Size of the single fragment buffer a stream holds; one preset, timer or
+// config section must serialize into this
+#define JSON_STREAM_FRAGMENT 512
+
+// Progress through one streamed document. The collection being listed can
+// change between fragments (a timer deleted from another request), so commas
+// and the closing brackets follow what was actually written, not the indices.
+struct JsonStreamState {
+    size_t index = 0;     // fragment being produced
+    size_t listed = 0;    // array items written so far
+    bool closed = false;  // closing brackets written
+};
+
+// Produces fragment `state.index` into buf (setting len, 0 = nothing for this
+// index). Returns false once the document is complete.
+typedef std::function<bool(JsonStreamState& state, char* buf, size_t size, size_t& len)> JsonFragmentProducer;
+
+// Feeds an AsyncChunkedResponse from a fragment producer. Memory stays at one
+// fragment no matter how many presets or timers the document holds.
+class JsonStreamWriter {
+public:
+    explicit JsonStreamWriter(JsonFragmentProducer producer) : _producer(producer) {}
+
+    // Chunk filler: copies as much as fits, returns 0 when done
+    size_t fill(uint8_t* buffer, size_t maxLen);
+
+private:
+    JsonFragmentProducer _producer;
+    char _fragment[JSON_STREAM_FRAGMENT];
+    size_t _fragmentLen = 0;
+    size_t _fragmentPos = 0;
+    JsonStreamState _state;
+    bool _done = false;
+};
+
+// Writes `prefix` followed by the serialized document. A document that does not
+// fit is replaced by `null` so the stream stays valid JSON.
+size_t serializeJsonFragment(char* buf, size_t size, const char* prefix, const JsonDocument& doc);
+
+// Next array item, comma-separated from the ones already listed
+size_t serializeJsonItem(JsonStreamState& state, char* buf, size_t size, const JsonDocument& doc);
+
+// Writes `closing` once, at or past the end of the list; then reports the
+// document complete
+bool closeJsonStream(JsonStreamState& state, const char* closing, char* buf, size_t size, size_t& len);
@@ -0,0 +1,92 @@
+#include "local_clock.h"
+#include "config.h"
+#include "timezone.h"
+#include <algorithm>
+
+void LocalClock::sync(uint32_t utcEpoch, uint32_t atMillis, uint16_t utcMillis) {
+    _anchorEpoch = utcEpoch;
+    _anchorMillis = atMillis - utcMillis;
+    _lastUpdateMillis = atMillis;
+    _slew = 0;
+    _synced = true;
+    _utc = UINT32_MAX; // force a recompute even if the second did not move
+    update(atMillis);
+}
+
+void LocalClock::discipline(uint32_t utcEpoch, uint32_t atMillis, uint16_t utcMillis) {
+    if (!_synced) {
+        sync(utcEpoch, atMillis, utcMillis);
+        return;
+    }
+    update(atMillis);
+    int64_t ours = (int64_t)_anchorEpoch * 1000 + (atMillis - _anchorMillis);
+    int64_t reference = (int64_t)utcEpoch * 1000 + utcMillis;
+    int64_t error = reference - ours;
+    if (error > NTP_SLEW_LIMIT || error < -NTP_SLEW_LIMIT) {
+        sync(utcEpoch, atMillis, utcMillis);
+        return;
+    }
+    _slew = (int32_t)error;
+}
+
+void LocalClock::update(uint32_t nowMillis) {
+    // Slew: move the anchor by a small fraction of the elapsed time. Going
+    // back never moves it past nowMillis, so elapsed stays non-negative.
+    if (_slew != 0) {
+        uint32_t budget = (nowMillis - _lastUpdateMillis) / NTP_SLEW_DIVISOR;
+        if (budget > 0) {
+            _lastUpdateMillis += budget * NTP_SLEW_DIVISOR;
+            if (_slew > 0) {
+                uint32_t step = std::min<uint32_t>(budget, (uint32_t)_slew);
+                _anchorMillis -= step;
+                _slew -= (int32_t)step;
+            } else {
+                uint32_t step = std::min<uint32_t>({budget, (uint32_t)-_slew, nowMillis - _anchorMillis});
+                _anchorMillis += step;
+                _slew += (int32_t)step;
+            }
+        }
+    } else {
+        _lastUpdateMillis = nowMillis;
+    }
+
+    // Move the anchor forward in whole seconds so millis() wraparound never
+    // accumulates more than one second of unsigned difference
+    uint32_t elapsed = nowMillis - _anchorMillis;
+    if (elapsed >= 1000) {
+        uint32_t seconds = elapsed / 1000;
+        _anchorEpoch += seconds;
+        _anchorMillis += seconds * 1000;
+        elapsed -= seconds * 1000;
+    }
+    _subSecond = (uint16_t)elapsed;
+
+    uint32_t configGen = _config ? _config->gen.time : 0;
+    if (_anchorEpoch != _utc || configGen != _configGen) {
+        _configGen = configGen;
+        recompute();
+    }
+}
+
+void LocalClock::recompute() {
+    _utc = _anchorEpoch;
+    _offset = _config ? _config->getTimezoneOffsetSeconds(_utc) : 0;
+    _local = (int64_t)_utc + _offset;
+
+    int64_t days = _local / 86400;
+    int64_t rem = _local % 86400;
+    if (rem < 0) {
+        rem += 86400;
+        --days;
+    }
+    _dayNumber = (int32_t)days;
+    _secondOfDay = (uint32_t)rem;
+    _minuteOfDay = (uint16_t)(_secondOfDay / 60);
+    _hour = (uint8_t)(_secondOfDay / 3600);
+    _minute = (uint8_t)(_minuteOfDay % 60);
+    _second = (uint8_t)(_secondOfDay % 60);
+
+    civilFromDays(_dayNumber, _year, _month, _day);
+    _weekday = weekdayFromDays(_dayNumber);
+    _dayOfYear = (uint16_t)(_dayNumber - daysFromCivil(_year, 1, 1) + 1);
+}
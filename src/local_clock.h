@@ -0,0 +1,67 @@
+#pragma once
+#include <Arduino.h>
+
+class Configuration;
+
+// Wall clock advanced from millis() between NTP syncs. The broken-down local
+// time is recomputed only when the second (or the time config) changes, so
+// every accessor is a plain field read.
+class LocalClock {
+public:
+    explicit LocalClock(Configuration* config) : _config(config) {}
+
+    // Anchor to a UTC epoch (+ utcMillis) that was current at millis() == atMillis
+    void sync(uint32_t utcEpoch, uint32_t atMillis, uint16_t utcMillis = 0);
+    // Same, for a reference that may differ only slightly from the running
+    // clock: errors up to NTP_SLEW_LIMIT are slewed in gradually so seconds
+    // never repeat or vanish; larger ones (or the first sync) step the clock
+    void discipline(uint32_t utcEpoch, uint32_t atMillis, uint16_t utcMillis);
+    // Advance to nowMillis; cheap unless a second boundary was crossed
+    void update(uint32_t nowMillis);
+
+    bool isSynced() const { return _synced; }
+    uint32_t utcEpoch() const { return _utc; }
+    int64_t localEpoch() const { return _local; }
+    int32_t utcOffset() const { return _offset; }
+
+    int32_t dayNumber() const { return _dayNumber; }     // local days since 1970-01-01
+    int32_t year() const { return _year; }
+    uint8_t month() const { return _month; }             // 1-12
+    uint8_t day() const { return _day; }                 // 1-31
+    uint8_t weekday() const { return _weekday; }         // 0 = Sunday
+    uint16_t dayOfYear() const { return _dayOfYear; }    // 1-366
+    uint8_t hour() const { return _hour; }
+    uint8_t minute() const { return _minute; }
+    uint8_t second() const { return _second; }
+    uint16_t minuteOfDay() const { return _minuteOfDay; }
+    uint32_t secondOfDay() const { return _secondOfDay; }
+    uint16_t subSecond() const { return _subSecond; }    // ms into the current second
+
+private:
+    void recompute();
+
+    Configuration* _config;
+    bool _synced = false;
+    // Until the first sync the clock counts uptime from epoch 0
+    uint32_t _anchorEpoch = 0;
+    uint32_t _anchorMillis = 0;
+    uint32_t _lastUpdateMillis = 0;
+    int32_t _slew = 0;                   // ms still to add (+) or remove (-)
+
+    uint32_t _utc = UINT32_MAX;          // second the fields below describe
+    uint32_t _configGen = UINT32_MAX;    // gen.time they were computed with
+    int32_t _offset = 0;
+    int64_t _local = 0;
+    int32_t _dayNumber = 0;
+    int32_t _year = 1970;
+    uint8_t _month = 1;
+    uint8_t _day = 1;
+    uint8_t _weekday = 4;
+    uint16_t _dayOfYear = 1;
+    uint8_t _hour = 0;
+    uint8_t _minute = 0;
+    uint8_t _second = 0;
+    uint16_t _minuteOfDay = 0;
+    uint32_t _secondOfDay = 0;
+    uint16_t _subSecond = 0;
+};
@@ -0,0 +1,109 @@
+#include "loop_scheduler.h"
+#include "sim_clock.h"
+#include <algorithm>
+
+LoopScheduler loopScheduler;
+
+void LoopScheduler::setFrameTask(const char* name, TaskFn fn, uint32_t intervalMs, uint32_t budgetUs) {
+    _frame.name = name;
+    _frame.fn = fn;
+    _frame.periodMs = intervalMs;
+    _frame.budgetUs = budgetUs;
+    _frameInterval = intervalMs;
+    _nextFrame = controlMillis();
+    _hasFrame = true;
+}
+
+void LoopScheduler::addTask(const char* name, TaskFn fn, uint32_t periodMs, uint8_t priority,
+                            uint32_t budgetUs, bool background) {
+    Task task;
+    task.name = name;
+    task.fn = fn;
+    task.periodMs = periodMs;
+    task.priority = priority;
+    task.budgetUs = budgetUs;
+    task.background = background;
+    auto pos = std::upper_bound(_tasks.begin(), _tasks.end(), task,
+        [](const Task& a, const Task& b) { return a.priority < b.priority; });
+    _tasks.insert(pos, task);
+}
+
+void LoopScheduler::run(Task& task, uint32_t nowMillis) {
+    task.ran = true;
+    task.lastRun = nowMillis;
+    uint32_t start = micros();
+    task.fn();
+    uint32_t cost = micros() - start;
+    ++task.runs;
+    task.totalUs += cost;
+    if (cost > task.maxUs) task.maxUs = cost;
+    if (cost > task.budgetUs) ++task.overruns;
+}
+
+uint32_t LoopScheduler::runOnce() {
+    uint32_t now = controlMillis();
+    bool rendered = false;
+    if (_hasFrame && (int32_t)(now - _nextFrame) >= 0) {
+        // A whole interval behind: resynchronise instead of rendering a burst
+        if (now - _nextFrame >= _frameInterval) {
+            ++_lateFrames;
+            _nextFrame = now;
+        }
+        _nextFrame += _frameInterval;
+        run(_frame, now);
+        rendered = true;
+    }
+
+    for (Task& task : _tasks) {
+        now = controlMillis();
+        if (task.ran && now - task.lastRun < task.periodMs) continue;
+        if (task.background && _hasFrame) {
+            int32_t slack = (int32_t)(_nextFrame - now);
+            bool fits = slack > 0 && (uint32_t)slack * 1000 >= task.budgetUs;
+            bool longerThanFrame = task.budgetUs >= _frameInterval * 1000;
+            if (!fits && !(rendered && longerThanFrame)) {
+                ++task.deferred;
+                continue;
+            }
+        }
+        run(task, now);
+    }
+
+    // Sleep until the next frame or the next periodic task
+    now = controlMillis();
+    uint32_t idle = UINT32_MAX;
+    if (_hasFrame) {
+        int32_t untilFrame = (int32_t)(_nextFrame - now);
+        idle = untilFrame > 0 ? (uint32_t)untilFrame : 0;
+    }
+    for (const Task& task : _tasks) {
+        if (task.periodMs == 0) continue;  // runs on whichever pass comes next
+        uint32_t since = now - task.lastRun;
+        // Deferred background work waits for the next frame anyway
+        if (since >= task.periodMs) {
+            if (!task.background) idle = 0;
+            continue;
+        }
+        idle = std::min(idle, task.periodMs - since);
+    }
+    return idle;
+}
+
+void LoopScheduler::writeTask(const Task& task, JsonObject obj) {
+    obj["name"] = task.name;
+    obj["runs"] = task.runs;
+    obj["overruns"] = task.overruns;
+    obj["deferred"] = task.deferred;
+    obj["budgetUs"] = task.budgetUs;
+    obj["maxUs"] = task.maxUs;
+    obj["avgUs"] = task.runs ? (uint32_t)(task.totalUs / task.runs) : 0;
+}
+
+void LoopScheduler::writeStats(JsonObject obj) const {
+    obj["lateFrames"] = _lateFrames;
+    JsonArray tasks = obj.createNestedArray("tasks");
+    if (_hasFrame) writeTask(_frame, tasks.createNestedObject());
+    for (const Task& task : _tasks) {
+        writeTask(task, tasks.createNestedObject());
+    }
+}
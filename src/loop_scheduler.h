@@ -0,0 +1,54 @@
+#pragma once
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <vector>
+
+// Cooperative scheduler for loop(). The frame task runs on its deadline and
+// always goes first. Foreground tasks run when their period has elapsed, in
+// priority order (0 first). Background tasks also need enough slack before
+// the next frame to fit their budget, or run right after a frame when the
+// budget is longer than a frame. Nothing is preempted: a task that takes
+// longer than its budget only counts as an overrun in the stats.
+class LoopScheduler {
+public:
+    typedef void (*TaskFn)();
+
+    void setFrameTask(const char* name, TaskFn fn, uint32_t intervalMs, uint32_t budgetUs);
+    // periodMs 0 runs on every pass
+    void addTask(const char* name, TaskFn fn, uint32_t periodMs, uint8_t priority,
+                 uint32_t budgetUs, bool background = false);
+
+    // One loop() pass; returns the time until something is due (ms)
+    uint32_t runOnce();
+
+    // Per-task counters for GET /api/perf
+    void writeStats(JsonObject obj) const;
+
+private:
+    struct Task {
+        const char* name = "";
+        TaskFn fn = nullptr;
+        uint32_t periodMs = 0;
+        uint8_t priority = 0;
+        uint32_t budgetUs = 0;
+        bool background = false;
+        bool ran = false;
+        uint32_t lastRun = 0;
+        uint32_t runs = 0;
+        uint32_t overruns = 0;   // runs that took longer than budgetUs
+        uint32_t deferred = 0;   // due, but skipped for lack of slack
+        uint32_t maxUs = 0;
+        uint64_t totalUs = 0;
+    };
+    void run(Task& task, uint32_t nowMillis);
+    static void writeTask(const Task& task, JsonObject obj);
+
+    Task _frame;
+    bool _hasFrame = false;
+    uint32_t _frameInterval = 0;
+    uint32_t _nextFrame = 0;
+    uint32_t _lateFrames = 0;    // frames started a whole interval late
+    std::vector<Task> _tasks;    // by priority
+};
+
+extern LoopScheduler loopScheduler;
@@ -24,12 +24,17 @@
 
 #include "config.h"
 #include "presets.h"
+#include "photoperiod.h"
 #include "effects.h"
 #include "scheduler.h"
 #include "bus_manager.h"
 #include "transition.h"
 #include "webserver.h"
 #include "captive_portal.h"
+#include "wifi_manager.h"
+#include "persistence.h"
+#include "frame_cache.h"
+#include "loop_scheduler.h"
 #include <Arduino.h>
 #include "debug.h"
 #include "ota.h"
@@ -39,20 +44,25 @@
 
 #include "version.h"
 #include "display.h"
+#include "sim_clock.h"
 
 
 // Global BusManager instance
 BusManager busManager;
 WebServerManager* webServerPtr = nullptr;
 
-// Track last configuration for change detection
-Configuration lastConfiguration;
+// Config generations last acted upon by onConfigChange
+ConfigGenerations lastConfigGen;
 
 // Global objects
 Configuration config;
 Scheduler scheduler(&config);
 TransitionEngine transition;
 WebServerManager webServer(&config, &scheduler);
+WiFiManager wifiManager(&config);
+PresetStore presetStore;
+Persistence persistence(&config, &state);
+FrameCache frameCache;
 
 // Use void* for runtime type switching
 void* strip = nullptr;
@@ -64,15 +74,18 @@ uint32_t lastUpdate = 0;
 // Track last timers for schedule update
 std::vector<Timer> lastTimers;
 
-// Track last scheduled preset applied by timer
-int8_t lastScheduledPreset = -1;
+// Boot work that used to block setup(). loop() advances it, so the lights
+// come on before the splash, WiFi and NTP have finished.
+enum class BootStage : uint8_t { WiFiConnecting, Services, Done };
+BootStage bootStage = BootStage::WiFiConnecting;
+bool splashDone = false;
 
 // Function declarations
-void setupWiFi();
+void advanceBoot();
+void setupLoopTasks();
+void trackNetworkState();
 void setupLEDs();
 void addBusToManager();
-void checkSchedule();
-void checkAndApplyScheduleAfterBoot();
 
 void setup() {
     webServerPtr = &webServer;
@@ -94,7 +107,7 @@ void setup() {
     // List files in LittleFS for debugging
     LittleFS.begin();
 
-    // Initialize display (test)
+    // Initialize display; the splash is drawn from loop()
     setup_display();
 
     // Load configuration
@@ -102,14 +115,19 @@ void setup() {
         config.setDefaults();
         config.save();
     }
-    // Ensure lastConfiguration matches loaded config at boot
-    lastConfiguration = config;
-
     // Load presets
-    if (!loadPresets(config.presets)) {
+    if (!presetStore.begin()) {
         debugPrintln("Failed to load presets");
-        savePresets(config.presets);
     }
+    ++config.gen.presets;
+    loadPhotoperiod(config.photoperiod);
+    ++config.gen.photoperiod;
+    // Ensure lastConfigGen matches loaded config at boot
+    lastConfigGen = config.gen;
+    // State and wall clock as of the last save (restart or power cut)
+    SystemState savedState;
+    uint32_t savedEpoch = 0;
+    bool stateSaved = loadLastState(savedState, savedEpoch);
 
 
     // Initialize LEDs and BusManager
@@ -121,10 +139,8 @@ void setup() {
     transition.forceCurrentBrightness(state.brightness); // Set current
     // Removed unnecessary initial transition at boot
 
-    // Connect to WiFi
-
-    setupWiFi();
-    delay(500); // Give network stack time to settle
+    // Start connecting; wifiManager.update() carries on from loop()
+    wifiManager.begin(millis());
 
     // Setup web server callbacks (moved up)
     webServer.onPowerChange(setPower);
@@ -136,31 +152,22 @@ void setup() {
         pinMode(config.led.relayPin, OUTPUT);
         digitalWrite(config.led.relayPin, state.power ? (config.led.relayActiveHigh ? HIGH : LOW) : (config.led.relayActiveHigh ? LOW : HIGH));
         // Only recalculate sun times if location changed
-        bool locationChanged = config.time.latitude != lastConfiguration.time.latitude || config.time.longitude != lastConfiguration.time.longitude;
+        bool locationChanged = config.gen.time != lastConfigGen.time;
         if (locationChanged) {
             scheduler.calculateSunTimes();
-            lastConfiguration.time.latitude = config.time.latitude;
-            lastConfiguration.time.longitude = config.time.longitude;
         }
         // Only update schedule if timers changed
-        bool timersChanged = config.timers != lastConfiguration.timers;
+        bool timersChanged = config.gen.timers != lastConfigGen.timers;
         if (timersChanged) {
             scheduler.begin(); // or scheduler.update() if begin is too heavy
-            lastConfiguration.timers = config.timers;
         }
         // Only reinitialize LEDs if hardware config changed
-        bool ledChanged = config.led.pin != lastConfiguration.led.pin ||
-                          config.led.count != lastConfiguration.led.count ||
-                          config.led.type != lastConfiguration.led.type ||
-                          config.led.colorOrder != lastConfiguration.led.colorOrder;
+        bool ledChanged = config.gen.led != lastConfigGen.led;
         if (ledChanged) {
             setupLEDs();
             updatePixelCount();
-            lastConfiguration.led.pin = config.led.pin;
-            lastConfiguration.led.count = config.led.count;
-            lastConfiguration.led.type = config.led.type;
-            lastConfiguration.led.colorOrder = config.led.colorOrder;
         }
+        lastConfigGen = config.gen;
         // Only reset transition engine and update LEDs if LED config changed
         if (ledChanged) {
             uint8_t prevBrightness = transition.getCurrentBrightness();
@@ -179,211 +186,161 @@ void setup() {
     // Start web server
     webServer.begin();
 
-    // Initialize scheduler
+    // Initialize scheduler (restores the time kept across a restart). After a
+    // power cut RTC memory is gone: run on the saved time until NTP answers.
     scheduler.begin();
+    if (stateSaved) scheduler.estimateTime(savedEpoch);
+    scheduler.update();
 
-    // Setup ArduinoOTA (ESP32 only)
-    setupArduinoOTA(config.network.hostname.c_str());
-    
-    // Wait for NTP time sync
-    debugPrintln("Waiting for time sync...");
-    for (int i = 0; i < 30; i++) {
-        scheduler.update();
-        if (scheduler.isTimeValid()) {
-            debugPrintln("Time synchronized!");
-            break;
-        }
-        delay(1000);
-    }
-
-    debugPrintln();
-    debugPrintln("System ready!");
-    debugPrint("IP Address: ");
-    debugPrintln(WiFi.localIP());
-    debugPrintln("=================================");
-
-    // Do not apply a scheduled preset here; let checkAndApplyScheduleAfterBoot() handle it after time sync
+    // First light: last-known state now, and the scheduled preset right away
+    // when the time survived the restart or could be estimated. Otherwise the
+    // schedule follows the first NTP reply.
     // Ensure transition starts from the actual brightness, not 0
     transition.forceCurrentBrightness(state.brightness);
-    setEffect(state.effect, state.params);
-    setBrightness(state.brightness);
-    setPower(state.power);
+    if (stateSaved) {
+        restoreState(savedState);
+    } else {
+        setEffect(state.effect, state.params);
+        setBrightness(state.brightness);
+        setPower(state.power);
+    }
+    checkAndApplyScheduleAfterBoot();
+    // Boot changes above count as saved
+    persistence.begin();
 
+    setupLoopTasks();
 }
 
-
-void loop() {
-    // Prioritize OTA: if OTA is in progress, only handle OTA and show debug dots
-    if (otaInProgress) {
-        handleArduinoOTA();
-        // Show debug dots handled in OTA progress callback
-        return;
+void advanceBoot() {
+    switch (bootStage) {
+    case BootStage::WiFiConnecting:
+        // Connected, or the setup AP is up after the first failed attempts
+        if (wifiManager.isConnected() || wifiManager.isAccessPoint()) {
+            bootStage = BootStage::Services;
+        }
+        break;
+    case BootStage::Services:
+        // Setup ArduinoOTA (ESP32 only)
+        setupArduinoOTA(config.network.hostname.c_str());
+        debugPrintln();
+        debugPrintln("System ready!");
+        debugPrint("IP Address: ");
+        debugPrintln(wifiManager.ip());
+        debugPrintln("=================================");
+        bootStage = BootStage::Done;
+        break;
+    case BootStage::Done:
+        break;
     }
+}
+
+
+// Loop tasks. The frame deadline wins; network housekeeping, captive DNS
+// and the TFT only get the slack between frames.
+static void renderTask() {
+    transition.update();
+    updateLEDs();
+}
+
+static void timeTask() {
     checkAndApplyScheduleAfterBoot();
-    handleArduinoOTA();
     scheduler.update();
-    webServer.update();
-    transition.update();
-    // Only check schedule on a new round minute
-    {
-        static int lastCheckedMinute = -1;
-        int currentMinute = scheduler.getCurrentMinute();
-        if (currentMinute != lastCheckedMinute) {
-            checkSchedule();
-            lastCheckedMinute = currentMinute;
-        }
+    // Apply the schedule when the next timer is due (armed deadline, not minute polling)
+    if (scheduler.pollDue()) {
+        checkSchedule();
     }
-    // --- WiFi reconnect logic ---
-    static uint32_t lastWiFiCheck = 0;
-    static int wifiReconnectAttempts = 0;
-    const int wifiReconnectInterval = 10000; // 10 seconds
-    const int maxWiFiReconnectAttempts = 5;
-    if (WiFi.getMode() != WIFI_AP && config.network.ssid.length() > 0) {
-        if (WiFi.status() != WL_CONNECTED) {
-            uint32_t now = millis();
-            if (now - lastWiFiCheck > wifiReconnectInterval) {
-                debugPrintln("[WiFi] Lost connection, attempting reconnect...");
-                WiFi.disconnect();
-                delay(100);
-                WiFi.begin(config.network.ssid.c_str(), config.network.password.c_str());
-                wifiReconnectAttempts++;
-                lastWiFiCheck = now;
-                if (wifiReconnectAttempts >= maxWiFiReconnectAttempts) {
-                    debugPrintln("[WiFi] Too many failed reconnects, switching to AP mode");
-                    WiFi.mode(WIFI_AP);
-                    WiFi.softAP(config.network.hostname.c_str(), config.network.apPassword.c_str());
-                    startCaptivePortal(WiFi.softAPIP());
-                    wifiReconnectAttempts = 0;
-                }
-            }
-        } else {
-            wifiReconnectAttempts = 0;
-        }
+}
+
+static void networkTask() {
+    wifiManager.update(millis());
+    trackNetworkState();
+}
+
+static void bootTask() {
+    if (bootStage == BootStage::Done) return;
+    advanceBoot();
+    if (bootStage == BootStage::Done && splashDone) bootTimes.ready = millis();
+}
+
+static void displayTask() {
+    if (!splashDone) {
+        splashDone = display_splash_step();
+        if (splashDone && bootStage == BootStage::Done) bootTimes.ready = millis();
+        return;
     }
-    static uint32_t lastFrame = 0;
-    uint32_t now = millis();
-    if (now - lastFrame >= (1000 / FRAMES_PER_SECOND)) {
-        lastFrame = now;
-        updateLEDs();
-        // Only update display if status changes
-        static String lastPreset;
-        static bool lastPower = false;
-        static uint8_t lastBrightness = 0;
-        static String lastIp;
+    // Only update display if status changes; strings are built only when redrawing
+    static uint32_t lastDisplayGen = UINT32_MAX;
+    uint32_t displayGen = state.gen.preset + state.gen.power + state.gen.brightness + state.gen.network + config.gen.presets;
+    if (displayGen != lastDisplayGen) {
         String presetName = "-";
-        if (state.preset < config.getPresetCount()) {
-            presetName = config.presets[state.preset].name;
-        }
-        String ipStr = (WiFi.getMode() == WIFI_AP) ? WiFi.softAPIP().toString() : WiFi.localIP().toString();
-        if (presetName != lastPreset || state.power != lastPower || state.brightness != lastBrightness || ipStr != lastIp) {
-            display_status(presetName.c_str(), state.power, ipStr.c_str());
-            lastPreset = presetName;
-            lastPower = state.power;
-            lastBrightness = state.brightness;
-            lastIp = ipStr;
+        Preset preset;
+        if (presetStore.get(state.preset, preset)) {
+            presetName = preset.name;
         }
-    }
-    if (WiFi.getMode() == WIFI_AP) {
-        handleCaptivePortalDns();
+        String ipStr = wifiManager.ip().toString();
+        display_status(presetName.c_str(), state.power, ipStr.c_str());
+        lastDisplayGen = displayGen;
     }
 }
 
-void setupWiFi() {
-    debugPrintln("[WiFi] setupWiFi() called");
-    debugPrint("Connecting to WiFi");
-    // Set hostname
-    #ifdef ESP8266
-        WiFi.hostname(config.network.hostname);
-    #else
-        WiFi.setHostname(config.network.hostname.c_str());
-    #endif
-    // Connect to WiFi
-    if (config.network.ssid.length() > 0) {
-        debugPrintln("");
-        debugPrintln("[WiFi] Calling WiFi.begin");
-        WiFi.begin(config.network.ssid.c_str(), config.network.password.c_str());
-        int attempts = 0;
-        int maxAttempts = 60; // 60 x 500ms = 30s (double previous)
-        while (WiFi.status() != WL_CONNECTED && attempts < maxAttempts) {
-            delay(500);
-            debugPrint(".");
-            attempts++;
-        }
-        debugPrintln("");
-        debugPrintln("[WiFi] First connection attempt done");
-        // If not connected, try a second round of retries (total up to 60s)
-        if (WiFi.status() != WL_CONNECTED) {
-            debugPrintln("");
-            debugPrintln("[WiFi] First WiFi attempt failed, retrying...");
-            WiFi.disconnect();
-            delay(1000);
-            debugPrintln("[WiFi] Calling WiFi.begin (retry)");
-            WiFi.begin(config.network.ssid.c_str(), config.network.password.c_str());
-            attempts = 0;
-            while (WiFi.status() != WL_CONNECTED && attempts < maxAttempts) {
-                delay(500);
-                debugPrint(".");
-                attempts++;
-            }
-            debugPrintln("");
-            debugPrintln("[WiFi] Second connection attempt done");
-        }
-        if (WiFi.status() == WL_CONNECTED) {
-            debugPrintln("");
-            debugPrintln("[WiFi] Connected!");
-            debugPrint("Connected! IP: ");
-            debugPrintln(WiFi.localIP());
-            stopCaptivePortal();
-            return;
-        }
+static void captiveDnsTask() {
+    if (wifiManager.isAccessPoint()) {
+        handleCaptivePortalDns();
     }
-    // If connection failed or no credentials, start AP mode
-    debugPrintln("");
-    debugPrintln("[WiFi] Starting Access Point mode");
-    WiFi.mode(WIFI_AP);
-    WiFi.softAP(config.network.hostname.c_str(), config.network.apPassword.c_str());
-    debugPrint("AP IP: ");
-    debugPrintln(WiFi.softAPIP());
-    // Start captive portal DNS
-    startCaptivePortal(WiFi.softAPIP());
 }
 
-void setupLEDs() {
-    busManager.setupStrip(config.led.type, config.led.colorOrder, config.led.pin, config.led.count);
+void setupLoopTasks() {
+    // name, function, period (ms), priority, budget (us), background
+    loopScheduler.setFrameTask("render", renderTask, 1000 / FRAMES_PER_SECOND, 8000);
+    loopScheduler.addTask("time", timeTask, 0, 0, 2000);
+    loopScheduler.addTask("broadcast", []() { webServer.update(); }, 0, 1, 3000);
+    loopScheduler.addTask("ota", handleArduinoOTA, 20, 2, 500);
+    loopScheduler.addTask("network", networkTask, 50, 2, 500);
+    loopScheduler.addTask("boot", bootTask, 50, 3, 1000);
+    loopScheduler.addTask("preview", []() { webServer.updatePreview(); }, 0, 4, 3000, true);
+    loopScheduler.addTask("dns", captiveDnsTask, 10, 5, 1000, true);
+    loopScheduler.addTask("display", displayTask, 50, 6, 20000, true);
+    loopScheduler.addTask("wsCleanup", []() { webServer.cleanupClients(); }, 1000, 7, 1000, true);
+    loopScheduler.addTask("persist", []() {
+        persistence.update(millis(), scheduler.clock().isSynced() ? scheduler.clock().utcEpoch() : 0);
+    }, 100, 8, 50000, true);
 }
 
-
-
-void handleScheduledPreset(int8_t presetId, int currentMinutes) {
-    const Timer* activeTimer = scheduler.getActiveTimer();
-    if (activeTimer && activeTimer->presetId == presetId && presetId != lastScheduledPreset) {
-        uint8_t brightness = activeTimer->brightness;
-        // If this is the first schedule application after boot, use powerOn transition time
-        static bool firstScheduleApplied = false;
-        uint32_t transitionTime = firstScheduleApplied ? config.transitionTimes.schedule : config.transitionTimes.powerOn;
-        webServer.applyTransitionTimeLimit(transitionTime);
-        state.transitionTime = transitionTime;
-        applyPreset(presetId, brightness);
-        firstScheduleApplied = true;
-        lastScheduledPreset = presetId;
+void loop() {
+    // Restarts asked for by web handlers and the OTA task. Flushed (or erased
+    // for a factory reset) here, on the task that does every other flash
+    // write, and also during an OTA.
+    if (persistence.restartDue(millis())) {
+        persistence.prepareRestart();
+        ESP.restart();
+    }
+    // Prioritize OTA: if OTA is in progress, only handle OTA and show debug dots
+    if (otaInProgress) {
+        handleArduinoOTA();
+        // Show debug dots handled in OTA progress callback
+        return;
     }
+    uint32_t idle = loopScheduler.runOnce();
+    // Nothing is due before the next frame, task or timer deadline: yield the
+    // CPU instead of spinning (web server and WiFi run on their own event tasks)
+    uint32_t untilDue = scheduler.millisUntilDue();
+    if (untilDue < idle) idle = untilDue;
+    if (idle > 0) delay(idle);
 }
 
-void checkSchedule() {
-    const Timer* activeTimer = scheduler.getActiveTimer();
-    if (activeTimer) {
-        handleScheduledPreset(activeTimer->presetId, scheduler.getTimerMinutes(*activeTimer));
+// Bump the network generation whenever WiFi mode or link status changes
+void trackNetworkState() {
+    static int lastMode = -1;
+    static int lastStatus = -1;
+    int mode = (int)WiFi.getMode();
+    int status = (int)WiFi.status();
+    if (mode != lastMode || status != lastStatus) {
+        lastMode = mode;
+        lastStatus = status;
+        ++state.gen.network;
     }
 }
 
-// Apply the correct schedule as soon as time becomes valid after boot (only once)
-
-void checkAndApplyScheduleAfterBoot() {
-    static bool scheduleApplied = false;
-    if (!scheduleApplied) {
-        if (scheduler.isTimeValid()) {
-            checkSchedule();
-            scheduleApplied = true;
-        }
-    }
+void setupLEDs() {
+    busManager.setupStrip(config.led.type, config.led.colorOrder, config.led.pin, config.led.count);
 }
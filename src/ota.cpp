@@ -4,8 +4,9 @@
 #include "freertos/task.h"
 #include <ArduinoOTA.h>
 #include "esp_task_wdt.h"
+#include "esp_ota_ops.h"
+#include "esp_partition.h"
 #endif
-#include <LittleFS.h>
 #include <ESPAsyncWebServer.h>
 #include <WiFiClientSecure.h>
 #ifdef ESP32
@@ -18,12 +19,15 @@
 #else
 #include <Updater.h>
 #endif
-#include <ESP32-targz.h>
 #include "config.h"
 #include "scheduler.h"
 #include "transition.h"
 #include "webserver.h"
 #include "ota.h"
+#include "persistence.h"
+#include "ota_stream.h"
+#include "version.h"
+#include <algorithm>
 
 extern WebServerManager* webServerPtr; // Must be set to the global instance
 
@@ -33,10 +37,13 @@ volatile bool otaRequested = false;
 void setupArduinoOTA(const char* hostname) {
 #ifdef ESP32
     ArduinoOTA.setHostname(hostname);
+    // loop() restarts after flushing the settings, see onEnd
+    ArduinoOTA.setRebootOnSuccess(false);
     ArduinoOTA.onStart([]() {
         otaInProgress = true;
     });
     ArduinoOTA.onEnd([]() {
+        persistence.requestRestart(0);
         otaInProgress = false;
     });
     ArduinoOTA.onError([](ota_error_t error) {
@@ -54,36 +61,102 @@ void handleArduinoOTA() {
 #endif
 }
 
-// Write callback for decompressed data (main-loop safe)
-static size_t totalBytesWritten = 0;
+// Image writer behind otaStream; Update is started by the first image bytes
 static bool updateStarted = false;
-static bool gzWriteCallback(unsigned char* buff, size_t buffsize) {
+static size_t rawImageSize = 0;
+static bool otaImageWriter(const uint8_t* buff, size_t buffsize);
+static OtaStream otaStream(otaImageWriter);
+
+static bool otaImageWriter(const uint8_t* buff, size_t buffsize) {
     if (!updateStarted) {
-        if (!Update.begin((ESP.getFreeSketchSpace() - 0x1000) & 0xFFFFF000)) {
+        // A delta states the image size; an inflated full image has none up
+        // front, so reserve all free sketch space
+        size_t size = otaStream.targetSize();
+        if (size == 0) size = otaStream.compressed() ? ((ESP.getFreeSketchSpace() - 0x1000) & 0xFFFFF000) : rawImageSize;
+        if (!Update.begin(size)) {
             return false;
         }
         updateStarted = true;
     }
-    size_t written = Update.write(buff, buffsize);
-    if (written == buffsize) {
-        totalBytesWritten += written;
-        static uint8_t dotCount = 0;
-        if (++dotCount >= 8) {
-            debugPrint(".");
-            dotCount = 0;
-        }
-        #ifdef ESP32
-        esp_task_wdt_reset();
-        #endif
-        yield();
-        return true;
+    size_t written = Update.write(const_cast<uint8_t*>(buff), buffsize);
+    return written == buffsize;
+}
+
+// Source of delta patches: the image this device is running. The patcher
+// keeps reads within the size passed to beginDelta().
+static bool readRunningImage(size_t offset, uint8_t* buf, size_t len) {
+#ifdef ESP32
+    static const esp_partition_t* running = nullptr;
+    if (!running) running = esp_ota_get_running_partition();
+    if (!running) return false;
+    // Hashing a whole image before the first write takes a while
+    if ((offset & 0xFFFF) == 0) esp_task_wdt_reset();
+    return esp_partition_read(running, offset, buf, len) == ESP_OK;
+#else
+    // The sketch image, eboot included, starts at the beginning of flash
+    if ((offset & 0xFFFF) == 0) yield();
+    return ESP.flashRead(offset, buf, len);
+#endif
+}
+
+// `size` is the stream length: the image size unless it turns out to be gzip.
+// With `delta` the stream is a patch against the running image instead.
+static void startUpdate(size_t size, bool delta = false) {
+    updateStarted = false;
+    rawImageSize = size;
+    if (delta) {
+        otaStream.beginDelta(readRunningImage, ESP.getSketchSize());
     } else {
+        otaStream.begin();
+    }
+}
+
+static void abortUpdate() {
+    otaStream.end();
+    if (updateStarted) {
+#ifdef ESP32
+        Update.abort();
+#else
+        Update.end(false);
+#endif
+        updateStarted = false;
+    }
+}
+
+// Called after the last chunk went through otaStream; the image only becomes
+// bootable if it is complete and matches `expectedSha256` (when given)
+static bool finishUpdate(const String& expectedSha256, String& errorOut) {
+    if (!otaStream.finish() || !otaStream.verify(expectedSha256)) {
+        errorOut = otaStream.error();
+        abortUpdate();
+        return false;
+    }
+    otaStream.end();
+    debugPrint("[OTA] Image SHA-256: ");
+    debugPrintln(otaStream.digestHex());
+    if (!updateStarted) {
+        errorOut = "Update never started - no data written";
+        return false;
+    }
+    if (!Update.end(true)) {
+        errorOut = String("Update error: ") + Update.getError();
+        return false;
+    }
+    if (!Update.isFinished()) {
+        errorOut = "Update not finished properly";
         return false;
     }
+    return true;
 }
 
-// Fetch the latest firmware URL for this environment from GitHub
-String getLatestFirmwareUrl(String& latestVersion) {
+// Release versions are tagged "v1.2.3", the firmware reports "1.2.3"
+static bool sameVersion(const String& a, const String& b) {
+    auto strip = [](const String& v) { return v.startsWith("v") ? v.substring(1) : v; };
+    return strip(a) == strip(b);
+}
+
+// Fetch the latest release for this environment from GitHub
+bool getLatestRelease(FirmwareRelease& release) {
     // Download manifest.json from the latest release
     const char* manifestUrl = "https://github.com/kabroxiko/DeepGlow/releases/latest/download/manifest.json";
     WiFiClientSecure client;
@@ -94,59 +167,47 @@ String getLatestFirmwareUrl(String& latestVersion) {
     int httpCode = http.GET();
     if (httpCode != HTTP_CODE_OK) {
         http.end();
-        latestVersion = "";
-        return "";
+        return false;
     }
     String payload = http.getString();
     http.end();
-    DynamicJsonDocument doc(2048); // Manifest is small
+    DynamicJsonDocument doc(4096); // Manifest is small, delta entries included
     DeserializationError err = deserializeJson(doc, payload);
     if (err) {
-        latestVersion = "";
-        return "";
+        return false;
     }
-    // Manifest is an array of objects: [{ type, env, version, url }]
+    // Manifest is an array of objects:
+    // [{ type, env, version, url, sha256, deltas: [{ from, url }] }]
     const char* targetEnv = OTA_ENV;
     for (JsonVariant entry : doc.as<JsonArray>()) {
         String env = entry["env"].as<String>();
         if (env == targetEnv) {
-            latestVersion = entry["version"].as<String>();
-            String firmwareUrl = entry["url"].as<String>();
-            if (firmwareUrl.length() == 0) {
-                return "";
+            release.version = entry["version"].as<String>();
+            release.url = entry["url"].as<String>();
+            // Older manifests have no digest; the gzip CRC still guards the image
+            release.sha256 = entry["sha256"] | "";
+            release.deltaUrl = "";
+            for (JsonVariant delta : entry["deltas"].as<JsonArray>()) {
+                if (sameVersion(delta["from"] | "", getFirmwareVersion())) {
+                    release.deltaUrl = delta["url"] | "";
+                    break;
+                }
             }
-            return firmwareUrl;
+            return release.url.length() > 0;
         }
     }
-    latestVersion = "";
-    return "";
+    return false;
 }
 
-// Perform OTA update from the latest GitHub release for this environment
-bool performGzOtaUpdate(String& errorOut) {
-    otaInProgress = true;
-    totalBytesWritten = 0;
-    updateStarted = false;
-
-    if (webServerPtr) webServerPtr->broadcastOtaStatus("start", "OTA update started");
-
-    String latestVersion;
-    String firmwareUrl = getLatestFirmwareUrl(latestVersion);
-    if (firmwareUrl.isEmpty()) {
-        errorOut = "Could not determine latest firmware URL.";
-        otaInProgress = false;
-        if (webServerPtr) webServerPtr->broadcastOtaStatus("error", errorOut);
-        return false;
-    }
-
-    // TODO: Compare latestVersion to current version, skip if not newer
-
+// Streams `url` through otaStream into the update partition and finishes the
+// update; on failure the update is aborted and errorOut says why
+static bool downloadImage(const String& url, bool delta, const String& expectedSha256, String& errorOut) {
     WiFiClientSecure client;
     client.setInsecure();
     client.setTimeout(30);
 
     HTTPClient http;
-    http.begin(client, firmwareUrl);
+    http.begin(client, url);
     http.setFollowRedirects(HTTPC_STRICT_FOLLOW_REDIRECTS);
     http.setUserAgent("ESP32-OTA-Updater");
 
@@ -154,8 +215,6 @@ bool performGzOtaUpdate(String& errorOut) {
     if (httpCode != HTTP_CODE_OK) {
         errorOut = String("HTTP error code: ") + httpCode;
         http.end();
-        otaInProgress = false;
-        if (webServerPtr) webServerPtr->broadcastOtaStatus("error", errorOut);
         return false;
     }
 
@@ -163,205 +222,146 @@ bool performGzOtaUpdate(String& errorOut) {
     if (contentLength <= 0) {
         errorOut = "Invalid content length";
         http.end();
-        otaInProgress = false;
-        if (webServerPtr) webServerPtr->broadcastOtaStatus("error", errorOut);
         return false;
     }
 
+    // Inflate (and patch) straight from the socket into the update partition
     WiFiClient* stream = http.getStreamPtr();
-
-    GzUnpacker *GZUnpacker = new GzUnpacker();
-    GZUnpacker->setStreamWriter(gzWriteCallback);
-    GZUnpacker->setGzProgressCallback([](uint8_t progress) {
-        if (webServerPtr) webServerPtr->broadcastOtaStatus("progress", "Decompressing", progress);
-        static uint8_t dotCount = 0;
-        if (++dotCount >= 8) {
-            debugPrint(".");
-            dotCount = 0;
+    startUpdate(contentLength, delta);
+    uint8_t buf[1024];
+    size_t received = 0;
+    int lastProgress = -1;
+    uint32_t lastData = millis();
+    bool ok = true;
+    while (ok && received < (size_t)contentLength) {
+        size_t available = stream->available();
+        if (available == 0) {
+            if (!http.connected() || millis() - lastData > 30000) break;
+            delay(1);
+            continue;
+        }
+        size_t want = std::min(std::min(available, sizeof(buf)), (size_t)contentLength - received);
+        size_t got = stream->readBytes(buf, want);
+        if (got == 0) break;
+        lastData = millis();
+        received += got;
+        ok = otaStream.write(buf, got);
+        int progress = (int)(received * 100 / contentLength);
+        if (progress != lastProgress) {
+            lastProgress = progress;
+            if (webServerPtr) webServerPtr->broadcastOtaStatus("progress", "Downloading", progress);
+            if (progress % 10 == 0) debugPrint(".");
         }
         #ifdef ESP32
         esp_task_wdt_reset();
         #endif
         yield();
-    });
-
-    // Use direct gzStreamExpander call, let callbacks handle watchdog/yield
-    bool success = GZUnpacker->gzStreamExpander(stream, contentLength);
-    delete GZUnpacker;
+    }
     http.end();
 
-
-    if (!success) {
-        errorOut = "Decompression failed!";
-        if (updateStarted) {
-    #ifdef ESP32
-            Update.abort();
-    #else
-            Update.end(false);
-    #endif
-        }
-        otaInProgress = false;
-        if (webServerPtr) webServerPtr->broadcastOtaStatus("error", errorOut);
+    if (!ok) {
+        errorOut = otaStream.error();
+        abortUpdate();
         return false;
     }
+    if (received < (size_t)contentLength) {
+        errorOut = "Download interrupted";
+        abortUpdate();
+        return false;
+    }
+    return finishUpdate(expectedSha256, errorOut);
+}
 
-    if (!updateStarted) {
-        errorOut = "Update never started - no data written";
+// Perform OTA update from the latest GitHub release for this environment
+bool performGzOtaUpdate(String& errorOut) {
+    otaInProgress = true;
+
+    if (webServerPtr) webServerPtr->broadcastOtaStatus("start", "OTA update started");
+
+    FirmwareRelease release;
+    if (!getLatestRelease(release)) {
+        errorOut = "Could not determine latest firmware URL.";
         otaInProgress = false;
         if (webServerPtr) webServerPtr->broadcastOtaStatus("error", errorOut);
         return false;
     }
 
-    if (Update.end(true)) {
-        if (Update.isFinished()) {
-            otaInProgress = false;
-            if (webServerPtr) webServerPtr->broadcastOtaStatus("success", "OTA update successful");
-            return true;
-        } else {
-            errorOut = "Update not finished properly";
-            otaInProgress = false;
-            if (webServerPtr) webServerPtr->broadcastOtaStatus("error", errorOut);
-            return false;
+    // TODO: Compare release.version to current version, skip if not newer
+
+    bool ok = false;
+    // A patch against the running version is a fraction of the full image;
+    // any failure before Update.end() leaves nothing bootable behind, so the
+    // full image is always there to fall back on
+    if (release.deltaUrl.length() > 0) {
+        ok = downloadImage(release.deltaUrl, true, release.sha256, errorOut);
+        if (!ok) {
+            debugPrint("[OTA] Delta update failed, downloading full image: ");
+            debugPrintln(errorOut);
+            if (webServerPtr) webServerPtr->broadcastOtaStatus("progress", "Delta failed, downloading full image", 0);
         }
-    } else {
-        errorOut = String("Update error: ") + Update.getError();
-        otaInProgress = false;
+    }
+    if (!ok) ok = downloadImage(release.url, false, release.sha256, errorOut);
+    otaInProgress = false;
+    if (!ok) {
         if (webServerPtr) webServerPtr->broadcastOtaStatus("error", errorOut);
         return false;
     }
+    if (webServerPtr) webServerPtr->broadcastOtaStatus("success", "OTA update successful");
+    return true;
 }
 
-// OTA direct POST handler (moved from webserver.cpp)
+static void sendOtaResponse(AsyncWebServerRequest* request, bool ok, const String& errorMsg) {
+    AsyncWebServerResponse *resp = nullptr;
+    if (ok) {
+        resp = request->beginResponse(200, "application/json", "{\"success\":true,\"message\":\"Rebooting\"}");
+    } else {
+        String errJson = String("{\"error\":\"") + errorMsg + "\"}";
+        resp = request->beginResponse(500, "application/json", errJson);
+    }
+    for (size_t i = 0; i < 3; ++i) resp->addHeader("Access-Control-Allow-Origin", "*");
+    request->send(resp);
+}
+
+// OTA direct POST handler (moved from webserver.cpp). Chunks go through
+// otaStream into the update partition as they arrive, .bin and .bin.gz alike.
 void handleOTAUpdate(AsyncWebServerRequest* request, unsigned char* data, unsigned int len, unsigned int index, unsigned int total) {
     static unsigned int lastDot = 0;
-    static File gzFile;
-    static bool isGz = false;
-    static size_t uploaded = 0;
+    static bool failed = false;
+    static String expectedSha256;
     if (index == 0) {
         Serial.println("[HTTP] POST /ota");
-        LittleFS.end();
-        // Clean up any previous upload file to free space
-        if (!LittleFS.begin()) {
-            auto resp = request->beginResponse(500, "application/json", "{\"error\":\"LittleFS mount failed\"}");
-            request->send(resp);
-            return;
-        }
-        LittleFS.remove("/ota_upload.bin.gz");
-        // Check gzip magic number
-        isGz = (len >= 2 && data[0] == 0x1F && data[1] == 0x8B);
-        uploaded = 0;
-        if (isGz) {
-            if (!LittleFS.begin()) {
-                auto resp = request->beginResponse(500, "application/json", "{\"error\":\"LittleFS mount failed\"}");
-                request->send(resp);
-                return;
-            }
-            gzFile = LittleFS.open("/ota_upload.bin.gz", "w+");
-            if (!gzFile) {
-                auto resp = request->beginResponse(500, "application/json", "{\"error\":\"Failed to open file for writing\"}");
-                request->send(resp);
-                return;
-            }
-        } else {
-#if defined(ESP32)
-            if (!Update.begin(UPDATE_SIZE_UNKNOWN)) {
-#elif defined(ESP8266)
-            if (!Update.begin(total)) {
-#endif
-                auto resp = request->beginResponse(500, "application/json", "{\"error\":\"Update.begin failed\"}");
-                request->send(resp);
-                return;
-            }
-            lastDot = 0;
-        }
+        failed = false;
+        lastDot = 0;
+        expectedSha256 = request->hasHeader(OTA_SHA256_HEADER) ? request->getHeader(OTA_SHA256_HEADER)->value() : String();
+        startUpdate(total);
     }
-    if (isGz) {
-        if (!gzFile || gzFile.write(data, len) != len) {
-            auto resp = request->beginResponse(500, "application/json", "{\"error\":\"File write error\"}");
-            request->send(resp);
-            return;
-        }
-        uploaded += len;
-        // Show a dot for every 64KB uploaded
-        if (uploaded % 65536 < len) {
+    // The rest of a rejected upload still arrives; ignore it
+    if (failed) return;
+    if (!otaStream.write(data, len)) {
+        failed = true;
+        String errorMsg = otaStream.error();
+        abortUpdate();
+        sendOtaResponse(request, false, errorMsg);
+        return;
+    }
+    // Print progress dots every 1%
+    if (total > 0) {
+        unsigned int dot = ((index + len) * 100) / total;
+        if (dot != lastDot) {
             debugPrint(".");
-        }
-    } else {
-        if (Update.write(data, len) != len) {
-            auto resp = request->beginResponse(500, "application/json", "{\"error\":\"Update write error\"}");
-            request->send(resp);
-            return;
-        }
-        // Print progress dots every 1%
-        if (total > 0) {
-            unsigned int dot = ((index + len) * 100) / total;
-            if (dot != lastDot) {
-                debugPrint(".");
-                lastDot = dot;
-            }
+            lastDot = dot;
         }
     }
     if (index + len == total) {
         if (lastDot != 0) Serial.println(""); // Ensure LF after last dot
-        lastDot = 0; // reset for next OTA
-        AsyncWebServerResponse *resp = nullptr;
-        bool ok = false; // Declare ok only once
         String errorMsg;
-        if (isGz && gzFile) {
-            gzFile.close();
-            // Decompress and flash
-            File inFile = LittleFS.open("/ota_upload.bin.gz", "r");
-            if (!inFile) {
-                resp = request->beginResponse(500, "application/json", "{\"error\":\"Failed to open uploaded gz file\"}");
-                request->send(resp);
-                return;
-            }
-            GzUnpacker *GZUnpacker = new GzUnpacker();
-            totalBytesWritten = 0;
-            updateStarted = false;
-            GZUnpacker->setStreamWriter(gzWriteCallback);
-            GZUnpacker->setGzProgressCallback([](uint8_t progress) {
-                if (webServerPtr) webServerPtr->broadcastOtaStatus("progress", "Decompressing", progress);
-            });
-            ok = GZUnpacker->gzStreamExpander(&inFile, inFile.size());
-            delete GZUnpacker;
-            inFile.close();
-            LittleFS.remove("/ota_upload.bin.gz");
-            if (!ok) {
-                errorMsg = "Decompression or flash failed";
-            } else if (!updateStarted) {
-                errorMsg = "Update never started - no data written";
-                ok = false;
-            } else if (!Update.end(true)) {
-                errorMsg = String("Update error: ") + Update.getError();
-                ok = false;
-            } else if (!Update.isFinished()) {
-                errorMsg = "Update not finished properly";
-                ok = false;
-            }
-        } else {
-            ok = Update.end(true);
-            if (!ok) {
-                errorMsg = String("Update error: ") + Update.getError();
-            } else if (!Update.isFinished()) {
-                errorMsg = "Update not finished properly";
-                ok = false;
-            }
-        }
+        bool ok = finishUpdate(expectedSha256, errorMsg);
         if (ok) {
-            resp = request->beginResponse(200, "application/json", "{\"success\":true,\"message\":\"Rebooting\"}");
             Serial.println("OTA update complete, rebooting");
-        } else {
-            String errJson = String("{\"error\":\"") + errorMsg + "\"}";
-            resp = request->beginResponse(500, "application/json", errJson);
         }
-        for (size_t i = 0; i < 3; ++i) resp->addHeader("Access-Control-Allow-Origin", "*");
-        request->send(resp);
+        sendOtaResponse(request, ok, errorMsg);
         if (ok) {
-            request->onDisconnect([]() {
-                delay(100);
-                ESP.restart();
-            });
+            request->onDisconnect([]() { persistence.requestRestart(100); });
         }
     }
 }
@@ -372,11 +372,9 @@ extern "C" void otaTask(void* parameter) {
     bool ok = performGzOtaUpdate(error);
     if (ok) {
         debugPrintln("");
-        debugPrintln("[OTA Task] OTA update successful, attempting restart...");
-        delay(1000);
-        ESP.restart();
-        delay(5000);
-        *((volatile int*)0) = 0; // Force a crash/reboot
+        debugPrintln("[OTA Task] OTA update successful, restarting...");
+        // loop() flushes the settings and restarts; this task only ends
+        persistence.requestRestart(1000);
     } else {
         debugPrint("[OTA Task] OTA update failed: ");
         debugPrintln(error);
@@ -6,6 +6,16 @@
 
 extern volatile bool otaInProgress;
 extern volatile bool otaRequested;
+// Optional request header on POST /ota: SHA-256 of the (uncompressed) image as hex
+#define OTA_SHA256_HEADER "X-Firmware-SHA256"
+
+struct FirmwareRelease {
+    String version;
+    String url;
+    String sha256;  // of the uncompressed image; empty if the manifest has none
+    String deltaUrl;  // patch from the running version, if the release has one
+};
+
 bool performGzOtaUpdate(String& errorOut);
 void setupArduinoOTA(const char* hostname);
 void handleArduinoOTA();
@@ -16,5 +26,5 @@ void handleOTAUpdate(AsyncWebServerRequest* request, unsigned char* data, unsign
 #ifdef ESP32
 extern "C" void otaTask(void* parameter = nullptr);
 #endif
-// Fetch the latest firmware URL for this environment from GitHub (returns empty string on failure)
-String getLatestFirmwareUrl(String& latestVersion);
+// Fetch the manifest entry for this environment from the latest GitHub release
+bool getLatestRelease(FirmwareRelease& release);
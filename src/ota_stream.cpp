@@ -0,0 +1,104 @@
+#include "ota_stream.h"
+#include <string.h>
+
+void OtaStream::begin() {
+    _inflater.end();
+    _sha.reset();
+    _mode = MODE_NONE;
+    _delta = false;
+    _failed = false;
+    _inputSize = 0;
+    _imageSize = 0;
+    _error = "";
+}
+
+void OtaStream::beginDelta(DeltaSourceReader source, size_t sourceSize) {
+    begin();
+    _delta = true;
+    _patcher.begin(source, sourceSize, [this](const uint8_t* out, size_t n) { return passOn(out, n); });
+}
+
+bool OtaStream::passOn(const uint8_t* data, size_t len) {
+    _sha.update(data, len);
+    _imageSize += len;
+    return _writer(data, len);
+}
+
+// Stream bytes after any gzip layer: the image itself, or a patch producing it
+bool OtaStream::feed(const uint8_t* data, size_t len) {
+    return _delta ? _patcher.write(data, len) : passOn(data, len);
+}
+
+bool OtaStream::write(const uint8_t* data, size_t len) {
+    if (_failed) return false;
+    if (len == 0) return true;
+    if (_mode == MODE_NONE) {
+        // ESP images start with 0xE9, gzip with 0x1F 0x8B
+        if (data[0] == 0x1F) {
+            _mode = MODE_GZIP;
+            if (!_inflater.begin([this](const uint8_t* out, size_t n) { return feed(out, n); })) {
+                _error = _inflater.error();
+                _failed = true;
+                return false;
+            }
+        } else {
+            _mode = MODE_RAW;
+        }
+    }
+    _inputSize += len;
+    bool ok = _mode == MODE_GZIP ? _inflater.write(data, len) : feed(data, len);
+    if (!ok) {
+        if (_delta && _patcher.error()) {
+            _error = _patcher.error();
+        } else {
+            _error = _mode == MODE_GZIP ? _inflater.error() : "Image write failed";
+        }
+        _failed = true;
+    }
+    return ok;
+}
+
+bool OtaStream::finish() {
+    if (_failed) return false;
+    if (_mode == MODE_NONE) {
+        _error = "Empty firmware image";
+        _failed = true;
+        return false;
+    }
+    if (_mode == MODE_GZIP) {
+        bool done = _inflater.done();
+        _inflater.end();
+        if (!done) {
+            _error = "Truncated gzip stream";
+            _failed = true;
+            return false;
+        }
+    }
+    if (_delta && !_patcher.done()) {
+        _error = "Truncated delta patch";
+        _failed = true;
+        return false;
+    }
+    _sha.finish(_digest);
+    return true;
+}
+
+bool OtaStream::verify(const String& expectedSha256) {
+    if (expectedSha256.length() == 0) return true;
+    uint8_t expected[SHA256_DIGEST_SIZE];
+    if (!parseSha256Hex(expectedSha256.c_str(), expected)) {
+        _error = "Invalid SHA-256";
+        return false;
+    }
+    if (memcmp(expected, _digest, SHA256_DIGEST_SIZE) != 0) {
+        _error = "SHA-256 mismatch";
+        return false;
+    }
+    return true;
+}
+
+String OtaStream::digestHex() const {
+    char hex[2 * SHA256_DIGEST_SIZE + 1];
+    formatSha256Hex(_digest, hex);
+    return String(hex);
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include <Arduino.h>
+#include "inflate.h"
+#include "delta.h"
+#include "sha256.h"
+
+// Turns a firmware upload or download into image bytes for Update.write()
+// as the chunks arrive. A stream starting with the gzip magic is inflated on
+// the fly, anything else is passed through as a raw image; either way the
+// image is hashed with SHA-256 on its way to the writer, so it can be
+// checked before Update.end() marks it bootable. Nothing touches LittleFS.
+// In delta mode the (inflated) stream is a patch against the running image
+// and the image is what the patch produces.
+class OtaStream {
+public:
+    explicit OtaStream(InflateSink writer) : _writer(writer) {}
+
+    // Starts a new image
+    void begin();
+    // Starts a new image built from a delta patch (see delta.h)
+    void beginDelta(DeltaSourceReader source, size_t sourceSize);
+    // Next chunk of the stream, compressed or raw
+    bool write(const uint8_t* data, size_t len);
+    // After the last chunk: true if the image is complete (for gzip, its
+    // CRC-32 and size matched) and the digest is ready
+    bool finish();
+    // Releases the inflate window
+    void end() { _inflater.end(); }
+
+    // Compares the image digest with 64 hex digits; an empty string is not checked
+    bool verify(const String& expectedSha256);
+    String digestHex() const;
+
+    bool compressed() const { return _mode == MODE_GZIP; }
+    bool delta() const { return _delta; }
+    // Image size when the stream states it up front (deltas), else 0
+    size_t targetSize() const { return _delta ? _patcher.targetSize() : 0; }
+    size_t inputSize() const { return _inputSize; }
+    size_t imageSize() const { return _imageSize; }
+    const String& error() const { return _error; }
+
+private:
+    enum Mode : uint8_t { MODE_NONE, MODE_RAW, MODE_GZIP };
+    bool passOn(const uint8_t* data, size_t len);
+    bool feed(const uint8_t* data, size_t len);
+
+    InflateSink _writer;
+    GzipInflater _inflater;
+    DeltaPatcher _patcher;
+    bool _delta = false;
+    Sha256 _sha;
+    uint8_t _digest[SHA256_DIGEST_SIZE] = {};
+    Mode _mode = MODE_NONE;
+    bool _failed = false;
+    size_t _inputSize = 0;
+    size_t _imageSize = 0;
+    String _error;
+};
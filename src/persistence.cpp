@@ -0,0 +1,253 @@
+#include "persistence.h"
+#include "presets.h"
+#include "photoperiod.h"
+#include "record_io.h"
+#include "state.h"
+#include "debug.h"
+#include <LittleFS.h>
+#include <algorithm>
+
+#define FILESYSTEM LittleFS
+
+static const char* const SECTION_NAMES[] = {"config", "presets", "photoperiod", "state"};
+
+#define STATE_RECORD_MAGIC 0x54534744  // "DGST"
+#define STATE_RECORD_VERSION 1
+
+// Every file written through writeFileAtomic() or countFlashWrite()
+static struct {
+    uint32_t files = 0;
+    uint32_t bytes = 0;
+    uint32_t failed = 0;
+    uint32_t maxUs = 0;
+    uint64_t totalUs = 0;
+} flashStats;
+
+bool ensureFilesystemMounted() {
+    static bool mounted = false;
+    if (!mounted) {
+        if (!FILESYSTEM.begin()) {
+            if (!FILESYSTEM.format()) {
+                return false;
+            }
+            if (!FILESYSTEM.begin()) {
+                return false;
+            }
+        }
+        mounted = true;
+    }
+    return true;
+}
+
+static bool writeAndVerify(const char* path, const uint8_t* data, size_t len) {
+    File file = FILESYSTEM.open(path, "w");
+    if (!file) return false;
+    size_t written = file.write(data, len);
+    file.close();
+    if (written != len) return false;
+
+    file = FILESYSTEM.open(path, "r");
+    if (!file || file.size() != len) return false;
+    uint8_t chunk[64];
+    uint32_t crc = 0;
+    size_t total = 0;
+    while (total < len) {
+        size_t got = file.read(chunk, std::min(sizeof(chunk), len - total));
+        if (got == 0) break;
+        crc = recordCrc32(chunk, got, crc);
+        total += got;
+    }
+    file.close();
+    return total == len && crc == recordCrc32(data, len);
+}
+
+bool writeFileAtomic(const char* path, const uint8_t* data, size_t len) {
+    if (!ensureFilesystemMounted()) return false;
+    uint32_t start = micros();
+    String tmp = String(path) + ".tmp";
+    // LittleFS renames atomically, replacing the old file in one step
+    bool ok = writeAndVerify(tmp.c_str(), data, len) && FILESYSTEM.rename(tmp.c_str(), path);
+    if (!ok) FILESYSTEM.remove(tmp.c_str());
+
+    countFlashWrite(len, micros() - start, ok);
+    if (!ok) {
+        debugPrint("[Persist] Write failed: ");
+        debugPrintln(path);
+    }
+    return ok;
+}
+
+bool saveLastState(const SystemState& state, uint32_t utcEpoch) {
+    RecordWriter w(STATE_RECORD_MAGIC, STATE_RECORD_VERSION);
+    w.u32(utcEpoch);
+    w.u8(state.power);
+    w.u8(state.brightness);
+    w.u8(state.preset);
+    w.u8(state.effect);
+    w.u8(state.params.speed);
+    w.u8(state.params.intensity);
+    w.u8(state.params.reverse);
+    w.u8(state.params.colorCount);
+    for (size_t i = 0; i < state.params.colorCount; ++i) w.u32(state.params.colors[i]);
+    const std::vector<uint8_t>& record = w.seal();
+    return writeFileAtomic(STATE_FILE, record.data(), record.size());
+}
+
+bool loadLastState(SystemState& state, uint32_t& utcEpoch) {
+    if (!ensureFilesystemMounted()) return false;
+    File file = FILESYSTEM.open(STATE_FILE, "r");
+    if (!file) return false;
+    std::vector<uint8_t> data(file.size());
+    size_t got = data.empty() ? 0 : file.read(data.data(), data.size());
+    file.close();
+    RecordReader r;
+    uint16_t version;
+    if (got != data.size() || !r.open(data.data(), data.size(), STATE_RECORD_MAGIC, version)) return false;
+    SystemState s;
+    uint8_t power = 0, reverse = 0, colorCount = 0;
+    uint32_t epoch = 0;
+    if (!r.u32(epoch) || !r.u8(power) || !r.u8(s.brightness) || !r.u8(s.preset) || !r.u8(s.effect) ||
+        !r.u8(s.params.speed) || !r.u8(s.params.intensity) || !r.u8(reverse) || !r.u8(colorCount) ||
+        colorCount > MAX_EFFECT_COLORS) {
+        return false;
+    }
+    for (size_t i = 0; i < colorCount; ++i) {
+        if (!r.u32(s.params.colors[i])) return false;
+    }
+    state.power = power != 0;
+    state.brightness = s.brightness;
+    state.preset = s.preset;
+    state.effect = s.effect;
+    state.params = s.params;
+    state.params.reverse = reverse != 0;
+    state.params.colorCount = colorCount;
+    utcEpoch = epoch;
+    return true;
+}
+
+void countFlashWrite(size_t bytes, uint32_t us, bool ok) {
+    ++flashStats.files;
+    flashStats.totalUs += us;
+    if (us > flashStats.maxUs) flashStats.maxUs = us;
+    if (ok) {
+        flashStats.bytes += bytes;
+    } else {
+        ++flashStats.failed;
+    }
+}
+
+uint32_t Persistence::generation(size_t section) const {
+    switch (section) {
+        case CONFIG: return _config->gen.configFile();
+        case PRESETS: return _config->gen.presets;
+        case PHOTOPERIOD: return _config->gen.photoperiod;
+        default:
+            if (!_state) return 0;
+            // Every change counts, and the saved clock turns stale once an interval
+            return _state->gen.power + _state->gen.brightness + _state->gen.effect + _state->gen.preset +
+                   _utcEpoch / PERSIST_EPOCH_INTERVAL;
+    }
+}
+
+void Persistence::begin() {
+    for (size_t i = 0; i < SECTION_COUNT; ++i) {
+        _sections[i].savedGen = _sections[i].seenGen = generation(i);
+    }
+}
+
+bool Persistence::write(size_t section) {
+    Section& s = _sections[section];
+    uint32_t gen = generation(section);
+    bool ok;
+    switch (section) {
+        case CONFIG: ok = _config->save(); break;
+        case PRESETS: ok = presetStore.flush(); break;
+        case PHOTOPERIOD: ok = savePhotoperiod(_config->photoperiod); break;
+        default: ok = saveLastState(*_state, _utcEpoch); break;
+    }
+    if (ok) {
+        // Also after a flush(), so the next edit starts a new debounce window
+        s.savedGen = s.seenGen = gen;
+        ++s.writes;
+    } else {
+        ++s.failed;
+    }
+    return ok;
+}
+
+void Persistence::update(uint32_t now, uint32_t utcEpoch) {
+    if (utcEpoch != 0) _utcEpoch = utcEpoch;
+    for (size_t i = 0; i < SECTION_COUNT; ++i) {
+        Section& s = _sections[i];
+        // A preset fade commits its effect at the end; save the settled state
+        if (i == STATE && _state && _state->inTransition) continue;
+        uint32_t gen = generation(i);
+        if (gen != s.seenGen) {
+            if (s.seenGen == s.savedGen) s.firstChange = now;
+            s.seenGen = gen;
+            s.lastChange = now;
+            ++s.changes;
+        }
+        if (gen == s.savedGen) continue;
+        if (now - s.lastChange < PERSIST_DEBOUNCE && now - s.firstChange < PERSIST_MAX_DELAY) continue;
+        if (!write(i)) {
+            // Try again after another debounce window
+            s.firstChange = s.lastChange = now;
+        }
+        // One file per pass keeps the loop responsive
+        return;
+    }
+}
+
+bool Persistence::flush() {
+    bool ok = true;
+    for (size_t i = 0; i < SECTION_COUNT; ++i) {
+        if (generation(i) != _sections[i].savedGen) ok = write(i) && ok;
+    }
+    return ok;
+}
+
+void Persistence::requestRestart(uint32_t delayMs) {
+    // The deadline is in place before the flag is seen
+    _restartAt = millis() + delayMs;
+    _restartRequested = true;
+}
+
+void Persistence::requestFactoryReset(uint32_t delayMs) {
+    _factoryReset = true;
+    requestRestart(delayMs);
+}
+
+bool Persistence::restartDue(uint32_t now) const {
+    return _restartRequested && (int32_t)(now - _restartAt) >= 0;
+}
+
+bool Persistence::prepareRestart() {
+    if (_factoryReset) return _config->factoryReset();
+    return flush();
+}
+
+bool Persistence::pending() const {
+    for (size_t i = 0; i < SECTION_COUNT; ++i) {
+        if (generation(i) != _sections[i].savedGen) return true;
+    }
+    return false;
+}
+
+void Persistence::writeStats(JsonObject obj) const {
+    obj["debounceMs"] = PERSIST_DEBOUNCE;
+    obj["flashWrites"] = flashStats.files;
+    obj["bytesWritten"] = flashStats.bytes;
+    obj["failedWrites"] = flashStats.failed;
+    obj["maxWriteUs"] = flashStats.maxUs;
+    obj["avgWriteUs"] = flashStats.files ? (uint32_t)(flashStats.totalUs / flashStats.files) : 0;
+    JsonObject sections = obj.createNestedObject("sections");
+    for (size_t i = 0; i < SECTION_COUNT; ++i) {
+        const Section& s = _sections[i];
+        JsonObject sectionObj = sections.createNestedObject(SECTION_NAMES[i]);
+        sectionObj["changes"] = s.changes;
+        sectionObj["writes"] = s.writes;
+        sectionObj["failed"] = s.failed;
+        sectionObj["pending"] = generation(i) != s.savedGen;
+    }
+}
@@ -0,0 +1,80 @@
+#pragma once
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include "config.h"
+
+// Mounts the filesystem on first use, formatting it if it does not mount
+bool ensureFilesystemMounted();
+// Replaces `path` through a temporary file. The temp copy is read back and
+// checked against the CRC of `data` before the rename, so a power cut leaves
+// either the old or the new file on flash, never a torn one.
+bool writeFileAtomic(const char* path, const uint8_t* data, size_t len);
+// For writers that update a file in place; counted in the same flash stats
+void countFlashWrite(size_t bytes, uint32_t us, bool ok);
+
+struct SystemState;
+// The last applied state (power, brightness, preset, effect and params) and
+// the wall clock at the time, so a boot after a power cut lights up as before
+// and can estimate the schedule until NTP answers. utcEpoch is 0 if unknown.
+bool saveLastState(const SystemState& state, uint32_t utcEpoch);
+bool loadLastState(SystemState& state, uint32_t& utcEpoch);
+
+// Deferred flash writes for the config record, presets, photoperiod curve and
+// last applied state.
+// Handlers only change the in-memory config (bumping its generations); a
+// section is written once it has been quiet for PERSIST_DEBOUNCE, or after
+// PERSIST_MAX_DELAY if it keeps changing, so a burst of edits costs one write
+// and HTTP handlers never wait for flash.
+class Persistence {
+public:
+    // Without `state` the last applied state is not tracked
+    explicit Persistence(Configuration* config, SystemState* state = nullptr) : _config(config), _state(state) {}
+
+    // Takes the configuration as loaded at boot to be on flash already
+    void begin();
+    // Writes sections whose changes have settled. `utcEpoch` (0 while the
+    // time is unknown) is saved with the state at least every
+    // PERSIST_EPOCH_INTERVAL.
+    void update(uint32_t now, uint32_t utcEpoch = 0);
+    // Writes every changed section now. Only from the loop task, which owns
+    // the flash writes; other tasks use requestRestart().
+    bool flush();
+    bool pending() const;
+
+    // Restart on behalf of a web handler or the OTA task: loop() flushes and
+    // restarts once `delayMs` has passed (time for a response to go out)
+    void requestRestart(uint32_t delayMs);
+    // The same, but loop() erases the settings instead of flushing them
+    void requestFactoryReset(uint32_t delayMs);
+    bool restartDue(uint32_t now) const;
+    // Run by loop() once restartDue(), right before the restart: flush(), or
+    // Configuration::factoryReset() when that was asked for
+    bool prepareRestart();
+
+    // Counters for GET /api/perf
+    void writeStats(JsonObject obj) const;
+
+private:
+    enum { CONFIG, PRESETS, PHOTOPERIOD, STATE, SECTION_COUNT };
+    struct Section {
+        uint32_t savedGen = 0;    // generation last written to flash
+        uint32_t seenGen = 0;     // generation at the previous update()
+        uint32_t firstChange = 0;
+        uint32_t lastChange = 0;
+        uint32_t changes = 0;     // generation moves seen
+        uint32_t writes = 0;
+        uint32_t failed = 0;
+    };
+    uint32_t generation(size_t section) const;
+    bool write(size_t section);
+
+    Configuration* _config;
+    SystemState* _state;
+    uint32_t _utcEpoch = 0;
+    volatile uint32_t _restartAt = 0;
+    volatile bool _restartRequested = false;
+    volatile bool _factoryReset = false;
+    Section _sections[SECTION_COUNT];
+};
+
+extern Persistence persistence;
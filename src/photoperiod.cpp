@@ -0,0 +1,219 @@
+#include "photoperiod.h"
+#include "json_stream.h"
+#include "persistence.h"
+#include "debug.h"
+#include <LittleFS.h>
+#include <algorithm>
+#include <math.h>
+
+#define FILESYSTEM LittleFS
+
+static const uint32_t DAY_MS = 86400000UL;
+
+// Percent with two decimals at the JSON boundary, 16-bit internally
+static double levelToPercent(uint16_t level) {
+    return round(level * 10000.0 / 65535.0) / 100.0;
+}
+
+static const char* interpolationName(PhotoperiodInterpolation mode) {
+    return mode == PHOTOPERIOD_LINEAR ? "linear" : "cubic";
+}
+
+static void keyframeToJson(const PhotoperiodKeyframe& keyframe, JsonObject obj) {
+    obj["hour"] = keyframe.minute / 60;
+    obj["minute"] = keyframe.minute % 60;
+    JsonArray rgbw = obj.createNestedArray("rgbw");
+    for (size_t c = 0; c < PHOTOPERIOD_CHANNELS; ++c) {
+        rgbw.add(levelToPercent(keyframe.level[c]));
+    }
+}
+
+const char* photoperiodFromJson(PhotoperiodConfig& curve, JsonObjectConst obj) {
+    PhotoperiodConfig parsed = curve;
+    if (obj.containsKey("enabled")) parsed.enabled = obj["enabled"];
+    if (obj.containsKey("interpolation")) {
+        const char* mode = obj["interpolation"] | "";
+        if (strcmp(mode, "linear") == 0) parsed.interpolation = PHOTOPERIOD_LINEAR;
+        else if (strcmp(mode, "cubic") == 0) parsed.interpolation = PHOTOPERIOD_CUBIC;
+        else return "Unknown interpolation";
+    }
+    if (obj.containsKey("keyframes")) {
+        JsonArrayConst keyframesArr = obj["keyframes"];
+        if (keyframesArr.size() > MAX_PHOTOPERIOD_KEYFRAMES) return "Too many keyframes";
+        std::vector<PhotoperiodKeyframe> keyframes;
+        keyframes.reserve(keyframesArr.size());
+        for (JsonObjectConst keyObj : keyframesArr) {
+            int hour = keyObj["hour"] | -1;
+            int minute = keyObj["minute"] | -1;
+            if (hour < 0 || hour > 23 || minute < 0 || minute > 59) return "Invalid keyframe time";
+            JsonArrayConst rgbw = keyObj["rgbw"];
+            if (rgbw.size() != PHOTOPERIOD_CHANNELS) return "Keyframe needs 4 rgbw levels";
+            PhotoperiodKeyframe keyframe;
+            keyframe.minute = (uint16_t)(hour * 60 + minute);
+            for (size_t c = 0; c < PHOTOPERIOD_CHANNELS; ++c) {
+                double percent = rgbw[c] | -1.0;
+                if (percent < 0.0 || percent > 100.0) return "Level out of range";
+                keyframe.level[c] = (uint16_t)lround(percent * 655.35);
+            }
+            keyframes.push_back(keyframe);
+        }
+        std::sort(keyframes.begin(), keyframes.end(),
+            [](const PhotoperiodKeyframe& a, const PhotoperiodKeyframe& b) { return a.minute < b.minute; });
+        for (size_t i = 1; i < keyframes.size(); ++i) {
+            if (keyframes[i].minute == keyframes[i - 1].minute) return "Duplicate keyframe time";
+        }
+        parsed.keyframes = keyframes;
+    }
+    if (parsed.enabled && parsed.keyframes.empty()) return "Enabled curve needs keyframes";
+    curve = parsed;
+    return nullptr;
+}
+
+bool writePhotoperiodJsonFragment(const PhotoperiodConfig& curve, JsonStreamState& state, char* buf, size_t size, size_t& len) {
+    if (state.index == 0) {
+        int n = snprintf(buf, size, "{\"enabled\":%s,\"interpolation\":\"%s\",\"keyframes\":[",
+                         curve.enabled ? "true" : "false", interpolationName(curve.interpolation));
+        len = n > 0 ? std::min((size_t)n, size - 1) : 0;
+        return true;
+    }
+    size_t i = state.index - 1;
+    if (i < curve.keyframes.size()) {
+        StaticJsonDocument<256> doc;
+        keyframeToJson(curve.keyframes[i], doc.to<JsonObject>());
+        len = serializeJsonItem(state, buf, size, doc);
+        return true;
+    }
+    return closeJsonStream(state, "]}", buf, size, len);
+}
+
+bool loadPhotoperiod(PhotoperiodConfig& curve) {
+    if (!ensureFilesystemMounted()) return false;
+    File file = FILESYSTEM.open(PHOTOPERIOD_FILE, "r");
+    if (!file) return false;
+    DynamicJsonDocument doc(4096);
+    DeserializationError err = deserializeJson(doc, file);
+    file.close();
+    if (err) return false;
+    const char* error = photoperiodFromJson(curve, doc.as<JsonObjectConst>());
+    if (error) {
+        debugPrint("[Photoperiod] Ignoring stored curve: ");
+        debugPrintln(error);
+        return false;
+    }
+    return true;
+}
+
+bool savePhotoperiod(const PhotoperiodConfig& curve) {
+    DynamicJsonDocument doc(4096);
+    doc["enabled"] = curve.enabled;
+    doc["interpolation"] = interpolationName(curve.interpolation);
+    JsonArray keyframesArr = doc.createNestedArray("keyframes");
+    for (const auto& keyframe : curve.keyframes) {
+        keyframeToJson(keyframe, keyframesArr.createNestedObject());
+    }
+
+    String out;
+    if (serializeJson(doc, out) == 0) return false;
+    return writeFileAtomic(PHOTOPERIOD_FILE, (const uint8_t*)out.c_str(), out.length());
+}
+
+void PhotoperiodTable::build(const PhotoperiodConfig& curve) {
+    _segments.clear();
+    _cursor = 0;
+    const std::vector<PhotoperiodKeyframe>& keys = curve.keyframes;
+    size_t n = keys.size();
+    if (n == 0) return;
+
+    // Segment i runs from keyframe i to i + 1; the last one wraps past midnight.
+    // Lengths in ms, slopes in level per ms.
+    std::vector<double> length(n);
+    std::vector<double> slope(n * PHOTOPERIOD_CHANNELS);
+    for (size_t i = 0; i < n; ++i) {
+        const PhotoperiodKeyframe& next = keys[(i + 1) % n];
+        uint32_t nextMinute = i + 1 < n ? next.minute : next.minute + 1440;
+        length[i] = (nextMinute - keys[i].minute) * 60000.0;
+        for (size_t c = 0; c < PHOTOPERIOD_CHANNELS; ++c) {
+            slope[i * PHOTOPERIOD_CHANNELS + c] = ((double)next.level[c] - keys[i].level[c]) / length[i];
+        }
+    }
+
+    // Monotone cubic (PCHIP) tangents: zero at local extrema, weighted harmonic
+    // mean of the neighbouring slopes elsewhere, so no segment overshoots
+    std::vector<double> tangent(n * PHOTOPERIOD_CHANNELS, 0.0);
+    if (curve.interpolation == PHOTOPERIOD_CUBIC && n > 1) {
+        for (size_t k = 0; k < n; ++k) {
+            size_t prev = (k + n - 1) % n;
+            double w1 = 2 * length[k] + length[prev];
+            double w2 = length[k] + 2 * length[prev];
+            for (size_t c = 0; c < PHOTOPERIOD_CHANNELS; ++c) {
+                double d0 = slope[prev * PHOTOPERIOD_CHANNELS + c];
+                double d1 = slope[k * PHOTOPERIOD_CHANNELS + c];
+                if (d0 * d1 > 0) {
+                    tangent[k * PHOTOPERIOD_CHANNELS + c] = (w1 + w2) / (w1 / d0 + w2 / d1);
+                }
+            }
+        }
+    }
+
+    _segments.resize(n);
+    for (size_t i = 0; i < n; ++i) {
+        Segment& seg = _segments[i];
+        seg.startMs = keys[i].minute * 60000UL;
+        seg.lengthMs = (uint32_t)length[i];
+        size_t next = (i + 1) % n;
+        for (size_t c = 0; c < PHOTOPERIOD_CHANNELS; ++c) {
+            double delta = (double)keys[next].level[c] - keys[i].level[c];
+            // Hermite tangents scaled to the segment (level per unit u)
+            double a = tangent[i * PHOTOPERIOD_CHANNELS + c] * length[i];
+            double b = tangent[next * PHOTOPERIOD_CHANNELS + c] * length[i];
+            seg.y0[c] = keys[i].level[c];
+            if (curve.interpolation == PHOTOPERIOD_LINEAR) {
+                seg.c1[c] = (int32_t)delta;
+                seg.c2[c] = 0;
+                seg.c3[c] = 0;
+            } else {
+                seg.c1[c] = (int32_t)lround(a);
+                seg.c2[c] = (int32_t)lround(3 * delta - 2 * a - b);
+                seg.c3[c] = (int32_t)lround(a + b - 2 * delta);
+            }
+        }
+    }
+}
+
+void PhotoperiodTable::evaluate(uint32_t msOfDay, uint16_t level[PHOTOPERIOD_CHANNELS]) const {
+    if (_segments.empty()) {
+        for (size_t c = 0; c < PHOTOPERIOD_CHANNELS; ++c) level[c] = 0;
+        return;
+    }
+    // Before the first keyframe we are still in the segment that wrapped past midnight
+    uint32_t ms = msOfDay < _segments[0].startMs ? msOfDay + DAY_MS : msOfDay;
+    if (_cursor >= _segments.size() ||
+        ms < _segments[_cursor].startMs || ms - _segments[_cursor].startMs >= _segments[_cursor].lengthMs) {
+        auto it = std::upper_bound(_segments.begin(), _segments.end(), ms,
+            [](uint32_t value, const Segment& seg) { return value < seg.startMs; });
+        _cursor = (size_t)(it - _segments.begin()) - 1;
+    }
+    const Segment& seg = _segments[_cursor];
+    int64_t u = ((int64_t)(ms - seg.startMs) << 16) / seg.lengthMs;  // Q16, [0, 1)
+    for (size_t c = 0; c < PHOTOPERIOD_CHANNELS; ++c) {
+        // Horner with 16 fractional bits carried through, rounded once at the
+        // end, so truncation cannot make a monotone ramp wobble by one step
+        int64_t v = (int64_t)seg.c3[c] << 16;
+        v = ((v * u) >> 16) + ((int64_t)seg.c2[c] << 16);
+        v = ((v * u) >> 16) + ((int64_t)seg.c1[c] << 16);
+        v = ((v * u) >> 16) + ((int64_t)seg.y0[c] << 16);
+        v = (v + 0x8000) >> 16;
+        level[c] = (uint16_t)(v < 0 ? 0 : (v > 65535 ? 65535 : v));
+    }
+}
+
+uint8_t TemporalDither::apply(size_t channel, uint16_t level) {
+    uint32_t sum = (uint32_t)level + _error[channel];
+    uint32_t out = sum >> 8;
+    if (out > 255) {
+        _error[channel] = 0;
+        return 255;
+    }
+    _error[channel] = sum & 0xFF;
+    return (uint8_t)out;
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include <vector>
+#include <ArduinoJson.h>
+#include "config.h"
+
+// Persistence in PHOTOPERIOD_FILE; a missing file leaves the curve disabled
+bool loadPhotoperiod(PhotoperiodConfig& curve);
+bool savePhotoperiod(const PhotoperiodConfig& curve);
+
+// JSON boundary: levels are percent (0-100, fractional) per channel.
+// Returns nullptr on success or a short error message; `curve` is untouched on error.
+const char* photoperiodFromJson(PhotoperiodConfig& curve, JsonObjectConst obj);
+// Streaming JSON for GET /api/photoperiod, one keyframe per fragment (see json_stream.h)
+bool writePhotoperiodJsonFragment(const PhotoperiodConfig& curve, JsonStreamState& state, char* buf, size_t size, size_t& len);
+
+// Keyframes compiled into cubic segments with fixed-point coefficients, so a
+// frame costs one segment lookup and a Horner evaluation per channel
+class PhotoperiodTable {
+public:
+    void build(const PhotoperiodConfig& curve);
+    bool empty() const { return _segments.empty(); }
+    // 16-bit level per channel at `msOfDay` (0-86399999)
+    void evaluate(uint32_t msOfDay, uint16_t level[PHOTOPERIOD_CHANNELS]) const;
+
+private:
+    struct Segment {
+        uint32_t startMs;   // keyframe time; the last segment wraps past midnight
+        uint32_t lengthMs;
+        // level(u) = y0 + c1*u + c2*u^2 + c3*u^3, u in [0, 1) as Q16
+        int32_t y0[PHOTOPERIOD_CHANNELS];
+        int32_t c1[PHOTOPERIOD_CHANNELS];
+        int32_t c2[PHOTOPERIOD_CHANNELS];
+        int32_t c3[PHOTOPERIOD_CHANNELS];
+    };
+    std::vector<Segment> _segments;
+    mutable size_t _cursor = 0;  // segment of the previous call; frames move forward
+};
+
+// Carries the remainder of 16-bit levels into later frames so 8-bit output
+// averages to the exact level and slow ramps never show a visible step
+class TemporalDither {
+public:
+    uint8_t apply(size_t channel, uint16_t level);
+
+private:
+    uint16_t _error[PHOTOPERIOD_CHANNELS] = {};
+};
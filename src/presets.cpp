@@ -1,112 +1,324 @@
 #include "presets.h"
+#include "colors.h"
+#include "json_stream.h"
+#include "persistence.h"
+#include "record_io.h"
+#include "debug.h"
 #include "inc/presets_json.inc"
 #include <LittleFS.h>
 #include <ArduinoJson.h>
+#include <algorithm>
 
 #define FILESYSTEM LittleFS
-#define PRESET_FILE "/presets.json"
-
-// Utility to ensure filesystem is mounted
-static bool ensureFilesystemMounted() {
-    static bool mounted = false;
-    if (!mounted) {
-        if (!FILESYSTEM.begin()) {
-            if (!FILESYSTEM.format()) {
-                return false;
-            }
-            if (!FILESYSTEM.begin()) {
-                return false;
-            }
+
+// Slot record; bump the version when appending fields
+#define PRESET_RECORD_MAGIC 0x52504744  // "DGPR"
+#define PRESET_RECORD_VERSION 1
+// Header 12 + fixed fields 7 + colors 32 + name length 2 + name
+#define PRESET_SLOT_SIZE 96
+static_assert(12 + 7 + 4 * MAX_EFFECT_COLORS + 2 + PRESET_NAME_MAX <= PRESET_SLOT_SIZE, "preset record must fit its slot");
+
+void paramsColorsFromJson(EffectParams& params, JsonArrayConst colorsArr) {
+    params.colorCount = 0;
+    params.colors.fill(0);
+    for (JsonVariantConst v : colorsArr) {
+        if (params.colorCount >= MAX_EFFECT_COLORS) break;
+        if (v.is<const char*>()) {
+            params.colors[params.colorCount++] = parse_hex_rgbw(v.as<const char*>());
         }
-        mounted = true;
     }
-    return true;
 }
 
-void resetPresetsFile() {
-    if (!ensureFilesystemMounted()) return;
-    if (FILESYSTEM.exists(PRESET_FILE)) {
-        FILESYSTEM.remove(PRESET_FILE);
+void paramsColorsToJson(const EffectParams& params, JsonArray colorsArr) {
+    char hex[10];
+    for (size_t i = 0; i < params.colorCount; ++i) {
+        format_hex_rgbw(params.colors[i], hex, sizeof(hex));
+        colorsArr.add(hex);
+    }
+}
+
+static void encodePreset(const Preset& p, RecordWriter& w) {
+    w.u8(p.id);
+    w.u8(p.enabled);
+    w.u8(p.effect);
+    w.u8(p.params.speed);
+    w.u8(p.params.intensity);
+    w.u8(p.params.reverse);
+    w.u8(p.params.colorCount);
+    for (size_t i = 0; i < p.params.colorCount; ++i) w.u32(p.params.colors[i]);
+    w.str(p.name);
+}
+
+static bool decodePreset(Preset& p, RecordReader& r) {
+    uint8_t flag;
+    if (!r.u8(p.id)) return false;
+    if (r.u8(flag)) p.enabled = flag;
+    r.u8(p.effect);
+    r.u8(p.params.speed);
+    r.u8(p.params.intensity);
+    if (r.u8(flag)) p.params.reverse = flag;
+    uint8_t count = 0;
+    r.u8(count);
+    p.params.colorCount = std::min<uint8_t>(count, MAX_EFFECT_COLORS);
+    for (size_t i = 0; i < count; ++i) {
+        uint32_t color = 0;
+        r.u32(color);
+        if (i < MAX_EFFECT_COLORS) p.params.colors[i] = color;
     }
+    r.str(p.name);
+    return true;
 }
 
-bool loadPresets(std::vector<Preset>& presets) {
-    // Delete presets file before loading (force regeneration)
-    resetPresetsFile();
+// Single place for the percent-to-internal conversion of a JSON preset
+void presetFromJson(Preset& p, JsonObjectConst presetObj) {
+    p.name = presetObj["name"] | "";
+    p.effect = presetObj["effect"] | 0;
+    p.enabled = presetObj["enabled"] | true;
+    if (presetObj.containsKey("params")) {
+        JsonObjectConst paramsObj = presetObj["params"];
+        // Convert speed from percent to 8-bit for internal use
+        p.params.speed = paramsObj["speed"].isNull() ? percentToHex(100) : percentToHex((uint8_t)paramsObj["speed"]);
+        p.params.intensity = paramsObj["intensity"].isNull() ? percentToHex(50) : percentToHex((uint8_t)paramsObj["intensity"]);
+        paramsColorsFromJson(p.params, paramsObj["colors"].as<JsonArrayConst>());
+    }
+}
 
-    size_t capacity = 8192;
-    DynamicJsonDocument doc(capacity);
+bool PresetStore::begin() {
+    TaskLockGuard guard(_lock);
+    memset(_used, 0, sizeof(_used));
+    for (CacheEntry& entry : _cache) entry = CacheEntry();
+    if (!ensureFilesystemMounted()) return false;
 
-    bool loaded = false;
-    File file = FILESYSTEM.open(PRESET_FILE, "r");
-    if (file && deserializeJson(doc, file) == DeserializationError::Ok && doc.containsKey("presets")) {
-        loaded = true;
+    File file = FILESYSTEM.open(PRESET_STORE_FILE, "r");
+    if (file) {
+        uint8_t slot[PRESET_SLOT_SIZE];
+        for (size_t id = 0; id < MAX_PRESETS && file.read(slot, sizeof(slot)) == sizeof(slot); ++id) {
+            RecordReader reader;
+            uint16_t version;
+            uint8_t storedId;
+            if (reader.open(slot, sizeof(slot), PRESET_RECORD_MAGIC, version) && reader.u8(storedId) && storedId == id) {
+                _used[id / 8] |= 1 << (id % 8);
+            }
+        }
         file.close();
-    } else {
-        // Load from embedded asset if file missing or invalid
+        if (count() > 0) return true;
+    }
+
+    // First boot: presets saved by older firmware, or the built-in set
+    DynamicJsonDocument doc(8192);
+    bool legacy = false;
+    File legacyFile = FILESYSTEM.open(LEGACY_PRESET_FILE, "r");
+    if (legacyFile) {
+        legacy = deserializeJson(doc, legacyFile) == DeserializationError::Ok && doc.containsKey("presets");
+        legacyFile.close();
+    }
+    if (!legacy) {
         DeserializationError err = deserializeJson(doc, web_presets_json, web_presets_json_len);
-        if (!err && doc.containsKey("presets")) {
-            loaded = true;
+        if (err || !doc.containsKey("presets")) return false;
+    }
+    bool ok = importJson(doc["presets"].as<JsonArrayConst>());
+    if (ok && legacy) {
+        FILESYSTEM.remove(LEGACY_PRESET_FILE);
+        debugPrintln("[Presets] Imported " LEGACY_PRESET_FILE);
+    }
+    return ok;
+}
+
+bool PresetStore::importJson(JsonArrayConst presetsArr) {
+    bool ok = true;
+    size_t index = 0;
+    for (JsonObjectConst presetObj : presetsArr) {
+        // Files written by older firmware have no ids; there the position is the id
+        int id = presetObj["id"] | (int)index;
+        ++index;
+        if (id < 0 || id >= MAX_PRESETS) continue;
+        Preset p;
+        presetFromJson(p, presetObj);
+        p.id = (uint8_t)id;
+        if (p.name.length() > PRESET_NAME_MAX) p.name = p.name.substring(0, PRESET_NAME_MAX);
+        if (writeSlot(p)) {
+            _used[p.id / 8] |= 1 << (p.id % 8);
+        } else {
+            ok = false;
+        }
+    }
+    return ok && count() > 0;
+}
+
+size_t PresetStore::count() const {
+    size_t n = 0;
+    for (uint8_t bits : _used) {
+        for (; bits; bits &= bits - 1) ++n;
+    }
+    return n;
+}
+
+PresetStore::CacheEntry* PresetStore::lookup(uint8_t id) {
+    for (CacheEntry& entry : _cache) {
+        if (entry.used && entry.preset.id == id) {
+            entry.lastUse = ++_useCounter;
+            return &entry;
         }
     }
-    if (!loaded) return false;
-    JsonArray presetsArray = doc["presets"];
-    presets.clear();
-    for (size_t i = 0; i < presetsArray.size(); i++) {
-        JsonObject presetObj = presetsArray[i];
+    return nullptr;
+}
+
+// Cache entry for `id`, evicting the least recently used clean one. Dirty
+// entries are only written by flush(), from the persistence service, so
+// nullptr when every entry holds an unsaved edit.
+PresetStore::CacheEntry* PresetStore::slotFor(uint8_t id) {
+    CacheEntry* found = lookup(id);
+    if (found) return found;
+    CacheEntry* victim = nullptr;
+    for (CacheEntry& entry : _cache) {
+        if (!entry.used) {
+            victim = &entry;
+            break;
+        }
+        if (!entry.dirty && (!victim || entry.lastUse < victim->lastUse)) victim = &entry;
+    }
+    if (!victim) return nullptr;
+    *victim = CacheEntry();
+    victim->preset.id = id;
+    victim->lastUse = ++_useCounter;
+    return victim;
+}
+
+bool PresetStore::get(uint8_t id, Preset& out) {
+    TaskLockGuard guard(_lock);
+    if (!exists(id)) return false;
+    CacheEntry* entry = lookup(id);
+    if (!entry) {
         Preset p;
-        p.id = presetObj["id"] | i;
-        p.name = presetObj["name"] | "";
-        p.effect = presetObj["effect"] | 0;
-        p.enabled = presetObj["enabled"] | true;
-        if (presetObj.containsKey("params")) {
-            JsonObject paramsObj = presetObj["params"];
-            // Convert speed from percent to 8-bit for internal use
-            p.params.speed = paramsObj["speed"].isNull() ? percentToHex(100) : percentToHex((uint8_t)paramsObj["speed"]);
-            p.params.intensity = paramsObj["intensity"].isNull() ? percentToHex(50) : percentToHex((uint8_t)paramsObj["intensity"]);
-            p.params.colors.clear();
-            if (paramsObj.containsKey("colors")) {
-                JsonArray colorsArr = paramsObj["colors"].as<JsonArray>();
-                for (JsonVariant v : colorsArr) {
-                    if (v.is<const char*>()) {
-                        p.params.colors.push_back(String(v.as<const char*>()));
-                    }
-                }
-            }
+        if (!readSlot(id, p)) return false;
+        entry = slotFor(id);
+        if (!entry) {
+            // Cache full of unsaved edits: served without caching it
+            out = p;
+            return true;
+        }
+        entry->preset = p;
+        entry->used = true;
+    }
+    out = entry->preset;
+    return true;
+}
+
+bool PresetStore::peek(uint8_t id, Preset& out) {
+    TaskLockGuard guard(_lock);
+    if (!exists(id)) return false;
+    for (const CacheEntry& entry : _cache) {
+        if (entry.used && entry.preset.id == id) {
+            out = entry.preset;
+            return true;
         }
-        presets.push_back(p);
     }
+    return readSlot(id, out);
+}
+
+bool PresetStore::put(const Preset& preset) {
+    TaskLockGuard guard(_lock);
+    if (preset.id >= MAX_PRESETS) return false;
+    CacheEntry* entry = slotFor(preset.id);
+    if (!entry) return false;
+    entry->preset = preset;
+    if (entry->preset.name.length() > PRESET_NAME_MAX) {
+        entry->preset.name = entry->preset.name.substring(0, PRESET_NAME_MAX);
+    }
+    entry->used = true;
+    entry->dirty = true;
+    _used[preset.id / 8] |= 1 << (preset.id % 8);
     return true;
 }
 
-bool savePresets(const std::vector<Preset>& presets) {
-    // Use DynamicJsonDocument for heap allocation
-    size_t capacity = 8192;
-    DynamicJsonDocument doc(capacity);
-    JsonArray presetsArray = doc.createNestedArray("presets");
-
-    for (size_t i = 0; i < presets.size(); i++) {
-        if (presets[i].name.length() == 0 && i > 0) continue;
-        JsonObject presetObj = presetsArray.createNestedObject();
-        presetObj["name"] = presets[i].name;
-        presetObj["effect"] = presets[i].effect;
-        presetObj["enabled"] = presets[i].enabled;
-        JsonObject paramsObj = presetObj.createNestedObject("params");
-        // Convert speed from 8-bit internal to percent for storage
-        paramsObj["speed"] = hexToPercent(presets[i].params.speed);
-        paramsObj["intensity"] = hexToPercent(presets[i].params.intensity);
-        JsonArray colorsArr = paramsObj.createNestedArray("colors");
-        for (const auto& c : presets[i].params.colors) {
-            colorsArr.add(c);
+bool PresetStore::flush() {
+    TaskLockGuard guard(_lock);
+    bool ok = true;
+    for (CacheEntry& entry : _cache) {
+        if (!entry.used || !entry.dirty) continue;
+        if (writeSlot(entry.preset)) {
+            entry.dirty = false;
+        } else {
+            ok = false;
         }
     }
+    return ok;
+}
 
+void PresetStore::reset() {
+    TaskLockGuard guard(_lock);
+    if (!ensureFilesystemMounted()) return;
+    FILESYSTEM.remove(PRESET_STORE_FILE);
+    memset(_used, 0, sizeof(_used));
+    for (CacheEntry& entry : _cache) entry = CacheEntry();
+}
+
+bool PresetStore::readSlot(uint8_t id, Preset& out) {
     if (!ensureFilesystemMounted()) return false;
-    File file = FILESYSTEM.open(PRESET_FILE, "w");
+    File file = FILESYSTEM.open(PRESET_STORE_FILE, "r");
     if (!file) return false;
-    size_t written = serializeJson(doc, file);
-    file.flush();
+    uint8_t slot[PRESET_SLOT_SIZE];
+    bool got = file.seek((uint32_t)id * PRESET_SLOT_SIZE) && file.read(slot, sizeof(slot)) == sizeof(slot);
     file.close();
-    delay(10);
-    return written > 0;
+    RecordReader reader;
+    uint16_t version;
+    Preset p;
+    if (!got || !reader.open(slot, sizeof(slot), PRESET_RECORD_MAGIC, version) || !decodePreset(p, reader) || p.id != id) {
+        debugPrint("[Presets] Bad slot ");
+        debugPrintln((unsigned int)id);
+        return false;
+    }
+    out = p;
+    return true;
+}
+
+// Rewrites one slot in place. LittleFS commits a file's changes only when it
+// is closed, so a power cut keeps the old slot; the record CRC catches the rest.
+bool PresetStore::writeSlot(const Preset& preset) {
+    if (!ensureFilesystemMounted()) return false;
+    RecordWriter writer(PRESET_RECORD_MAGIC, PRESET_RECORD_VERSION);
+    encodePreset(preset, writer);
+    const std::vector<uint8_t>& record = writer.seal();
+    uint8_t slot[PRESET_SLOT_SIZE] = {};
+    memcpy(slot, record.data(), std::min(record.size(), sizeof(slot)));
+
+    uint32_t start = micros();
+    File file = FILESYSTEM.open(PRESET_STORE_FILE, FILESYSTEM.exists(PRESET_STORE_FILE) ? "r+" : "w");
+    bool ok = (bool)file;
+    if (ok) {
+        // Grow the file with empty slots up to this one
+        uint32_t offset = (uint32_t)preset.id * PRESET_SLOT_SIZE;
+        uint8_t empty[PRESET_SLOT_SIZE] = {};
+        for (uint32_t size = file.size(); ok && size < offset; size += PRESET_SLOT_SIZE) {
+            ok = file.seek(size) && file.write(empty, PRESET_SLOT_SIZE) == PRESET_SLOT_SIZE;
+        }
+        ok = ok && file.seek(offset) && file.write(slot, sizeof(slot)) == sizeof(slot);
+        file.close();
+    }
+    countFlashWrite(sizeof(slot), micros() - start, ok);
+    return ok;
+}
+
+bool writePresetsJsonFragment(PresetStore& store, JsonStreamState& state, char* buf, size_t size, size_t& len) {
+    if (state.index == 0) {
+        len = strlcpy(buf, "{\"presets\":[", size);
+        return true;
+    }
+    size_t id = state.index - 1;
+    if (id < MAX_PRESETS) {
+        Preset preset;
+        if (!store.peek((uint8_t)id, preset)) return true;
+        StaticJsonDocument<384> doc;
+        doc["id"] = preset.id;
+        doc["name"] = preset.name;
+        doc["effect"] = preset.effect;
+        doc["enabled"] = preset.enabled;
+        JsonObject paramsObj = doc.createNestedObject("params");
+        paramsObj["speed"] = hexToPercent(preset.params.speed);
+        paramsObj["intensity"] = hexToPercent(preset.params.intensity);
+        paramsColorsToJson(preset.params, paramsObj.createNestedArray("colors"));
+        len = serializeJsonItem(state, buf, size, doc);
+        return true;
+    }
+    return closeJsonStream(state, "]}", buf, size, len);
 }
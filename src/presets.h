@@ -2,8 +2,64 @@
 #include <vector>
 #include <ArduinoJson.h>
 #include "config.h"
+#include "task_lock.h"
 
-// Preset management API
-bool loadPresets(std::vector<Preset>& presets);
-bool savePresets(const std::vector<Preset>& presets);
-void resetPresetsFile();
+// Presets live in PRESET_STORE_FILE as fixed-size slots, slot N holding
+// preset id N as a CRC-checked record (see record_io.h). Only a bitmap of
+// used ids and a few decoded presets stay in RAM, so lookup by id is a bit
+// test plus one slot read, and RAM does not grow with the number of presets.
+// Used from loop() and the web handlers; the cache is guarded by a TaskLock.
+class PresetStore {
+public:
+    // Scans the slot file; on first boot imports LEGACY_PRESET_FILE, or the
+    // embedded defaults when there is none
+    bool begin();
+
+    bool exists(uint8_t id) const { return id < MAX_PRESETS && (_used[id / 8] & (1 << (id % 8))); }
+    size_t count() const;
+
+    // Copies preset `id` into `out`; false if it does not exist
+    bool get(uint8_t id, Preset& out);
+    // Same, but a slot read from flash is not cached (listings)
+    bool peek(uint8_t id, Preset& out);
+    // Adds or replaces preset.id in memory; flush() writes its slot. False
+    // while PRESET_CACHE_SIZE other presets are waiting for that flush.
+    bool put(const Preset& preset);
+    // Writes every preset changed since the last flush
+    bool flush();
+
+    // Drops the slot file; the defaults are imported again at the next boot
+    void reset();
+
+private:
+    struct CacheEntry {
+        Preset preset;
+        bool used = false;
+        bool dirty = false;
+        uint32_t lastUse = 0;
+    };
+    CacheEntry* lookup(uint8_t id);
+    CacheEntry* slotFor(uint8_t id);
+    bool readSlot(uint8_t id, Preset& out);
+    bool writeSlot(const Preset& preset);
+    bool importJson(JsonArrayConst presetsArr);
+
+    uint8_t _used[(MAX_PRESETS + 7) / 8] = {};
+    CacheEntry _cache[PRESET_CACHE_SIZE];
+    uint32_t _useCounter = 0;
+    TaskLock _lock;
+};
+
+extern PresetStore presetStore;
+
+// Streaming JSON for GET /api/presets, one preset per fragment (see json_stream.h)
+bool writePresetsJsonFragment(PresetStore& store, JsonStreamState& state, char* buf, size_t size, size_t& len);
+
+// Sets name, effect, enabled and (if given) params of `preset` from a JSON
+// preset, converting percent to the internal 8-bit scale. The id is not
+// touched; without "params" the preset keeps its own.
+void presetFromJson(Preset& preset, JsonObjectConst presetObj);
+
+// Hex color conversion at the JSON boundary
+void paramsColorsFromJson(EffectParams& params, JsonArrayConst colorsArr);
+void paramsColorsToJson(const EffectParams& params, JsonArray colorsArr);
@@ -0,0 +1,59 @@
+#include "preview.h"
+#include "ws_protocol.h"
+#include <string.h>
+
+size_t PreviewEncoder::encode(uint8_t* out, size_t outSize) {
+    if (_pixels == 0 || outSize < PREVIEW_HEADER_SIZE) return 0;
+    bool keyframe = _forceKeyframe || _previous.size() != _current.size() ||
+                    _sinceKeyframe + 1 >= PREVIEW_KEYFRAME_INTERVAL;
+    if (!keyframe && memcmp(_current.data(), _previous.data(), _current.size()) == 0) return 0;
+
+    size_t pos = PREVIEW_HEADER_SIZE;
+    uint16_t skip = 0;
+    uint16_t p = 0;
+    while (p < _pixels) {
+        const uint8_t* px = &_current[p * 3];
+        if (!keyframe && memcmp(px, &_previous[p * 3], 3) == 0) {
+            ++skip;
+            ++p;
+            continue;
+        }
+        // Extend the run while the color repeats (unchanged pixels may be repainted)
+        uint16_t run = 1;
+        while (p + run < _pixels && run < 255 && memcmp(&_current[(p + run) * 3], px, 3) == 0) ++run;
+        while (skip > 255) {
+            if (pos + 5 > outSize) return 0;
+            out[pos++] = 255;
+            out[pos++] = 0;
+            out[pos++] = 0;
+            out[pos++] = 0;
+            out[pos++] = 0;
+            skip -= 255;
+        }
+        if (pos + 5 > outSize) return 0;
+        out[pos++] = (uint8_t)skip;
+        out[pos++] = (uint8_t)run;
+        out[pos++] = px[0];
+        out[pos++] = px[1];
+        out[pos++] = px[2];
+        skip = 0;
+        p += run;
+    }
+
+    out[0] = WS_PROTOCOL_VERSION;
+    out[1] = WS_MSG_PREVIEW;
+    out[2] = keyframe ? PREVIEW_FLAG_KEYFRAME : 0;
+    out[3] = _pixels & 0xFF;
+    out[4] = _pixels >> 8;
+    out[5] = _sequence & 0xFF;
+    out[6] = _sequence >> 8;
+
+    ++_sequence;
+    _sinceKeyframe = keyframe ? 0 : _sinceKeyframe + 1;
+    _forceKeyframe = false;
+    _previous = _current;
+    ++framesEncoded;
+    if (keyframe) ++keyframesEncoded;
+    bytesEncoded += pos;
+    return pos;
+}
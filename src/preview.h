@@ -0,0 +1,77 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include "config.h"
+#include "colors.h"
+
+// Live LED preview frames (WS_MSG_PREVIEW, see ws_protocol.h).
+//
+// The strip is averaged down to at most PREVIEW_PIXELS 8-bit RGB pixels
+// (white folded into RGB the same way the web UI previews RGBW colors).
+// Payload after the [version][type] header:
+//   u8 flags (bit 0 = keyframe), u16 pixel count, u16 sequence,
+//   then tokens of [u8 skip][u8 run][r][g][b]: leave `skip` pixels as they
+//   were, then paint `run` pixels with the color. Keyframes never skip;
+//   delta frames omit trailing unchanged pixels.
+
+#define PREVIEW_FLAG_KEYFRAME 0x01
+#define PREVIEW_HEADER_SIZE 7
+
+class PreviewEncoder {
+public:
+    explicit PreviewEncoder(uint16_t maxPixels = PREVIEW_PIXELS) : _maxPixels(maxPixels) {}
+
+    // Averages ledCount source pixels (packed RGBW) into the preview frame
+    template<typename GetPixel>
+    void capture(uint16_t ledCount, GetPixel getPixel);
+
+    // Encodes the captured frame against the last one sent. Returns the message
+    // length, or 0 if nothing changed or `outSize` is too small.
+    size_t encode(uint8_t* out, size_t outSize);
+
+    // Next frame is sent in full (new subscriber, dropped frame)
+    void requestKeyframe() { _forceKeyframe = true; }
+
+    uint16_t pixelCount() const { return _pixels; }
+    size_t maxMessageSize() const { return PREVIEW_HEADER_SIZE + 5 * (size_t)_maxPixels; }
+
+    uint32_t framesEncoded = 0;
+    uint32_t keyframesEncoded = 0;
+    uint32_t bytesEncoded = 0;
+
+private:
+    uint16_t _maxPixels;
+    uint16_t _pixels = 0;
+    uint16_t _sequence = 0;
+    uint16_t _sinceKeyframe = 0;
+    bool _forceKeyframe = true;
+    std::vector<uint8_t> _current;  // 3 bytes per preview pixel
+    std::vector<uint8_t> _previous;
+};
+
+template<typename GetPixel>
+void PreviewEncoder::capture(uint16_t ledCount, GetPixel getPixel) {
+    uint16_t pixels = ledCount < _maxPixels ? ledCount : _maxPixels;
+    if (pixels != _pixels) {
+        _pixels = pixels;
+        _forceKeyframe = true;
+    }
+    _current.resize((size_t)_pixels * 3);
+    for (uint16_t p = 0; p < _pixels; ++p) {
+        uint32_t start = (uint32_t)p * ledCount / _pixels;
+        uint32_t end = (uint32_t)(p + 1) * ledCount / _pixels;
+        uint32_t sumR = 0, sumG = 0, sumB = 0;
+        for (uint32_t i = start; i < end; ++i) {
+            uint8_t r, g, b, w;
+            unpack_rgbw(getPixel((uint16_t)i), r, g, b, w);
+            sumR += r + (255 - r) * w / 255;
+            sumG += g + (255 - g) * w / 255;
+            sumB += b + (255 - b) * w / 255;
+        }
+        uint32_t n = end - start;
+        _current[p * 3] = sumR / n;
+        _current[p * 3 + 1] = sumG / n;
+        _current[p * 3 + 2] = sumB / n;
+    }
+}
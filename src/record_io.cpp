@@ -0,0 +1,126 @@
+#include "record_io.h"
+#include <string.h>
+#include <algorithm>
+
+#define RECORD_HEADER_SIZE 12  // magic u32, version u16, payload length u16, CRC u32
+
+// Bitwise CRC-32 (IEEE, reflected); records are small and written rarely, so
+// a 1 KB table is not worth the RAM
+uint32_t recordCrc32(const uint8_t* data, size_t len, uint32_t crc) {
+    crc = ~crc;
+    while (len--) {
+        crc ^= *data++;
+        for (int bit = 0; bit < 8; ++bit) {
+            crc = (crc >> 1) ^ (0xEDB88320UL & (0 - (crc & 1)));
+        }
+    }
+    return ~crc;
+}
+
+static void putLe(uint8_t* out, uint32_t v, size_t bytes) {
+    for (size_t i = 0; i < bytes; ++i) out[i] = (uint8_t)(v >> (8 * i));
+}
+
+static uint32_t getLe(const uint8_t* in, size_t bytes) {
+    uint32_t v = 0;
+    for (size_t i = 0; i < bytes; ++i) v |= (uint32_t)in[i] << (8 * i);
+    return v;
+}
+
+RecordWriter::RecordWriter(uint32_t magic, uint16_t version) {
+    _buf.reserve(128);
+    _buf.resize(RECORD_HEADER_SIZE);
+    putLe(&_buf[0], magic, 4);
+    putLe(&_buf[4], version, 2);
+}
+
+void RecordWriter::u16(uint16_t v) {
+    u8((uint8_t)v);
+    u8((uint8_t)(v >> 8));
+}
+
+void RecordWriter::u32(uint32_t v) {
+    u16((uint16_t)v);
+    u16((uint16_t)(v >> 16));
+}
+
+void RecordWriter::f64(double v) {
+    uint64_t bits;
+    memcpy(&bits, &v, sizeof(bits));
+    u32((uint32_t)bits);
+    u32((uint32_t)(bits >> 32));
+}
+
+void RecordWriter::str(const String& s) {
+    uint16_t len = (uint16_t)std::min<size_t>(s.length(), UINT16_MAX);
+    u16(len);
+    _buf.insert(_buf.end(), (const uint8_t*)s.c_str(), (const uint8_t*)s.c_str() + len);
+}
+
+const std::vector<uint8_t>& RecordWriter::seal() {
+    size_t payload = _buf.size() - RECORD_HEADER_SIZE;
+    putLe(&_buf[6], (uint32_t)payload, 2);
+    // The CRC covers version and length too, so a flipped bit there is caught
+    uint32_t crc = recordCrc32(&_buf[4], 4);
+    putLe(&_buf[8], recordCrc32(&_buf[RECORD_HEADER_SIZE], payload, crc), 4);
+    return _buf;
+}
+
+bool RecordReader::open(const uint8_t* data, size_t size, uint32_t magic, uint16_t& version) {
+    _data = nullptr;
+    _size = _pos = 0;
+    if (size < RECORD_HEADER_SIZE || getLe(data, 4) != magic) return false;
+    size_t payload = getLe(data + 6, 2);
+    if (size < RECORD_HEADER_SIZE + payload) return false;
+    uint32_t crc = recordCrc32(data + 4, 4);
+    if (recordCrc32(data + RECORD_HEADER_SIZE, payload, crc) != getLe(data + 8, 4)) return false;
+    version = (uint16_t)getLe(data + 4, 2);
+    _data = data + RECORD_HEADER_SIZE;
+    _size = payload;
+    return true;
+}
+
+bool RecordReader::take(size_t n) {
+    if (_size - _pos < n) {
+        _pos = _size;
+        return false;
+    }
+    _pos += n;
+    return true;
+}
+
+bool RecordReader::u8(uint8_t& v) {
+    if (!take(1)) return false;
+    v = _data[_pos - 1];
+    return true;
+}
+
+bool RecordReader::u16(uint16_t& v) {
+    if (!take(2)) return false;
+    v = (uint16_t)getLe(_data + _pos - 2, 2);
+    return true;
+}
+
+bool RecordReader::u32(uint32_t& v) {
+    if (!take(4)) return false;
+    v = getLe(_data + _pos - 4, 4);
+    return true;
+}
+
+bool RecordReader::f64(double& v) {
+    if (!take(8)) return false;
+    uint64_t bits = getLe(_data + _pos - 8, 4) | ((uint64_t)getLe(_data + _pos - 4, 4) << 32);
+    memcpy(&v, &bits, sizeof(v));
+    return true;
+}
+
+bool RecordReader::str(String& s) {
+    uint16_t len;
+    if (!u16(len) || !take(len)) return false;
+    String value;
+    value.reserve(len);
+    const char* p = (const char*)_data + _pos - len;
+    for (uint16_t i = 0; i < len; ++i) value += p[i];
+    s = value;
+    return true;
+}
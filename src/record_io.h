@@ -0,0 +1,53 @@
+#pragma once
+#include <Arduino.h>
+#include <vector>
+
+// Compact binary records for flash storage: a 12-byte header (magic, schema
+// version, payload length, CRC-32) followed by little-endian fields.
+//
+// Schema rule: fields are only ever appended. A reader stops at the end of
+// the payload and leaves later fields at their defaults, so an older record
+// still loads; fields a newer firmware appended are simply not read.
+
+uint32_t recordCrc32(const uint8_t* data, size_t len, uint32_t crc = 0);
+
+class RecordWriter {
+public:
+    // Reserves the header; seal() fills it in
+    RecordWriter(uint32_t magic, uint16_t version);
+
+    void u8(uint8_t v) { _buf.push_back(v); }
+    void u16(uint16_t v);
+    void u32(uint32_t v);
+    void f64(double v);
+    void str(const String& s);  // u16 length + bytes, no terminator
+
+    // Completes the header and returns the whole record
+    const std::vector<uint8_t>& seal();
+
+private:
+    std::vector<uint8_t> _buf;
+};
+
+class RecordReader {
+public:
+    RecordReader() = default;
+
+    // Validates magic, length and CRC; on success the reader is positioned
+    // at the first payload field and `version` holds the writer's schema
+    bool open(const uint8_t* data, size_t size, uint32_t magic, uint16_t& version);
+
+    // Each read returns false (leaving `v` untouched) once the payload is exhausted
+    bool u8(uint8_t& v);
+    bool u16(uint16_t& v);
+    bool u32(uint32_t& v);
+    bool f64(double& v);
+    bool str(String& s);
+
+private:
+    bool take(size_t n);
+
+    const uint8_t* _data = nullptr;
+    size_t _size = 0;
+    size_t _pos = 0;
+};
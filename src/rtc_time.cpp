@@ -0,0 +1,44 @@
+#include "rtc_time.h"
+
+#define RTC_TIME_MAGIC 0x44475443  // "DGTC"
+
+struct RtcTimeRecord {
+    uint32_t magic;
+    uint32_t utcEpoch;
+    uint32_t check;  // ~(magic ^ utcEpoch); catches garbage after power-on
+};
+
+#if defined(ESP8266)
+// RTC user memory is addressed in 4-byte blocks; the first ones hold the
+// eboot command used by OTA, so stay well clear of them
+#define RTC_TIME_BLOCK 64
+
+void storeRtcTime(uint32_t utcEpoch) {
+    RtcTimeRecord record = {RTC_TIME_MAGIC, utcEpoch, ~(RTC_TIME_MAGIC ^ utcEpoch)};
+    ESP.rtcUserMemoryWrite(RTC_TIME_BLOCK, (uint32_t*)&record, sizeof(record));
+}
+
+bool restoreRtcTime(uint32_t& utcEpoch) {
+    RtcTimeRecord record;
+    if (!ESP.rtcUserMemoryRead(RTC_TIME_BLOCK, (uint32_t*)&record, sizeof(record))) return false;
+    if (record.magic != RTC_TIME_MAGIC || record.check != ~(RTC_TIME_MAGIC ^ record.utcEpoch)) return false;
+    utcEpoch = record.utcEpoch;
+    return true;
+}
+#else
+// Not initialised by the bootloader, so it keeps its value across resets
+static RTC_NOINIT_ATTR RtcTimeRecord rtcTimeRecord;
+
+void storeRtcTime(uint32_t utcEpoch) {
+    rtcTimeRecord.magic = RTC_TIME_MAGIC;
+    rtcTimeRecord.utcEpoch = utcEpoch;
+    rtcTimeRecord.check = ~(RTC_TIME_MAGIC ^ utcEpoch);
+}
+
+bool restoreRtcTime(uint32_t& utcEpoch) {
+    if (rtcTimeRecord.magic != RTC_TIME_MAGIC ||
+        rtcTimeRecord.check != ~(RTC_TIME_MAGIC ^ rtcTimeRecord.utcEpoch)) return false;
+    utcEpoch = rtcTimeRecord.utcEpoch;
+    return true;
+}
+#endif
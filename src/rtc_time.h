@@ -0,0 +1,8 @@
+#pragma once
+#include <Arduino.h>
+
+// Last known UTC time in RTC memory, which survives restarts (OTA, watchdog,
+// crash) but not power loss. Lets schedules resume at boot before NTP answers.
+void storeRtcTime(uint32_t utcEpoch);
+// False after power-on or if the record is corrupt
+bool restoreRtcTime(uint32_t& utcEpoch);
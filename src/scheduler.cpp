@@ -2,86 +2,245 @@
 #include "scheduler.h"
 #include "config.h"
 #include "debug.h"
+#include "solar.h"
+#include "presets.h"
+#include "sim_clock.h"
+#include "rtc_time.h"
 #include <math.h>
+#include <algorithm>
+#ifndef SIMULATED_CLOCK
 #if defined(ESP8266)
 #include <ESP8266WiFi.h>
 #else
 #include <WiFi.h>
 #endif
+#endif
 
-const Timer* Scheduler::getActiveTimer() {
-    if (!isTimeValid()) return nullptr;
-    int currentMinutes = getCurrentTimeInMinutes();
-    const Timer* best = nullptr;
-    int bestMinutes = -1;
-    for (const auto& t : _config->timers) {
+// Sort key for the per-preset view: preset first, then time of day
+static bool presetEntryLess(const ScheduleEntry& a, const ScheduleEntry& b) {
+    if (a.presetId != b.presetId) return a.presetId < b.presetId;
+    return a.minutes < b.minutes;
+}
+
+void Scheduler::rebuildTimeline() {
+    _timelineTimersGen = _config->gen.timers;
+    _timelinePresetsGen = _config->gen.presets;
+    _timelineSunGen = _sunGeneration;
+
+    _timeline.clear();
+    _timeline.reserve(_config->timers.size());
+    for (size_t i = 0; i < _config->timers.size(); i++) {
+        const Timer& t = _config->timers[i];
         if (!isTimerActive(t, 0)) continue;
         int timerMinutes = getTimerMinutes(t);
         if (timerMinutes == -1) continue;
-        if (timerMinutes <= currentMinutes && timerMinutes > bestMinutes) {
-            bestMinutes = timerMinutes;
-            best = &t;
-        }
+        ScheduleEntry entry;
+        entry.minutes = (uint16_t)timerMinutes;
+        entry.presetId = t.presetId;
+        entry.brightness = t.brightness;
+        entry.timerIndex = (uint16_t)i;
+        entry.presetValid = presetStore.exists(t.presetId);
+        _timeline.push_back(entry);
     }
-    // If no timer has triggered today, select the last timer of the previous day
-    if (!best) {
-        int latestMinutes = -1;
-        for (const auto& t : _config->timers) {
-            if (!isTimerActive(t, 0)) continue;
-            int timerMinutes = getTimerMinutes(t);
-            if (timerMinutes == -1) continue;
-            if (timerMinutes > latestMinutes) {
-                latestMinutes = timerMinutes;
-                best = &t;
-            }
-        }
+    // Stable sorts keep config order among equal times, which is the tie-break
+    // the linear scans used (first timer wins)
+    std::stable_sort(_timeline.begin(), _timeline.end(),
+        [](const ScheduleEntry& a, const ScheduleEntry& b) { return a.minutes < b.minutes; });
+    _presetTimeline = _timeline;
+    std::stable_sort(_presetTimeline.begin(), _presetTimeline.end(), presetEntryLess);
+    ++_timelineVersion;
+    debugPrint("[Scheduler] Timeline rebuilt, entries: ");
+    debugPrintln(_timeline.size());
+}
+
+const std::vector<ScheduleEntry>& Scheduler::timeline() {
+    if (_timelineTimersGen != _config->gen.timers ||
+        _timelinePresetsGen != _config->gen.presets ||
+        _timelineSunGen != _sunGeneration) {
+        rebuildTimeline();
     }
-    return best;
+    return _timeline;
+}
+
+// First entry of the latest time group at or before `minutes` in [begin, end),
+// wrapping to the last group of the previous day
+template<typename It, typename Key>
+static It findLatestAtOrBefore(It begin, It end, int minutes, Key key) {
+    if (begin == end) return end;
+    It it = std::upper_bound(begin, end, minutes,
+        [&](int m, const ScheduleEntry& e) { return m < key(e); });
+    int groupMinutes = key(it == begin ? *(end - 1) : *(it - 1));
+    return std::lower_bound(begin, end, groupMinutes,
+        [&](const ScheduleEntry& e, int m) { return key(e) < m; });
+}
+
+static int entryMinutes(const ScheduleEntry& e) { return e.minutes; }
+
+const ScheduleEntry* Scheduler::getActiveEntry(int currentMinutes) {
+    const std::vector<ScheduleEntry>& entries = timeline();
+    auto it = findLatestAtOrBefore(entries.begin(), entries.end(), currentMinutes, entryMinutes);
+    return it == entries.end() ? nullptr : &*it;
 }
 
-Scheduler::Scheduler(Configuration* config) {
+const ScheduleEntry* Scheduler::getNextEntry(int currentMinutes) {
+    const std::vector<ScheduleEntry>& entries = timeline();
+    if (entries.empty()) return nullptr;
+    auto it = std::upper_bound(entries.begin(), entries.end(), currentMinutes,
+        [](int m, const ScheduleEntry& e) { return m < e.minutes; });
+    return it == entries.end() ? &entries.front() : &*it;
+}
+
+int64_t Scheduler::nextDueAtOrAfter(int64_t fromLocal) {
+    const std::vector<ScheduleEntry>& entries = timeline();
+    if (entries.empty()) return INT64_MAX;
+    int64_t day = fromLocal / 86400;
+    int64_t secondOfDay = fromLocal % 86400;
+    if (secondOfDay < 0) {
+        secondOfDay += 86400;
+        --day;
+    }
+    int firstMinute = (int)((secondOfDay + 59) / 60);
+    auto it = std::lower_bound(entries.begin(), entries.end(), firstMinute,
+        [](const ScheduleEntry& e, int m) { return e.minutes < m; });
+    if (it == entries.end()) {
+        ++day;
+        it = entries.begin();
+    }
+    return day * 86400 + (int64_t)it->minutes * 60;
+}
+
+void Scheduler::armDeadline() {
+    int64_t now = _clock.localEpoch();
+    // Never re-fire an instant already handled (DST fall-back repeats local times)
+    int64_t from = _lastFired == INT64_MIN ? now : std::max(now, _lastFired + 1);
+    _nextDue = nextDueAtOrAfter(from);
+    _armedVersion = _timelineVersion;
+}
+
+bool Scheduler::pollDue() {
+    if (!isTimeValid()) return false;
+    timeline(); // rebuilds (and bumps the version) if timers, presets or sun times changed
+    int64_t now = _clock.localEpoch();
+    if (_recheckDue) {
+        // The estimated time may have been hours off in either direction:
+        // start over from the real time
+        _recheckDue = false;
+        _lastFired = INT64_MIN;
+        armDeadline();
+        return true;
+    }
+    // Re-arm after a timeline change or when the clock stepped back by more than a day.
+    // A step that large is a correction, not a DST repeat: times after it are new.
+    // A deadline already passed still fires first (a step forward into a new day
+    // also rebuilds the timeline).
+    bool steppedBack = _nextDue != INT64_MAX && _nextDue - now > 86400;
+    if (steppedBack) _lastFired = INT64_MIN;
+    bool missed = _nextDue != INT64_MAX && now >= _nextDue;
+    if ((_armedVersion != _timelineVersion && !missed) || steppedBack) {
+        armDeadline();
+    }
+    if (now < _nextDue) return false;
+    _lastFired = _nextDue;
+    armDeadline();
+    return true;
+}
+
+uint32_t Scheduler::millisUntilDue() {
+    if (_nextDue == INT64_MAX || _armedVersion != _timelineVersion) return UINT32_MAX;
+    int64_t ms = (_nextDue - _clock.localEpoch()) * 1000 - _clock.subSecond();
+    if (ms <= 0) return 0;
+    return ms > (int64_t)UINT32_MAX ? UINT32_MAX : (uint32_t)ms;
+}
+
+const Timer* Scheduler::getActiveTimer() {
+    if (!isTimeValid()) return nullptr;
+    const ScheduleEntry* entry = getActiveEntry(getCurrentTimeInMinutes());
+    return entry ? &_config->timers[entry->timerIndex] : nullptr;
+}
+
+Scheduler::Scheduler(Configuration* config) : _clock(config) {
     _config = config;
-    int tzOffset = 0;
-    if (_config) tzOffset = _config->getTimezoneOffsetSeconds();
-    _timeClient = new NTPClient(_ntpUDP, _config->time.ntpServer.c_str(), tzOffset, NTP_UPDATE_INTERVAL);
 }
 
 void Scheduler::begin() {
-    _timeClient->begin();
-    updateNTP();
+#ifndef SIMULATED_CLOCK
+    // A restart keeps the last time in RTC memory; the reset itself takes
+    // about a second, which the next NTP reply slews away
+    uint32_t storedEpoch;
+    if (!_clock.isSynced() && restoreRtcTime(storedEpoch)) {
+        syncTime(storedEpoch + 1 + controlMillis() / 1000);
+        debugPrintln("[NTP] Time restored from RTC memory");
+    }
+    _sntp.begin();
+#endif
+}
+
+void Scheduler::syncTime(uint32_t utcEpoch) {
+    _clock.sync(utcEpoch, controlMillis());
+}
+
+void Scheduler::estimateTime(uint32_t utcEpoch) {
+    if (_clock.isSynced() || utcEpoch == 0) return;
+    syncTime(utcEpoch);
+    _timeEstimated = true;
 }
 
 int Scheduler::getCurrentTimeInMinutes() {
-    return timeToMinutes(getCurrentHour(), getCurrentMinute());
+    return _clock.minuteOfDay();
 }
 
 void Scheduler::update() {
+#ifndef SIMULATED_CLOCK
     // Completely disable NTP logic in AP mode (no time sync attempts)
     #if defined(ESP8266)
     bool apMode = (WiFi.getMode() == WIFI_AP);
     #else
     bool apMode = (WiFi.getMode() == WIFI_MODE_AP);
     #endif
-    if (!apMode) {
-        uint32_t interval = isTimeValid() ? NTP_UPDATE_INTERVAL : NTP_RETRY_INTERVAL;
-        if (millis() - _lastNTPUpdate > interval) {
+    // Requests wait for the link, so boot can start lighting before WiFi is up
+    if (!apMode && WiFi.status() == WL_CONNECTED) {
+        switch (_sntp.poll(controlMillis())) {
+            case SntpClient::Status::Synced:
+                _clock.discipline(_sntp.epoch(), _sntp.atMillis(), _sntp.epochMillis());
+                if (_timeEstimated) {
+                    _timeEstimated = false;
+                    _recheckDue = true;
+                }
+                _ntpSynced = true;
+                _ntpHealthy = true;
+                debugPrintln("[NTP] Time updated");
+                break;
+            case SntpClient::Status::Failed:
+                _ntpHealthy = false;
+                debugPrintln("[NTP] Request timed out");
+                break;
+            default:
+                break;
+        }
+        uint32_t interval = !_ntpSynced ? NTP_FIRST_SYNC_INTERVAL
+                          : (_ntpHealthy ? NTP_UPDATE_INTERVAL : NTP_RETRY_INTERVAL);
+        if (!_sntp.busy() && (!_ntpRequested || controlMillis() - _lastNTPUpdate > interval)) {
             updateNTP();
         }
-        _timeClient->update();
     }
-    // Calculate sun times only once per day at midnight or on first update
-    static bool sunTimesCalculated = false;
-    if (_sunriseMinutes == -1 || (getCurrentHour() == 0 && getCurrentMinute() == 0 && !sunTimesCalculated)) {
-        calculateSunTimes();
-        sunTimesCalculated = true;
+#endif
+    _clock.update(controlMillis());
+#ifndef SIMULATED_CLOCK
+    if (_clock.isSynced() && _clock.utcEpoch() != _storedEpoch) {
+        storeRtcTime(_clock.utcEpoch());
+        _storedEpoch = _clock.utcEpoch();
     }
-    // Reset flag after midnight
-    if (getCurrentHour() != 0 || getCurrentMinute() != 0) {
-        sunTimesCalculated = false;
+#endif
+    // Recalculate sun times once per local day (and after the first sync moves the date)
+    if (_sunTimesDay != _clock.dayNumber()) {
+        calculateSunTimes();
+        _sunTimesDay = _clock.dayNumber();
     }
 }
 
 void Scheduler::updateNTP() {
+    _lastNTPUpdate = controlMillis();
+    _ntpRequested = true;
     if (_config) {
         String ntpServer = _config->time.ntpServer;
         if (ntpServer.length() == 0 || ntpServer == "null") {
@@ -89,6 +248,7 @@ void Scheduler::updateNTP() {
             return;
         }
     }
+#ifndef SIMULATED_CLOCK
     // Disable NTP update if in AP mode (no internet)
     #if defined(ESP8266)
     if (WiFi.getMode() == WIFI_AP) {
@@ -101,12 +261,18 @@ void Scheduler::updateNTP() {
         return;
     }
     #endif
-    _timeClient->forceUpdate();
-    _lastNTPUpdate = millis();
-    debugPrintln("NTP time updated");
+#endif
+    // Only sends the request; update() picks up the reply
+    if (!_sntp.request(_config->time.ntpServer.c_str(), _lastNTPUpdate)) {
+        _ntpHealthy = false;
+    }
 }
 
 bool Scheduler::isTimeValid() {
+#ifdef SIMULATED_CLOCK
+    // No network: time is whatever the harness injected with syncTime()
+    return _clock.isSynced();
+#else
     if (_config) {
         String ntpServer = _config->time.ntpServer;
         if (ntpServer.length() == 0 || ntpServer == "null") {
@@ -114,134 +280,72 @@ bool Scheduler::isTimeValid() {
             return true;
         }
     }
-    return _timeClient->isTimeSet();
+    return _clock.isSynced();
+#endif
 }
 
-uint8_t Scheduler::getScheduledBrightness(int8_t presetId, int currentMinutes) {
-    int mostRecentMinutes = -1;
-    uint8_t mostRecentBrightness = 100;
-    for (const auto& t : _config->timers) {
-        if (!t.enabled) continue;
-        if (t.presetId != presetId) continue;
-        int timerMinutes = getTimerMinutes(t);
-        if (timerMinutes == -1) continue;
-        if (timerMinutes <= currentMinutes && timerMinutes > mostRecentMinutes) {
-            mostRecentMinutes = timerMinutes;
-            mostRecentBrightness = t.brightness;
-        }
-    }
-    // If no timer has triggered today, select the last timer of the previous day
-    if (mostRecentMinutes == -1) {
-        int latestMinutes = -1;
-        uint8_t latestBrightness = 100;
-        for (const auto& t : _config->timers) {
-            if (!t.enabled) continue;
-            if (t.presetId != presetId) continue;
-            int timerMinutes = getTimerMinutes(t);
-            if (timerMinutes == -1) continue;
-            if (timerMinutes > latestMinutes) {
-                latestMinutes = timerMinutes;
-                latestBrightness = t.brightness;
-            }
-        }
-        mostRecentBrightness = latestBrightness;
-    }
-    return mostRecentBrightness;
+uint8_t Scheduler::getScheduledBrightness(int16_t presetId, int currentMinutes) {
+    if (presetId < 0) return 100;
+    timeline();
+    ScheduleEntry probe;
+    probe.presetId = (uint8_t)presetId;
+    auto range = std::equal_range(_presetTimeline.begin(), _presetTimeline.end(), probe,
+        [](const ScheduleEntry& a, const ScheduleEntry& b) { return a.presetId < b.presetId; });
+    if (range.first == range.second) return 100;
+    auto it = findLatestAtOrBefore(range.first, range.second, currentMinutes, entryMinutes);
+    return it->brightness;
 }
 
 String Scheduler::getCurrentTime() {
-    // Get the current epoch time (UTC)
-    unsigned long epoch = _timeClient->getEpochTime();
-    int tzOffset = 0;
-    if (_config) tzOffset = _config->getTimezoneOffsetSeconds();
-    epoch += tzOffset;
-    // Calculate hours, minutes, seconds in local time
-    int hours = (epoch / 3600) % 24;
-    int minutes = (epoch / 60) % 60;
-    int seconds = epoch % 60;
-    char buffer[9];
-    snprintf(buffer, sizeof(buffer), "%02d:%02d:%02d", hours, minutes, seconds);
+    // Room for three full uint8_t fields, so -Wformat-truncation has nothing to flag
+    char buffer[12];
+    snprintf(buffer, sizeof(buffer), "%02u:%02u:%02u",
+             (unsigned)_clock.hour(), (unsigned)_clock.minute(), (unsigned)_clock.second());
     return String(buffer);
 }
 
 uint8_t Scheduler::getCurrentHour() {
-    unsigned long epoch = _timeClient->getEpochTime();
-    int tzOffset = 0;
-    if (_config) tzOffset = _config->getTimezoneOffsetSeconds();
-    epoch += tzOffset;
-    return (epoch / 3600) % 24;
+    return _clock.hour();
 }
 
 uint8_t Scheduler::getCurrentMinute() {
-    unsigned long epoch = _timeClient->getEpochTime();
-    int tzOffset = 0;
-    if (_config) tzOffset = _config->getTimezoneOffsetSeconds();
-    epoch += tzOffset;
-    return (epoch / 60) % 60;
+    return _clock.minute();
+}
+
+uint32_t Scheduler::getCurrentSecondOfDay() {
+    return _clock.secondOfDay();
 }
 
 
-// Simplified sunrise calculation using sine approximation
+// Sun events for the current local date (NOAA algorithm, see solar.h). Runs
+// once per local day or on location change; the loop only reads the cache.
 void Scheduler::calculateSunTimes() {
     if (_config->time.latitude == 0.0 && _config->time.longitude == 0.0) {
         // Default times if location not set
         _sunriseMinutes = 6 * 60;  // 6:00 AM
         _sunsetMinutes = 18 * 60;  // 6:00 PM
+        _civilDawnMinutes = _sunriseMinutes - 30;
+        _civilDuskMinutes = _sunsetMinutes + 30;
+        ++_sunGeneration;
         return;
     }
-    
-    _sunriseMinutes = calculateSunriseMinutes();
-    _sunsetMinutes = calculateSunsetMinutes();
-}
-
-int Scheduler::calculateSunriseMinutes() {
-    // Simplified calculation - in production, use a proper astronomy library
-    // This is a basic approximation
-    float lat = _config->time.latitude * PI / 180.0;
-    
-    // Day of year approximation
-    unsigned long epochTime = _timeClient->getEpochTime();
-    int dayOfYear = (epochTime / 86400) % 365;
-    
-    // Solar declination approximation
-    float declination = 0.409 * sin(2 * PI / 365.0 * dayOfYear - 1.39);
-    
-    // Hour angle
-    float hourAngle = acos(-tan(lat) * tan(declination));
-    
-    // Sunrise time in hours
-    float sunriseHour = 12.0 - (hourAngle * 12.0 / PI);
-    
-    // Convert to minutes since midnight
-    int minutes = (int)(sunriseHour * 60);
-    
-    // Clamp to reasonable values
-    if (minutes < 4 * 60) minutes = 4 * 60;   // Not before 4 AM
-    if (minutes > 10 * 60) minutes = 10 * 60;  // Not after 10 AM
-    
-    return minutes;
-}
 
-int Scheduler::calculateSunsetMinutes() {
-    // Simplified calculation
-    float lat = _config->time.latitude * PI / 180.0;
-    
-    unsigned long epochTime = _timeClient->getEpochTime();
-    int dayOfYear = (epochTime / 86400) % 365;
-    
-    float declination = 0.409 * sin(2 * PI / 365.0 * dayOfYear - 1.39);
-    float hourAngle = acos(-tan(lat) * tan(declination));
-    
-    // Sunset time in hours
-    float sunsetHour = 12.0 + (hourAngle * 12.0 / PI);
-    
-    int minutes = (int)(sunsetHour * 60);
-    
-    // Clamp to reasonable values
-    if (minutes < 16 * 60) minutes = 16 * 60;  // Not before 4 PM
-    if (minutes > 22 * 60) minutes = 22 * 60;  // Not after 10 PM
-    
-    return minutes;
+    // Offset in effect at local noon, so a DST switch at night does not shift the day
+    int64_t localNoon = (int64_t)_clock.dayNumber() * 86400 + 12 * 3600;
+    int32_t offset = _config->getTimezoneOffsetSeconds((uint32_t)(localNoon - _clock.utcOffset()));
+    SolarDay sun;
+    computeSolarDay(_clock.year(), _clock.month(), _clock.day(),
+                    _config->time.latitude, _config->time.longitude, offset, sun);
+    // SOLAR_NO_EVENT (polar day/night) leaves sunrise/sunset timers idle that day
+    _sunriseMinutes = sun.sunrise;
+    _sunsetMinutes = sun.sunset;
+    _civilDawnMinutes = sun.civilDawn;
+    _civilDuskMinutes = sun.civilDusk;
+    ++_sunGeneration;
+    debugPrint("[Scheduler] Sun times: ");
+    debugPrint(getSunriseTime());
+    debugPrint(" - ");
+    debugPrintln(getSunsetTime());
 }
 
 String Scheduler::getSunriseTime() {
@@ -294,41 +398,21 @@ int Scheduler::getTimerMinutes(const Timer& timer) {
 }
 
 
-int8_t Scheduler::getCurrentScheduledPreset() {
+int16_t Scheduler::getCurrentScheduledPreset() {
     if (!isTimeValid()) return -1;
-
-    int currentMinutes = timeToMinutes(getCurrentHour(), getCurrentMinute());
-    int8_t mostRecentPreset = -1;
-    int mostRecentMinutes = -1;
-    int minutesInDay = 24 * 60;
-    // Find the most recent timer that should have triggered (today)
-    for (size_t i = 0; i < _config->timers.size(); i++) {
-        if (!isTimerActive(_config->timers[i], 0)) continue;
-        int timerMinutes = getTimerMinutes(_config->timers[i]);
-        if (timerMinutes == -1) continue;
-        if (_config->timers[i].presetId >= _config->getPresetCount()) continue;
-        if (timerMinutes <= currentMinutes) {
-            if (timerMinutes > mostRecentMinutes) {
-                mostRecentMinutes = timerMinutes;
-                mostRecentPreset = _config->timers[i].presetId;
-            }
-        }
-    }
-    // If no timer has triggered today, select the last timer of the previous day (highest timerMinutes overall)
-    if (mostRecentPreset == -1) {
-        int latestMinutes = -1;
-        int8_t latestPreset = -1;
-        for (size_t i = 0; i < _config->timers.size(); i++) {
-            if (!isTimerActive(_config->timers[i], 0)) continue;
-            int timerMinutes = getTimerMinutes(_config->timers[i]);
-            if (timerMinutes == -1) continue;
-            if (_config->timers[i].presetId >= _config->getPresetCount()) continue;
-            if (timerMinutes > latestMinutes) {
-                latestMinutes = timerMinutes;
-                latestPreset = _config->timers[i].presetId;
-            }
+    const std::vector<ScheduleEntry>& entries = timeline();
+    auto group = findLatestAtOrBefore(entries.begin(), entries.end(), _clock.minuteOfDay(), entryMinutes);
+    // Timers pointing at a missing preset are skipped by stepping back one time
+    // group at a time (wrapping into the previous day)
+    size_t visited = 0;
+    while (group != entries.end() && visited < entries.size()) {
+        auto groupEnd = std::upper_bound(group, entries.end(), (int)group->minutes,
+            [](int m, const ScheduleEntry& e) { return m < e.minutes; });
+        for (auto it = group; it != groupEnd; ++it) {
+            if (it->presetValid) return it->presetId;
         }
-        mostRecentPreset = latestPreset;
+        visited += groupEnd - group;
+        group = findLatestAtOrBefore(entries.begin(), entries.end(), (int)group->minutes - 1, entryMinutes);
     }
-    return mostRecentPreset;
+    return -1;
 }
@@ -2,9 +2,20 @@
 #define SCHEDULER_H
 
 #include <Arduino.h>
-#include <NTPClient.h>
-#include <WiFiUdp.h>
 #include "config.h"
+#include "local_clock.h"
+#include "sntp.h"
+#include <vector>
+
+// One enabled timer resolved to a minute of the current day (sunrise/sunset
+// already substituted)
+struct ScheduleEntry {
+    uint16_t minutes = 0;
+    uint8_t presetId = 0;
+    uint8_t brightness = 255;  // internal hex (0-255)
+    uint16_t timerIndex = 0;   // index into Configuration::timers
+    bool presetValid = false;  // presetId refers to an existing preset
+};
 
 class Scheduler {
 public:
@@ -16,34 +27,81 @@ public:
     void update();
 
     bool isTimeValid();
+    // Set the wall clock to `utcEpoch` as of now; NTP results land here too.
+    // Simulated-clock builds have no NTP and take time only from this call.
+    void syncTime(uint32_t utcEpoch);
+    // Seed an unsynced clock with an approximate time (the one saved before a
+    // power cut). Timers run on it until the first NTP reply, after which
+    // pollDue() reports once so the active timer is applied again.
+    void estimateTime(uint32_t utcEpoch);
+    // Broken-down local time, refreshed once per second by update()
+    const LocalClock& clock() const { return _clock; }
     String getCurrentTime();
     uint8_t getCurrentHour();
     uint8_t getCurrentMinute();
+    uint32_t getCurrentSecondOfDay();
 
     void calculateSunTimes();
     String getSunriseTime();
     String getSunsetTime();
 
     // Returns the brightness for the given presetId and time (minutes), or 100 if not found
-    uint8_t getScheduledBrightness(int8_t presetId, int currentMinutes);
-    int8_t getCurrentScheduledPreset();  // Returns preset that should be active on boot
+    uint8_t getScheduledBrightness(int16_t presetId, int currentMinutes);
+    int16_t getCurrentScheduledPreset();  // Returns preset that should be active on boot
     // Returns the current time in minutes since midnight
     int getCurrentTimeInMinutes();
     int timeToMinutes(uint8_t hour, uint8_t minute);
     int getTimerMinutes(const Timer& timer);
+
+    // Enabled timers sorted by minute; rebuilt lazily when timers, presets or
+    // sun times change, so lookups below are binary searches
+    const std::vector<ScheduleEntry>& timeline();
+    // Latest entry at or before `currentMinutes`, wrapping to yesterday's last
+    const ScheduleEntry* getActiveEntry(int currentMinutes);
+    // First entry strictly after `currentMinutes`, wrapping to tomorrow's first
+    const ScheduleEntry* getNextEntry(int currentMinutes);
+
+    // True once when the armed timer deadline has passed; re-arms for the next
+    // entry. Each timeline entry fires once per day, to the second.
+    bool pollDue();
+    // Time left until the armed deadline (UINT32_MAX when nothing is armed)
+    uint32_t millisUntilDue();
     
     Configuration* _config;
-    WiFiUDP _ntpUDP;
-    NTPClient* _timeClient;
+    SntpClient _sntp;
+    LocalClock _clock;
 
     uint32_t _lastNTPUpdate = 0;
+    bool _ntpRequested = false; // first request goes out as soon as WiFi is up
+    bool _ntpSynced = false;    // time came from the network at least once
+    bool _ntpHealthy = false;   // the last request was answered
+    bool _timeEstimated = false; // the clock runs on estimateTime() until NTP answers
+    bool _recheckDue = false;    // NTP replaced the estimate: pollDue() fires once
+    uint32_t _storedEpoch = 0;  // last second written to RTC memory
 
     int _sunriseMinutes = -1;  // Minutes since midnight
     int _sunsetMinutes = -1;
+    int _civilDawnMinutes = -1;  // sun 6 degrees below the horizon
+    int _civilDuskMinutes = -1;
+    int32_t _sunTimesDay = -1;  // LocalClock::dayNumber() the sun times belong to
+    uint32_t _sunGeneration = 0; // bumped by calculateSunTimes()
+
+    std::vector<ScheduleEntry> _timeline;        // by minute
+    std::vector<ScheduleEntry> _presetTimeline;  // by (presetId, minute)
+    uint32_t _timelineTimersGen = UINT32_MAX;
+    uint32_t _timelinePresetsGen = UINT32_MAX;
+    uint32_t _timelineSunGen = UINT32_MAX;
+    uint32_t _timelineVersion = 0;              // bumped by every rebuild
+    void rebuildTimeline();
+
+    // Deadline in local epoch seconds (LocalClock::localEpoch())
+    int64_t _nextDue = INT64_MAX;
+    int64_t _lastFired = INT64_MIN;
+    uint32_t _armedVersion = UINT32_MAX;
+    int64_t nextDueAtOrAfter(int64_t fromLocal);
+    void armDeadline();
 
     void updateNTP();
-    int calculateSunriseMinutes();
-    int calculateSunsetMinutes();
     bool isTimerActive(const Timer& timer, uint8_t dayOfWeek);
 };
 
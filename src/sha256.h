@@ -0,0 +1,30 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+#define SHA256_DIGEST_SIZE 32
+
+// Incremental SHA-256 (FIPS 180-4) for checking firmware images as they
+// stream through; same result on ESP8266, ESP32 and the host.
+class Sha256 {
+public:
+    Sha256() { reset(); }
+
+    void reset();
+    void update(const uint8_t* data, size_t len);
+    // Writes the digest; call reset() before hashing another message
+    void finish(uint8_t digest[SHA256_DIGEST_SIZE]);
+
+private:
+    void compress(const uint8_t block[64]);
+
+    uint32_t _state[8];
+    uint64_t _length = 0;   // bytes hashed so far
+    uint8_t _block[64];
+    size_t _blockLen = 0;
+};
+
+// Parses 64 hex digits (either case); false for anything else
+bool parseSha256Hex(const char* hex, uint8_t digest[SHA256_DIGEST_SIZE]);
+// Writes 64 lowercase hex digits and a terminator into `out`
+void formatSha256Hex(const uint8_t digest[SHA256_DIGEST_SIZE], char out[2 * SHA256_DIGEST_SIZE + 1]);
@@ -0,0 +1,5 @@
+#include "sim_clock.h"
+
+#ifdef SIMULATED_CLOCK
+uint32_t g_simMillis = 0;
+#endif
@@ -0,0 +1,15 @@
+#pragma once
+#include <Arduino.h>
+
+// Millisecond time base of the control path: scheduler, transitions, effects
+// and frame pacing. Firmware reads millis(). Builds with -DSIMULATED_CLOCK read
+// a virtual clock instead, which a host replay harness advances in large steps
+// (together with Scheduler::syncTime()) to run a day of schedule and fades in
+// milliseconds of CPU time.
+#ifdef SIMULATED_CLOCK
+extern uint32_t g_simMillis;
+inline uint32_t controlMillis() { return g_simMillis; }
+inline void advanceSimulatedMillis(uint32_t ms) { g_simMillis += ms; }
+#else
+inline uint32_t controlMillis() { return millis(); }
+#endif
@@ -0,0 +1,103 @@
+#include "sntp.h"
+#include "config.h"
+#include "debug.h"
+#if defined(ESP8266)
+#include <ESP8266WiFi.h>
+#else
+#include <WiFi.h>
+#endif
+
+static const uint16_t NTP_PORT = 123;
+static const uint16_t NTP_LOCAL_PORT = 2390;
+static const size_t NTP_PACKET_SIZE = 48;
+static const uint32_t SEVENTY_YEARS = 2208988800UL;  // 1900 -> 1970
+
+static uint32_t readBigEndian32(const uint8_t* p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static void writeBigEndian32(uint8_t* p, uint32_t value) {
+    p[0] = value >> 24;
+    p[1] = value >> 16;
+    p[2] = value >> 8;
+    p[3] = value;
+}
+
+void SntpClient::begin() {
+    if (_started) return;
+    _udp.begin(NTP_LOCAL_PORT);
+    _started = true;
+}
+
+bool SntpClient::request(const char* server, uint32_t nowMillis) {
+    if (!_started) begin();
+    if (!_resolved || _server != server) {
+        // DNS is the one blocking step left, so the answer is kept until the
+        // server changes or a request goes unanswered
+        IPAddress ip;
+        if (!WiFi.hostByName(server, ip)) {
+            debugPrintln("[NTP] Could not resolve server");
+            return false;
+        }
+        _server = server;
+        _serverIp = ip;
+        _resolved = true;
+    }
+
+    // Drop late replies to earlier requests
+    while (_udp.parsePacket() > 0) {
+        _udp.flush();
+    }
+
+    uint8_t packet[NTP_PACKET_SIZE] = {};
+    packet[0] = 0x23;  // LI 0, version 4, mode 3 (client)
+    _nonce = nowMillis ^ (_nonce * 2654435761UL) ^ 0x5A5A5A5AUL;
+    writeBigEndian32(packet + 40, _nonce);
+    if (!_udp.beginPacket(_serverIp, NTP_PORT)) return false;
+    _udp.write(packet, NTP_PACKET_SIZE);
+    if (!_udp.endPacket()) return false;
+
+    _sentAt = nowMillis;
+    _status = Status::Waiting;
+    return true;
+}
+
+SntpClient::Status SntpClient::poll(uint32_t nowMillis) {
+    if (_status != Status::Waiting) return Status::Idle;
+
+    int size = _udp.parsePacket();
+    if (size >= (int)NTP_PACKET_SIZE) {
+        uint8_t packet[NTP_PACKET_SIZE];
+        _udp.read(packet, NTP_PACKET_SIZE);
+        _udp.flush();
+        uint8_t leap = packet[0] >> 6;
+        uint8_t mode = packet[0] & 0x07;
+        uint8_t stratum = packet[1];
+        // Only a server reply to this request, from a synchronized server
+        // (stratum 0 is a kiss-o'-death)
+        if (mode != 4 || leap == 3 || stratum == 0 || stratum > 15 ||
+            readBigEndian32(packet + 24) != _nonce) {
+            debugPrintln("[NTP] Ignoring unusable reply");
+            return Status::Waiting;
+        }
+        uint32_t seconds = readBigEndian32(packet + 40);
+        uint32_t fraction = readBigEndian32(packet + 44);
+        // Server transmit time plus half the round trip, as of nowMillis
+        uint32_t ms = (uint32_t)(((uint64_t)fraction * 1000 + 0x80000000UL) >> 32) + (nowMillis - _sentAt) / 2;
+        _epoch = seconds - SEVENTY_YEARS + ms / 1000;
+        _epochMillis = ms % 1000;
+        _atMillis = nowMillis;
+        _status = Status::Idle;
+        return Status::Synced;
+    }
+    if (size > 0) {
+        _udp.flush();
+    }
+
+    if (nowMillis - _sentAt >= NTP_TIMEOUT) {
+        _status = Status::Idle;
+        _resolved = false;  // resolve again next time
+        return Status::Failed;
+    }
+    return Status::Waiting;
+}
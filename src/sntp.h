@@ -0,0 +1,37 @@
+#pragma once
+#include <Arduino.h>
+#include <WiFiUdp.h>
+
+// Minimal SNTP (RFC 4330) client that never blocks the loop: request() sends
+// one packet, poll() checks for the reply and gives up after NTP_TIMEOUT.
+class SntpClient {
+public:
+    enum class Status { Idle, Waiting, Synced, Failed };
+
+    void begin();
+    // Resolves `server` (cached until it changes or a request fails) and sends
+    // a request; false if the name does not resolve or the send fails
+    bool request(const char* server, uint32_t nowMillis);
+    // Synced or Failed is returned once per request, then the client is Idle
+    Status poll(uint32_t nowMillis);
+    bool busy() const { return _status == Status::Waiting; }
+
+    // Valid after poll() returned Synced: UTC time at millis() == atMillis()
+    uint32_t epoch() const { return _epoch; }
+    uint16_t epochMillis() const { return _epochMillis; }
+    uint32_t atMillis() const { return _atMillis; }
+
+private:
+    WiFiUDP _udp;
+    bool _started = false;
+    Status _status = Status::Idle;
+    String _server;
+    IPAddress _serverIp;
+    bool _resolved = false;
+    uint32_t _sentAt = 0;
+    uint32_t _nonce = 0;  // echoed back as the originate timestamp
+
+    uint32_t _epoch = 0;
+    uint16_t _epochMillis = 0;
+    uint32_t _atMillis = 0;
+};
@@ -0,0 +1,86 @@
+#include "solar.h"
+#include "timezone.h"
+#include <math.h>
+
+static const double DEG = M_PI / 180.0;
+
+// Julian day at 0h UTC of the given civil date
+static double julianDay(int32_t year, uint8_t month, uint8_t day) {
+    return daysFromCivil(year, month, day) + 2440587.5;
+}
+
+// Solar declination (radians) and equation of time (minutes) at `jd`
+static void solarPosition(double jd, double& declination, double& eqTime) {
+    double t = (jd - 2451545.0) / 36525.0;  // Julian centuries since J2000
+
+    double meanLong = fmod(280.46646 + t * (36000.76983 + t * 0.0003032), 360.0);
+    double meanAnom = 357.52911 + t * (35999.05029 - 0.0001537 * t);
+    double eccent = 0.016708634 - t * (0.000042037 + 0.0000001267 * t);
+    double m = meanAnom * DEG;
+    double center = sin(m) * (1.914602 - t * (0.004817 + 0.000014 * t)) +
+                    sin(2 * m) * (0.019993 - 0.000101 * t) +
+                    sin(3 * m) * 0.000289;
+    double omega = (125.04 - 1934.136 * t) * DEG;
+    double apparentLong = (meanLong + center - 0.00569 - 0.00478 * sin(omega)) * DEG;
+    double meanObliq = 23.0 + (26.0 + (21.448 - t * (46.815 + t * (0.00059 - t * 0.001813))) / 60.0) / 60.0;
+    double obliq = (meanObliq + 0.00256 * cos(omega)) * DEG;
+
+    declination = asin(sin(obliq) * sin(apparentLong));
+
+    double y = tan(obliq / 2);
+    y *= y;
+    double l0 = meanLong * DEG;
+    eqTime = 4.0 / DEG * (y * sin(2 * l0) - 2 * eccent * sin(m) +
+                          4 * eccent * y * sin(m) * cos(2 * l0) -
+                          0.5 * y * y * sin(4 * l0) - 1.25 * eccent * eccent * sin(2 * m));
+}
+
+// UTC minutes of solar noon on day `jd0` (0h UTC) at `longitude`
+static double solarNoonUtc(double jd0, double longitude) {
+    double declination, eqTime;
+    solarPosition(jd0 + (720.0 - 4.0 * longitude) / 1440.0, declination, eqTime);
+    double noon = 720.0 - 4.0 * longitude - eqTime;
+    // Second pass at the refined instant
+    solarPosition(jd0 + noon / 1440.0, declination, eqTime);
+    return 720.0 - 4.0 * longitude - eqTime;
+}
+
+// UTC minutes when the sun reaches `zenith` degrees before (rising) or after
+// noon; NAN if it never does that day
+static double solarEventUtc(double jd0, double latitude, double longitude, double zenith, bool rising) {
+    double minutes = solarNoonUtc(jd0, longitude);
+    double lat = latitude * DEG;
+    // Two refinements: evaluate declination and equation of time at the event
+    for (int i = 0; i < 2; ++i) {
+        double declination, eqTime;
+        solarPosition(jd0 + minutes / 1440.0, declination, eqTime);
+        double cosHa = cos(zenith * DEG) / (cos(lat) * cos(declination)) - tan(lat) * tan(declination);
+        if (cosHa < -1.0 || cosHa > 1.0) return NAN;
+        double hourAngle = acos(cosHa) / DEG;
+        double noon = 720.0 - 4.0 * longitude - eqTime;
+        minutes = rising ? noon - 4.0 * hourAngle : noon + 4.0 * hourAngle;
+    }
+    return minutes;
+}
+
+static int16_t toLocalMinutes(double utcMinutes, int32_t utcOffsetSeconds) {
+    if (isnan(utcMinutes)) return SOLAR_NO_EVENT;
+    long minutes = lround(utcMinutes + utcOffsetSeconds / 60.0);
+    minutes %= 1440;
+    if (minutes < 0) minutes += 1440;
+    return (int16_t)minutes;
+}
+
+void computeSolarDay(int32_t year, uint8_t month, uint8_t day,
+                     double latitude, double longitude, int32_t utcOffsetSeconds,
+                     SolarDay& out) {
+    // Event times come out as UTC minutes relative to 0h UTC of the date (they
+    // may fall outside 0-1440); shifting by the offset lands them on the local day
+    double jd0 = julianDay(year, month, day);
+
+    out.solarNoon = toLocalMinutes(solarNoonUtc(jd0, longitude), utcOffsetSeconds);
+    out.sunrise = toLocalMinutes(solarEventUtc(jd0, latitude, longitude, 90.833, true), utcOffsetSeconds);
+    out.sunset = toLocalMinutes(solarEventUtc(jd0, latitude, longitude, 90.833, false), utcOffsetSeconds);
+    out.civilDawn = toLocalMinutes(solarEventUtc(jd0, latitude, longitude, 96.0, true), utcOffsetSeconds);
+    out.civilDusk = toLocalMinutes(solarEventUtc(jd0, latitude, longitude, 96.0, false), utcOffsetSeconds);
+}
@@ -0,0 +1,20 @@
+#pragma once
+#include <stdint.h>
+
+#define SOLAR_NO_EVENT -1  // Sun never crosses the threshold that day (polar day/night)
+
+// Sun events of one local day, in minutes after local midnight
+struct SolarDay {
+    int16_t civilDawn = SOLAR_NO_EVENT;  // sun 6 degrees below the horizon, rising
+    int16_t sunrise = SOLAR_NO_EVENT;    // upper limb on the horizon, with refraction
+    int16_t solarNoon = SOLAR_NO_EVENT;
+    int16_t sunset = SOLAR_NO_EVENT;
+    int16_t civilDusk = SOLAR_NO_EVENT;
+};
+
+// NOAA solar position algorithm (Meeus), good to about a minute between the
+// polar circles. `utcOffsetSeconds` is the local offset in effect that day.
+// Uses double internally; call it once per day, not per frame.
+void computeSolarDay(int32_t year, uint8_t month, uint8_t day,
+                     double latitude, double longitude, int32_t utcOffsetSeconds,
+                     SolarDay& out);
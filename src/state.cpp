@@ -6,6 +6,11 @@
 #include "webserver.h"
 #include "display.h"
 #include "colors.h"
+#include "photoperiod.h"
+#include "presets.h"
+#include "frame_cache.h"
+#include "scheduler.h"
+#include "sim_clock.h"
 #include "debug.h"
 
 // Cache previous brightness for brightness-only transitions
@@ -19,12 +24,13 @@ PendingTransitionState pendingTransition;
 extern volatile uint8_t g_effectSpeed;
 
 SystemState state;
+BootTimes bootTimes;
 
 extern BusManager busManager;
 
 // Global user-selected colors (fixed size)
 #include <array>
-std::array<uint32_t, 8> color = {0x000000, 0x000000, 0x000000, 0x000000, 0x000000, 0x000000, 0x000000, 0x000000};
+std::array<uint32_t, MAX_EFFECT_COLORS> color = {0x000000, 0x000000, 0x000000, 0x000000, 0x000000, 0x000000, 0x000000, 0x000000};
 size_t colorCount = 2;
 
 extern Configuration config;
@@ -33,11 +39,12 @@ extern TransitionEngine transition;
 extern WebServerManager webServer;
 extern void* strip;
 
-extern int8_t lastScheduledPreset;
+// Track last scheduled preset applied by timer
+int16_t lastScheduledPreset = -1;
 
-static bool hasValidPresetColors(const std::vector<String>& presetColorsVec) {
-	for (const auto& hex : presetColorsVec) {
-		if (parse_hex_rgbw(hex.c_str()) == 0x00000000) return false;
+static bool hasValidPresetColors(const EffectParams& params) {
+	for (size_t i = 0; i < params.colorCount; ++i) {
+		if (params.colors[i] == 0x00000000) return false;
 	}
 	return true;
 }
@@ -50,41 +57,33 @@ static void captureCurrentBusFrame(std::vector<uint32_t>& frame) {
 	}
 }
 
-static void fillArrayFromPresetColors(const std::vector<String>& presetColorsVec, std::array<uint32_t, 8>& arr) {
-	size_t n = presetColorsVec.size();
-	for (size_t i = 0; i < n && i < 8; ++i) {
-		arr[i] = parse_hex_rgbw(presetColorsVec[i].c_str());
-	}
-	for (size_t i = n; i < 8; ++i) {
-		arr[i] = 0x00000000;
-	}
+// Effects always get at least one palette entry
+static size_t effectiveColorCount(const EffectParams& params) {
+	return params.colorCount > 0 ? params.colorCount : 1;
 }
 
 static void setPendingTransitionFromPreset(const Preset& preset, size_t n) {
 	pendingTransition.effect = preset.effect;
 	pendingTransition.params = preset.params;
-	pendingTransition.params.colors.clear();
-	for (size_t i = 0; i < n; ++i) {
-		char hex[11];
-		snprintf(hex, sizeof(hex), "#%08X", color[i]);
-		pendingTransition.params.colors.push_back(String(hex));
+	pendingTransition.params.colorCount = n;
+	for (size_t i = 0; i < MAX_EFFECT_COLORS; ++i) {
+		pendingTransition.params.colors[i] = (i < n) ? color[i] : 0;
 	}
 	pendingTransition.preset = preset.id;
 }
 
 void applyPreset(uint8_t presetId, uint8_t brightness) {
 	transition.abortTransition();
-	auto it = std::find_if(config.presets.begin(), config.presets.end(), [presetId](const Preset& p) { return p.id == presetId; });
-	if (it == config.presets.end() || !it->enabled) return;
-	Preset& preset = *it;
+	Preset preset;
+	if (!presetStore.get(presetId, preset) || !preset.enabled) return;
 	uint8_t safeBrightness = std::min(brightness, config.safety.maxBrightness);
-	state.brightness = safeBrightness;
+	updateField(state.brightness, safeBrightness, state.gen.brightness);
 
 	state.prevEffect = state.effect;
 	state.prevParams = state.params;
-	colorCount = preset.params.colors.size() > 0 ? preset.params.colors.size() : 1;
-	fillArrayFromPresetColors(preset.params.colors, color);
-	if (preset.effect == 1 && !hasValidPresetColors(preset.params.colors)) return;
+	colorCount = effectiveColorCount(preset.params);
+	color = preset.params.colors;
+	if (preset.effect == 1 && !hasValidPresetColors(preset.params)) return;
 
 	previousBrightness = transition.getCurrentBrightness();
 	uint32_t prevColor1 = transition.getCurrentColor1();
@@ -98,12 +97,9 @@ void applyPreset(uint8_t presetId, uint8_t brightness) {
 	transition.setPreviousFrame(prevFrame);
 
 	std::vector<uint32_t> targetFrame(count, 0);
-	std::array<uint32_t, 8> presetColors = {0};
-	fillArrayFromPresetColors(preset.params.colors, presetColors);
-	size_t presetColorCount = preset.params.colors.size() > 0 ? preset.params.colors.size() : 1;
 	uint8_t presetBrightnessHex = (brightness > 0 ? brightness : 255);
 	presetBrightnessHex = std::min(presetBrightnessHex, config.safety.maxBrightness);
-	renderEffectToBuffer(preset.effect, preset.params, targetFrame, count, presetColors, presetColorCount, presetBrightnessHex);
+	frameCache.render(preset.effect, preset.params, targetFrame, count, effectiveColorCount(preset.params), presetBrightnessHex);
 	transition.setTargetFrame(targetFrame);
 
 	if (doTransition) {
@@ -117,10 +113,10 @@ void applyPreset(uint8_t presetId, uint8_t brightness) {
 		transition.startEffectAndBrightnessTransition(safeBrightness, color[0], color[1], state.transitionTime);
 	}
 
-	setPendingTransitionFromPreset(preset, preset.params.colors.size());
-	state.power = true;
-	state.inTransition = true;
-	state.preset = preset.id;
+	setPendingTransitionFromPreset(preset, preset.params.colorCount);
+	updateField(state.power, true, state.gen.power);
+	updateField(state.inTransition, true, state.gen.transition);
+	updateField(state.preset, preset.id, state.gen.preset);
 	webServer.broadcastState();
 }
 
@@ -129,11 +125,13 @@ void setPower(bool power) {
 		return;
 	}
 	state.power = power;
+	++state.gen.power;
 	digitalWrite(config.led.relayPin, power ? (config.led.relayActiveHigh ? HIGH : LOW) : (config.led.relayActiveHigh ? LOW : HIGH));
 	uint8_t targetBrightness = power ? state.brightness : 0;
 	// Use powerOn transition time for power changes
-	state.transitionTime = config.transitionTimes.powerOn;
-	webServer.applyTransitionTimeLimit(state.transitionTime);
+	uint32_t transitionTime = config.transitionTimes.powerOn;
+	webServer.applyTransitionTimeLimit(transitionTime);
+	updateField(state.transitionTime, transitionTime, state.gen.transition);
 	if (power) {
 		transition.forceCurrentBrightness(state.brightness);
 	}
@@ -158,9 +156,10 @@ static void captureCurrentFrameForTransition() {
 
 void setBrightness(uint8_t brightness) {
 	webServer.applyBrightnessLimit(brightness);
-	state.brightness = brightness;
-	state.transitionTime = config.transitionTimes.manual;
-	webServer.applyTransitionTimeLimit(state.transitionTime);
+	updateField(state.brightness, brightness, state.gen.brightness);
+	uint32_t transitionTime = config.transitionTimes.manual;
+	webServer.applyTransitionTimeLimit(transitionTime);
+	updateField(state.transitionTime, transitionTime, state.gen.transition);
 	uint8_t current = transition.getCurrentBrightness();
 	if (brightness == current) return;
 	if (!transition.isTransitioning()) {
@@ -177,15 +176,16 @@ void setBrightness(uint8_t brightness) {
 }
 
 void setEffect(uint8_t effect, const EffectParams& params) {
-	state.effect = effect;
-	state.params = params;
-	state.params.colors.clear();
-	// Only push actual preset colors, not padded black entries
-	size_t n = colorCount;
-	for (size_t i = 0; i < n; ++i) {
-		char hex[11];
-		snprintf(hex, sizeof(hex), "#%08X", color[i]);
-		state.params.colors.push_back(String(hex));
+	EffectParams newParams = params;
+	// Only keep actual preset colors, not padded black entries
+	newParams.colorCount = colorCount;
+	for (size_t i = 0; i < MAX_EFFECT_COLORS; ++i) {
+		newParams.colors[i] = (i < colorCount) ? color[i] : 0;
+	}
+	if (state.effect != effect || !(state.params == newParams)) {
+		state.effect = effect;
+		state.params = newParams;
+		++state.gen.effect;
 	}
 	// Debug: print speed value to confirm it's 8-bit
 	printf("[DEBUG] setEffect: state.params.speed = %u\n", state.params.speed);
@@ -199,26 +199,35 @@ void setEffect(uint8_t effect, const EffectParams& params) {
 
 // Call this when user changes color from UI/API
 void setUserColor(const uint32_t* newColor, size_t count) {
+	if (count > MAX_EFFECT_COLORS) count = MAX_EFFECT_COLORS;
 	colorCount = count;
-	state.params.colors.clear();
-	for (size_t i = 0; i < 8; ++i) {
-		char hex[11];
-		snprintf(hex, sizeof(hex), "#%08X", color[i]);
-		state.params.colors.push_back(String(hex));
+	for (size_t i = 0; i < MAX_EFFECT_COLORS; ++i) {
+		color[i] = (i < count) ? newColor[i] : 0;
 	}
 	// Use effect transition time for color/effect changes
-	state.transitionTime = config.transitionTimes.manual;
+	updateField(state.transitionTime, config.transitionTimes.manual, state.gen.transition);
 	setEffect(state.effect, state.params);
 }
 
-// Helper to convert color hex strings to array
-static std::array<uint32_t, 8> getColorsFromParams(const std::vector<String>& colorsVec) {
-	std::array<uint32_t, 8> colors = {0};
-	for (size_t i = 0; i < colorsVec.size() && i < 8; ++i) {
-		const String& hex = colorsVec[i];
-		colors[i] = (uint32_t)strtoul(hex.c_str() + (hex[0] == '#' ? 1 : 0), nullptr, 16);
+void restoreState(const SystemState& saved) {
+	colorCount = std::min<size_t>(saved.params.colorCount, MAX_EFFECT_COLORS);
+	for (size_t i = 0; i < MAX_EFFECT_COLORS; ++i) {
+		color[i] = (i < colorCount) ? saved.params.colors[i] : 0;
 	}
-	return colors;
+	setEffect(saved.effect, saved.params);
+	updateField(state.preset, saved.preset, state.gen.preset);
+	uint8_t brightness = saved.brightness;
+	webServer.applyBrightnessLimit(brightness);
+	updateField(state.brightness, brightness, state.gen.brightness);
+	if (!saved.power || brightness == 0) return;
+	updateField(state.power, true, state.gen.power);
+	digitalWrite(config.led.relayPin, config.led.relayActiveHigh ? HIGH : LOW);
+	uint32_t transitionTime = config.transitionTimes.powerOn;
+	webServer.applyTransitionTimeLimit(transitionTime);
+	updateField(state.transitionTime, transitionTime, state.gen.transition);
+	transition.forceCurrentBrightness(0);
+	transition.startEffectAndBrightnessTransition(brightness, transition.getCurrentColor1(), transition.getCurrentColor2(), state.transitionTime);
+	webServer.broadcastState();
 }
 
 static void renderFrameToBus(const std::vector<uint32_t>& frame) {
@@ -246,25 +255,22 @@ static void renderTransitionFrame(size_t count, float colorProgress, bool bright
 	std::vector<uint32_t> prevFrame(count, 0);
 	std::vector<uint32_t> nextFrame(count, 0);
 	if (brightnessOnly) {
-		auto colors = getColorsFromParams(pendingTransition.params.colors);
-		size_t colorCount = pendingTransition.params.colors.size() > 0 ? pendingTransition.params.colors.size() : 1;
+		const EffectParams& params = pendingTransition.params;
 		uint8_t prevBrightness = transition.getCurrentBrightness();
 		uint8_t nextBrightness = transition.getTargetBrightness();
-		renderEffectToBuffer(pendingTransition.effect, pendingTransition.params, prevFrame, count, colors, colorCount, prevBrightness);
-		renderEffectToBuffer(pendingTransition.effect, pendingTransition.params, nextFrame, count, colors, colorCount, nextBrightness);
+		// The current brightness moves every frame; caching it would only evict useful frames
+		renderEffectToBuffer(pendingTransition.effect, params, prevFrame, count, params.colors, effectiveColorCount(params), prevBrightness);
+		frameCache.render(pendingTransition.effect, params, nextFrame, count, effectiveColorCount(params), nextBrightness);
 	} else {
-		if (state.prevEffect == 0) {
+		if (state.prevEffect >= 0 && isEffectTimeInvariant(state.prevEffect)) {
+			// Captured from the bus when the transition started; a static frame does not change
 			prevFrame = transition.getPreviousFrame();
 		} else {
-			auto prevColors = getColorsFromParams(state.prevParams.colors);
-			size_t prevColorCount = state.prevParams.colors.size() > 0 ? state.prevParams.colors.size() : 1;
 			uint8_t prevBrightness = transition.getCurrentBrightness();
-			renderEffectToBuffer(state.prevEffect, state.prevParams, prevFrame, count, prevColors, prevColorCount, prevBrightness);
+			renderEffectToBuffer(state.prevEffect, state.prevParams, prevFrame, count, state.prevParams.colors, effectiveColorCount(state.prevParams), prevBrightness);
 		}
-		auto nextColors = getColorsFromParams(pendingTransition.params.colors);
-		size_t nextColorCount = pendingTransition.params.colors.size() > 0 ? pendingTransition.params.colors.size() : 1;
 		uint8_t nextBrightness = transition.getTargetBrightness();
-		renderEffectToBuffer(pendingTransition.effect, pendingTransition.params, nextFrame, count, nextColors, nextColorCount, nextBrightness);
+		frameCache.render(pendingTransition.effect, pendingTransition.params, nextFrame, count, effectiveColorCount(pendingTransition.params), nextBrightness);
 	}
 	std::vector<uint32_t> blended(count, 0);
 	blendFrames(prevFrame, nextFrame, colorProgress, blended);
@@ -272,12 +278,15 @@ static void renderTransitionFrame(size_t count, float colorProgress, bool bright
 }
 
 static void commitPendingTransition() {
-	state.effect = pendingTransition.effect;
-	state.params = pendingTransition.params;
-	state.preset = pendingTransition.preset;
-	state.brightness = transition.getTargetBrightness();
-	if (state.effect == 0 && state.params.colors.size() > 0) {
-		color[0] = parse_hex_rgbw(state.params.colors[0].c_str());
+	if (state.effect != pendingTransition.effect || !(state.params == pendingTransition.params)) {
+		state.effect = pendingTransition.effect;
+		state.params = pendingTransition.params;
+		++state.gen.effect;
+	}
+	updateField(state.preset, pendingTransition.preset, state.gen.preset);
+	updateField(state.brightness, transition.getTargetBrightness(), state.gen.brightness);
+	if (state.effect == 0 && state.params.colorCount > 0) {
+		color[0] = state.params.colors[0];
 	}
 	setEffect(state.effect, state.params);
 	transition.clearFrames();
@@ -285,32 +294,60 @@ static void commitPendingTransition() {
 
 static void renderAnimationFrame(size_t count, uint8_t brightness) {
 	std::vector<uint32_t> animFrame(count, 0);
-	auto animColors = getColorsFromParams(state.params.colors);
-	size_t animColorCount = state.params.colors.size() > 0 ? state.params.colors.size() : 1;
-	renderEffectToBuffer(state.effect, state.params, animFrame, count, animColors, animColorCount, brightness);
+	frameCache.render(state.effect, state.params, animFrame, count, effectiveColorCount(state.params), brightness);
 	renderFrameToBus(animFrame);
 }
 
+// Photoperiod mode: the whole strip follows the keyframe curve at the current
+// local time, scaled by the safety limit and dithered from 16 to 8 bits
+static PhotoperiodTable photoperiodTable;
+static uint32_t photoperiodGeneration = UINT32_MAX;
+static TemporalDither photoperiodDither;
+
+static bool renderPhotoperiodFrame(size_t count) {
+	if (!config.photoperiod.enabled || !scheduler.isTimeValid()) return false;
+	if (photoperiodGeneration != config.gen.photoperiod) {
+		photoperiodTable.build(config.photoperiod);
+		photoperiodGeneration = config.gen.photoperiod;
+	}
+	if (photoperiodTable.empty()) return false;
+	const LocalClock& clock = scheduler.clock();
+	uint16_t level[PHOTOPERIOD_CHANNELS];
+	photoperiodTable.evaluate(clock.secondOfDay() * 1000UL + clock.subSecond(), level);
+	uint8_t out[PHOTOPERIOD_CHANNELS];
+	for (size_t c = 0; c < PHOTOPERIOD_CHANNELS; ++c) {
+		uint16_t limited = (uint16_t)((uint32_t)level[c] * config.safety.maxBrightness / 255);
+		out[c] = photoperiodDither.apply(c, limited);
+	}
+	uint32_t packed = pack_rgbw(out[0], out[1], out[2], out[3]);
+	for (size_t i = 0; i < count; ++i) {
+		busManager.setPixelColor(i, packed);
+	}
+	busManager.show();
+	return true;
+}
+
 void updateLEDs() {
 	BusNeoPixel* neo = busManager.getNeoPixelBus();
 	if (!neo || !neo->getStrip()) return;
 	if (!state.power) {
 		busManager.turnOffLEDs();
-		state.inTransition = false;
-		state.brightness = 0;
+		updateField(state.inTransition, false, state.gen.transition);
+		updateField(state.brightness, (uint8_t)0, state.gen.brightness);
 		digitalWrite(config.led.relayPin, config.led.relayActiveHigh ? LOW : HIGH);
 		return;
 	}
+	if (bootTimes.firstLight == 0) bootTimes.firstLight = millis();
 	size_t count = busManager.getPixelCount();
 	static bool pendingCommit = false;
 	if (transition.isTransitioning()) {
 		pendingCommit = true;
-		float progress = float(millis() - transition.getStartTime()) / float(transition.getDuration());
+		float progress = float(controlMillis() - transition.getStartTime()) / float(transition.getDuration());
 		if (progress > 1.0f) progress = 1.0f;
 		progress = progress * progress * (3.0f - 2.0f * progress); // smoothstep
 		float colorFrac = transition.getEffectTransitionFraction();
 		float colorProgress = (progress < colorFrac) ? (progress / colorFrac) : 1.0f;
-		bool brightnessOnly = (pendingTransition.effect == state.effect && pendingTransition.params.colors == state.params.colors);
+		bool brightnessOnly = (pendingTransition.effect == state.effect && pendingTransition.params.colorsEqual(state.params));
 		renderTransitionFrame(count, colorProgress, brightnessOnly);
 	} else {
 		if (pendingCommit) {
@@ -318,11 +355,52 @@ void updateLEDs() {
 			pendingCommit = false;
 		}
 		uint8_t currentBrightness = transition.getCurrentBrightness();
-		state.inTransition = false;
-		state.brightness = currentBrightness;
-		renderAnimationFrame(count, currentBrightness);
+		updateField(state.inTransition, false, state.gen.transition);
+		updateField(state.brightness, currentBrightness, state.gen.brightness);
+		if (!renderPhotoperiodFrame(count)) {
+			renderAnimationFrame(count, currentBrightness);
+		}
 		if (state.power) {
 			digitalWrite(config.led.relayPin, config.led.relayActiveHigh ? HIGH : LOW);
 		}
 	}
 }
+
+// --- Schedule ---
+// Called from the time task when a timer deadline passes, and once when the
+// time first becomes valid after boot
+
+static void handleScheduledPreset(int16_t presetId, int currentMinutes) {
+	const Timer* activeTimer = scheduler.getActiveTimer();
+	if (activeTimer && activeTimer->presetId == presetId && presetId != lastScheduledPreset) {
+		uint8_t brightness = activeTimer->brightness;
+		// If this is the first schedule application after boot, use powerOn transition time
+		static bool firstScheduleApplied = false;
+		uint32_t transitionTime = firstScheduleApplied ? config.transitionTimes.schedule : config.transitionTimes.powerOn;
+		webServer.applyTransitionTimeLimit(transitionTime);
+		updateField(state.transitionTime, transitionTime, state.gen.transition);
+		applyPreset(presetId, brightness);
+		firstScheduleApplied = true;
+		lastScheduledPreset = presetId;
+	}
+}
+
+void checkSchedule() {
+	// The photoperiod curve replaces timer steps while it is enabled
+	if (config.photoperiod.enabled) return;
+	const Timer* activeTimer = scheduler.getActiveTimer();
+	if (activeTimer) {
+		handleScheduledPreset(activeTimer->presetId, scheduler.getTimerMinutes(*activeTimer));
+	}
+}
+
+// Apply the correct schedule as soon as time becomes valid after boot (only once)
+void checkAndApplyScheduleAfterBoot() {
+	static bool scheduleApplied = false;
+	if (!scheduleApplied) {
+		if (scheduler.isTimeValid()) {
+			checkSchedule();
+			scheduleApplied = true;
+		}
+	}
+}
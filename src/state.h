@@ -4,6 +4,20 @@
 #include "config.h"
 
 
+// Monotonic change counters per field group. Consumers (display, WebSocket
+// broadcaster) cache the value they last saw and compare integers.
+struct StateGenerations {
+    uint32_t power = 0;
+    uint32_t brightness = 0;
+    uint32_t effect = 0;      // effect id and params
+    uint32_t preset = 0;
+    uint32_t transition = 0;  // transitionTime and inTransition
+    uint32_t network = 0;     // WiFi mode / link status
+    uint32_t total() const {
+        return power + brightness + effect + preset + transition + network;
+    }
+};
+
 // All internal state uses hex (0-255)
 struct SystemState {
     bool power = false;
@@ -15,14 +29,29 @@ struct SystemState {
     bool inTransition = false;
     int8_t prevEffect = -1;
     EffectParams prevParams;
+    StateGenerations gen;
 };
 
 extern SystemState state;
+
+// Boot milestones in millis() since reset (0 = not reached yet), for /api/perf
+struct BootTimes {
+    uint32_t firstLight = 0;  // first frame rendered with power on
+    uint32_t ready = 0;       // splash, WiFi (or AP) and OTA setup finished
+};
+extern BootTimes bootTimes;
 void applyPreset(uint8_t presetId, uint8_t brightness);
 void setPower(bool power);
 void setBrightness(uint8_t brightness);
 void setEffect(uint8_t effect, const EffectParams& params);
 void setUserColor(const uint32_t* color, size_t count);
+// The state saved before a restart or power cut (see loadLastState()); a lit
+// state fades in from dark over the power-on transition time
+void restoreState(const SystemState& saved);
 void updateLEDs();
+// Apply the preset of the timer active now (skipped while a photoperiod curve runs)
+void checkSchedule();
+// checkSchedule() once, as soon as the time is valid after boot
+void checkAndApplyScheduleAfterBoot();
 
 #endif // STATE_H
@@ -0,0 +1,46 @@
+#pragma once
+
+#ifdef ESP32
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#endif
+
+// Guards state shared between loop() and the network tasks. On ESP32 the
+// AsyncTCP callbacks and the OTA task run on their own FreeRTOS tasks; on
+// ESP8266 (and the host) everything runs from one context and the lock is
+// free. Recursive, so a locked method may call another one. Hold it only
+// around the shared data, never while sending on a socket.
+class TaskLock {
+public:
+#ifdef ESP32
+    void lock() {
+        if (!_mutex) {
+            // First use may race; the loser's mutex is simply dropped
+            SemaphoreHandle_t m = xSemaphoreCreateRecursiveMutex();
+            portENTER_CRITICAL(&_init);
+            if (!_mutex) { _mutex = m; m = nullptr; }
+            portEXIT_CRITICAL(&_init);
+            if (m) vSemaphoreDelete(m);
+        }
+        xSemaphoreTakeRecursive(_mutex, portMAX_DELAY);
+    }
+    void unlock() { xSemaphoreGiveRecursive(_mutex); }
+private:
+    SemaphoreHandle_t _mutex = nullptr;
+    portMUX_TYPE _init = portMUX_INITIALIZER_UNLOCKED;
+#else
+    void lock() {}
+    void unlock() {}
+#endif
+};
+
+// Scoped hold of a TaskLock
+class TaskLockGuard {
+public:
+    explicit TaskLockGuard(TaskLock& lock) : _lock(lock) { _lock.lock(); }
+    ~TaskLockGuard() { _lock.unlock(); }
+    TaskLockGuard(const TaskLockGuard&) = delete;
+    TaskLockGuard& operator=(const TaskLockGuard&) = delete;
+private:
+    TaskLock& _lock;
+};
@@ -0,0 +1,50 @@
+#include "timezone.h"
+#include <string.h>
+
+// Generated by scripts/embed_assets.py from src/assets/timezones.json
+#include "inc/timezones_table.inc"
+
+const TimezoneInfo* findTimezone(const char* name) {
+    for (size_t i = 0; i < TIMEZONE_COUNT; ++i) {
+        if (strcmp(TIMEZONES[i].name, name) == 0) return &TIMEZONES[i];
+    }
+    return nullptr;
+}
+
+// Local wall-clock second (days since epoch * 86400 + time) of a rule in `year`
+static int64_t ruleLocalSeconds(const TzTransitionRule& rule, int32_t year) {
+    int32_t first = daysFromCivil(year, rule.month, 1);
+    int32_t day = first + (rule.weekday + 7 - weekdayFromDays(first)) % 7 + (rule.week - 1) * 7;
+    if (rule.week == 5) {
+        int32_t nextMonth = rule.month == 12 ? daysFromCivil(year + 1, 1, 1) : daysFromCivil(year, rule.month + 1, 1);
+        while (day >= nextMonth) day -= 7;
+    }
+    return (int64_t)day * 86400 + rule.time;
+}
+
+int32_t timezoneOffsetAt(const TimezoneInfo& tz, bool applyDst, uint32_t utc, uint32_t& validUntil) {
+    validUntil = UINT32_MAX;
+    if (!tz.hasDst || !applyDst) return tz.stdOffset;
+
+    int32_t year;
+    uint8_t month, day;
+    civilFromDays((int32_t)(utc / 86400), year, month, day);
+
+    // Transitions of this and the next year as UTC instants; the start is given
+    // in standard time, the end in daylight time
+    int64_t t = utc;
+    int64_t next = INT64_MAX;
+    bool inDst = false;
+    for (int32_t y = year - 1; y <= year + 1; ++y) {
+        int64_t start = ruleLocalSeconds(tz.dstStart, y) - tz.stdOffset;
+        int64_t end = ruleLocalSeconds(tz.dstEnd, y) - tz.dstOffset;
+        // The latest transition at or before t decides the current offset
+        if (start <= t && end <= t) inDst = start > end;
+        else if (start <= t) inDst = true;
+        else if (end <= t) inDst = false;
+        if (start > t && start < next) next = start;
+        if (end > t && end < next) next = end;
+    }
+    if (next < (int64_t)UINT32_MAX) validUntil = (uint32_t)next;
+    return inDst ? tz.dstOffset : tz.stdOffset;
+}
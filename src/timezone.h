@@ -0,0 +1,59 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+// POSIX "Mm.w.d/time" transition: weekday d (0 = Sunday) of week w (5 = last)
+// of month m, at `time` seconds after local midnight (may exceed 24h)
+struct TzTransitionRule {
+    uint8_t month;
+    uint8_t week;
+    uint8_t weekday;
+    int32_t time;
+};
+
+// One zone, precompiled from timezones.json by embed_assets.py
+struct TimezoneInfo {
+    const char* name;
+    int32_t stdOffset;   // seconds east of UTC
+    int32_t dstOffset;   // seconds east of UTC while DST is in effect
+    bool hasDst;
+    TzTransitionRule dstStart;
+    TzTransitionRule dstEnd;
+};
+
+extern const TimezoneInfo TIMEZONES[];
+extern const size_t TIMEZONE_COUNT;
+
+// nullptr when the name is unknown
+const TimezoneInfo* findTimezone(const char* name);
+
+// UTC offset in effect at `utc` (Unix seconds). `validUntil` receives the next
+// transition so callers can cache the result until then.
+int32_t timezoneOffsetAt(const TimezoneInfo& tz, bool applyDst, uint32_t utc, uint32_t& validUntil);
+
+// Proleptic Gregorian calendar helpers (days since 1970-01-01)
+inline int32_t daysFromCivil(int32_t y, uint32_t m, uint32_t d) {
+    y -= m <= 2;
+    const int32_t era = (y >= 0 ? y : y - 399) / 400;
+    const uint32_t yoe = (uint32_t)(y - era * 400);
+    const uint32_t doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    const uint32_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + (int32_t)doe - 719468;
+}
+
+inline void civilFromDays(int32_t z, int32_t& y, uint8_t& m, uint8_t& d) {
+    z += 719468;
+    const int32_t era = (z >= 0 ? z : z - 146096) / 146097;
+    const uint32_t doe = (uint32_t)(z - era * 146097);
+    const uint32_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    const uint32_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    const uint32_t mp = (5 * doy + 2) / 153;
+    d = (uint8_t)(doy - (153 * mp + 2) / 5 + 1);
+    m = (uint8_t)(mp < 10 ? mp + 3 : mp - 9);
+    y = (int32_t)yoe + era * 400 + (m <= 2);
+}
+
+// 0 = Sunday
+inline uint8_t weekdayFromDays(int32_t z) {
+    return (uint8_t)(z >= -4 ? (z + 4) % 7 : (z + 5) % 7 + 6);
+}
@@ -3,6 +3,7 @@
 #include "transition.h"
 #include "bus_manager.h"
 #include "colors.h"
+#include "sim_clock.h"
 void TransitionEngine::abortTransition() {
     _active = false;
     _phase = Phase::None;
@@ -19,7 +20,7 @@ void TransitionEngine::startEffectAndBrightnessTransition(uint8_t targetBrightne
     _targetColor1 = targetColor1;
     _startColor2 = _currentColor2;
     _targetColor2 = targetColor2;
-    _startTime = millis();
+    _startTime = controlMillis();
     _duration = duration;
     _active = true;
 }
@@ -82,7 +83,7 @@ void TransitionEngine::startTransition(uint8_t targetBrightness, uint32_t durati
     // Always start a transition, even if brightness does not change, to allow color transitions
     _startBrightness = _currentBrightness;
     _targetBrightness = targetBrightness;
-    _startTime = millis();
+    _startTime = controlMillis();
     _duration = duration < ABSOLUTE_MIN_TRANSITION ? ABSOLUTE_MIN_TRANSITION : duration;
     _active = true;
 }
@@ -100,7 +101,7 @@ void TransitionEngine::update() {
         return;
     }
 
-    uint32_t elapsed = millis() - _startTime;
+    uint32_t elapsed = controlMillis() - _startTime;
     if (elapsed >= _duration) {
         _currentBrightness = _targetBrightness;
         _currentColor1 = _targetColor1;
@@ -9,6 +9,8 @@
 #include "inc/config_js.inc"
 
 #include <Ticker.h>
+#include <algorithm>
+#include <memory>
 #include <LittleFS.h>
 #include <WiFiClientSecure.h>
 
@@ -21,9 +23,15 @@
 #include "effects.h"
 #include "transition.h"
 #include "presets.h"
+#include "photoperiod.h"
 #include "state.h"
+#include "loop_scheduler.h"
+#include "persistence.h"
+#include "frame_cache.h"
 #include "version.h"
 #include "ota.h"
+#include "bus_manager.h"
+#include "json_stream.h"
 #include "webserver.h"
 
 // Stub implementations for OTA memory management hooks
@@ -42,6 +50,7 @@ static const size_t CORS_HEADER_COUNT = sizeof(CORS_HEADERS) / sizeof(CORS_HEADE
 
 extern TransitionEngine transition;
 extern SystemState state;
+extern BusManager busManager;
 
 // Helper: URL decode for form fields (declaration)
 static String urlDecode(const String& input);
@@ -62,35 +71,67 @@ void WebServerManager::broadcastOtaStatus(const String& status, const String& me
     if (_ws) _ws->textAll(json);
 }
 
-// Helper: Extract JSON body from POST request (for upload handler)
-static String extractJsonBody(AsyncWebServerRequest* request, uint8_t* data, size_t len) {
-    String jsonStr;
-    if (len > 0 && data != nullptr) {
-        for (size_t i = 0; i < len; ++i) jsonStr += (char)data[i];
-    } else {
-        jsonStr = request->arg("plain");
+// Helper: Serve a build-time gzipped asset; answers 304 when the browser's copy is current
+static void sendGzipAsset(AsyncWebServerRequest* request, const char* contentType, const uint8_t* data, size_t len, const char* etag) {
+    if (request->hasHeader("If-None-Match") && request->getHeader("If-None-Match")->value() == etag) {
+        AsyncWebServerResponse *resp = request->beginResponse(304);
+        resp->addHeader("ETag", etag);
+        request->send(resp);
+        return;
+    }
+    AsyncWebServerResponse *resp = request->beginResponse_P(200, contentType, data, len);
+    resp->addHeader("Content-Encoding", "gzip");
+    resp->addHeader("ETag", etag);
+    // Revalidate on every load; the 304 path keeps that to a few bytes
+    resp->addHeader("Cache-Control", "no-cache");
+    request->send(resp);
+}
+
+// Helper: Stream a JSON document through a chunked response, one fragment in memory at a time
+static void sendJsonStream(AsyncWebServerRequest* request, JsonFragmentProducer producer) {
+    std::shared_ptr<JsonStreamWriter> writer = std::make_shared<JsonStreamWriter>(producer);
+    AsyncWebServerResponse *resp = request->beginChunkedResponse("application/json", [writer](uint8_t* buffer, size_t maxLen, size_t) -> size_t {
+        return writer->fill(buffer, maxLen);
+    });
+    for (size_t i = 0; i < CORS_HEADER_COUNT; ++i) resp->addHeader(CORS_HEADERS[i][0], CORS_HEADERS[i][1]);
+    request->send(resp);
+}
+
+// Helper: Collect a POST body that may arrive in several chunks. The buffer is
+// sized from `total` once and lives in request->_tempObject, which the request
+// frees. Returns the NUL-terminated body on the final chunk, nullptr before
+// that or when the body was rejected (a 413 has then been sent).
+static uint8_t* accumulateBody(AsyncWebServerRequest* request, uint8_t* data, size_t len, size_t index, size_t total) {
+    if (index == 0) {
+        if (total > MAX_REQUEST_BODY) {
+            AsyncWebServerResponse *resp = request->beginResponse(413, "application/json", "{\"error\":\"Request body too large\"}");
+            for (size_t i = 0; i < CORS_HEADER_COUNT; ++i) resp->addHeader(CORS_HEADERS[i][0], CORS_HEADERS[i][1]);
+            request->send(resp);
+            return nullptr;
+        }
+        request->_tempObject = malloc(total + 1);
     }
-    return jsonStr;
+    uint8_t* body = (uint8_t*)request->_tempObject;
+    if (!body || index + len > total) return nullptr;
+    memcpy(body + index, data, len);
+    if (index + len < total) return nullptr;
+    body[total] = '\0';
+    return body;
 }
 
-// Helper: Extract POST body for main POST handler
+// Helper: Extract POST body for main POST handler (form-encoded fallback)
 static String extractPostBody(AsyncWebServerRequest* request) {
     String body = request->arg("plain");
     if (body.length() == 0 && request->params() > 0) {
         body = request->getParam((size_t)0)->value();
     }
-    if (body.length() == 0) {
-        if (request->_tempObject && ((String*)request->_tempObject)->length() > 0) {
-            body = *((String*)request->_tempObject);
-        }
-    }
     return body;
 }
 
 // Helper: Deserialize JSON and handle error response
 template<typename TDoc>
-static bool parseJsonOrRespond(AsyncWebServerRequest* request, const String& jsonStr, TDoc& doc) {
-    DeserializationError error = deserializeJson(doc, jsonStr);
+static bool parseJsonOrRespond(AsyncWebServerRequest* request, const uint8_t* data, size_t len, TDoc& doc) {
+    DeserializationError error = deserializeJson(doc, (const char*)data, len);
     if (error) {
         AsyncWebServerResponse *resp = request->beginResponse(400, "application/json", "{\"error\":\"Invalid JSON\"}");
         for (size_t i = 0; i < CORS_HEADER_COUNT; ++i) resp->addHeader(CORS_HEADERS[i][0], CORS_HEADERS[i][1]);
@@ -134,6 +175,10 @@ static String urlDecode(const String& input) {
 }
 
 
+static void removeClientId(std::vector<uint32_t>& ids, uint32_t id) {
+    ids.erase(std::remove(ids.begin(), ids.end(), id), ids.end());
+}
+
 WebServerManager::WebServerManager(Configuration* config, Scheduler* scheduler) {
     _config = config;
     _scheduler = scheduler;
@@ -149,17 +194,35 @@ void WebServerManager::begin() {
 }
 
 void WebServerManager::update() {
-    _ws->cleanupClients();
     // No periodic broadcast; state is sent only on connection and on actual changes
+    flushBroadcast();
+}
+
+void WebServerManager::cleanupClients() {
+    _ws->cleanupClients();
 }
 
 void WebServerManager::setupWebSocket() {
     _ws->onEvent([this](AsyncWebSocket* server, AsyncWebSocketClient* client, 
                      AwsEventType type, void* arg, uint8_t* data, size_t len) {
         if (type == WS_EVT_CONNECT) {
-            // Send current state immediately to the new client
+            // Every client starts on JSON until it sends WS_MSG_HELLO
+            {
+                TaskLockGuard guard(_clientsLock);
+                _jsonClients.push_back(client->id());
+            }
             client->text(getStateJSON());
         } else if (type == WS_EVT_DISCONNECT) {
+            TaskLockGuard guard(_clientsLock);
+            removeClientId(_jsonClients, client->id());
+            removeClientId(_binaryClients, client->id());
+            removeClientId(_previewClients, client->id());
+        } else if (type == WS_EVT_DATA) {
+            AwsFrameInfo* info = (AwsFrameInfo*)arg;
+            // Commands are a few bytes; only accept complete single-frame binary messages
+            if (info->final && info->index == 0 && info->len == len && info->opcode == WS_BINARY) {
+                handleWsBinary(client, data, len);
+            }
         }
     });
     _server->addHandler(_ws);
@@ -213,13 +276,15 @@ void WebServerManager::setupRoutes() {
         AsyncWebServerResponse *resp = request->beginResponse(200, "application/json", "{\"success\":true,\"message\":\"Rebooting\"}");
         for (size_t i = 0; i < CORS_HEADER_COUNT; ++i) resp->addHeader(CORS_HEADERS[i][0], CORS_HEADERS[i][1]);
         request->send(resp);
-        request->onDisconnect([]() { delay(100); ESP.restart(); });
+        request->onDisconnect([]() { persistence.requestRestart(100); });
     },
         NULL,
-        [logRequest](AsyncWebServerRequest* request, uint8_t* data, size_t len, size_t, size_t) {
+        [logRequest](AsyncWebServerRequest* request, uint8_t* data, size_t len, size_t index, size_t total) {
+            uint8_t* body = accumulateBody(request, data, len, index, total);
+            if (!body) return;
             logRequest(request);
             StaticJsonDocument<128> doc;
-            DeserializationError error = deserializeJson(doc, data, len);
+            DeserializationError error = deserializeJson(doc, (const char*)body, total);
             String respJson;
             int status = 200;
             if (error || !doc.containsKey("command")) {
@@ -241,7 +306,7 @@ void WebServerManager::setupRoutes() {
             if (!error && doc.containsKey("command")) {
                 String cmd = doc["command"].as<String>();
                 if (cmd == "reboot") {
-                    request->onDisconnect([]() { delay(100); ESP.restart(); });
+                    request->onDisconnect([]() { persistence.requestRestart(100); });
                 }
             }
         }
@@ -265,10 +330,7 @@ void WebServerManager::setupRoutes() {
             for (size_t i = 0; i < CORS_HEADER_COUNT; ++i) resp->addHeader(CORS_HEADERS[i][0], CORS_HEADERS[i][1]);
             request->send(resp);
             if (!Update.hasError()) {
-                request->onDisconnect([]() {
-                    delay(100);
-                    ESP.restart();
-                });
+                request->onDisconnect([]() { persistence.requestRestart(100); });
             }
         },
         NULL,
@@ -307,11 +369,11 @@ void WebServerManager::setupRoutes() {
     // Serve web assets from filesystem image
     _server->on("/", HTTP_GET, [logRequest](AsyncWebServerRequest* request) {
         logRequest(request);
-        request->send_P(200, "text/html", web_index_html, web_index_html_len);
+        sendGzipAsset(request, "text/html", web_index_html, web_index_html_len, web_index_html_etag);
     });
     _server->on("/index.html", HTTP_GET, [logRequest](AsyncWebServerRequest* request) {
         logRequest(request);
-        request->send_P(200, "text/html", web_index_html, web_index_html_len);
+        sendGzipAsset(request, "text/html", web_index_html, web_index_html_len, web_index_html_etag);
     });
     // Serve WiFi page for POST: robust handler parses body manually
     _server->on("/wifi", HTTP_POST, 
@@ -324,23 +386,22 @@ void WebServerManager::setupRoutes() {
                 String ssid = urlDecode(request->getParam("ssid", true)->value());
                 String password = request->hasParam("password", true) ? urlDecode(request->getParam("password", true)->value()) : "";
                 if (ssid.length() > 0) {
-                    _config->network.ssid = ssid;
-                    _config->network.password = password;
-                    _config->save();
+                    updateField(_config->network.ssid, ssid, _config->gen.network);
+                    updateField(_config->network.password, password, _config->gen.network);
                     String html = "<html><body><h2>Connecting to WiFi...</h2><p>Device will reboot if successful.</p></body></html>";
                     request->send(200, "text/html", html);
-                    delay(1000);
-                    ESP.restart();
+                    persistence.requestRestart(1000);
                     return;
                 }
-                request->send_P(200, "text/html", web_wifi_html, web_wifi_html_len);
+                sendGzipAsset(request, "text/html", web_wifi_html, web_wifi_html_len, web_wifi_html_etag);
             }
         }, 
         nullptr,
-        [this, logRequest](AsyncWebServerRequest* request, uint8_t* data, size_t len, size_t, size_t) {
+        [this, logRequest](AsyncWebServerRequest* request, uint8_t* data, size_t len, size_t index, size_t total) {
+            uint8_t* raw = accumulateBody(request, data, len, index, total);
+            if (!raw) return;
             logRequest(request);
-            String body;
-            for (size_t i = 0; i < len; ++i) body += (char)data[i];
+            String body((const char*)raw);
             String ssid, password;
             int ssidIdx = body.indexOf("ssid=");
             int passIdx = body.indexOf("password=");
@@ -353,38 +414,36 @@ void WebServerManager::setupRoutes() {
                 password = urlDecode(body.substring(passIdx + 9, amp == -1 ? body.length() : amp));
             }
             if (ssid.length() > 0) {
-                _config->network.ssid = ssid;
-                _config->network.password = password;
-                _config->save();
+                updateField(_config->network.ssid, ssid, _config->gen.network);
+                updateField(_config->network.password, password, _config->gen.network);
                 String html = "<html><body><h2>Connecting to WiFi...</h2><p>Device will reboot if successful.</p></body></html>";
                 request->send(200, "text/html", html);
-                delay(1000);
-                ESP.restart();
+                persistence.requestRestart(1000);
                 return;
             }
-            request->send_P(200, "text/html", web_wifi_html, web_wifi_html_len);
+            sendGzipAsset(request, "text/html", web_wifi_html, web_wifi_html_len, web_wifi_html_etag);
         }
     );
     // For GET, serve the WiFi form
     _server->on("/wifi", HTTP_GET, [logRequest](AsyncWebServerRequest* request) {
         logRequest(request);
-        request->send_P(200, "text/html", web_wifi_html, web_wifi_html_len);
+        sendGzipAsset(request, "text/html", web_wifi_html, web_wifi_html_len, web_wifi_html_etag);
     });
     _server->on("/app.js", HTTP_GET, [logRequest](AsyncWebServerRequest* request) {
         logRequest(request);
-        request->send_P(200, "application/javascript", web_app_js, web_app_js_len);
+        sendGzipAsset(request, "application/javascript", web_app_js, web_app_js_len, web_app_js_etag);
     });
     _server->on("/config.html", HTTP_GET, [logRequest](AsyncWebServerRequest* request) {
         logRequest(request);
-        request->send_P(200, "text/html", web_config_html, web_config_html_len);
+        sendGzipAsset(request, "text/html", web_config_html, web_config_html_len, web_config_html_etag);
     });
     _server->on("/config.js", HTTP_GET, [logRequest](AsyncWebServerRequest* request) {
         logRequest(request);
-        request->send_P(200, "application/javascript", web_config_js, web_config_js_len);
+        sendGzipAsset(request, "application/javascript", web_config_js, web_config_js_len, web_config_js_etag);
     });
     _server->on("/style.css", HTTP_GET, [logRequest](AsyncWebServerRequest* request) {
         logRequest(request);
-        request->send_P(200, "text/css", web_style_css, web_style_css_len);
+        sendGzipAsset(request, "text/css", web_style_css, web_style_css_len, web_style_css_etag);
     });
 
     // State API
@@ -409,10 +468,11 @@ void WebServerManager::setupRoutes() {
         },
         nullptr,
         // Upload handler for application/json
-        [this, logRequest](AsyncWebServerRequest* request, uint8_t* data, size_t len, size_t, size_t) {
+        [this, logRequest](AsyncWebServerRequest* request, uint8_t* data, size_t len, size_t index, size_t total) {
+            uint8_t* body = accumulateBody(request, data, len, index, total);
+            if (!body) return;
             logRequest(request);
-            String body = extractJsonBody(request, data, len);
-            handleSetState(request, (uint8_t*)body.c_str(), body.length());
+            handleSetState(request, body, total);
         }
     );
 
@@ -452,10 +512,11 @@ void WebServerManager::setupRoutes() {
         },
         nullptr,
         // Upload handler for application/json
-        [this, logRequest](AsyncWebServerRequest* request, uint8_t* data, size_t len, size_t, size_t) {
+        [this, logRequest](AsyncWebServerRequest* request, uint8_t* data, size_t len, size_t index, size_t total) {
+            uint8_t* body = accumulateBody(request, data, len, index, total);
+            if (!body) return;
             logRequest(request);
-            String body = extractJsonBody(request, data, len);
-            handleSetPreset(request, (uint8_t*)body.c_str(), body.length());
+            handleSetPreset(request, body, total);
         }
     );
     
@@ -468,9 +529,10 @@ void WebServerManager::setupRoutes() {
     });
     _server->on("/api/config", HTTP_GET, [this, logRequest](AsyncWebServerRequest* request) {
         logRequest(request);
-        AsyncWebServerResponse *resp = request->beginResponse(200, "application/json", _config->toJsonString());
-        for (size_t i = 0; i < CORS_HEADER_COUNT; ++i) resp->addHeader(CORS_HEADERS[i][0], CORS_HEADERS[i][1]);
-        request->send(resp);
+        Configuration* config = _config;
+        sendJsonStream(request, [config](JsonStreamState& state, char* buf, size_t size, size_t& len) {
+            return config->writeJsonFragment(state, buf, size, len);
+        });
     });
     _server->on("/api/config", HTTP_POST,
         [this, logRequest](AsyncWebServerRequest* request) {
@@ -481,27 +543,23 @@ void WebServerManager::setupRoutes() {
         },
         nullptr,
         // Upload handler for application/json
-        [this, logRequest](AsyncWebServerRequest* request, uint8_t* data, size_t len, size_t, size_t) {
+        [this, logRequest](AsyncWebServerRequest* request, uint8_t* data, size_t len, size_t index, size_t total) {
+            uint8_t* body = accumulateBody(request, data, len, index, total);
+            if (!body) return;
             logRequest(request);
-            String body = extractJsonBody(request, data, len);
-            handleSetConfig(request, (uint8_t*)body.c_str(), body.length());
+            handleSetConfig(request, body, total);
         }
     );
 
     // Factory Reset API
-    _server->on("/api/factory_reset", HTTP_POST, [this, logRequest](AsyncWebServerRequest* request) {
+    _server->on("/api/factory_reset", HTTP_POST, [logRequest](AsyncWebServerRequest* request) {
         logRequest(request);
-        bool ok = _config->factoryReset();
-        if (ok) {
-            AsyncWebServerResponse *resp = request->beginResponse(200, "application/json", "{\"success\":true,\"message\":\"Factory reset complete, rebooting...\"}");
-            for (size_t i = 0; i < CORS_HEADER_COUNT; ++i) resp->addHeader(CORS_HEADERS[i][0], CORS_HEADERS[i][1]);
-            request->send(resp);
-            request->onDisconnect([]() { delay(100); ESP.restart(); });
-        } else {
-            AsyncWebServerResponse *resp = request->beginResponse(500, "application/json", "{\"success\":false,\"error\":\"Failed to delete config file\"}");
-            for (size_t i = 0; i < CORS_HEADER_COUNT; ++i) resp->addHeader(CORS_HEADERS[i][0], CORS_HEADERS[i][1]);
-            request->send(resp);
-        }
+        // The files are removed by loop() right before the restart, so no
+        // pending save can write them back
+        AsyncWebServerResponse *resp = request->beginResponse(200, "application/json", "{\"success\":true,\"message\":\"Factory reset, rebooting...\"}");
+        for (size_t i = 0; i < CORS_HEADER_COUNT; ++i) resp->addHeader(CORS_HEADERS[i][0], CORS_HEADERS[i][1]);
+        request->send(resp);
+        request->onDisconnect([]() { persistence.requestFactoryReset(100); });
     });
 
     // Timers API
@@ -523,11 +581,39 @@ void WebServerManager::setupRoutes() {
         request->send(resp);
     });
     _server->on("/api/timer", HTTP_POST, nullptr, nullptr,
-        [this, logRequest](AsyncWebServerRequest* request, uint8_t* data, size_t len, size_t, size_t) {
+        [this, logRequest](AsyncWebServerRequest* request, uint8_t* data, size_t len, size_t index, size_t total) {
+            uint8_t* body = accumulateBody(request, data, len, index, total);
+            if (!body) return;
+            logRequest(request);
+            handleSetTimer(request, body, total);
+        }
+    );
+    // Photoperiod curve API
+    _server->on("/api/photoperiod", HTTP_OPTIONS, [logRequest](AsyncWebServerRequest* request) {
+        logRequest(request);
+        AsyncWebServerResponse *resp = request->beginResponse(204);
+        for (size_t i = 0; i < CORS_HEADER_COUNT; ++i) resp->addHeader(CORS_HEADERS[i][0], CORS_HEADERS[i][1]);
+        request->send(resp);
+    });
+    _server->on("/api/photoperiod", HTTP_GET, [this, logRequest](AsyncWebServerRequest* request) {
+        logRequest(request);
+        handleGetPhotoperiod(request);
+    });
+    _server->on("/api/photoperiod", HTTP_POST, nullptr, nullptr,
+        [this, logRequest](AsyncWebServerRequest* request, uint8_t* data, size_t len, size_t index, size_t total) {
+            uint8_t* body = accumulateBody(request, data, len, index, total);
+            if (!body) return;
             logRequest(request);
-            handleSetTimer(request, data, len);
+            handleSetPhotoperiod(request, body, total);
         }
     );
+    // Performance counters API
+    _server->on("/api/perf", HTTP_GET, [this, logRequest](AsyncWebServerRequest* request) {
+        logRequest(request);
+        AsyncWebServerResponse *resp = request->beginResponse(200, "application/json", getPerfJSON());
+        for (size_t i = 0; i < CORS_HEADER_COUNT; ++i) resp->addHeader(CORS_HEADERS[i][0], CORS_HEADERS[i][1]);
+        request->send(resp);
+    });
     // Supported timezones API
     _server->on("/api/timezones", HTTP_GET, [this, logRequest](AsyncWebServerRequest* request) {
         logRequest(request);
@@ -555,33 +641,24 @@ void WebServerManager::handleGetState(AsyncWebServerRequest* request) {
 
 void WebServerManager::handleSetState(AsyncWebServerRequest* request, uint8_t* data, size_t len) {
     StaticJsonDocument<512> doc;
-    String jsonStr = extractJsonBody(request, data, len);
-    if (!parseJsonOrRespond(request, jsonStr, doc)) return;
+    if (!parseJsonOrRespond(request, data, len, doc)) return;
 
     // Only update fields present in the request
     bool updated = false;
     if (doc.containsKey("brightness")) {
-        uint8_t brightness = percentToHex(doc["brightness"]);
-        applyBrightnessLimit(brightness);
-        applyTransitionTimeLimit(state.transitionTime);
-        if (_brightnessCallback) _brightnessCallback(brightness);
+        controlBrightness((uint8_t)doc["brightness"]);
         updated = true;
     }
     if (doc.containsKey("transitionTime")) {
-        uint32_t transitionTime = (uint32_t)doc["transitionTime"];
-        applyTransitionTimeLimit(transitionTime);
-        applyBrightnessLimit(state.brightness);
-        state.transitionTime = transitionTime;
+        controlTransitionTime((uint32_t)doc["transitionTime"]);
         updated = true;
     }
     if (doc.containsKey("power")) {
-        bool power = doc["power"];
-        if (_powerCallback) _powerCallback(power);
+        controlPower(doc["power"]);
         updated = true;
     }
     if (doc.containsKey("effect")) {
-        uint8_t effect = (uint8_t)(int)doc["effect"];
-        if (_effectCallback) _effectCallback(effect, state.params);
+        controlEffect((uint8_t)(int)doc["effect"]);
         updated = true;
     }
     if (doc.containsKey("params")) {
@@ -589,29 +666,15 @@ void WebServerManager::handleSetState(AsyncWebServerRequest* request, uint8_t* d
         EffectParams params = state.params;
         if (paramsObj.containsKey("speed") && !paramsObj["speed"].isNull()) {
             params.speed = percentToHex((uint8_t)paramsObj["speed"]); // convert percent to 8-bit
-            updated = true;
         }
         if (paramsObj.containsKey("intensity") && !paramsObj["intensity"].isNull()) {
             params.intensity = percentToHex((uint8_t)paramsObj["intensity"]);
-            updated = true;
         }
         if (paramsObj.containsKey("colors")) {
-            JsonArray colorsArr = paramsObj["colors"].as<JsonArray>();
-            std::vector<String> parsedColors;
-            for (JsonVariant v : colorsArr) {
-                if (v.is<const char*>()) {
-                    String hex = v.as<const char*>();
-                    if (hex.length() == 6 && hex[0] != '#') {
-                        hex = "#" + hex;
-                    }
-                    parsedColors.push_back(hex);
-                }
-            }
-            params.colors = parsedColors;
-            state.params.colors = parsedColors;
-            updated = true;
+            paramsColorsFromJson(params, paramsObj["colors"].as<JsonArrayConst>());
         }
-        if (updated && _effectCallback) _effectCallback(state.effect, params);
+        controlParams(params);
+        updated = true;
     }
 
     if (updated) {
@@ -622,12 +685,109 @@ void WebServerManager::handleSetState(AsyncWebServerRequest* request, uint8_t* d
     request->send(resp);
 }
 
-void WebServerManager::handleGetPresets(AsyncWebServerRequest* request) {
-    {
-        AsyncWebServerResponse *resp = request->beginResponse(200, "application/json", getPresetsJSON());
-        for (size_t i = 0; i < CORS_HEADER_COUNT; ++i) resp->addHeader(CORS_HEADERS[i][0], CORS_HEADERS[i][1]);
-        request->send(resp);
+void WebServerManager::controlBrightness(uint8_t percent) {
+    uint8_t brightness = percentToHex(percent);
+    applyBrightnessLimit(brightness);
+    applyTransitionTimeLimit(state.transitionTime);
+    if (_brightnessCallback) _brightnessCallback(brightness);
+}
+
+void WebServerManager::controlTransitionTime(uint32_t transitionTime) {
+    applyTransitionTimeLimit(transitionTime);
+    applyBrightnessLimit(state.brightness);
+    updateField(state.transitionTime, transitionTime, state.gen.transition);
+}
+
+void WebServerManager::controlPower(bool power) {
+    if (_powerCallback) _powerCallback(power);
+}
+
+void WebServerManager::controlEffect(uint8_t effect) {
+    if (_effectCallback) _effectCallback(effect, state.params);
+}
+
+// params carries speed/intensity as hex, already merged over state.params
+void WebServerManager::controlParams(const EffectParams& params) {
+    if (!params.colorsEqual(state.params)) {
+        state.params.colorCount = params.colorCount;
+        state.params.colors = params.colors;
+        ++state.gen.effect;
     }
+    if (_effectCallback) _effectCallback(state.effect, params);
+}
+
+bool WebServerManager::controlPreset(uint8_t presetId) {
+    if (!presetStore.exists(presetId)) return false;
+    if (_presetCallback) _presetCallback(presetId);
+    return true;
+}
+
+void WebServerManager::handleWsBinary(AsyncWebSocketClient* client, const uint8_t* data, size_t len) {
+    WsCommand cmd;
+    if (!decodeWsCommand(data, len, cmd)) {
+        debugPrintln("[WS] Ignoring malformed binary message");
+        return;
+    }
+    switch (cmd.type) {
+        case WS_MSG_HELLO: {
+            {
+                TaskLockGuard guard(_clientsLock);
+                removeClientId(_jsonClients, client->id());
+                if (std::find(_binaryClients.begin(), _binaryClients.end(), client->id()) == _binaryClients.end()) {
+                    _binaryClients.push_back(client->id());
+                }
+            }
+            // Full state first; later broadcasts only carry the changed fields
+            StateSnapshot snap;
+            captureStateSnapshot(snap);
+            uint8_t out[WS_STATE_MESSAGE_MAX];
+            size_t n = encodeStateMessage(snap, WS_FIELD_ALL, out, sizeof(out));
+            if (n) client->binary(out, n);
+            return;
+        }
+        case WS_MSG_POWER:
+            controlPower(cmd.value != 0);
+            break;
+        case WS_MSG_BRIGHTNESS:
+            controlBrightness(cmd.value);
+            break;
+        case WS_MSG_EFFECT:
+            controlEffect(cmd.value);
+            break;
+        case WS_MSG_PARAMS: {
+            EffectParams params = state.params;
+            params.speed = percentToHex(cmd.params.speed);
+            params.intensity = percentToHex(cmd.params.intensity);
+            if (cmd.params.colorCount > 0) {
+                params.colorCount = cmd.params.colorCount;
+                params.colors = cmd.params.colors;
+            }
+            controlParams(params);
+            break;
+        }
+        case WS_MSG_PRESET:
+            if (!controlPreset(cmd.value)) return;
+            break;
+        case WS_MSG_TRANSITION:
+            controlTransitionTime(cmd.transitionTime);
+            break;
+        case WS_MSG_PREVIEW_SUBSCRIBE: {
+            TaskLockGuard guard(_clientsLock);
+            removeClientId(_previewClients, client->id());
+            if (cmd.value) {
+                _previewClients.push_back(client->id());
+                ++_previewSubscriptions;  // updatePreview() starts it on a keyframe
+            }
+            return;
+        }
+    }
+    broadcastState();
+}
+
+void WebServerManager::handleGetPresets(AsyncWebServerRequest* request) {
+    sendJsonStream(request, [](JsonStreamState& state, char* buf, size_t size, size_t& len) {
+        return writePresetsJsonFragment(presetStore, state, buf, size, len);
+    });
 }
 
 void WebServerManager::handleSetPreset(AsyncWebServerRequest* request, uint8_t* data, size_t len) {
@@ -635,8 +795,7 @@ void WebServerManager::handleSetPreset(AsyncWebServerRequest* request, uint8_t*
     try {
     #endif
         StaticJsonDocument<512> doc;
-        String jsonStr = extractJsonBody(request, data, len);
-        if (!parseJsonOrRespond(request, jsonStr, doc)) return;
+        if (!parseJsonOrRespond(request, data, len, doc)) return;
         if (!doc.containsKey("id")) {
             AsyncWebServerResponse *resp = request->beginResponse(400, "application/json", "{\"error\":\"Missing preset ID\"}");
             for (size_t i = 0; i < CORS_HEADER_COUNT; ++i) resp->addHeader(CORS_HEADERS[i][0], CORS_HEADERS[i][1]);
@@ -644,43 +803,36 @@ void WebServerManager::handleSetPreset(AsyncWebServerRequest* request, uint8_t*
             return;
         }
         int reqId = doc["id"].as<int>();
-        if (_config->presets.size() == 0) {
-            AsyncWebServerResponse *resp = request->beginResponse(400, "application/json", "{\"error\":\"No presets available\"}");
-            for (size_t i = 0; i < CORS_HEADER_COUNT; ++i) resp->addHeader(CORS_HEADERS[i][0], CORS_HEADERS[i][1]);
-            request->send(resp);
-            return;
-        }
-        auto it = std::find_if(_config->presets.begin(), _config->presets.end(), [reqId](const Preset& p) { return p.id == reqId; });
-        if (it == _config->presets.end()) {
+        bool apply = doc.containsKey("apply") && doc["apply"];
+        Preset preset;
+        bool found = reqId >= 0 && reqId < MAX_PRESETS && presetStore.get((uint8_t)reqId, preset);
+        // Saving to an unused id creates the preset; applying needs an existing one
+        if (reqId < 0 || reqId >= MAX_PRESETS || (apply && !found)) {
             AsyncWebServerResponse *resp = request->beginResponse(400, "application/json", "{\"error\":\"Invalid preset ID\"}");
             for (size_t i = 0; i < CORS_HEADER_COUNT; ++i) resp->addHeader(CORS_HEADERS[i][0], CORS_HEADERS[i][1]);
             request->send(resp);
             return;
         }
-        if (doc.containsKey("apply") && doc["apply"]) {
-            if (_presetCallback) _presetCallback(it->id);
+        if (apply) {
+            if (_presetCallback) _presetCallback(preset.id);
             AsyncWebServerResponse *resp = request->beginResponse(200, "application/json", "{\"success\":true}");
             for (size_t i = 0; i < CORS_HEADER_COUNT; ++i) resp->addHeader(CORS_HEADERS[i][0], CORS_HEADERS[i][1]);
             request->send(resp);
         } else {
-            it->name = doc["name"] | "";
-            it->effect = (uint8_t)(int)doc["effect"];
-            it->enabled = doc["enabled"] | true;
-            if (doc.containsKey("params")) {
-                JsonObject paramsObj = doc["params"];
-                it->params.speed = paramsObj["speed"].isNull() ? percentToHex(100) : percentToHex((uint8_t)paramsObj["speed"]);
-                it->params.intensity = paramsObj["intensity"].isNull() ? percentToHex(50) : percentToHex((uint8_t)paramsObj["intensity"]);
-                it->params.colors.clear();
-                if (paramsObj.containsKey("colors")) {
-                    JsonArray colorsArr = paramsObj["colors"].as<JsonArray>();
-                    for (JsonVariant v : colorsArr) {
-                        if (v.is<const char*>()) {
-                            it->params.colors.push_back(String(v.as<const char*>()));
-                        }
-                    }
-                }
+            if (!found) {
+                preset = Preset();
+                preset.id = (uint8_t)reqId;
             }
-            savePresets(_config->presets);
+            presetFromJson(preset, doc.as<JsonObjectConst>());
+            // Only this preset's slot is written, by the persistence service.
+            // Refused while the cache is full of edits it has not saved yet.
+            if (!presetStore.put(preset)) {
+                AsyncWebServerResponse *resp = request->beginResponse(503, "application/json", "{\"error\":\"Saving earlier preset changes, try again\"}");
+                for (size_t i = 0; i < CORS_HEADER_COUNT; ++i) resp->addHeader(CORS_HEADERS[i][0], CORS_HEADERS[i][1]);
+                request->send(resp);
+                return;
+            }
+            ++_config->gen.presets;
             AsyncWebServerResponse *resp = request->beginResponse(200, "application/json", "{\"success\":true}");
             for (size_t i = 0; i < CORS_HEADER_COUNT; ++i) resp->addHeader(CORS_HEADERS[i][0], CORS_HEADERS[i][1]);
             request->send(resp);
@@ -699,61 +851,69 @@ void WebServerManager::handleSetPreset(AsyncWebServerRequest* request, uint8_t*
 void WebServerManager::handleSetConfig(AsyncWebServerRequest* request, uint8_t* data, size_t len) {
     // Parse uploaded JSON
     DynamicJsonDocument doc(4096);
-    String jsonStr = extractJsonBody(request, data, len);
-    if (!parseJsonOrRespond(request, jsonStr, doc)) return;
-    // Load current config from file for comparison
-    DynamicJsonDocument currentDoc(4096);
-    bool loaded = _config->loadFromFile(CONFIG_FILE, currentDoc);
-    bool isDifferent = true;
-    if (loaded) {
-        String incoming, stored;
-        serializeJson(doc, incoming);
-        serializeJson(currentDoc, stored);
-        isDifferent = (incoming != stored);
-    }
-    if (!isDifferent) {
-        AsyncWebServerResponse *resp = request->beginResponse(200, "application/json", "{\"success\":true,\"message\":\"No changes detected\"}");
-        for (size_t i = 0; i < CORS_HEADER_COUNT; ++i) resp->addHeader(CORS_HEADERS[i][0], CORS_HEADERS[i][1]);
-        request->send(resp);
-        return;
-    }
+    if (!parseJsonOrRespond(request, data, len, doc)) return;
+    // Generations tell us whether anything actually changed, no need to re-read the file
+    uint32_t genBefore = _config->gen.total();
     // Accept and persist SSID/password if present in network object
     if (doc.containsKey("network")) {
         JsonObject netObj = doc["network"];
         if (netObj.containsKey("ssid")) {
-            _config->network.ssid = netObj["ssid"].as<String>();
+            updateField(_config->network.ssid, netObj["ssid"].as<String>(), _config->gen.network);
         }
         if (netObj.containsKey("password")) {
-            _config->network.password = netObj["password"].as<String>();
+            updateField(_config->network.password, netObj["password"].as<String>(), _config->gen.network);
         }
     }
     // Only update fields present in the uploaded JSON
     _config->partialUpdate(doc.as<JsonObject>());
-    bool saveResult = _config->save();
-    if (saveResult) {
-        if (_configCallback) _configCallback();
-        AsyncWebServerResponse *resp = request->beginResponse(200, "application/json", "{\"success\":true}");
-        for (size_t i = 0; i < CORS_HEADER_COUNT; ++i) resp->addHeader(CORS_HEADERS[i][0], CORS_HEADERS[i][1]);
-        request->send(resp);
-    } else {
-        AsyncWebServerResponse *resp = request->beginResponse(500, "application/json", "{\"success\":false,\"error\":\"Failed to save config\"}");
+    if (_config->gen.total() == genBefore) {
+        AsyncWebServerResponse *resp = request->beginResponse(200, "application/json", "{\"success\":true,\"message\":\"No changes detected\"}");
         for (size_t i = 0; i < CORS_HEADER_COUNT; ++i) resp->addHeader(CORS_HEADERS[i][0], CORS_HEADERS[i][1]);
         request->send(resp);
+        return;
     }
+    // The persistence service writes the record once edits settle
+    if (_configCallback) _configCallback();
+    AsyncWebServerResponse *resp = request->beginResponse(200, "application/json", "{\"success\":true}");
+    for (size_t i = 0; i < CORS_HEADER_COUNT; ++i) resp->addHeader(CORS_HEADERS[i][0], CORS_HEADERS[i][1]);
+    request->send(resp);
 }
 
-void WebServerManager::handleGetTimers(AsyncWebServerRequest* request) {
-    {
-        AsyncWebServerResponse *resp = request->beginResponse(200, "application/json", getTimersJSON());
+void WebServerManager::handleGetPhotoperiod(AsyncWebServerRequest* request) {
+    Configuration* config = _config;
+    sendJsonStream(request, [config](JsonStreamState& state, char* buf, size_t size, size_t& len) {
+        return writePhotoperiodJsonFragment(config->photoperiod, state, buf, size, len);
+    });
+}
+
+void WebServerManager::handleSetPhotoperiod(AsyncWebServerRequest* request, uint8_t* data, size_t len) {
+    DynamicJsonDocument doc(4096);
+    if (!parseJsonOrRespond(request, data, len, doc)) return;
+    PhotoperiodConfig curve = _config->photoperiod;
+    const char* error = photoperiodFromJson(curve, doc.as<JsonObjectConst>());
+    if (error) {
+        String body = String("{\"error\":\"") + error + "\"}";
+        AsyncWebServerResponse *resp = request->beginResponse(400, "application/json", body);
         for (size_t i = 0; i < CORS_HEADER_COUNT; ++i) resp->addHeader(CORS_HEADERS[i][0], CORS_HEADERS[i][1]);
         request->send(resp);
+        return;
     }
+    updateField(_config->photoperiod, curve, _config->gen.photoperiod);
+    AsyncWebServerResponse *resp = request->beginResponse(200, "application/json", "{\"success\":true}");
+    for (size_t i = 0; i < CORS_HEADER_COUNT; ++i) resp->addHeader(CORS_HEADERS[i][0], CORS_HEADERS[i][1]);
+    request->send(resp);
+}
+
+void WebServerManager::handleGetTimers(AsyncWebServerRequest* request) {
+    Configuration* config = _config;
+    sendJsonStream(request, [config](JsonStreamState& state, char* buf, size_t size, size_t& len) {
+        return config->writeTimersJsonFragment(state, buf, size, len);
+    });
 }
 
 void WebServerManager::handleSetTimer(AsyncWebServerRequest* request, uint8_t* data, size_t len) {
     StaticJsonDocument<512> doc;
-    String jsonStr = extractJsonBody(request, data, len);
-    if (!parseJsonOrRespond(request, jsonStr, doc)) return;
+    if (!parseJsonOrRespond(request, data, len, doc)) return;
     
     uint8_t timerId = doc["id"] | 0;
     
@@ -766,18 +926,19 @@ void WebServerManager::handleSetTimer(AsyncWebServerRequest* request, uint8_t* d
         return;
     }
     
-    _config->timers[timerId].enabled = doc["enabled"] | false;
-    _config->timers[timerId].type = (TimerType)(int)doc["type"];
-    _config->timers[timerId].hour = doc["hour"] | 0;
-    _config->timers[timerId].minute = doc["minute"] | 0;
-    _config->timers[timerId].presetId = doc["presetId"] | 0;
+    Timer timer = _config->timers[timerId];
+    timer.enabled = doc["enabled"] | false;
+    timer.type = (TimerType)(int)doc["type"];
+    timer.hour = doc["hour"] | 0;
+    timer.minute = doc["minute"] | 0;
+    timer.presetId = doc["presetId"] | 0;
     // Always store timer brightness as hex internally; convert from percent at API boundary
     if (doc.containsKey("brightness")) {
         uint8_t percent = doc["brightness"] | 100;
-        _config->timers[timerId].brightness = percentToHex(percent);
+        timer.brightness = percentToHex(percent);
     }
-    
-    _config->save();
+    // Written to flash by the persistence service once edits settle
+    updateField(_config->timers[timerId], timer, _config->gen.timers);
     
     {
         AsyncWebServerResponse *resp = request->beginResponse(200, "application/json", "{\"success\":true}");
@@ -786,96 +947,81 @@ void WebServerManager::handleSetTimer(AsyncWebServerRequest* request, uint8_t* d
     }
 }
 
-String WebServerManager::getStateJSON() {
-    StaticJsonDocument<512> doc;
+void WebServerManager::captureStateSnapshot(StateSnapshot& snap) {
     extern TransitionEngine transition;
     extern PendingTransitionState pendingTransition;
     // Only use pendingTransition for fields that actually change during a transition
     if (state.inTransition) {
-        doc["power"] = true;
-        doc["effect"] = pendingTransition.effect;
-        doc["preset"] = pendingTransition.preset;
-        JsonObject paramsObj = doc.createNestedObject("params");
-        paramsObj["speed"] = hexToPercent(pendingTransition.params.speed);
-        paramsObj["intensity"] = hexToPercent(pendingTransition.params.intensity);
-        JsonArray colorsArr = paramsObj.createNestedArray("colors");
-        for (const auto& c : pendingTransition.params.colors) {
-            colorsArr.add(c);
-        }
+        snap.power = true;
+        snap.effect = pendingTransition.effect;
+        snap.preset = pendingTransition.preset;
+        snap.params = pendingTransition.params;
     } else {
-        doc["power"] = state.power;
-        doc["effect"] = state.effect;
-        doc["preset"] = state.preset;
-        JsonObject paramsObj = doc.createNestedObject("params");
-        paramsObj["speed"] = hexToPercent(state.params.speed);
-        paramsObj["intensity"] = hexToPercent(state.params.intensity);
-        JsonArray colorsArr = paramsObj.createNestedArray("colors");
-        for (const auto& c : state.params.colors) {
-            colorsArr.add(c);
-        }
+        snap.power = state.power;
+        snap.effect = state.effect;
+        snap.preset = state.preset;
+        snap.params = state.params;
     }
     // These fields are always reported from state/transition engine
-    doc["brightness"] = hexToPercent(transition.getTargetBrightness());
-    doc["transitionTime"] = state.transitionTime;
+    snap.brightness = hexToPercent(transition.getTargetBrightness());
+    snap.transitionTime = state.transitionTime;
+    snap.secondOfDay = _scheduler->isTimeValid() ? _scheduler->getCurrentSecondOfDay() : WS_CLOCK_UNSYNCED;
+    snap.sunriseMinutes = _scheduler->_sunriseMinutes < 0 ? WS_MINUTES_UNKNOWN : (uint16_t)_scheduler->_sunriseMinutes;
+    snap.sunsetMinutes = _scheduler->_sunsetMinutes < 0 ? WS_MINUTES_UNKNOWN : (uint16_t)_scheduler->_sunsetMinutes;
+}
+
+void WebServerManager::buildStateJSON(JsonDocument& doc) {
+    StateSnapshot snap;
+    captureStateSnapshot(snap);
+    doc["power"] = snap.power;
+    doc["effect"] = snap.effect;
+    doc["preset"] = snap.preset;
+    JsonObject paramsObj = doc.createNestedObject("params");
+    paramsObj["speed"] = hexToPercent(snap.params.speed);
+    paramsObj["intensity"] = hexToPercent(snap.params.intensity);
+    paramsColorsToJson(snap.params, paramsObj.createNestedArray("colors"));
+    doc["brightness"] = snap.brightness;
+    doc["transitionTime"] = snap.transitionTime;
     doc["time"] = _scheduler->isTimeValid() ? _scheduler->getCurrentTime() : "--:--";
     doc["sunrise"] = _scheduler->getSunriseTime();
     doc["sunset"] = _scheduler->getSunsetTime();
-
-    String output;
-    serializeJson(doc, output);
-    return output;
 }
 
-String WebServerManager::getPresetsJSON() {
-    StaticJsonDocument<4096> doc;
-    JsonArray presetsArray = doc.createNestedArray("presets");
-    for (size_t i = 0; i < _config->getPresetCount(); i++) {
-        if (_config->presets[i].name.length() == 0 && i > 0) continue;
-        const auto& preset = _config->presets[i];
-        JsonObject presetObj = presetsArray.createNestedObject();
-        presetObj["id"] = i;
-        presetObj["name"] = preset.name;
-        presetObj["effect"] = preset.effect;
-        presetObj["enabled"] = preset.enabled;
-        JsonObject paramsObj = presetObj.createNestedObject("params");
-        paramsObj["speed"] = preset.params.speed;
-        paramsObj["intensity"] = hexToPercent(preset.params.intensity);
-        JsonArray colorsArr = paramsObj.createNestedArray("colors");
-        if (preset.params.colors.size() > 0) {
-            for (const auto& c : preset.params.colors) {
-                colorsArr.add(c);
-            }
-        }
-    }
+String WebServerManager::getStateJSON() {
+    StaticJsonDocument<512> doc;
+    buildStateJSON(doc);
     String output;
     serializeJson(doc, output);
     return output;
 }
 
-
-
-String WebServerManager::getTimersJSON() {
-    StaticJsonDocument<2048> doc;
-    JsonArray timersArray = doc.createNestedArray("timers");
-
-    for (size_t i = 0; i < _config->timers.size(); i++) {
-        // Only include timers that are enabled or have a nonzero hour/minute or non-empty name
-        const auto& t = _config->timers[i];
-        bool isActive = t.enabled || t.hour != 0 || t.minute != 0;
-    #ifdef TIMER_NAME_SUPPORT
-        isActive = isActive || (t.name && t.name[0] != '\0');
-    #endif
-        if (!isActive) continue;
-        JsonObject timerObj = timersArray.createNestedObject();
-        timerObj["id"] = i;
-        timerObj["enabled"] = t.enabled;
-        timerObj["type"] = t.type;
-        timerObj["hour"] = t.hour;
-        timerObj["minute"] = t.minute;
-        timerObj["presetId"] = t.presetId;
-        timerObj["brightness"] = hexToPercent(t.brightness);
+String WebServerManager::getPerfJSON() {
+    DynamicJsonDocument doc(3072);
+    JsonObject wsObj = doc.createNestedObject("broadcast");
+    wsObj["requested"] = _broadcastsRequested;
+    wsObj["sent"] = _broadcastsSent;
+    wsObj["intervalMs"] = _broadcastInterval;
+    wsObj["clients"] = _ws->count();
+    JsonObject previewObj = doc.createNestedObject("preview");
+    {
+        TaskLockGuard guard(_clientsLock);
+        wsObj["binaryClients"] = _binaryClients.size();
+        previewObj["clients"] = _previewClients.size();
     }
-
+    previewObj["pixels"] = _preview.pixelCount();
+    previewObj["frames"] = _preview.framesEncoded;
+    previewObj["keyframes"] = _preview.keyframesEncoded;
+    previewObj["bytes"] = _preview.bytesEncoded;
+    previewObj["bytesPerFrame"] = _preview.framesEncoded ? _preview.bytesEncoded / _preview.framesEncoded : 0;
+    previewObj["usPerFrame"] = _preview.framesEncoded ? _previewMicros / _preview.framesEncoded : 0;
+    previewObj["intervalMs"] = _previewInterval;
+    previewObj["dropped"] = _previewDropped;
+    JsonObject bootObj = doc.createNestedObject("boot");
+    bootObj["firstLightMs"] = bootTimes.firstLight;
+    bootObj["readyMs"] = bootTimes.ready;
+    loopScheduler.writeStats(doc.createNestedObject("loop"));
+    persistence.writeStats(doc.createNestedObject("persist"));
+    frameCache.writeStats(doc.createNestedObject("frameCache"));
     String output;
     serializeJson(doc, output);
     return output;
@@ -898,12 +1044,113 @@ bool WebServerManager::applyTransitionTimeLimit(uint32_t& transitionTime) {
 }
 
 void WebServerManager::broadcastState() {
+    ++_broadcastsRequested;
+    _broadcastPending = true;
+}
+
+// Send at most one state message per interval, however many setters asked for it
+void WebServerManager::flushBroadcast() {
+    if (!_broadcastPending) return;
+    uint32_t now = millis();
+    if (now - _lastBroadcast < _broadcastInterval) return;
+    _broadcastPending = false;
     // Sync config.state.brightness with transition engine before broadcasting
     extern TransitionEngine transition;
-    // Store as percent for reporting
-    state.brightness = transition.getCurrentBrightness();
-    String stateJSON = getStateJSON();
-    _ws->textAll(stateJSON);
+    updateField(state.brightness, transition.getCurrentBrightness(), state.gen.brightness);
+    // Skip serialization entirely when no state group changed since the last broadcast
+    uint32_t generation = state.gen.total();
+    if (generation == _lastBroadcastGeneration) return;
+    _lastBroadcastGeneration = generation;
+    _lastBroadcast = now;
+    StateSnapshot snap;
+    captureStateSnapshot(snap);
+    uint16_t mask = diffStateSnapshots(_lastSnapshot, snap);
+    _lastSnapshot = snap;
+    if (_ws->count() == 0) return;
+    std::vector<uint32_t> binaryClients, jsonClients;
+    {
+        TaskLockGuard guard(_clientsLock);
+        binaryClients = _binaryClients;
+        jsonClients = _jsonClients;
+    }
+    // Binary clients only get the fields that changed
+    if (!binaryClients.empty() && mask != 0) {
+        uint8_t out[WS_STATE_MESSAGE_MAX];
+        size_t n = encodeStateMessage(snap, mask, out, sizeof(out));
+        if (n && jsonClients.empty()) {
+            AsyncWebSocketMessageBuffer* buffer = _ws->makeBuffer(n);
+            if (buffer) {
+                memcpy(buffer->get(), out, n);
+                _ws->binaryAll(buffer);
+            }
+        } else if (n) {
+            for (uint32_t id : binaryClients) {
+                AsyncWebSocketClient* c = _ws->client(id);
+                if (c) c->binary(out, n);
+            }
+        }
+    }
+    if (!jsonClients.empty()) {
+        // Serialize once into a buffer shared by every JSON client
+        StaticJsonDocument<512> doc;
+        buildStateJSON(doc);
+        if (binaryClients.empty()) {
+            size_t len = measureJson(doc);
+            AsyncWebSocketMessageBuffer* buffer = _ws->makeBuffer(len);
+            if (!buffer) return;
+            serializeJson(doc, (char*)buffer->get(), len + 1);
+            _ws->textAll(buffer);
+        } else {
+            String json;
+            serializeJson(doc, json);
+            for (uint32_t id : jsonClients) {
+                AsyncWebSocketClient* c = _ws->client(id);
+                if (c) c->text(json);
+            }
+        }
+    }
+    ++_broadcastsSent;
+}
+
+// Streams the downsampled strip to subscribers, keeping capture + encode + send
+// under PREVIEW_FRAME_SHARE percent of wall time
+void WebServerManager::updatePreview() {
+    uint32_t now = millis();
+    if (now - _lastPreview < _previewInterval) return;
+    {
+        TaskLockGuard guard(_clientsLock);
+        if (_previewClients.empty()) return;
+        _previewTargets = _previewClients;
+        if (_previewSubscriptions != _previewSubscriptionsSeen) {
+            _previewSubscriptionsSeen = _previewSubscriptions;
+            _preview.requestKeyframe();
+        }
+    }
+    _lastPreview = now;
+    // Deltas assume every subscriber saw the previous frame; skip the whole frame
+    // if any queue is full and resync with a keyframe
+    for (uint32_t id : _previewTargets) {
+        AsyncWebSocketClient* c = _ws->client(id);
+        if (!c || !c->canSend()) {
+            ++_previewDropped;
+            _preview.requestKeyframe();
+            return;
+        }
+    }
+    uint32_t start = micros();
+    _preview.capture(busManager.getPixelCount(), [](uint16_t i) { return busManager.getPixelColor(i); });
+    _previewScratch.resize(_preview.maxMessageSize());
+    size_t n = _preview.encode(_previewScratch.data(), _previewScratch.size());
+    if (n) {
+        for (uint32_t id : _previewTargets) {
+            AsyncWebSocketClient* c = _ws->client(id);
+            if (c) c->binary(_previewScratch.data(), n);
+        }
+    }
+    uint32_t cost = micros() - start;
+    _previewMicros += cost;
+    uint32_t budgetInterval = cost * 100 / PREVIEW_FRAME_SHARE / 1000;
+    _previewInterval = budgetInterval > PREVIEW_INTERVAL ? budgetInterval : PREVIEW_INTERVAL;
 }
 
 void WebServerManager::onPowerChange(void (*callback)(bool)) {
@@ -10,6 +10,10 @@
 #include <ArduinoJson.h>
 #include "config.h"
 #include "scheduler.h"
+#include "ws_protocol.h"
+#include "preview.h"
+#include "task_lock.h"
+#include <vector>
 
 #ifndef WEBSERVER_H
 #define WEBSERVER_H
@@ -19,8 +23,15 @@ public:
     WebServerManager(Configuration* config, Scheduler* scheduler);
     
     void begin();
+    // Flushes coalesced state broadcasts; cheap, runs every loop pass
     void update();
+    // Live preview frames; background work between LED frames
+    void updatePreview();
+    // Frees closed WebSocket clients
+    void cleanupClients();
+    // Marks state dirty; the actual send is coalesced in update()
     void broadcastState();
+    void setBroadcastInterval(uint32_t intervalMs) { _broadcastInterval = intervalMs; }
 
     // OTA status broadcast
     void broadcastOtaStatus(const String& status, const String& message = "", int progress = -1);
@@ -43,6 +54,32 @@ private:
     AsyncWebSocket* _ws;
     
     uint32_t _lastBroadcast = 0;
+    uint32_t _lastBroadcastGeneration = 0; // state.gen.total() at the last broadcast
+    uint32_t _broadcastInterval = WS_BROADCAST_INTERVAL;
+    bool _broadcastPending = false;
+    uint32_t _broadcastsRequested = 0;
+    uint32_t _broadcastsSent = 0;
+
+    // Clients that negotiated the binary protocol (WS_MSG_HELLO) get deltas,
+    // the rest keep receiving full JSON state. The id lists change in the
+    // AsyncTCP callbacks and are read from loop(): touch them under
+    // _clientsLock only, and send from a copy.
+    TaskLock _clientsLock;
+    std::vector<uint32_t> _binaryClients;
+    std::vector<uint32_t> _jsonClients;
+    StateSnapshot _lastSnapshot;
+
+    // Live LED preview; nothing is captured while there are no subscribers
+    std::vector<uint32_t> _previewClients;
+    uint32_t _previewSubscriptions = 0;      // bumped under _clientsLock
+    uint32_t _previewSubscriptionsSeen = 0;
+    std::vector<uint32_t> _previewTargets;   // loop()'s copy of _previewClients
+    PreviewEncoder _preview;
+    std::vector<uint8_t> _previewScratch;
+    uint32_t _lastPreview = 0;
+    uint32_t _previewInterval = PREVIEW_INTERVAL; // stretched when encoding gets expensive
+    uint32_t _previewMicros = 0;
+    uint32_t _previewDropped = 0;
     
     // Callbacks
     void (*_powerCallback)(bool) = nullptr;
@@ -65,12 +102,25 @@ private:
     void handleSetConfig(AsyncWebServerRequest* request, uint8_t* data, size_t len); // convert percent->hex from user
     void handleGetTimers(AsyncWebServerRequest* request);
     void handleSetTimer(AsyncWebServerRequest* request, uint8_t* data, size_t len);
+    void handleGetPhotoperiod(AsyncWebServerRequest* request);
+    void handleSetPhotoperiod(AsyncWebServerRequest* request, uint8_t* data, size_t len); // percent<->16-bit
     
+    void flushBroadcast();
+    void handleWsBinary(AsyncWebSocketClient* client, const uint8_t* data, size_t len);
+
+    // Control actions shared by the REST and binary WebSocket paths
+    void controlBrightness(uint8_t percent);
+    void controlTransitionTime(uint32_t transitionTime);
+    void controlPower(bool power);
+    void controlEffect(uint8_t effect);
+    void controlParams(const EffectParams& params);
+    bool controlPreset(uint8_t presetId);
+
     // Helper functions
+    void captureStateSnapshot(StateSnapshot& snap);
+    void buildStateJSON(JsonDocument& doc);
     String getStateJSON();
-    String getPresetsJSON();
-    String getConfigJSON();
-    String getTimersJSON();
+    String getPerfJSON();
         friend bool performGzOtaUpdate(String& errorOut);
         friend void otaProgressCallback(uint8_t progress);
 };
@@ -0,0 +1,116 @@
+#include "wifi_manager.h"
+#include "captive_portal.h"
+#include "debug.h"
+#include <algorithm>
+
+void WiFiManager::begin(uint32_t nowMillis) {
+#if defined(ESP8266)
+    WiFi.hostname(_config->network.hostname);
+    _gotIpHandler = WiFi.onStationModeGotIP([this](const WiFiEventStationModeGotIP&) { _gotIp = true; });
+    _disconnectedHandler = WiFi.onStationModeDisconnected([this](const WiFiEventStationModeDisconnected&) { _lostLink = true; });
+#else
+    WiFi.setHostname(_config->network.hostname.c_str());
+    WiFi.onEvent([this](WiFiEvent_t event, WiFiEventInfo_t) {
+        if (event == ARDUINO_EVENT_WIFI_STA_GOT_IP) _gotIp = true;
+        else if (event == ARDUINO_EVENT_WIFI_STA_DISCONNECTED) _lostLink = true;
+    });
+#endif
+    if (_config->network.ssid.length() == 0) {
+        startAccessPoint();
+        _state = State::Idle;
+        return;
+    }
+    // Retries follow the backoff below, not the SDK's own schedule
+    WiFi.mode(WIFI_STA);
+    WiFi.setAutoReconnect(false);
+    startAttempt(nowMillis);
+}
+
+void WiFiManager::update(uint32_t nowMillis) {
+    switch (_state) {
+    case State::Idle:
+        break;
+    case State::Connecting:
+        if (_gotIp) {
+            _gotIp = false;
+            _lostLink = false;
+            _state = State::Connected;
+            _stateSince = nowMillis;
+            _failures = 0;
+            _backoff = WIFI_BACKOFF_MIN;
+            debugPrint("[WiFi] Connected! IP: ");
+            debugPrintln(WiFi.localIP());
+            if (_apActive) stopAccessPoint();
+        } else if (nowMillis - _stateSince >= WIFI_CONNECT_TIMEOUT) {
+            // Disconnect events during an attempt are the SDK retrying (or our
+            // own disconnect); only the timeout ends it
+            attemptFailed(nowMillis);
+        }
+        break;
+    case State::Connected:
+        // A stale event from an earlier attempt must not drop a live link
+        if (_lostLink) {
+            _lostLink = false;
+            if (WiFi.status() != WL_CONNECTED) {
+                debugPrintln("[WiFi] Lost connection");
+                ++_reconnects;
+                _state = State::Backoff;
+                _stateSince = nowMillis;
+                _backoff = WIFI_BACKOFF_MIN;
+            }
+        }
+        break;
+    case State::Backoff:
+        if (nowMillis - _stateSince >= _backoff) {
+            startAttempt(nowMillis);
+        }
+        break;
+    }
+}
+
+IPAddress WiFiManager::ip() const {
+    if (_state != State::Connected && _apActive) return WiFi.softAPIP();
+    return WiFi.localIP();
+}
+
+void WiFiManager::startAttempt(uint32_t nowMillis) {
+    debugPrintln("[WiFi] Calling WiFi.begin");
+    _gotIp = false;
+    WiFi.begin(_config->network.ssid.c_str(), _config->network.password.c_str());
+    _state = State::Connecting;
+    _stateSince = nowMillis;
+}
+
+void WiFiManager::attemptFailed(uint32_t nowMillis) {
+    debugPrintln("[WiFi] Connection attempt failed");
+    WiFi.disconnect();
+    if (_failures < UINT8_MAX) ++_failures;
+    if (_failures > 1) {
+        _backoff = std::min<uint32_t>(_backoff * 2, WIFI_BACKOFF_MAX);
+    }
+    if (_failures >= WIFI_AP_FALLBACK_ATTEMPTS && !_apActive) {
+        startAccessPoint();
+    }
+    _state = State::Backoff;
+    _stateSince = nowMillis;
+}
+
+void WiFiManager::startAccessPoint() {
+    debugPrintln("[WiFi] Starting Access Point mode");
+    // Keep the station enabled so retries continue behind the setup AP
+    WiFi.mode(_config->network.ssid.length() > 0 ? WIFI_AP_STA : WIFI_AP);
+    WiFi.softAP(_config->network.hostname.c_str(), _config->network.apPassword.c_str());
+    debugPrint("AP IP: ");
+    debugPrintln(WiFi.softAPIP());
+    // Start captive portal DNS
+    startCaptivePortal(WiFi.softAPIP());
+    _apActive = true;
+}
+
+void WiFiManager::stopAccessPoint() {
+    debugPrintln("[WiFi] Station connected, closing Access Point");
+    stopCaptivePortal();
+    WiFi.softAPdisconnect(true);
+    WiFi.mode(WIFI_STA);
+    _apActive = false;
+}
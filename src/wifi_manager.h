@@ -0,0 +1,57 @@
+#pragma once
+#include <Arduino.h>
+#if defined(ESP8266)
+#include <ESP8266WiFi.h>
+#else
+#include <WiFi.h>
+#endif
+#include "config.h"
+
+// Station connection policy driven from loop(), never blocking it. WiFi events
+// only set flags; update() acts on them. Failed attempts back off
+// exponentially. After WIFI_AP_FALLBACK_ATTEMPTS the setup AP and captive
+// portal open alongside the station, which keeps retrying and closes the AP
+// again once it connects.
+class WiFiManager {
+public:
+    enum class State : uint8_t {
+        Idle,        // no credentials: AP only
+        Connecting,  // attempt in progress
+        Connected,
+        Backoff      // waiting before the next attempt
+    };
+
+    explicit WiFiManager(Configuration* config) : _config(config) {}
+
+    void begin(uint32_t nowMillis);
+    void update(uint32_t nowMillis);
+
+    State state() const { return _state; }
+    bool isConnected() const { return _state == State::Connected; }
+    bool isAccessPoint() const { return _apActive; }
+    // Address clients should use: the station IP, else the AP IP
+    IPAddress ip() const;
+    uint32_t reconnects() const { return _reconnects; }
+
+private:
+    void startAttempt(uint32_t nowMillis);
+    void attemptFailed(uint32_t nowMillis);
+    void startAccessPoint();
+    void stopAccessPoint();
+
+    Configuration* _config;
+    State _state = State::Idle;
+    bool _apActive = false;
+    uint32_t _stateSince = 0;
+    uint32_t _backoff = WIFI_BACKOFF_MIN;
+    uint8_t _failures = 0;       // consecutive failed attempts
+    uint32_t _reconnects = 0;    // links lost after being connected
+
+    // Set from the WiFi event context, consumed by update()
+    volatile bool _gotIp = false;
+    volatile bool _lostLink = false;
+#if defined(ESP8266)
+    WiFiEventHandler _gotIpHandler;
+    WiFiEventHandler _disconnectedHandler;
+#endif
+};
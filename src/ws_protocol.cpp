@@ -0,0 +1,118 @@
+#include "ws_protocol.h"
+
+// Bounded little-endian writer; `ok` drops to false on overflow
+struct WireWriter {
+    uint8_t* out;
+    size_t size;
+    size_t pos = 0;
+    bool ok = true;
+    WireWriter(uint8_t* o, size_t s) : out(o), size(s) {}
+    void u8(uint8_t v) {
+        if (pos + 1 > size) { ok = false; return; }
+        out[pos++] = v;
+    }
+    void u16(uint16_t v) {
+        u8(v & 0xFF);
+        u8(v >> 8);
+    }
+    void u32(uint32_t v) {
+        u16(v & 0xFFFF);
+        u16(v >> 16);
+    }
+};
+
+struct WireReader {
+    const uint8_t* data;
+    size_t len;
+    size_t pos = 0;
+    bool ok = true;
+    WireReader(const uint8_t* d, size_t l) : data(d), len(l) {}
+    uint8_t u8() {
+        if (pos + 1 > len) { ok = false; return 0; }
+        return data[pos++];
+    }
+    uint16_t u16() {
+        uint16_t lo = u8();
+        return lo | ((uint16_t)u8() << 8);
+    }
+    uint32_t u32() {
+        uint32_t lo = u16();
+        return lo | ((uint32_t)u16() << 16);
+    }
+};
+
+static void writeParams(WireWriter& w, const EffectParams& params) {
+    w.u8(hexToPercent(params.speed));
+    w.u8(hexToPercent(params.intensity));
+    uint8_t count = params.colorCount > MAX_EFFECT_COLORS ? MAX_EFFECT_COLORS : params.colorCount;
+    w.u8(count);
+    for (size_t i = 0; i < count; ++i) w.u32(params.colors[i]);
+}
+
+static bool readParams(WireReader& r, EffectParams& params) {
+    params.speed = r.u8();
+    params.intensity = r.u8();
+    uint8_t count = r.u8();
+    if (count > MAX_EFFECT_COLORS) return false;
+    params.colorCount = count;
+    params.colors.fill(0);
+    for (size_t i = 0; i < count; ++i) params.colors[i] = r.u32();
+    return r.ok;
+}
+
+uint16_t diffStateSnapshots(const StateSnapshot& prev, const StateSnapshot& next) {
+    uint16_t mask = 0;
+    if (prev.power != next.power) mask |= WS_FIELD_POWER;
+    if (prev.brightness != next.brightness) mask |= WS_FIELD_BRIGHTNESS;
+    if (prev.effect != next.effect) mask |= WS_FIELD_EFFECT;
+    if (prev.preset != next.preset) mask |= WS_FIELD_PRESET;
+    if (!(prev.params == next.params)) mask |= WS_FIELD_PARAMS;
+    if (prev.transitionTime != next.transitionTime) mask |= WS_FIELD_TRANSITION;
+    if (prev.sunriseMinutes != next.sunriseMinutes || prev.sunsetMinutes != next.sunsetMinutes) mask |= WS_FIELD_CLOCK;
+    return mask;
+}
+
+size_t encodeStateMessage(const StateSnapshot& snap, uint16_t mask, uint8_t* out, size_t outSize) {
+    WireWriter w(out, outSize);
+    w.u8(WS_PROTOCOL_VERSION);
+    w.u8(WS_MSG_STATE);
+    w.u16(mask);
+    if (mask & WS_FIELD_POWER) w.u8(snap.power ? 1 : 0);
+    if (mask & WS_FIELD_BRIGHTNESS) w.u8(snap.brightness);
+    if (mask & WS_FIELD_EFFECT) w.u8(snap.effect);
+    if (mask & WS_FIELD_PRESET) w.u8(snap.preset);
+    if (mask & WS_FIELD_PARAMS) writeParams(w, snap.params);
+    if (mask & WS_FIELD_TRANSITION) w.u32(snap.transitionTime);
+    if (mask & WS_FIELD_CLOCK) {
+        w.u32(snap.secondOfDay);
+        w.u16(snap.sunriseMinutes);
+        w.u16(snap.sunsetMinutes);
+    }
+    return w.ok ? w.pos : 0;
+}
+
+bool decodeWsCommand(const uint8_t* data, size_t len, WsCommand& cmd) {
+    WireReader r(data, len);
+    if (r.u8() != WS_PROTOCOL_VERSION) return false;
+    cmd.type = r.u8();
+    switch (cmd.type) {
+        case WS_MSG_HELLO:
+            break;
+        case WS_MSG_POWER:
+        case WS_MSG_BRIGHTNESS:
+        case WS_MSG_EFFECT:
+        case WS_MSG_PRESET:
+        case WS_MSG_PREVIEW_SUBSCRIBE:
+            cmd.value = r.u8();
+            break;
+        case WS_MSG_PARAMS:
+            if (!readParams(r, cmd.params)) return false;
+            break;
+        case WS_MSG_TRANSITION:
+            cmd.transitionTime = r.u32();
+            break;
+        default:
+            return false;
+    }
+    return r.ok;
+}
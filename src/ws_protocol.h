@@ -0,0 +1,95 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <array>
+#include "config.h"
+
+// Compact binary WebSocket protocol.
+//
+// Every message starts with a two byte header: [version][type].
+// Multi-byte integers are little-endian, colors are packed 0xRRGGBBWW.
+//
+// Server -> client
+//   WS_MSG_STATE   u16 field mask, then the masked fields in bit order:
+//     POWER       u8 (0/1)
+//     BRIGHTNESS  u8 percent
+//     EFFECT      u8
+//     PRESET      u8
+//     PARAMS      u8 speed %, u8 intensity %, u8 color count, count x u32 color
+//     TRANSITION  u32 transition time (ms)
+//     CLOCK       u32 local second of day (0xFFFFFFFF = not synced),
+//                 u16 sunrise minutes, u16 sunset minutes (0xFFFF = unknown)
+//   WS_MSG_PREVIEW  downsampled LED frame, see preview.h
+//
+// Client -> server
+//   WS_MSG_HELLO       subscribe to binary state (answered with a full WS_MSG_STATE)
+//   WS_MSG_POWER       u8 (0/1)
+//   WS_MSG_BRIGHTNESS  u8 percent
+//   WS_MSG_EFFECT      u8
+//   WS_MSG_PARAMS      same layout as the PARAMS state field (count 0 keeps the current colors)
+//   WS_MSG_PRESET      u8 preset id
+//   WS_MSG_TRANSITION  u32 ms
+//   WS_MSG_PREVIEW_SUBSCRIBE  u8 (0/1) start or stop the live preview stream
+
+#define WS_PROTOCOL_VERSION 1
+
+enum WsMessageType : uint8_t {
+    WS_MSG_STATE = 0x01,
+    WS_MSG_PREVIEW = 0x02,
+    WS_MSG_HELLO = 0x10,
+    WS_MSG_POWER = 0x11,
+    WS_MSG_BRIGHTNESS = 0x12,
+    WS_MSG_EFFECT = 0x13,
+    WS_MSG_PARAMS = 0x14,
+    WS_MSG_PRESET = 0x15,
+    WS_MSG_TRANSITION = 0x16,
+    WS_MSG_PREVIEW_SUBSCRIBE = 0x17
+};
+
+enum WsStateField : uint16_t {
+    WS_FIELD_POWER = 1 << 0,
+    WS_FIELD_BRIGHTNESS = 1 << 1,
+    WS_FIELD_EFFECT = 1 << 2,
+    WS_FIELD_PRESET = 1 << 3,
+    WS_FIELD_PARAMS = 1 << 4,
+    WS_FIELD_TRANSITION = 1 << 5,
+    WS_FIELD_CLOCK = 1 << 6,
+    WS_FIELD_ALL = 0x7F
+};
+
+#define WS_CLOCK_UNSYNCED 0xFFFFFFFFUL
+#define WS_MINUTES_UNKNOWN 0xFFFF
+
+// Upper bound of an encoded WS_MSG_STATE with every field present
+#define WS_STATE_MESSAGE_MAX (2 + 2 + 4 + (3 + 4 * MAX_EFFECT_COLORS) + 4 + 8)
+
+// Client-visible state as reported over the wire (brightness in percent)
+struct StateSnapshot {
+    bool power = false;
+    uint8_t brightness = 0;
+    uint8_t effect = 0;
+    uint8_t preset = 0;
+    EffectParams params;
+    uint32_t transitionTime = 0;
+    uint32_t secondOfDay = WS_CLOCK_UNSYNCED;
+    uint16_t sunriseMinutes = WS_MINUTES_UNKNOWN;
+    uint16_t sunsetMinutes = WS_MINUTES_UNKNOWN;
+};
+
+// Decoded client command; only the members relevant to `type` are set
+struct WsCommand {
+    uint8_t type = 0;
+    uint8_t value = 0;           // POWER, BRIGHTNESS (percent), EFFECT, PRESET, PREVIEW_SUBSCRIBE
+    uint32_t transitionTime = 0; // TRANSITION
+    EffectParams params;         // PARAMS (speed/intensity in percent)
+};
+
+// Field mask of everything that differs. The running clock is ignored;
+// CLOCK is only flagged when sunrise or sunset moved.
+uint16_t diffStateSnapshots(const StateSnapshot& prev, const StateSnapshot& next);
+
+// Returns the encoded length, or 0 if `outSize` is too small
+size_t encodeStateMessage(const StateSnapshot& snap, uint16_t mask, uint8_t* out, size_t outSize);
+
+// Returns false for unknown versions/types or truncated payloads
+bool decodeWsCommand(const uint8_t* data, size_t len, WsCommand& cmd);
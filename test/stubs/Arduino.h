@@ -0,0 +1,153 @@
+#pragma once
+// Host stand-in for the Arduino core: just the API the firmware modules under
+// test use. Time only moves when a test moves it (see hostAdvanceMillis()).
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdio.h>
+#include <math.h>
+#include <string>
+#include <algorithm>
+
+#define PROGMEM
+#define RTC_NOINIT_ATTR
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+#ifndef PI
+#define PI 3.1415926535897932384626433832795
+#endif
+
+class String : public std::string {
+public:
+    String() {}
+    String(const char* s) : std::string(s ? s : "") {}
+    String(const char* s, size_t n) : std::string(s, n) {}
+    String(const std::string& s) : std::string(s) {}
+    explicit String(char c) : std::string(1, c) {}
+    String(int v) : std::string(std::to_string(v)) {}
+    String(unsigned int v) : std::string(std::to_string(v)) {}
+    String(long v) : std::string(std::to_string(v)) {}
+    String(unsigned long v) : std::string(std::to_string(v)) {}
+    String(double v, unsigned int decimals = 2) {
+        char buf[48];
+        snprintf(buf, sizeof(buf), "%.*f", (int)decimals, v);
+        assign(buf);
+    }
+
+    bool concat(const char* s) { append(s ? s : ""); return true; }
+    bool concat(const String& s) { append(s); return true; }
+    bool concat(char c) { push_back(c); return true; }
+    bool isEmpty() const { return empty(); }
+    String substring(size_t from) const { return from < size() ? String(substr(from)) : String(); }
+    String substring(size_t from, size_t to) const {
+        if (to > size()) to = size();
+        return from < to ? String(substr(from, to - from)) : String();
+    }
+    int indexOf(char c, size_t from = 0) const { size_t p = find(c, from); return p == npos ? -1 : (int)p; }
+    int indexOf(const char* s, size_t from = 0) const { size_t p = find(s, from); return p == npos ? -1 : (int)p; }
+    bool startsWith(const char* s) const { return compare(0, strlen(s), s) == 0; }
+    bool endsWith(const char* s) const { size_t n = strlen(s); return n <= size() && compare(size() - n, n, s) == 0; }
+    bool equals(const char* s) const { return *this == s; }
+    bool equalsIgnoreCase(const char* s) const { return strcasecmp(c_str(), s) == 0; }
+    long toInt() const { return strtol(c_str(), nullptr, 10); }
+    float toFloat() const { return strtof(c_str(), nullptr); }
+};
+
+// Named by ArduinoJson's String adapter
+class StringSumHelper : public String {
+public:
+    using String::String;
+};
+
+class Print {
+public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t c) = 0;
+    virtual size_t write(const uint8_t* buffer, size_t size) {
+        size_t n = 0;
+        while (size--) n += write(*buffer++);
+        return n;
+    }
+    size_t write(const char* s) { return write((const uint8_t*)s, strlen(s)); }
+    size_t print(const char* s) { return write(s); }
+    size_t print(const String& s) { return write((const uint8_t*)s.data(), s.size()); }
+    size_t print(char c) { return write((uint8_t)c); }
+    size_t print(long v, int base = 10) { return printNumber(v, base); }
+    size_t print(int v, int base = 10) { return printNumber(v, base); }
+    size_t print(unsigned long v, int base = 10) { return printNumber((long long)v, base); }
+    size_t print(unsigned int v, int base = 10) { return printNumber(v, base); }
+    size_t print(double v, int digits = 2) { return print(String(v, digits)); }
+    size_t println() { return write("\r\n"); }
+    template<typename T> size_t println(const T& v) { size_t n = print(v); return n + println(); }
+    template<typename T> size_t println(const T& v, int arg) { size_t n = print(v, arg); return n + println(); }
+
+private:
+    size_t printNumber(long long v, int base) {
+        char buf[72];
+        if (base == 16) snprintf(buf, sizeof(buf), "%llx", v);
+        else snprintf(buf, sizeof(buf), "%lld", v);
+        return write(buf);
+    }
+};
+
+class Stream : public Print {
+public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() = 0;
+    size_t readBytes(char* buffer, size_t length) {
+        size_t n = 0;
+        while (n < length) {
+            int c = read();
+            if (c < 0) break;
+            buffer[n++] = (char)c;
+        }
+        return n;
+    }
+    size_t readBytes(uint8_t* buffer, size_t length) { return readBytes((char*)buffer, length); }
+    void setTimeout(unsigned long) {}
+};
+
+// Debug output is compiled out unless DEBUG_SERIAL is set; then it goes to stderr
+class HardwareSerial : public Stream {
+public:
+    void begin(unsigned long) {}
+    size_t write(uint8_t c) override { fputc(c, stderr); return 1; }
+    using Print::write;
+    int available() override { return 0; }
+    int read() override { return -1; }
+    int peek() override { return -1; }
+};
+extern HardwareSerial Serial;
+
+#include "IPAddress.h"
+
+// Host clock: starts at 0 and only moves when a test says so
+uint32_t millis();
+uint32_t micros();
+void delay(uint32_t ms);
+void yield();
+void hostSetMillis(uint32_t ms);
+void hostAdvanceMillis(uint32_t ms);
+void hostAdvanceMicros(uint32_t us);
+
+inline void pinMode(uint8_t, uint8_t) {}
+inline void digitalWrite(uint8_t, uint8_t) {}
+inline long random(long max) { return max > 0 ? rand() % max : 0; }
+inline long random(long min, long max) { return max > min ? min + rand() % (max - min) : min; }
+
+#if defined(__GLIBC__) && !(__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 38))
+inline size_t strlcpy(char* dst, const char* src, size_t size) {
+    size_t len = strlen(src);
+    if (size) {
+        size_t n = len < size - 1 ? len : size - 1;
+        memcpy(dst, src, n);
+        dst[n] = 0;
+    }
+    return len;
+}
+#endif
@@ -0,0 +1,2 @@
+#pragma once
+// Nothing from AsyncTCP is used directly by the modules built on the host
@@ -0,0 +1,22 @@
+#pragma once
+// Captive-portal DNS server: records what the firmware started, answers nothing
+#include <Arduino.h>
+#include <IPAddress.h>
+
+class DNSServer {
+public:
+    bool start(uint16_t port, const String& domainName, const IPAddress& resolvedIP) {
+        running = true;
+        this->port = port;
+        ip = resolvedIP;
+        return true;
+    }
+    void stop() { running = false; }
+    void processNextRequest() { ++requests; }
+
+    // Test hooks
+    bool running = false;
+    uint16_t port = 0;
+    IPAddress ip;
+    uint32_t requests = 0;
+};
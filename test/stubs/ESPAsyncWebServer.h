@@ -0,0 +1,7 @@
+#pragma once
+// Declarations only: webserver.h holds these by pointer. Host tests replace
+// the WebServerManager members they need instead of linking webserver.cpp.
+class AsyncWebServer;
+class AsyncWebSocket;
+class AsyncWebSocketClient;
+class AsyncWebServerRequest;
@@ -0,0 +1,23 @@
+#pragma once
+#include <stdint.h>
+#include <stdio.h>
+
+class String;
+
+class IPAddress {
+public:
+    IPAddress() {}
+    IPAddress(uint32_t address) : _address(address) {}
+    IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d)
+        : _address((uint32_t)a | ((uint32_t)b << 8) | ((uint32_t)c << 16) | ((uint32_t)d << 24)) {}
+    operator uint32_t() const { return _address; }
+    uint8_t operator[](int i) const { return (_address >> (8 * i)) & 0xFF; }
+    template<typename S = String> S toString() const {
+        char buf[16];
+        snprintf(buf, sizeof(buf), "%u.%u.%u.%u", (*this)[0], (*this)[1], (*this)[2], (*this)[3]);
+        return S(buf);
+    }
+
+private:
+    uint32_t _address = 0;
+};
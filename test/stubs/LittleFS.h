@@ -0,0 +1,80 @@
+#pragma once
+// In-memory LittleFS. Files are byte vectors keyed by path. A test can cut
+// the power after a number of written bytes (failWritesAfter) to check what
+// survives an interrupted save.
+#include <Arduino.h>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+class File : public Stream {
+public:
+    File() {}
+    File(std::shared_ptr<std::vector<uint8_t>> data, bool writable, size_t pos)
+        : _data(data), _writable(writable), _pos(pos) {}
+
+    explicit operator bool() const { return (bool)_data; }
+    size_t size() const { return _data ? _data->size() : 0; }
+    size_t position() const { return _pos; }
+    bool seek(uint32_t pos) {
+        if (!_data || pos > _data->size()) return false;
+        _pos = pos;
+        return true;
+    }
+    size_t read(uint8_t* buf, size_t len) {
+        if (!_data || _pos >= _data->size()) return 0;
+        size_t n = std::min(len, _data->size() - _pos);
+        memcpy(buf, _data->data() + _pos, n);
+        _pos += n;
+        return n;
+    }
+    size_t read(char* buf, size_t len) { return read((uint8_t*)buf, len); }
+    int read() override {
+        uint8_t c;
+        return read(&c, 1) ? c : -1;
+    }
+    int peek() override { return (_data && _pos < _data->size()) ? (*_data)[_pos] : -1; }
+    int available() override { return _data ? (int)(_data->size() - _pos) : 0; }
+    size_t write(uint8_t c) override { return write(&c, 1); }
+    size_t write(const uint8_t* buf, size_t len) override;
+    using Print::write;
+    void flush() {}
+    void close() { _data.reset(); }
+
+private:
+    std::shared_ptr<std::vector<uint8_t>> _data;
+    bool _writable = false;
+    size_t _pos = 0;
+};
+
+class LittleFSFS {
+public:
+    bool begin() { return _mountable; }
+    void end() {}
+    bool format() { _files.clear(); return true; }
+    File open(const char* path, const char* mode);
+    File open(const String& path, const char* mode) { return open(path.c_str(), mode); }
+    bool exists(const char* path) const { return _files.count(path) > 0; }
+    bool exists(const String& path) const { return exists(path.c_str()); }
+    bool remove(const char* path) { return _files.erase(path) > 0; }
+    bool remove(const String& path) { return remove(path.c_str()); }
+    bool rename(const char* from, const char* to);
+
+    // Test hooks
+    void reset() { _files.clear(); opens = 0; bytesWritten = 0; _writeBudget = -1; _mountable = true; }
+    void failWritesAfter(long bytes) { _writeBudget = bytes; }  // -1: never
+    void setMountable(bool mountable) { _mountable = mountable; }
+    std::vector<uint8_t>* data(const char* path) { auto it = _files.find(path); return it == _files.end() ? nullptr : it->second.get(); }
+    size_t fileCount() const { return _files.size(); }
+    uint32_t opens = 0;
+    uint32_t bytesWritten = 0;
+
+private:
+    friend class File;
+    std::map<std::string, std::shared_ptr<std::vector<uint8_t>>> _files;
+    long _writeBudget = -1;
+    bool _mountable = true;
+};
+
+extern LittleFSFS LittleFS;
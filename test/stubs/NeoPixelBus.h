@@ -0,0 +1,44 @@
+#pragma once
+// In-memory NeoPixelBus: pixels live in a vector and Show() snapshots them
+// into `shown`, the frame the strip would display.
+#include <Arduino.h>
+#include <vector>
+
+struct RgbColor {
+    RgbColor(uint8_t r = 0, uint8_t g = 0, uint8_t b = 0) : R(r), G(g), B(b) {}
+    uint8_t R, G, B;
+};
+
+struct RgbwColor {
+    RgbwColor(uint8_t r = 0, uint8_t g = 0, uint8_t b = 0, uint8_t w = 0) : R(r), G(g), B(b), W(w) {}
+    uint8_t R, G, B, W;
+};
+
+struct NeoRgbFeature { typedef RgbColor ColorObject; };
+struct NeoGrbFeature { typedef RgbColor ColorObject; };
+struct NeoRgbwFeature { typedef RgbwColor ColorObject; };
+struct NeoSk6812Method {};
+struct NeoWs2812xMethod {};
+
+template<typename Feature, typename Method>
+class NeoPixelBus {
+public:
+    typedef typename Feature::ColorObject Color;
+
+    NeoPixelBus(uint16_t count, uint8_t pin) : pixels(count), pin(pin) {}
+    void Begin() {}
+    void Show() {
+        shown = pixels;
+        ++shows;
+    }
+    void SetPixelColor(uint16_t i, Color c) {
+        if (i < pixels.size()) pixels[i] = c;
+    }
+    Color GetPixelColor(uint16_t i) const { return i < pixels.size() ? pixels[i] : Color(); }
+    uint16_t PixelCount() const { return (uint16_t)pixels.size(); }
+
+    std::vector<Color> pixels;
+    std::vector<Color> shown;
+    uint32_t shows = 0;
+    uint8_t pin;
+};
@@ -0,0 +1,101 @@
+#pragma once
+// Station/AP state of the ESP32 WiFi API, driven by the test: connect() and
+// dropLink() raise the events the firmware subscribes to with onEvent().
+#include <Arduino.h>
+#include <IPAddress.h>
+#include <WiFiUdp.h>
+#include <functional>
+#include <map>
+
+typedef enum { WIFI_MODE_NULL = 0, WIFI_MODE_STA, WIFI_MODE_AP, WIFI_MODE_APSTA } wifi_mode_t;
+#define WIFI_OFF WIFI_MODE_NULL
+#define WIFI_STA WIFI_MODE_STA
+#define WIFI_AP WIFI_MODE_AP
+#define WIFI_AP_STA WIFI_MODE_APSTA
+
+typedef enum { WL_IDLE_STATUS = 0, WL_NO_SSID_AVAIL = 1, WL_CONNECTED = 3, WL_CONNECT_FAILED = 4, WL_DISCONNECTED = 6 } wl_status_t;
+
+typedef enum {
+    ARDUINO_EVENT_WIFI_STA_CONNECTED = 4,
+    ARDUINO_EVENT_WIFI_STA_DISCONNECTED = 5,
+    ARDUINO_EVENT_WIFI_STA_GOT_IP = 7,
+} WiFiEvent_t;
+typedef struct {} WiFiEventInfo_t;
+typedef std::function<void(WiFiEvent_t, WiFiEventInfo_t)> WiFiEventFuncCb;
+
+class WiFiClass {
+public:
+    bool mode(wifi_mode_t m) {
+        _mode = m;
+        return true;
+    }
+    wifi_mode_t getMode() const { return _mode; }
+    wl_status_t status() const { return _status; }
+    bool setHostname(const char* name) {
+        hostname = name;
+        return true;
+    }
+    bool setAutoReconnect(bool on) {
+        autoReconnect = on;
+        return true;
+    }
+    wl_status_t begin(const char* ssid, const char* password = nullptr) {
+        ++beginCalls;
+        this->ssid = ssid;
+        _status = WL_DISCONNECTED;
+        return _status;
+    }
+    bool disconnect(bool wifiOff = false) {
+        ++disconnectCalls;
+        _status = WL_DISCONNECTED;
+        return true;
+    }
+    bool softAP(const char* name, const char* password = nullptr) {
+        apActive = true;
+        apName = name;
+        return true;
+    }
+    bool softAPdisconnect(bool wifiOff = false) {
+        apActive = false;
+        return true;
+    }
+    IPAddress softAPIP() const { return apActive ? IPAddress(192, 168, 4, 1) : IPAddress(); }
+    IPAddress localIP() const { return _status == WL_CONNECTED ? IPAddress(192, 168, 1, 50) : IPAddress(); }
+    int hostByName(const char* host, IPAddress& ip) {
+        auto it = hosts.find(host);
+        if (it == hosts.end()) return 0;
+        ip = it->second;
+        return 1;
+    }
+    int onEvent(WiFiEventFuncCb cb) {
+        _handlers.push_back(cb);
+        return (int)_handlers.size();
+    }
+
+    // Test hooks
+    void connect() {
+        _status = WL_CONNECTED;
+        raise(ARDUINO_EVENT_WIFI_STA_GOT_IP);
+    }
+    void dropLink() {
+        _status = WL_DISCONNECTED;
+        raise(ARDUINO_EVENT_WIFI_STA_DISCONNECTED);
+    }
+    void raise(WiFiEvent_t event) {
+        for (auto& cb : _handlers) cb(event, WiFiEventInfo_t());
+    }
+    void reset() { *this = WiFiClass(); }
+    std::map<std::string, IPAddress> hosts;
+    std::string hostname, ssid, apName;
+    bool autoReconnect = true;
+    bool apActive = false;
+    int beginCalls = 0;
+    int disconnectCalls = 0;
+
+private:
+    wifi_mode_t _mode = WIFI_MODE_NULL;
+    wl_status_t _status = WL_IDLE_STATUS;
+    std::vector<WiFiEventFuncCb> _handlers;
+};
+
+extern WiFiClass WiFi;
@@ -0,0 +1,85 @@
+#pragma once
+// Loopback UDP socket. Packets a test queues with deliver() are returned by
+// parsePacket()/read() in order; sent packets are collected in `sent`.
+// boundTo(port) finds a socket that code under test owns privately.
+#include <Arduino.h>
+#include <IPAddress.h>
+#include <deque>
+#include <map>
+#include <vector>
+
+struct UdpPacket {
+    IPAddress address;
+    uint16_t port = 0;
+    std::vector<uint8_t> data;
+};
+
+class WiFiUDP {
+public:
+    WiFiUDP() {}
+    WiFiUDP(const WiFiUDP&) = delete;
+    WiFiUDP& operator=(const WiFiUDP&) = delete;
+    ~WiFiUDP() { stop(); }
+
+    uint8_t begin(uint16_t port) {
+        stop();
+        localPort = port;
+        bound()[port] = this;
+        return 1;
+    }
+    int beginPacket(IPAddress address, uint16_t port) {
+        if (!sendSucceeds) return 0;
+        _out = UdpPacket();
+        _out.address = address;
+        _out.port = port;
+        return 1;
+    }
+    size_t write(const uint8_t* buf, size_t len) {
+        _out.data.insert(_out.data.end(), buf, buf + len);
+        return len;
+    }
+    int endPacket() {
+        if (!sendSucceeds) return 0;
+        sent.push_back(_out);
+        return 1;
+    }
+    int parsePacket() {
+        if (inbox.empty()) return 0;
+        _in = inbox.front().data;
+        inbox.pop_front();
+        _pos = 0;
+        return (int)_in.size();
+    }
+    int available() { return (int)(_in.size() - _pos); }
+    int read(uint8_t* buf, size_t len) {
+        size_t n = std::min(len, _in.size() - _pos);
+        memcpy(buf, _in.data() + _pos, n);
+        _pos += n;
+        return (int)n;
+    }
+    void flush() { _pos = _in.size(); }
+    void stop() {
+        auto it = bound().find(localPort);
+        if (it != bound().end() && it->second == this) bound().erase(it);
+    }
+
+    // Test hooks
+    static WiFiUDP* boundTo(uint16_t port) {
+        auto it = bound().find(port);
+        return it == bound().end() ? nullptr : it->second;
+    }
+    void deliver(const std::vector<uint8_t>& data) { inbox.push_back({IPAddress(), 0, data}); }
+    uint16_t localPort = 0;
+    bool sendSucceeds = true;
+    std::vector<UdpPacket> sent;
+    std::deque<UdpPacket> inbox;
+
+private:
+    static std::map<uint16_t, WiFiUDP*>& bound() {
+        static std::map<uint16_t, WiFiUDP*> sockets;
+        return sockets;
+    }
+    UdpPacket _out;
+    std::vector<uint8_t> _in;
+    size_t _pos = 0;
+};
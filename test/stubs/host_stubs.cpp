@@ -0,0 +1,57 @@
+#include <Arduino.h>
+#include <LittleFS.h>
+#include <WiFi.h>
+
+HardwareSerial Serial;
+LittleFSFS LittleFS;
+WiFiClass WiFi;
+
+static uint64_t hostMicros = 0;
+
+uint32_t millis() { return (uint32_t)(hostMicros / 1000); }
+uint32_t micros() { return (uint32_t)hostMicros; }
+void delay(uint32_t ms) { hostMicros += (uint64_t)ms * 1000; }
+void yield() {}
+void hostSetMillis(uint32_t ms) { hostMicros = (uint64_t)ms * 1000; }
+void hostAdvanceMillis(uint32_t ms) { hostMicros += (uint64_t)ms * 1000; }
+void hostAdvanceMicros(uint32_t us) { hostMicros += us; }
+
+size_t File::write(const uint8_t* buf, size_t len) {
+    if (!_data || !_writable) return 0;
+    long& budget = LittleFS._writeBudget;
+    if (budget >= 0 && (long)len > budget) len = (size_t)budget;  // power cut mid-write
+    if (budget >= 0) budget -= (long)len;
+    if (_data->size() < _pos + len) _data->resize(_pos + len);
+    memcpy(_data->data() + _pos, buf, len);
+    _pos += len;
+    LittleFS.bytesWritten += len;
+    return len;
+}
+
+File LittleFSFS::open(const char* path, const char* mode) {
+    ++opens;
+    auto it = _files.find(path);
+    if (mode[0] == 'r') {
+        if (it == _files.end()) return File();
+        return File(it->second, mode[1] == '+', 0);
+    }
+    if (mode[0] == 'w') {
+        auto data = std::make_shared<std::vector<uint8_t>>();
+        _files[path] = data;
+        return File(data, true, 0);
+    }
+    if (mode[0] == 'a') {
+        if (it == _files.end()) it = _files.emplace(path, std::make_shared<std::vector<uint8_t>>()).first;
+        return File(it->second, true, it->second->size());
+    }
+    return File();
+}
+
+bool LittleFSFS::rename(const char* from, const char* to) {
+    auto it = _files.find(from);
+    if (it == _files.end()) return false;
+    auto data = it->second;
+    _files.erase(it);
+    _files[to] = data;
+    return true;
+}
@@ -0,0 +1,57 @@
+#pragma once
+// Minimal test registry for the host tests. Each test_*.cpp builds into its
+// own executable (see CMakeLists.txt); main() runs every TEST in it and
+// exits non-zero if a CHECK failed.
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+#include <sstream>
+#include <vector>
+
+namespace test {
+struct Case {
+    const char* name;
+    void (*fn)();
+};
+std::vector<Case>& registry();
+extern int failures;
+
+struct Register {
+    Register(const char* name, void (*fn)()) { registry().push_back({name, fn}); }
+};
+
+template<typename T> std::string show(const T& v) {
+    std::ostringstream out;
+    out << v;
+    return out.str();
+}
+inline std::string show(uint8_t v) { return std::to_string(v); }
+inline std::string show(int8_t v) { return std::to_string(v); }
+inline std::string show(const std::nullptr_t&) { return "nullptr"; }
+
+void fail(const char* file, int line, const std::string& what);
+}
+
+#define TEST(name) \
+    static void test_##name(); \
+    static test::Register register_##name(#name, test_##name); \
+    static void test_##name()
+
+#define CHECK(cond) \
+    do { if (!(cond)) test::fail(__FILE__, __LINE__, "CHECK(" #cond ")"); } while (0)
+
+#define CHECK_EQ(a, b) \
+    do { \
+        auto checkA_ = (a); \
+        auto checkB_ = (b); \
+        if (!(checkA_ == checkB_)) \
+            test::fail(__FILE__, __LINE__, "CHECK_EQ(" #a ", " #b "): " + test::show(checkA_) + " != " + test::show(checkB_)); \
+    } while (0)
+
+#define CHECK_NEAR(a, b, tolerance) \
+    do { \
+        double checkA_ = (a); \
+        double checkB_ = (b); \
+        if (!(checkA_ - checkB_ <= (tolerance) && checkB_ - checkA_ <= (tolerance))) \
+            test::fail(__FILE__, __LINE__, "CHECK_NEAR(" #a ", " #b "): " + test::show(checkA_) + " vs " + test::show(checkB_)); \
+    } while (0)
@@ -0,0 +1,202 @@
+#include "test.h"
+#include "config.h"
+#include "json_stream.h"
+#include "presets.h"
+#include <LittleFS.h>
+#include <chrono>
+#include <cstdlib>
+#include <new>
+
+PresetStore presetStore;
+
+// Heap accounting for the whole test binary: every allocation carries its
+// size in a header so live and peak bytes can be tracked
+static size_t heapLive = 0;
+static size_t heapPeak = 0;
+
+void* operator new(size_t size) {
+    size_t* p = (size_t*)malloc(size + sizeof(max_align_t));
+    if (!p) throw std::bad_alloc();
+    *p = size;
+    heapLive += size;
+    if (heapLive > heapPeak) heapPeak = heapLive;
+    return (char*)p + sizeof(max_align_t);
+}
+
+void operator delete(void* ptr) noexcept {
+    if (!ptr) return;
+    size_t* p = (size_t*)((char*)ptr - sizeof(max_align_t));
+    heapLive -= *p;
+    free(p);
+}
+
+void operator delete(void* ptr, size_t) noexcept { operator delete(ptr); }
+
+// Peak heap above what was live when `fn` started
+template<typename Fn>
+static size_t peakHeap(Fn fn) {
+    size_t base = heapLive;
+    heapPeak = heapLive;
+    fn();
+    return heapPeak - base;
+}
+
+template<typename Fn>
+static double microsPerCall(int calls, Fn fn) {
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < calls; ++i) fn();
+    std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / calls;
+}
+
+// Defaults with every section moved away from them
+static void customize(Configuration& c) {
+    c.setDefaults();
+    c.led.count = 144;
+    c.led.type = "WS2812B";
+    c.safety.maxBrightness = 200;
+    c.transitionTimes.schedule = 1800000;
+    c.network.ssid = "Tank";
+    c.network.password = "secret";
+    c.time.timezone = "Europe/Berlin";
+    c.time.latitude = 52.52;
+    c.time.longitude = 13.405;
+    c.timers.clear();
+    for (int i = 0; i < 12; ++i) {
+        Timer t;
+        t.enabled = i % 3 != 0;
+        t.type = (TimerType)(i % 3);
+        t.hour = (i * 2) % 24;
+        t.minute = (i * 7) % 60;
+        t.presetId = i % 6;
+        t.brightness = 20 * i;
+        c.timers.push_back(t);
+    }
+    c.markAllChanged();
+}
+
+static bool sameSettings(const Configuration& a, const Configuration& b) {
+    return a.led == b.led && a.safety == b.safety && a.transitionTimes == b.transitionTimes &&
+           a.network == b.network && a.time == b.time && a.timers == b.timers;
+}
+
+static std::vector<uint8_t> readAll(const char* path) {
+    File file = LittleFS.open(path, "r");
+    std::vector<uint8_t> data(file ? file.size() : 0);
+    if (!data.empty()) file.read(data.data(), data.size());
+    return data;
+}
+
+static void writeAll(const char* path, const void* data, size_t len) {
+    File file = LittleFS.open(path, "w");
+    file.write((const uint8_t*)data, len);
+    file.close();
+}
+
+TEST(record_round_trips_every_section) {
+    LittleFS.reset();
+    Configuration saved;
+    customize(saved);
+    CHECK(saved.save());
+    CHECK(LittleFS.exists(CONFIG_FILE));
+    Configuration loaded;
+    CHECK(loaded.load());
+    CHECK(sameSettings(loaded, saved));
+    // Nothing changed since the load: save() does not write
+    size_t written = LittleFS.bytesWritten;
+    CHECK(loaded.save());
+    CHECK_EQ(LittleFS.bytesWritten, written);
+}
+
+TEST(legacy_json_is_migrated_once) {
+    LittleFS.reset();
+    const char json[] = "{\"led\":{\"count\":77},\"network\":{\"ssid\":\"Tank\"},"
+                        "\"timers\":[{\"enabled\":true,\"hour\":9,\"minute\":30,\"presetId\":2,\"brightness\":50}]}";
+    writeAll(LEGACY_CONFIG_FILE, json, sizeof(json) - 1);
+    Configuration c;
+    CHECK(c.load());
+    CHECK_EQ(c.led.count, (uint16_t)77);
+    CHECK_EQ(c.network.ssid, String("Tank"));
+    CHECK_EQ(c.timers.size(), (size_t)1);
+    // Keys the file does not have keep their defaults
+    Configuration defaults;
+    defaults.setDefaults();
+    CHECK_EQ(c.led.type, defaults.led.type);
+    CHECK(c.time == defaults.time);
+    CHECK(!LittleFS.exists(LEGACY_CONFIG_FILE));
+    CHECK(LittleFS.exists(CONFIG_FILE));
+
+    Configuration again;
+    CHECK(again.load());
+    CHECK(sameSettings(again, c));
+}
+
+TEST(damaged_record_is_rejected_not_half_applied) {
+    LittleFS.reset();
+    Configuration saved;
+    customize(saved);
+    CHECK(saved.save());
+    std::vector<uint8_t> record = readAll(CONFIG_FILE);
+    Configuration defaults;
+    defaults.setDefaults();
+    int accepted = 0;
+    for (size_t bit = 0; bit < record.size() * 8; ++bit) {
+        std::vector<uint8_t> damaged = record;
+        damaged[bit / 8] ^= 1 << (bit % 8);
+        writeAll(CONFIG_FILE, damaged.data(), damaged.size());
+        Configuration c;
+        c.load();
+        if (!sameSettings(c, defaults)) ++accepted;
+    }
+    CHECK_EQ(accepted, 0);
+    // Truncated on flash (power cut during a non-atomic copy)
+    writeAll(CONFIG_FILE, record.data(), record.size() / 2);
+    Configuration c;
+    CHECK(c.load());
+    CHECK(sameSettings(c, defaults));
+}
+
+TEST(binary_load_beats_the_json_path) {
+    LittleFS.reset();
+    Configuration saved;
+    customize(saved);
+    CHECK(saved.save());
+    size_t recordBytes = readAll(CONFIG_FILE).size();
+
+    // The previous load: defaults parsed from config_default.inc, then the
+    // settings file parsed and merged on top
+    std::string json;
+    {
+        JsonStreamWriter writer([&](JsonStreamState& st, char* buf, size_t size, size_t& len) {
+            return saved.writeJsonFragment(st, buf, size, len);
+        });
+        char buf[256];
+        for (size_t n; (n = writer.fill((uint8_t*)buf, sizeof(buf))) > 0;) json.append(buf, n);
+    }
+    writeAll("/bench.json", json.data(), json.size());
+    auto jsonLoad = []() {
+        Configuration c;
+        c.setDefaults();
+        std::vector<uint8_t> text = readAll("/bench.json");
+        DynamicJsonDocument doc(4096);
+        if (deserializeJson(doc, (const char*)text.data(), text.size())) return false;
+        c.partialUpdate(doc.as<JsonObject>());
+        return c.timers.size() == 12;
+    };
+    auto binaryLoad = []() {
+        Configuration c;
+        return c.load() && c.timers.size() == 12;
+    };
+    CHECK(jsonLoad());
+    CHECK(binaryLoad());
+
+    size_t jsonHeap = peakHeap(jsonLoad);
+    size_t binaryHeap = peakHeap(binaryLoad);
+    double jsonUs = microsPerCall(500, jsonLoad);
+    double binaryUs = microsPerCall(500, binaryLoad);
+    printf("  binary %zu B: %.1f us, peak heap %zu B\n", recordBytes, binaryUs, binaryHeap);
+    printf("  JSON %zu B: %.1f us, peak heap %zu B\n", json.size(), jsonUs, jsonHeap);
+    CHECK(recordBytes * 2 < json.size());
+    CHECK(binaryHeap * 2 < jsonHeap);
+    CHECK(binaryUs * 2 < jsonUs);
+}
@@ -0,0 +1,202 @@
+#include "test.h"
+#include "delta.h"
+#include "inflate.h"
+#include "ota_stream.h"
+#include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
+
+// Patches made by scripts/make_delta.py (MAKE_DELTA and PYTHON come from
+// CMake), applied by DeltaPatcher the way the OTA download does
+
+typedef std::vector<uint8_t> Bytes;
+
+static uint32_t nextRandom(uint32_t& seed) {
+    seed = seed * 1103515245 + 12345;
+    return seed >> 16;
+}
+
+// Code-like image: random instruction runs, strings and zero padding
+static Bytes makeImage(size_t size, uint32_t seed) {
+    Bytes image;
+    image.push_back(0xE9);
+    while (image.size() < size) {
+        size_t run = 16 + nextRandom(seed) % 800;
+        switch (nextRandom(seed) % 3) {
+            case 0:
+                for (size_t i = 0; i < run; ++i) image.push_back(nextRandom(seed));
+                break;
+            case 1: {
+                static const char text[] = "[Scheduler] Timer applied, preset ";
+                for (size_t i = 0; i < run; ++i) image.push_back(text[i % (sizeof(text) - 1)]);
+                break;
+            }
+            default:
+                image.insert(image.end(), run, 0);
+                break;
+        }
+    }
+    image.resize(size);
+    return image;
+}
+
+// The next build of `old`: code inserted near the start, so everything after
+// it moves and its 32-bit addresses shift; a rewritten function; a new tail
+static Bytes nextBuild(const Bytes& old) {
+    uint32_t seed = 99;
+    Bytes image(old.begin(), old.begin() + old.size() / 10);
+    for (int i = 0; i < 37; ++i) image.push_back(nextRandom(seed));
+    for (size_t pos = old.size() / 10; pos < old.size(); ++pos) {
+        uint8_t b = old[pos];
+        if (pos % 256 == 0) b += 0x40;  // address moved by the insertion
+        image.push_back(b);
+    }
+    for (size_t i = 0; i < 1500; ++i) image[image.size() / 2 + i] = nextRandom(seed);
+    for (size_t i = 0; i < 3000; ++i) image.push_back(nextRandom(seed));
+    return image;
+}
+
+static std::string tempDir() {
+    char path[] = "/tmp/test_deltaXXXXXX";
+    if (!mkdtemp(path)) abort();
+    return path;
+}
+
+static void writeFile(const std::string& path, const Bytes& data) {
+    FILE* f = fopen(path.c_str(), "wb");
+    if (!f || fwrite(data.data(), 1, data.size(), f) != data.size()) abort();
+    fclose(f);
+}
+
+static Bytes readFile(const std::string& path) {
+    Bytes data;
+    FILE* f = fopen(path.c_str(), "rb");
+    if (!f) return data;
+    uint8_t buf[4096];
+    for (size_t n; (n = fread(buf, 1, sizeof(buf), f)) > 0;) data.insert(data.end(), buf, buf + n);
+    fclose(f);
+    return data;
+}
+
+// Runs make_delta.py on the pair and returns the .patch.gz
+static Bytes makeDelta(const Bytes& from, const Bytes& to) {
+    std::string dir = tempDir();
+    writeFile(dir + "/old.bin", from);
+    writeFile(dir + "/new.bin", to);
+    std::string command = std::string(PYTHON) + " " + MAKE_DELTA + " " + dir + "/old.bin " + dir + "/new.bin " + dir + "/delta.patch.gz";
+    if (system(command.c_str()) != 0) test::fail(__FILE__, __LINE__, "make_delta.py failed");
+    Bytes patch = readFile(dir + "/delta.patch.gz");
+    std::string cleanup = "rm -rf " + dir;
+    system(cleanup.c_str());
+    return patch;
+}
+
+static Bytes gunzip(const Bytes& gz) {
+    Bytes out;
+    GzipInflater inflater;
+    inflater.begin([&](const uint8_t* data, size_t len) {
+        out.insert(out.end(), data, data + len);
+        return true;
+    });
+    if (!inflater.write(gz.data(), gz.size()) || !inflater.done()) out.clear();
+    return out;
+}
+
+struct Applied {
+    bool ok = false;
+    Bytes image;
+    std::string error;
+};
+
+// Feeds the uncompressed patch to DeltaPatcher in `chunk`-byte pieces, with
+// `source` as the running image
+static Applied apply(const Bytes& source, const Bytes& patch, size_t chunk) {
+    Applied result;
+    DeltaPatcher patcher;
+    patcher.begin([&](size_t offset, uint8_t* buf, size_t len) {
+        if (offset + len > source.size()) return false;
+        memcpy(buf, source.data() + offset, len);
+        return true;
+    }, source.size(), [&](const uint8_t* data, size_t len) {
+        result.image.insert(result.image.end(), data, data + len);
+        return true;
+    });
+    result.ok = true;
+    for (size_t pos = 0; result.ok && pos < patch.size(); pos += chunk) {
+        result.ok = patcher.write(patch.data() + pos, std::min(chunk, patch.size() - pos));
+    }
+    result.ok = result.ok && patcher.done();
+    if (patcher.error()) result.error = patcher.error();
+    return result;
+}
+
+static void checkPair(const Bytes& from, const Bytes& to, size_t& patchSize) {
+    Bytes gz = makeDelta(from, to);
+    CHECK(!gz.empty());
+    patchSize = gz.size();
+    Bytes patch = gunzip(gz);
+    CHECK(patch.size() >= DELTA_HEADER_SIZE);
+    for (size_t chunk : {1, 1460}) {
+        Applied a = apply(from, patch, chunk);
+        CHECK(a.ok);
+        CHECK(a.image == to);
+    }
+
+    // A source that differs in one byte has another hash: refused before
+    // anything is written
+    Bytes other = from;
+    other[from.size() / 3] ^= 0x01;
+    for (size_t chunk : {1, 1460}) {
+        Applied a = apply(other, patch, chunk);
+        CHECK(!a.ok);
+        CHECK(a.image.empty());
+        CHECK_EQ(a.error, std::string("Delta is for a different firmware"));
+    }
+    // So is a running image shorter than the one the patch was made from
+    Bytes shorter(from.begin(), from.end() - 1);
+    CHECK(!apply(shorter, patch, 1460).ok);
+}
+
+static const size_t IMAGE_SIZE = 48 * 1024;
+
+TEST(related_images_give_a_small_exact_patch) {
+    Bytes from = makeImage(IMAGE_SIZE, 1);
+    Bytes to = nextBuild(from);
+    size_t patchSize = 0;
+    checkPair(from, to, patchSize);
+    printf("  related: %zu -> %zu bytes, patch %zu bytes\n", from.size(), to.size(), patchSize);
+    // The inserted, rewritten and appended bytes, plus little else
+    CHECK(patchSize < to.size() / 4);
+}
+
+TEST(unrelated_images_still_patch_exactly) {
+    Bytes from = makeImage(IMAGE_SIZE, 2);
+    Bytes to = makeImage(IMAGE_SIZE + 999, 3);
+    size_t patchSize = 0;
+    checkPair(from, to, patchSize);
+    printf("  unrelated: %zu -> %zu bytes, patch %zu bytes\n", from.size(), to.size(), patchSize);
+}
+
+TEST(gzipped_patch_applies_through_the_ota_stream) {
+    Bytes from = makeImage(IMAGE_SIZE, 4);
+    Bytes to = nextBuild(from);
+    Bytes gz = makeDelta(from, to);
+    Bytes written;
+    OtaStream ota([&](const uint8_t* data, size_t len) {
+        written.insert(written.end(), data, data + len);
+        return true;
+    });
+    for (size_t chunk : {1, 1460}) {
+        written.clear();
+        ota.beginDelta([&](size_t offset, uint8_t* buf, size_t len) {
+            memcpy(buf, from.data() + offset, len);
+            return true;
+        }, from.size());
+        bool ok = true;
+        for (size_t pos = 0; ok && pos < gz.size(); pos += chunk) ok = ota.write(gz.data() + pos, std::min(chunk, gz.size() - pos));
+        CHECK(ok && ota.finish());
+        CHECK(ota.compressed() && ota.delta());
+        CHECK_EQ(ota.targetSize(), to.size());
+        CHECK(written == to);
+    }
+}
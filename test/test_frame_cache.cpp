@@ -0,0 +1,129 @@
+#include "test.h"
+#include "bus_manager.h"
+#include "effects.h"
+#include "frame_cache.h"
+
+// The globals effects.cpp renders through (defined in state.cpp and main.cpp
+// in the firmware)
+SystemState state;
+std::array<uint32_t, MAX_EFFECT_COLORS> color = {};
+size_t colorCount = 0;
+EffectParams transitionPrevParams;
+PendingTransitionState pendingTransition;
+BusManager busManager;
+Configuration config;
+void* strip = nullptr;
+
+static const uint8_t SOLID = 0;
+static const uint8_t SUNRISE = 1;
+static const uint8_t LEDS = 60;
+
+static EffectParams params(uint32_t first, uint32_t second) {
+    EffectParams p;
+    p.speed = 128;
+    p.intensity = 200;
+    p.colorCount = 2;
+    p.colors[0] = first;
+    p.colors[1] = second;
+    return p;
+}
+
+static uint32_t stat(const FrameCache& cache, const char* key) {
+    DynamicJsonDocument doc(512);
+    cache.writeStats(doc.to<JsonObject>());
+    return doc[key].as<uint32_t>();
+}
+
+// Renders through the cache and checks the frame against a direct render
+static void renderChecked(FrameCache& cache, uint8_t effect, const EffectParams& p, size_t leds, uint8_t brightness) {
+    std::vector<uint32_t> cached(leds, 0xdeadbeef), direct(leds, 0);
+    cache.render(effect, p, cached, leds, p.colorCount, brightness);
+    renderEffectToBuffer(effect, p, direct, leds, p.colors, p.colorCount, brightness);
+    CHECK(cached == direct);
+}
+
+TEST(cached_static_frame_matches_a_direct_render) {
+    FrameCache cache;
+    EffectParams p = params(0x00ff8040, 0x10203040);
+    renderChecked(cache, SOLID, p, LEDS, 255);
+    CHECK_EQ(stat(cache, "misses"), (uint32_t)1);
+    for (int i = 0; i < 10; ++i) renderChecked(cache, SOLID, p, LEDS, 255);
+    CHECK_EQ(stat(cache, "hits"), (uint32_t)10);
+    CHECK_EQ(stat(cache, "misses"), (uint32_t)1);
+    CHECK_EQ(stat(cache, "entries"), (uint32_t)1);
+    CHECK_EQ(stat(cache, "bytes"), (uint32_t)(LEDS * sizeof(uint32_t)));
+}
+
+TEST(every_input_of_the_frame_is_part_of_the_key) {
+    FrameCache cache;
+    EffectParams base = params(0x00ff8040, 0x10203040);
+    std::vector<EffectParams> variants(5, base);
+    variants[0].speed = 1;
+    variants[1].intensity = 50;
+    variants[2].reverse = true;
+    variants[3].colors[0] = 0x00ff8041;
+    variants[4].colorCount = 1;
+    renderChecked(cache, SOLID, base, LEDS, 200);
+    uint32_t misses = 1;
+    for (const EffectParams& p : variants) {
+        renderChecked(cache, SOLID, p, LEDS, 200);
+        CHECK_EQ(stat(cache, "misses"), ++misses);
+    }
+    renderChecked(cache, SOLID, base, LEDS, 201);
+    CHECK_EQ(stat(cache, "misses"), ++misses);
+    renderChecked(cache, SOLID, base, LEDS + 1, 200);
+    CHECK_EQ(stat(cache, "misses"), ++misses);
+    CHECK_EQ(stat(cache, "hits"), (uint32_t)0);
+
+    // Colors past colorCount are not rendered, so they do not split the key
+    renderChecked(cache, SOLID, base, LEDS, 200);
+    EffectParams unused = base;
+    unused.colors[5] = 0x12345678;
+    renderChecked(cache, SOLID, unused, LEDS, 200);
+    CHECK_EQ(stat(cache, "hits"), (uint32_t)1);
+}
+
+TEST(least_recently_used_frame_is_replaced) {
+    FrameCache cache;
+    std::vector<EffectParams> presets;
+    for (uint32_t i = 0; i <= FRAME_CACHE_SIZE; ++i) presets.push_back(params(0x00100000 * (i + 1), 0));
+    for (size_t i = 0; i < FRAME_CACHE_SIZE; ++i) renderChecked(cache, SOLID, presets[i], LEDS, 255);
+    // Touch the oldest, so the second one is now least recently used
+    renderChecked(cache, SOLID, presets[0], LEDS, 255);
+    renderChecked(cache, SOLID, presets[FRAME_CACHE_SIZE], LEDS, 255);
+    CHECK_EQ(stat(cache, "entries"), (uint32_t)FRAME_CACHE_SIZE);
+    uint32_t misses = stat(cache, "misses");
+    renderChecked(cache, SOLID, presets[0], LEDS, 255);
+    CHECK_EQ(stat(cache, "misses"), misses);
+    renderChecked(cache, SOLID, presets[1], LEDS, 255);
+    CHECK_EQ(stat(cache, "misses"), misses + 1);
+}
+
+TEST(time_varying_effects_are_rendered_every_time) {
+    CHECK(isEffectTimeInvariant(SOLID));
+    CHECK(!isEffectTimeInvariant(SUNRISE));
+    CHECK(!isEffectTimeInvariant(200));
+    FrameCache cache;
+    EffectParams p = params(0x00ff0000, 0x000000ff);
+    // These keep state between frames, so no direct render to compare with
+    std::vector<uint32_t> frame(LEDS);
+    for (int i = 0; i < 5; ++i) {
+        cache.render(SUNRISE, p, frame, LEDS, p.colorCount, 255);
+        hostAdvanceMillis(1000);
+    }
+    CHECK_EQ(stat(cache, "uncached"), (uint32_t)5);
+    CHECK_EQ(stat(cache, "entries"), (uint32_t)0);
+    CHECK_EQ(stat(cache, "hits") + stat(cache, "misses"), (uint32_t)0);
+}
+
+TEST(rendering_leaves_the_live_state_alone) {
+    FrameCache cache;
+    state.brightness = 42;
+    state.params = params(0x00010203, 0);
+    color[0] = 0x00010203;
+    renderChecked(cache, SOLID, params(0x00ffffff, 0), LEDS, 255);
+    renderChecked(cache, SOLID, params(0x00ffffff, 0), LEDS, 255);
+    CHECK_EQ(state.brightness, (uint8_t)42);
+    CHECK_EQ(state.params.colors[0], (uint32_t)0x00010203);
+    CHECK_EQ(color[0], (uint32_t)0x00010203);
+}
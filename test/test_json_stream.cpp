@@ -0,0 +1,265 @@
+#include "test.h"
+#include "config.h"
+#include "json_stream.h"
+#include "photoperiod.h"
+#include "presets.h"
+#include "persistence.h"
+#include <LittleFS.h>
+#include <cstdlib>
+#include <new>
+
+Configuration config;
+PresetStore presetStore;
+Persistence persistence(&config);
+
+// Heap accounting for the whole test binary, as in test_config_store
+static size_t heapLive = 0;
+static size_t heapPeak = 0;
+
+void* operator new(size_t size) {
+    size_t* p = (size_t*)malloc(size + sizeof(max_align_t));
+    if (!p) throw std::bad_alloc();
+    *p = size;
+    heapLive += size;
+    if (heapLive > heapPeak) heapPeak = heapLive;
+    return (char*)p + sizeof(max_align_t);
+}
+
+void operator delete(void* ptr) noexcept {
+    if (!ptr) return;
+    size_t* p = (size_t*)((char*)ptr - sizeof(max_align_t));
+    heapLive -= *p;
+    free(p);
+}
+
+void operator delete(void* ptr, size_t) noexcept { operator delete(ptr); }
+
+// Drains a writer in chunks of `chunk` bytes; `between` runs after every chunk
+template<typename Between>
+static std::string drain(JsonFragmentProducer producer, size_t chunk, Between between) {
+    JsonStreamWriter writer(producer);
+    std::string out;
+    std::vector<uint8_t> buf(chunk);
+    for (size_t n; (n = writer.fill(buf.data(), chunk)) > 0;) {
+        CHECK(n <= chunk);
+        out.append((const char*)buf.data(), n);
+        between(out);
+    }
+    return out;
+}
+
+static std::string drain(JsonFragmentProducer producer, size_t chunk) {
+    return drain(producer, chunk, [](const std::string&) {});
+}
+
+static bool parses(const std::string& json, JsonDocument& doc) {
+    return deserializeJson(doc, json.c_str(), json.size()) == DeserializationError::Ok;
+}
+
+static JsonFragmentProducer timersProducer() {
+    return [](JsonStreamState& state, char* buf, size_t size, size_t& len) {
+        return config.writeTimersJsonFragment(state, buf, size, len);
+    };
+}
+
+static JsonFragmentProducer configProducer() {
+    return [](JsonStreamState& state, char* buf, size_t size, size_t& len) {
+        return config.writeJsonFragment(state, buf, size, len);
+    };
+}
+
+static void setTimers(size_t count) {
+    config.timers.assign(count, Timer());
+    for (size_t i = 0; i < count; ++i) {
+        config.timers[i].enabled = true;
+        config.timers[i].hour = i % 24;
+        config.timers[i].minute = (i * 7) % 60;
+        config.timers[i].presetId = i % 5;
+    }
+}
+
+TEST(chunk_size_does_not_change_the_document) {
+    config.setDefaults();
+    setTimers(12);
+    std::string reference = drain(configProducer(), 4096);
+    DynamicJsonDocument doc(16384);
+    CHECK(parses(reference, doc));
+    CHECK_EQ(doc["timers"].size(), (size_t)12);
+    CHECK_EQ(doc["led"]["count"].as<int>(), (int)config.led.count);
+    for (size_t chunk : {1, 2, 3, 7, 64, 511, 512, 513, 1460}) {
+        CHECK_EQ(drain(configProducer(), chunk), reference);
+    }
+}
+
+TEST(unlisted_timers_leave_no_stray_commas) {
+    setTimers(6);
+    // Unset timers (disabled at 00:00) are not listed, including the first ones
+    config.timers[0] = Timer();
+    config.timers[1] = Timer();
+    config.timers[4] = Timer();
+    std::string json = drain(timersProducer(), 16);
+    DynamicJsonDocument doc(4096);
+    CHECK(parses(json, doc));
+    CHECK_EQ(doc["timers"].size(), (size_t)3);
+    CHECK_EQ(doc["timers"][0]["id"].as<int>(), 2);
+
+    config.timers.assign(4, Timer());
+    json = drain(timersProducer(), 16);
+    CHECK_EQ(json, std::string("{\"timers\":[]}"));
+}
+
+TEST(timers_shrinking_mid_stream_still_close_the_document) {
+    for (size_t keep : {0, 1, 5}) {
+        setTimers(20);
+        bool shrunk = false;
+        std::string json = drain(timersProducer(), 100, [&](const std::string& out) {
+            // Another request deletes timers while the response is being sent
+            if (!shrunk && out.size() > 300) {
+                config.timers.resize(keep);
+                shrunk = true;
+            }
+        });
+        CHECK(shrunk);
+        DynamicJsonDocument doc(16384);
+        CHECK(parses(json, doc));
+        CHECK(json.size() >= 2 && json.compare(json.size() - 2, 2, "]}") == 0);
+    }
+}
+
+TEST(timers_growing_mid_stream_stay_valid) {
+    setTimers(3);
+    bool grown = false;
+    std::string json = drain(timersProducer(), 32, [&](const std::string& out) {
+        if (!grown && out.size() > 40) {
+            setTimers(10);
+            grown = true;
+        }
+    });
+    DynamicJsonDocument doc(16384);
+    CHECK(parses(json, doc));
+    CHECK_EQ(doc["timers"].size(), (size_t)10);
+}
+
+TEST(config_document_closes_after_timers_shrink) {
+    config.setDefaults();
+    setTimers(15);
+    bool shrunk = false;
+    std::string json = drain(configProducer(), 256, [&](const std::string& out) {
+        if (!shrunk && out.find("\"timers\":[{") != std::string::npos) {
+            config.timers.clear();
+            shrunk = true;
+        }
+    });
+    CHECK(shrunk);
+    DynamicJsonDocument doc(16384);
+    CHECK(parses(json, doc));
+    CHECK(doc.containsKey("transitionTimes"));
+}
+
+TEST(photoperiod_keyframes_stream_as_one_array) {
+    PhotoperiodConfig curve;
+    curve.enabled = true;
+    for (uint8_t h = 6; h < 22; h += 2) {
+        PhotoperiodKeyframe k;
+        k.minute = h * 60;
+        curve.keyframes.push_back(k);
+    }
+    std::string json = drain([&curve](JsonStreamState& state, char* buf, size_t size, size_t& len) {
+        return writePhotoperiodJsonFragment(curve, state, buf, size, len);
+    }, 5, [&curve](const std::string& out) {
+        if (out.size() > 150 && curve.keyframes.size() > 2) curve.keyframes.resize(2);
+    });
+    DynamicJsonDocument doc(8192);
+    CHECK(parses(json, doc));
+    CHECK(doc["enabled"].as<bool>());
+}
+
+TEST(presets_list_with_gaps) {
+    LittleFS.reset();
+    presetStore.reset();
+    for (uint8_t id : {3, 4, 9}) {
+        Preset p;
+        p.id = id;
+        p.name = "preset";
+        presetStore.put(p);
+    }
+    std::string json = drain([](JsonStreamState& state, char* buf, size_t size, size_t& len) {
+        return writePresetsJsonFragment(presetStore, state, buf, size, len);
+    }, 64);
+    DynamicJsonDocument doc(8192);
+    CHECK(parses(json, doc));
+    CHECK_EQ(doc["presets"].size(), (size_t)3);
+    CHECK_EQ(doc["presets"][0]["id"].as<int>(), 3);
+}
+
+// Fills the store with `count` presets with full-length names
+static void storePresets(size_t count) {
+    LittleFS.reset();
+    presetStore.reset();
+    for (size_t id = 0; id < count; ++id) {
+        Preset p;
+        p.id = (uint8_t)id;
+        char name[PRESET_NAME_MAX + 1];
+        snprintf(name, sizeof(name), "Preset %03u ................................", (unsigned)id);
+        p.name = name;
+        p.params.colorCount = 2;
+        CHECK(presetStore.put(p));
+        if (id % PRESET_CACHE_SIZE == 0) CHECK(presetStore.flush());
+    }
+    CHECK(presetStore.flush());
+}
+
+// Peak heap while one preset is turned into a fragment: the slot read and,
+// with the host ArduinoJson stand-in, the document (a StaticJsonDocument on
+// the stack in the firmware)
+static size_t presetFragmentPeakHeap() {
+    JsonStreamState state;
+    state.index = 1;  // past the opening, at preset 0
+    char buf[JSON_STREAM_FRAGMENT];
+    size_t len = 0;
+    size_t base = heapLive;
+    heapPeak = heapLive;
+    CHECK(writePresetsJsonFragment(presetStore, state, buf, sizeof(buf), len));
+    CHECK(len > 0);
+    return heapPeak - base;
+}
+
+// Peak heap while GET /api/presets is streamed, writer included (the web
+// server allocates it per request). The output goes into a string reserved
+// beforehand, so only the writer's own allocations count.
+static size_t presetsPeakHeap(std::string& json) {
+    json.clear();
+    json.reserve(64 * 1024);
+    uint8_t chunk[1460];
+    size_t base = heapLive;
+    heapPeak = heapLive;
+    JsonStreamWriter* writer = new JsonStreamWriter([](JsonStreamState& state, char* buf, size_t size, size_t& len) {
+        return writePresetsJsonFragment(presetStore, state, buf, size, len);
+    });
+    for (size_t n; (n = writer->fill(chunk, sizeof(chunk))) > 0;) json.append((const char*)chunk, n);
+    delete writer;
+    return heapPeak - base;
+}
+
+TEST(presets_stream_peak_heap_does_not_grow_from_6_to_200) {
+    std::string json;
+    storePresets(6);
+    size_t small = presetsPeakHeap(json);
+    size_t smallBytes = json.size();
+    DynamicJsonDocument doc(64 * 1024);
+    CHECK(parses(json, doc));
+    CHECK_EQ(doc["presets"].size(), (size_t)6);
+
+    storePresets(200);
+    size_t large = presetsPeakHeap(json);
+    CHECK(parses(json, doc));
+    CHECK_EQ(doc["presets"].size(), (size_t)200);
+    size_t fragment = presetFragmentPeakHeap();
+    printf("  6 presets: %zu B of JSON, peak heap %zu B\n", smallBytes, small);
+    printf("  200 presets: %zu B of JSON, peak heap %zu B (writer %zu B, one preset %zu B)\n",
+           json.size(), large, sizeof(JsonStreamWriter), fragment);
+    CHECK_EQ(large, small);
+    // The writer with its one fragment buffer, one preset in flight and the
+    // cache entries a read may touch; nothing per preset
+    CHECK(large <= sizeof(JsonStreamWriter) + fragment + PRESET_CACHE_SIZE * (PRESET_NAME_MAX + 1));
+}
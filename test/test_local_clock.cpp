@@ -0,0 +1,154 @@
+#include "test.h"
+#include "config.h"
+#include "local_clock.h"
+#include "presets.h"
+#include "timezone.h"
+#include <stdlib.h>
+#include <time.h>
+#include <fstream>
+
+PresetStore presetStore;
+
+static Configuration zoneConfig(const char* zone, bool dst = true) {
+    Configuration config;
+    config.time.timezone = zone;
+    config.time.dstEnabled = dst;
+    ++config.gen.time;
+    return config;
+}
+
+static bool matchesLocaltime(const LocalClock& clock) {
+    time_t t = (time_t)clock.utcEpoch();
+    struct tm local;
+    localtime_r(&t, &local);
+    return clock.utcOffset() == local.tm_gmtoff && clock.year() == local.tm_year + 1900 &&
+           clock.month() == local.tm_mon + 1 && clock.day() == local.tm_mday && clock.weekday() == local.tm_wday &&
+           clock.dayOfYear() == local.tm_yday + 1 && clock.hour() == local.tm_hour &&
+           clock.minute() == local.tm_min && clock.second() == local.tm_sec &&
+           clock.minuteOfDay() == local.tm_hour * 60 + local.tm_min &&
+           clock.secondOfDay() == (uint32_t)(local.tm_hour * 3600 + local.tm_min * 60 + local.tm_sec);
+}
+
+TEST(broken_down_time_matches_localtime) {
+    std::ifstream probe("/usr/share/zoneinfo/Europe/Berlin");
+    if (!probe) {
+        printf("  (no system zoneinfo, skipped)\n");
+        return;
+    }
+    for (const char* zone : {"America/New_York", "Europe/Berlin", "Australia/Sydney", "Asia/Kolkata"}) {
+        Configuration config = zoneConfig(zone);
+        setenv("TZ", zone, 1);
+        tzset();
+        LocalClock clock(&config);
+        // 2020 through 2025 in steps that land on every second of the minute;
+        // zoneinfo and the table agree for these years
+        uint32_t ms = 12345;
+        clock.sync((uint32_t)daysFromCivil(2020, 1, 1) * 86400, ms);
+        int mismatches = 0;
+        for (uint32_t step = 0; step < 6u * 366 * 87; ++step) {
+            ms += 997000;
+            clock.update(ms);
+            if (!matchesLocaltime(clock) && mismatches++ < 3) {
+                test::fail(__FILE__, __LINE__, std::string(zone) + " differs at " + std::to_string(clock.utcEpoch()));
+            }
+        }
+        CHECK_EQ(mismatches, 0);
+    }
+}
+
+TEST(seconds_follow_millis_across_wraparound) {
+    Configuration config = zoneConfig("Etc/UTC");
+    LocalClock clock(&config);
+    CHECK(!clock.isSynced());
+    uint32_t start = UINT32_MAX - 5500;
+    clock.sync(1700000000, start, 250);
+    CHECK(clock.isSynced());
+    CHECK_EQ(clock.subSecond(), (uint16_t)250);
+    uint32_t last = clock.utcEpoch();
+    for (uint32_t ms = start; ms != start + 20000; ms += 10) {
+        clock.update(ms);
+        CHECK(clock.utcEpoch() == last || clock.utcEpoch() == last + 1);
+        last = clock.utcEpoch();
+    }
+    // 20 s after 1700000000.250
+    CHECK_EQ(clock.utcEpoch(), (uint32_t)1700000020);
+    CHECK_EQ(clock.subSecond(), (uint16_t)240);
+}
+
+TEST(unsynced_clock_counts_uptime) {
+    LocalClock clock(nullptr);
+    clock.update(90061000);  // 1 day, 1 h, 1 min, 1 s
+    CHECK_EQ(clock.dayNumber(), (int32_t)1);
+    CHECK_EQ(clock.hour(), (uint8_t)1);
+    CHECK_EQ(clock.minute(), (uint8_t)1);
+    CHECK_EQ(clock.second(), (uint8_t)1);
+}
+
+TEST(zone_change_applies_without_a_new_second) {
+    Configuration config = zoneConfig("Etc/UTC");
+    LocalClock clock(&config);
+    clock.sync((uint32_t)daysFromCivil(2025, 7, 1) * 86400 + 12 * 3600, 0);
+    CHECK_EQ(clock.hour(), (uint8_t)12);
+    config.time.timezone = "Asia/Kolkata";
+    ++config.gen.time;
+    clock.update(0);
+    CHECK_EQ(clock.utcOffset(), (int32_t)19800);
+    CHECK_EQ(clock.hour(), (uint8_t)17);
+    CHECK_EQ(clock.minute(), (uint8_t)30);
+}
+
+// Runs the clock at 10 ms ticks for `ms` and checks seconds neither repeat
+// nor vanish while a correction is slewed in
+static void runWithoutJumps(LocalClock& clock, uint32_t& now, uint32_t ms) {
+    uint32_t last = clock.utcEpoch();
+    int jumps = 0;
+    for (uint32_t end = now + ms; now != end; now += 10) {
+        clock.update(now);
+        if (clock.utcEpoch() != last && clock.utcEpoch() != last + 1) ++jumps;
+        last = clock.utcEpoch();
+    }
+    clock.update(now);
+    CHECK_EQ(jumps, 0);
+}
+
+static int64_t clockMillis(const LocalClock& clock) {
+    return (int64_t)clock.utcEpoch() * 1000 + clock.subSecond();
+}
+
+TEST(small_errors_are_slewed_both_ways) {
+    for (int32_t error : {1500, -1500, 40, -40}) {
+        Configuration config = zoneConfig("Etc/UTC");
+        LocalClock clock(&config);
+        uint32_t now = 5000;
+        clock.sync(1700000000, now);
+        now += 60000;
+        clock.update(now);
+        int64_t reference = clockMillis(clock) + error;
+        clock.discipline((uint32_t)(reference / 1000), now, (uint16_t)(reference % 1000));
+        // Not stepped: the correction is still pending
+        CHECK(clockMillis(clock) != reference);
+        // 1 ms per NTP_SLEW_DIVISOR ms, so |error| * divisor to converge
+        uint32_t needed = (uint32_t)abs(error) * NTP_SLEW_DIVISOR;
+        runWithoutJumps(clock, now, needed + 1000);
+        reference += needed + 1000;
+        CHECK_EQ(clockMillis(clock), reference);
+    }
+}
+
+TEST(large_errors_step_the_clock) {
+    Configuration config = zoneConfig("Etc/UTC");
+    LocalClock clock(&config);
+    uint32_t now = 0;
+    // The first discipline of an unsynced clock steps too
+    clock.discipline(1700000000, now, 500);
+    CHECK_EQ(clockMillis(clock), (int64_t)1700000000500);
+    now += 1000;
+    clock.discipline(1700003600, now, 0);
+    CHECK_EQ(clockMillis(clock), (int64_t)1700003600000);
+    // Just inside the limit is slewed, just outside it is stepped
+    now += 1000;
+    clock.discipline(1700003601 + NTP_SLEW_LIMIT / 1000, now, NTP_SLEW_LIMIT % 1000);
+    CHECK_EQ(clockMillis(clock), (int64_t)1700003601000);
+    clock.discipline(1700003601 + NTP_SLEW_LIMIT / 1000, now, NTP_SLEW_LIMIT % 1000 + 1);
+    CHECK_EQ(clockMillis(clock), (int64_t)1700003601001 + NTP_SLEW_LIMIT);
+}
@@ -0,0 +1,25 @@
+#include "test.h"
+
+namespace test {
+int failures = 0;
+
+std::vector<Case>& registry() {
+    static std::vector<Case> cases;
+    return cases;
+}
+
+void fail(const char* file, int line, const std::string& what) {
+    fprintf(stderr, "%s:%d: %s\n", file, line, what.c_str());
+    ++failures;
+}
+}
+
+int main() {
+    for (const test::Case& c : test::registry()) {
+        int before = test::failures;
+        c.fn();
+        printf("%s %s\n", test::failures == before ? "[ OK ]" : "[FAIL]", c.name);
+    }
+    printf("%zu tests, %d failed checks\n", test::registry().size(), test::failures);
+    return test::failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,397 @@
+#include "test.h"
+#include "inflate.h"
+#include "ota_stream.h"
+#include "sha256.h"
+#include <zlib.h>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <unistd.h>
+
+// Heap accounting for the whole test binary, as in test_config_store
+static size_t heapLive = 0;
+static size_t heapPeak = 0;
+
+void* operator new(size_t size) {
+    size_t* p = (size_t*)malloc(size + sizeof(max_align_t));
+    if (!p) throw std::bad_alloc();
+    *p = size;
+    heapLive += size;
+    if (heapLive > heapPeak) heapPeak = heapLive;
+    return (char*)p + sizeof(max_align_t);
+}
+
+void* operator new[](size_t size) { return operator new(size); }
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+    try {
+        return operator new(size);
+    } catch (...) {
+        return nullptr;
+    }
+}
+void* operator new[](size_t size, const std::nothrow_t& tag) noexcept { return operator new(size, tag); }
+
+void operator delete(void* ptr) noexcept {
+    if (!ptr) return;
+    size_t* p = (size_t*)((char*)ptr - sizeof(max_align_t));
+    heapLive -= *p;
+    free(p);
+}
+
+void operator delete(void* ptr, size_t) noexcept { operator delete(ptr); }
+void operator delete[](void* ptr) noexcept { operator delete(ptr); }
+void operator delete[](void* ptr, size_t) noexcept { operator delete(ptr); }
+
+// Stand-in for the Update class behind otaImageWriter() in ota.cpp: begin()
+// reserves the partition, write() returns what fit
+struct MockUpdate {
+    size_t partition = 1 << 20;
+    size_t reserved = 0;
+    bool started = false;
+    size_t failAt = SIZE_MAX;   // bytes accepted before the flash "fails"
+    std::vector<uint8_t> flash;
+
+    bool begin(size_t size) {
+        if (size > partition) return false;
+        reserved = size;
+        started = true;
+        return true;
+    }
+    size_t write(const uint8_t* data, size_t len) {
+        size_t room = std::min(reserved, failAt) - std::min(flash.size(), std::min(reserved, failAt));
+        size_t n = std::min(len, room);
+        flash.insert(flash.end(), data, data + n);
+        return n;
+    }
+};
+
+static MockUpdate update;
+static OtaStream* current = nullptr;
+static size_t rawImageSize = 0;  // the upload's Content-Length
+
+// otaImageWriter() without the hardware: start on the first bytes, reserving
+// the whole partition for a compressed image
+static bool imageWriter(const uint8_t* data, size_t len) {
+    if (!update.started && !update.begin(current->compressed() ? update.partition : rawImageSize)) return false;
+    return update.write(data, len) == len;
+}
+
+// A firmware-like image: header byte, code-like random runs, repeated
+// strings, zero padding and copies from farther back than the 32 KB window
+static std::vector<uint8_t> makeImage(size_t size, uint32_t seed) {
+    std::vector<uint8_t> image;
+    image.reserve(size);
+    image.push_back(0xE9);
+    while (image.size() < size) {
+        seed = seed * 1103515245 + 12345;
+        size_t run = 16 + (seed >> 8) % 2000;
+        switch ((seed >> 20) % 4) {
+            case 0:
+                for (size_t i = 0; i < run; ++i) {
+                    seed = seed * 1103515245 + 12345;
+                    image.push_back(seed >> 16);
+                }
+                break;
+            case 1: {
+                static const char text[] = "[OTA] Update started, writing image to the next partition\n";
+                for (size_t i = 0; i < run; ++i) image.push_back(text[i % (sizeof(text) - 1)]);
+                break;
+            }
+            case 2:
+                image.insert(image.end(), run, 0);
+                break;
+            default: {
+                size_t back = std::min(image.size(), (size_t)(1000 + (seed >> 4) % 60000));
+                size_t from = image.size() - back;
+                for (size_t i = 0; i < run; ++i) image.push_back(image[from + i % back]);
+                break;
+            }
+        }
+    }
+    image.resize(size);
+    return image;
+}
+
+static std::vector<uint8_t> gzip(const std::vector<uint8_t>& data, int level, gz_header* header = nullptr) {
+    z_stream z = {};
+    if (deflateInit2(&z, level, Z_DEFLATED, 15 + 16, 9, Z_DEFAULT_STRATEGY) != Z_OK) abort();
+    if (header) deflateSetHeader(&z, header);
+    std::vector<uint8_t> out(deflateBound(&z, data.size()) + 1024);
+    z.next_in = const_cast<Bytef*>(data.data());
+    z.avail_in = data.size();
+    z.next_out = out.data();
+    z.avail_out = out.size();
+    if (deflate(&z, Z_FINISH) != Z_STREAM_END) abort();
+    out.resize(z.total_out);
+    deflateEnd(&z);
+    return out;
+}
+
+// The reference decoder
+static std::vector<uint8_t> zlibInflate(const std::vector<uint8_t>& gz, size_t size) {
+    z_stream z = {};
+    if (inflateInit2(&z, 15 + 16) != Z_OK) abort();
+    std::vector<uint8_t> out(size + 1);
+    z.next_in = const_cast<Bytef*>(gz.data());
+    z.avail_in = gz.size();
+    z.next_out = out.data();
+    z.avail_out = out.size();
+    int status = inflate(&z, Z_FINISH);
+    out.resize(z.total_out);
+    inflateEnd(&z);
+    if (status != Z_STREAM_END) out.clear();
+    return out;
+}
+
+static std::string sha256sum(const std::vector<uint8_t>& data) {
+    char path[] = "/tmp/test_ota_streamXXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0 || write(fd, data.data(), data.size()) != (ssize_t)data.size()) abort();
+    close(fd);
+    std::string command = std::string("sha256sum ") + path;
+    FILE* pipe = popen(command.c_str(), "r");
+    char hex[65] = {};
+    if (!pipe || fread(hex, 1, 64, pipe) != 64) abort();
+    pclose(pipe);
+    unlink(path);
+    return hex;
+}
+
+static std::string digestOf(const uint8_t* data, size_t len, size_t chunk) {
+    Sha256 sha;
+    for (size_t pos = 0; pos < len; pos += chunk) sha.update(data + pos, std::min(chunk, len - pos));
+    uint8_t digest[SHA256_DIGEST_SIZE];
+    sha.finish(digest);
+    char hex[2 * SHA256_DIGEST_SIZE + 1];
+    formatSha256Hex(digest, hex);
+    return hex;
+}
+
+// Feeds `stream` to an OtaStream in `chunk`-byte pieces through the mock Update
+static bool upload(OtaStream& ota, const std::vector<uint8_t>& stream, size_t chunk) {
+    update = MockUpdate();
+    current = &ota;
+    rawImageSize = stream.size();
+    ota.begin();
+    for (size_t pos = 0; pos < stream.size(); pos += chunk) {
+        if (!ota.write(stream.data() + pos, std::min(chunk, stream.size() - pos))) return false;
+    }
+    return ota.finish();
+}
+
+static const size_t CHUNKS[] = {1, 2, 3, 7, 64, 255, 1460, 4096, 32768, 65536, 100000};
+
+static const std::vector<uint8_t>& image() {
+    static std::vector<uint8_t> data = makeImage(300000, 7);
+    return data;
+}
+
+TEST(sha256_matches_sha256sum) {
+    CHECK_EQ(digestOf((const uint8_t*)"abc", 3, 3),
+             std::string("ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad"));
+    CHECK_EQ(digestOf(nullptr, 0, 1), std::string("e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855"));
+    // Lengths around the 55/56/64-byte padding edges, and a whole image
+    for (size_t len : {55, 56, 63, 64, 65, 119, 120, 1000}) {
+        std::vector<uint8_t> data(image().begin(), image().begin() + len);
+        CHECK_EQ(digestOf(data.data(), len, len), sha256sum(data));
+    }
+    std::string expected = sha256sum(image());
+    for (size_t chunk : CHUNKS) CHECK_EQ(digestOf(image().data(), image().size(), chunk), expected);
+}
+
+TEST(sha256_hex_parsing) {
+    uint8_t digest[SHA256_DIGEST_SIZE];
+    std::string hex = sha256sum(image());
+    CHECK(parseSha256Hex(hex.c_str(), digest));
+    std::string upper = hex;
+    for (char& c : upper) c = toupper(c);
+    uint8_t again[SHA256_DIGEST_SIZE];
+    CHECK(parseSha256Hex(upper.c_str(), again));
+    CHECK(memcmp(digest, again, SHA256_DIGEST_SIZE) == 0);
+    char formatted[2 * SHA256_DIGEST_SIZE + 1];
+    formatSha256Hex(digest, formatted);
+    CHECK_EQ(std::string(formatted), hex);
+    CHECK(!parseSha256Hex(hex.substr(0, 63).c_str(), digest));
+    CHECK(!parseSha256Hex((hex + "0").c_str(), digest));
+    CHECK(!parseSha256Hex(("g" + hex.substr(1)).c_str(), digest));
+}
+
+TEST(inflate_matches_zlib_at_every_level_and_chunk_size) {
+    for (int level : {0, 1, 6, 9}) {
+        std::vector<uint8_t> gz = gzip(image(), level);
+        CHECK(zlibInflate(gz, image().size()) == image());
+        for (size_t chunk : CHUNKS) {
+            std::vector<uint8_t> out;
+            GzipInflater inflater;
+            CHECK(inflater.begin([&](const uint8_t* data, size_t len) {
+                out.insert(out.end(), data, data + len);
+                return true;
+            }));
+            bool ok = true;
+            for (size_t pos = 0; ok && pos < gz.size(); pos += chunk) {
+                ok = inflater.write(gz.data() + pos, std::min(chunk, gz.size() - pos));
+            }
+            if (!ok || !inflater.done() || out != image()) {
+                printf("  level %d, chunk %zu: %s\n", level, chunk, inflater.error() ? inflater.error() : "wrong output");
+                test::fail(__FILE__, __LINE__, "inflated image differs from zlib's");
+            }
+            CHECK_EQ(inflater.outputSize(), (uint32_t)image().size());
+        }
+    }
+}
+
+TEST(inflate_reads_every_optional_header_field) {
+    gz_header header = {};
+    static char name[] = "firmware.bin";
+    static char comment[] = "DeepGlow";
+    static Bytef extra[] = {'D', 'G', 4, 0, 1, 2, 3, 4};
+    header.name = (Bytef*)name;
+    header.comment = (Bytef*)comment;
+    header.extra = extra;
+    header.extra_len = sizeof(extra);
+    header.hcrc = 1;
+    std::vector<uint8_t> gz = gzip(image(), 6, &header);
+    CHECK(zlibInflate(gz, image().size()) == image());
+    for (size_t chunk : {1, 5, 1460}) {
+        OtaStream ota(imageWriter);
+        CHECK(upload(ota, gz, chunk));
+        CHECK(update.flash == image());
+    }
+}
+
+TEST(damaged_or_truncated_gzip_is_rejected) {
+    std::vector<uint8_t> gz = gzip(image(), 6);
+    OtaStream ota(imageWriter);
+
+    std::vector<uint8_t> badCrc = gz;
+    badCrc[badCrc.size() - 6] ^= 0x01;
+    CHECK(!upload(ota, badCrc, 1460));
+
+    std::vector<uint8_t> badSize = gz;
+    badSize[badSize.size() - 1] ^= 0x01;
+    CHECK(!upload(ota, badSize, 1460));
+
+    std::vector<uint8_t> badBlock = gz;
+    badBlock[10] = 0xFF;  // block type 3 does not exist
+    CHECK(!upload(ota, badBlock, 1460));
+
+    std::vector<uint8_t> truncated(gz.begin(), gz.end() - 100);
+    CHECK(!upload(ota, truncated, 1460));
+    CHECK_EQ(String(ota.error()), String("Truncated gzip stream"));
+
+    // A write after a failure is refused until begin()
+    CHECK(!ota.write(gz.data(), 10));
+    CHECK(upload(ota, gz, 1460));
+}
+
+TEST(ota_stream_hands_the_image_to_update_and_checks_its_hash) {
+    std::string expected = sha256sum(image());
+    for (int level : {0, 9}) {
+        std::vector<uint8_t> gz = gzip(image(), level);
+        for (size_t chunk : {1, 1460, 100000}) {
+            OtaStream ota(imageWriter);
+            CHECK(upload(ota, gz, chunk));
+            CHECK(ota.compressed());
+            CHECK_EQ(update.reserved, update.partition);
+            CHECK(update.flash == image());
+            CHECK_EQ(ota.inputSize(), gz.size());
+            CHECK_EQ(ota.imageSize(), image().size());
+            CHECK_EQ(std::string(ota.digestHex().c_str()), expected);
+            CHECK(ota.verify(String(expected.c_str())));
+        }
+    }
+
+    // A raw image passes through untouched
+    OtaStream ota(imageWriter);
+    CHECK(upload(ota, image(), 4096));
+    CHECK(!ota.compressed());
+    CHECK(update.flash == image());
+    CHECK(ota.verify(String(expected.c_str())));
+    CHECK(ota.verify(""));  // no hash given: not checked
+
+    std::string wrong = expected;
+    wrong[0] = wrong[0] == '0' ? '1' : '0';
+    CHECK(!ota.verify(String(wrong.c_str())));
+    CHECK_EQ(ota.error(), String("SHA-256 mismatch"));
+    CHECK(!ota.verify("not a digest"));
+    CHECK_EQ(ota.error(), String("Invalid SHA-256"));
+}
+
+TEST(update_failures_stop_the_stream) {
+    std::vector<uint8_t> gz = gzip(image(), 6);
+    OtaStream ota(imageWriter);
+
+    // Flash write error halfway through
+    update = MockUpdate();
+    update.failAt = image().size() / 2;
+    current = &ota;
+    ota.begin();
+    bool ok = true;
+    for (size_t pos = 0; ok && pos < gz.size(); pos += 1460) ok = ota.write(gz.data() + pos, std::min<size_t>(1460, gz.size() - pos));
+    CHECK(!ok);
+    CHECK(!ota.finish());
+    CHECK(update.flash.size() <= image().size() / 2);
+
+    // Raw image larger than Update can take
+    update = MockUpdate();
+    update.partition = 1000;
+    rawImageSize = image().size();
+    ota.begin();
+    CHECK(!ota.write(image().data(), 4096));
+    CHECK_EQ(ota.error(), String("Image write failed"));
+    CHECK(!update.started);
+
+    // Nothing uploaded
+    ota.begin();
+    CHECK(!ota.finish());
+    CHECK_EQ(ota.error(), String("Empty firmware image"));
+}
+
+struct Throughput {
+    double mbPerSecond;
+    size_t heapPeak;  // allocated while the upload runs
+};
+
+// Times one upload in TCP-segment pieces into a preallocated "flash", so the
+// sink costs a copy and no allocation
+static Throughput measureUpload(const std::vector<uint8_t>& stream, const std::string& expected) {
+    std::vector<uint8_t> flash(image().size());
+    size_t written = 0;
+    OtaStream ota([&](const uint8_t* data, size_t len) {
+        if (written + len > flash.size()) return false;
+        memcpy(flash.data() + written, data, len);
+        written += len;
+        return true;
+    });
+    const size_t chunk = 1460;
+    size_t base = heapLive;
+    heapPeak = heapLive;
+    auto start = std::chrono::steady_clock::now();
+    ota.begin();
+    bool ok = true;
+    for (size_t pos = 0; ok && pos < stream.size(); pos += chunk) {
+        ok = ota.write(stream.data() + pos, std::min(chunk, stream.size() - pos));
+    }
+    ok = ok && ota.finish();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    Throughput t = {image().size() / seconds / 1e6, heapPeak - base};
+    CHECK(ok);
+    CHECK(flash == image());
+    CHECK(ota.verify(String(expected.c_str())));
+    return t;
+}
+
+TEST(upload_throughput_and_peak_heap) {
+    std::string expected = sha256sum(image());
+    std::vector<uint8_t> gz = gzip(image(), 9);
+    Throughput raw = measureUpload(image(), expected);
+    Throughput packed = measureUpload(gz, expected);
+    printf("  raw: %.1f MB/s (SHA-256 + sink), heap peak %zu B\n", raw.mbPerSecond, raw.heapPeak);
+    printf("  gzip %zu -> %zu B: %.1f MB/s (inflate + SHA-256 + sink), heap peak %zu B, OtaStream %zu B\n",
+           gz.size(), image().size(), packed.mbPerSecond, packed.heapPeak, sizeof(OtaStream));
+    CHECK_EQ(raw.heapPeak, (size_t)0);
+    // The 32 KB window plus the stream state: about 34 KB whatever the image size
+    CHECK(packed.heapPeak >= INFLATE_WINDOW_SIZE);
+    CHECK(packed.heapPeak + sizeof(OtaStream) <= 34 * 1024);
+}
@@ -0,0 +1,207 @@
+#include "test.h"
+#include "config.h"
+#include "persistence.h"
+#include "presets.h"
+#include "state.h"
+#include <LittleFS.h>
+
+PresetStore presetStore;
+
+static Configuration config;
+static SystemState lights;
+static uint32_t now = 1000;
+
+static void edit(uint8_t maxBrightness) {
+    config.safety.maxBrightness = maxBrightness;
+    ++config.gen.safety;
+}
+
+static void start(Persistence& p) {
+    LittleFS.reset();
+    config.setDefaults();
+    lights = SystemState();
+    p.begin();
+}
+
+static uint32_t stat(const Persistence& p, const char* section, const char* key) {
+    DynamicJsonDocument doc(2048);
+    p.writeStats(doc.to<JsonObject>());
+    return doc["sections"][section][key].as<uint32_t>();
+}
+
+static uint8_t savedMaxBrightness() {
+    Configuration loaded;
+    loaded.load();
+    return loaded.safety.maxBrightness;
+}
+
+TEST(burst_of_edits_is_one_write_once_it_settles) {
+    Persistence p(&config, &lights);
+    start(p);
+    for (int i = 0; i < 10; ++i) {
+        edit(100 + i);
+        p.update(now);
+        now += 500;
+    }
+    uint32_t lastEdit = now - 500;
+    p.update(lastEdit + PERSIST_DEBOUNCE - 1);
+    CHECK(!LittleFS.exists(CONFIG_FILE));
+    CHECK_EQ(LittleFS.bytesWritten, (uint32_t)0);
+    CHECK(p.pending());
+    p.update(lastEdit + PERSIST_DEBOUNCE);
+    CHECK(!p.pending());
+    CHECK_EQ(savedMaxBrightness(), (uint8_t)109);
+    CHECK_EQ(stat(p, "config", "changes"), (uint32_t)10);
+    CHECK_EQ(stat(p, "config", "writes"), (uint32_t)1);
+    now = lastEdit + PERSIST_DEBOUNCE;
+}
+
+TEST(steady_edits_are_written_after_the_max_delay) {
+    Persistence p(&config, &lights);
+    start(p);
+    uint32_t first = now;
+    uint32_t writtenAt = 0;
+    for (uint32_t t = 0; t <= PERSIST_MAX_DELAY && !writtenAt; t += PERSIST_DEBOUNCE / 2) {
+        edit(50 + t / 1000);
+        p.update(first + t);
+        if (LittleFS.exists(CONFIG_FILE)) writtenAt = first + t;
+    }
+    CHECK_EQ(writtenAt, first + PERSIST_MAX_DELAY);
+    CHECK_EQ(stat(p, "config", "writes"), (uint32_t)1);
+    now = writtenAt;
+}
+
+TEST(power_cut_during_a_write_keeps_the_previous_file) {
+    Persistence p(&config, &lights);
+    start(p);
+    edit(120);
+    CHECK(p.flush());
+    std::vector<uint8_t> before = *LittleFS.data(CONFIG_FILE);
+
+    DynamicJsonDocument doc(2048);
+    p.writeStats(doc.to<JsonObject>());
+    uint32_t failedBefore = doc["failedWrites"];
+    edit(80);
+    p.update(now);
+    LittleFS.failWritesAfter(10);
+    now += PERSIST_DEBOUNCE;
+    p.update(now);
+    CHECK(*LittleFS.data(CONFIG_FILE) == before);
+    CHECK(!LittleFS.exists(String(CONFIG_FILE) + ".tmp"));
+    CHECK_EQ(LittleFS.fileCount(), (size_t)1);
+    CHECK(p.pending());
+    CHECK_EQ(stat(p, "config", "failed"), (uint32_t)1);
+    p.writeStats(doc.to<JsonObject>());
+    CHECK_EQ(doc["failedWrites"].as<uint32_t>(), failedBefore + 1);
+
+    // Power is back: retried after another debounce window, not at once
+    LittleFS.failWritesAfter(-1);
+    p.update(now + PERSIST_DEBOUNCE - 1);
+    CHECK(*LittleFS.data(CONFIG_FILE) == before);
+    now += PERSIST_DEBOUNCE;
+    p.update(now);
+    CHECK(!p.pending());
+    CHECK_EQ(savedMaxBrightness(), (uint8_t)80);
+}
+
+TEST(one_file_per_pass_and_flush_writes_everything) {
+    Persistence p(&config, &lights);
+    start(p);
+    edit(90);
+    ++lights.gen.brightness;
+    p.update(now);
+    now += PERSIST_DEBOUNCE;
+    p.update(now);
+    CHECK(p.pending());
+    CHECK(LittleFS.exists(CONFIG_FILE) != LittleFS.exists(STATE_FILE));
+    p.update(now);
+    CHECK(!p.pending());
+    CHECK(LittleFS.exists(CONFIG_FILE) && LittleFS.exists(STATE_FILE));
+
+    // flush() does not wait for the debounce
+    edit(91);
+    ++lights.gen.power;
+    p.update(now);
+    CHECK(p.flush());
+    CHECK(!p.pending());
+    CHECK_EQ(savedMaxBrightness(), (uint8_t)91);
+    CHECK_EQ(stat(p, "config", "writes"), (uint32_t)2);
+    CHECK_EQ(stat(p, "state", "writes"), (uint32_t)2);
+}
+
+TEST(state_is_saved_once_a_fade_ends_and_with_a_fresh_clock) {
+    Persistence p(&config, &lights);
+    start(p);
+    const uint32_t epoch = 486110 * PERSIST_EPOCH_INTERVAL;  // on an interval boundary
+    lights.power = true;
+    lights.brightness = 180;
+    lights.preset = 3;
+    lights.effect = 2;
+    lights.params.colorCount = 2;
+    lights.params.colors[0] = 0x112233;
+    lights.params.colors[1] = 0xff000080;
+    lights.inTransition = true;
+    ++lights.gen.preset;
+    p.update(now, epoch);
+    now += PERSIST_MAX_DELAY;
+    p.update(now, epoch);
+    CHECK(!LittleFS.exists(STATE_FILE));
+    lights.inTransition = false;
+    p.update(now, epoch);
+    p.update(now + PERSIST_DEBOUNCE, epoch);
+    now += PERSIST_DEBOUNCE;
+
+    SystemState loaded;
+    uint32_t savedEpoch = 0;
+    CHECK(loadLastState(loaded, savedEpoch));
+    CHECK_EQ(savedEpoch, epoch);
+    CHECK(loaded.power);
+    CHECK_EQ(loaded.brightness, (uint8_t)180);
+    CHECK_EQ(loaded.preset, (uint8_t)3);
+    CHECK_EQ(loaded.effect, (uint8_t)2);
+    CHECK_EQ(loaded.params.colorCount, (size_t)2);
+    CHECK_EQ(loaded.params.colors[1], (uint32_t)0xff000080);
+
+    // No change but the clock: written again once an interval has passed
+    p.update(now, epoch + PERSIST_EPOCH_INTERVAL - 1);
+    CHECK(!p.pending());
+    p.update(now, epoch + PERSIST_EPOCH_INTERVAL);
+    CHECK(p.pending());
+    CHECK(p.flush());
+    CHECK(loadLastState(loaded, savedEpoch));
+    CHECK_EQ(savedEpoch, epoch + PERSIST_EPOCH_INTERVAL);
+}
+
+TEST(restart_is_due_after_the_requested_delay) {
+    Persistence p(&config);
+    uint32_t t = millis();
+    CHECK(!p.restartDue(t));
+    p.requestRestart(100);
+    CHECK(!p.restartDue(t + 99));
+    CHECK(p.restartDue(t + 100));
+    CHECK(p.restartDue(t + 5000));
+}
+
+TEST(factory_reset_erases_instead_of_flushing) {
+    Persistence p(&config, &lights);
+    start(p);
+    edit(120);
+    ++lights.gen.brightness;
+    CHECK(p.flush());
+    CHECK(LittleFS.exists(STATE_FILE));
+
+    // Edits still pending when the reset is asked for are not written back
+    edit(60);
+    p.update(now);
+    uint32_t t = millis();
+    p.requestFactoryReset(100);
+    CHECK(!p.restartDue(t + 99));
+    CHECK(p.restartDue(t + 100));
+    CHECK_EQ(savedMaxBrightness(), (uint8_t)120);  // nothing touched until loop() runs it
+    CHECK(p.prepareRestart());
+    CHECK(!LittleFS.exists(STATE_FILE));
+    Configuration defaults;
+    defaults.setDefaults();
+    CHECK_EQ(savedMaxBrightness(), defaults.safety.maxBrightness);
+    CHECK_EQ(stat(p, "config", "writes"), (uint32_t)1);
+}
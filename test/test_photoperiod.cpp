@@ -0,0 +1,217 @@
+#include "test.h"
+#include "config.h"
+#include "photoperiod.h"
+#include "presets.h"
+#include <LittleFS.h>
+
+PresetStore presetStore;
+
+static const uint32_t DAY_MS = 86400000UL;
+
+static PhotoperiodKeyframe keyframe(uint8_t hour, uint8_t minute, uint16_t r, uint16_t g, uint16_t b, uint16_t w) {
+    PhotoperiodKeyframe k;
+    k.minute = hour * 60 + minute;
+    k.level = {r, g, b, w};
+    return k;
+}
+
+// Dawn, midday, dusk and a moonlight level overnight (wrapping past midnight)
+static PhotoperiodConfig dayCurve(PhotoperiodInterpolation mode) {
+    PhotoperiodConfig curve;
+    curve.enabled = true;
+    curve.interpolation = mode;
+    curve.keyframes = {
+        keyframe(6, 0, 0, 0, 1000, 0),
+        keyframe(8, 30, 40000, 30000, 50000, 20000),
+        keyframe(13, 0, 65535, 60000, 65535, 65535),
+        keyframe(19, 45, 30000, 20000, 40000, 10000),
+        keyframe(22, 0, 0, 0, 3000, 0),
+    };
+    return curve;
+}
+
+// Keyframe index whose segment contains `ms`, and the position in it
+static size_t segmentAt(const PhotoperiodConfig& curve, uint32_t ms, double& u) {
+    const auto& k = curve.keyframes;
+    size_t n = k.size();
+    for (size_t i = 0; i < n; ++i) {
+        uint32_t start = k[i].minute * 60000UL;
+        uint32_t end = i + 1 < n ? k[i + 1].minute * 60000UL : k[0].minute * 60000UL + DAY_MS;
+        uint32_t t = ms < k[0].minute * 60000UL ? ms + DAY_MS : ms;
+        if (t >= start && t < end) {
+            u = (double)(t - start) / (end - start);
+            return i;
+        }
+    }
+    return 0;
+}
+
+TEST(linear_curve_matches_exact_interpolation_all_day) {
+    PhotoperiodConfig curve = dayCurve(PHOTOPERIOD_LINEAR);
+    PhotoperiodTable table;
+    table.build(curve);
+    int worst = 0;
+    for (uint32_t ms = 0; ms < DAY_MS; ms += 1000) {
+        uint16_t level[PHOTOPERIOD_CHANNELS];
+        table.evaluate(ms, level);
+        double u;
+        size_t i = segmentAt(curve, ms, u);
+        const auto& a = curve.keyframes[i];
+        const auto& b = curve.keyframes[(i + 1) % curve.keyframes.size()];
+        for (size_t c = 0; c < PHOTOPERIOD_CHANNELS; ++c) {
+            double exact = a.level[c] + (b.level[c] - (double)a.level[c]) * u;
+            worst = std::max(worst, (int)fabs(level[c] - exact));
+        }
+    }
+    // Q16 position: one level of 65535 at most
+    CHECK(worst <= 1);
+}
+
+TEST(curves_hit_keyframes_and_never_overshoot) {
+    for (PhotoperiodInterpolation mode : {PHOTOPERIOD_LINEAR, PHOTOPERIOD_CUBIC}) {
+        PhotoperiodConfig curve = dayCurve(mode);
+        PhotoperiodTable table;
+        table.build(curve);
+        for (const PhotoperiodKeyframe& k : curve.keyframes) {
+            uint16_t level[PHOTOPERIOD_CHANNELS];
+            table.evaluate(k.minute * 60000UL, level);
+            for (size_t c = 0; c < PHOTOPERIOD_CHANNELS; ++c) CHECK_EQ(level[c], k.level[c]);
+        }
+        // Every 100 ms of the day: inside the keyframe range of the segment,
+        // moving in one direction, and without visible jumps
+        uint16_t prev[PHOTOPERIOD_CHANNELS];
+        table.evaluate(DAY_MS - 100, prev);
+        int outside = 0, reversals = 0, jumps = 0;
+        for (uint32_t ms = 0; ms < DAY_MS; ms += 100) {
+            uint16_t level[PHOTOPERIOD_CHANNELS];
+            table.evaluate(ms, level);
+            double u;
+            size_t i = segmentAt(curve, ms, u);
+            const auto& a = curve.keyframes[i];
+            const auto& b = curve.keyframes[(i + 1) % curve.keyframes.size()];
+            for (size_t c = 0; c < PHOTOPERIOD_CHANNELS; ++c) {
+                uint16_t lo = std::min(a.level[c], b.level[c]), hi = std::max(a.level[c], b.level[c]);
+                if (level[c] < lo || level[c] > hi) ++outside;
+                int step = (int)level[c] - prev[c];
+                int direction = b.level[c] > a.level[c] ? 1 : (b.level[c] < a.level[c] ? -1 : 0);
+                if (step * direction < -1 || (direction == 0 && step != 0)) ++reversals;
+                if (abs(step) > 64) ++jumps;  // a quarter of one 8-bit step per 100 ms
+                prev[c] = level[c];
+            }
+        }
+        CHECK_EQ(outside, 0);
+        CHECK_EQ(reversals, 0);
+        CHECK_EQ(jumps, 0);
+    }
+}
+
+TEST(lookups_out_of_order_match_a_fresh_table) {
+    PhotoperiodConfig curve = dayCurve(PHOTOPERIOD_CUBIC);
+    PhotoperiodTable walked, fresh;
+    walked.build(curve);
+    uint32_t probes[] = {0, 5 * 3600000, 23 * 3600000, 100, 13 * 3600000, 7 * 3600000, DAY_MS - 1, 21 * 3600000};
+    for (uint32_t ms : probes) {
+        uint16_t a[PHOTOPERIOD_CHANNELS], b[PHOTOPERIOD_CHANNELS];
+        walked.evaluate(ms, a);
+        fresh.build(curve);
+        fresh.evaluate(ms, b);
+        for (size_t c = 0; c < PHOTOPERIOD_CHANNELS; ++c) CHECK_EQ(a[c], b[c]);
+    }
+}
+
+TEST(dither_averages_to_the_16_bit_level) {
+    for (uint16_t level : {0, 1, 127, 128, 255, 256, 1000, 32768, 65280, 65535}) {
+        TemporalDither dither;
+        uint32_t sum = 0;
+        for (int frame = 0; frame < 256; ++frame) sum += dither.apply(0, level);
+        // 256 frames of 8-bit output add up to the 16-bit level
+        CHECK(abs((int)sum - (int)level) <= 255 || level > 65280);
+        CHECK_EQ(sum / 256, (uint32_t)level >> 8);
+    }
+}
+
+// Writes the level of every minute of the day, both interpolations, to
+// photoperiod_curve.csv for plotting (16-bit levels, 0-65535)
+TEST(per_minute_levels_written_for_the_whole_day) {
+    PhotoperiodTable linear, cubic;
+    linear.build(dayCurve(PHOTOPERIOD_LINEAR));
+    cubic.build(dayCurve(PHOTOPERIOD_CUBIC));
+    FILE* f = fopen("photoperiod_curve.csv", "w");
+    CHECK(f != nullptr);
+    if (!f) return;
+    fprintf(f, "minute,time,linear_r,linear_g,linear_b,linear_w,cubic_r,cubic_g,cubic_b,cubic_w\n");
+    size_t rows = 0;
+    uint32_t peak = 0;
+    for (uint32_t minute = 0; minute < 24 * 60; ++minute) {
+        uint16_t a[PHOTOPERIOD_CHANNELS], b[PHOTOPERIOD_CHANNELS];
+        linear.evaluate(minute * 60000UL, a);
+        cubic.evaluate(minute * 60000UL, b);
+        fprintf(f, "%u,%02u:%02u,%u,%u,%u,%u,%u,%u,%u,%u\n", minute, minute / 60, minute % 60,
+                a[0], a[1], a[2], a[3], b[0], b[1], b[2], b[3]);
+        peak = std::max<uint32_t>(peak, a[3]);
+        ++rows;
+    }
+    fclose(f);
+    printf("  %zu minutes written to photoperiod_curve.csv\n", rows);
+    CHECK_EQ(rows, (size_t)1440);
+    CHECK_EQ(peak, (uint32_t)65535);  // white reaches the 13:00 keyframe
+}
+
+TEST(json_round_trip_and_errors) {
+    PhotoperiodConfig curve;
+    DynamicJsonDocument doc(2048);
+    deserializeJson(doc, "{\"enabled\":true,\"interpolation\":\"linear\",\"keyframes\":["
+                         "{\"hour\":20,\"minute\":0,\"rgbw\":[0,0,5,0]},"
+                         "{\"hour\":8,\"minute\":15,\"rgbw\":[100,50.5,25,0.01]}]}");
+    CHECK(photoperiodFromJson(curve, doc.as<JsonObjectConst>()) == nullptr);
+    CHECK(curve.enabled);
+    CHECK_EQ(curve.keyframes.size(), (size_t)2);
+    CHECK_EQ(curve.keyframes[0].minute, (uint16_t)(8 * 60 + 15));  // sorted
+    CHECK_EQ(curve.keyframes[0].level[0], (uint16_t)65535);
+
+    const char* bad[] = {
+        "{\"interpolation\":\"step\"}",
+        "{\"keyframes\":[{\"hour\":24,\"minute\":0,\"rgbw\":[0,0,0,0]}]}",
+        "{\"keyframes\":[{\"hour\":1,\"minute\":0,\"rgbw\":[0,0,0]}]}",
+        "{\"keyframes\":[{\"hour\":1,\"minute\":0,\"rgbw\":[0,0,0,101]}]}",
+        "{\"keyframes\":[{\"hour\":1,\"minute\":0,\"rgbw\":[0,0,0,0]},{\"hour\":1,\"minute\":0,\"rgbw\":[1,1,1,1]}]}",
+        "{\"keyframes\":[]}",
+    };
+    for (const char* json : bad) {
+        PhotoperiodConfig before = curve;
+        deserializeJson(doc, json);
+        CHECK(photoperiodFromJson(curve, doc.as<JsonObjectConst>()) != nullptr);
+        CHECK(curve == before);  // untouched on error
+    }
+}
+
+TEST(saved_curve_loads_back) {
+    LittleFS.reset();
+    PhotoperiodConfig curve = dayCurve(PHOTOPERIOD_CUBIC), loaded;
+    CHECK(savePhotoperiod(curve));
+    CHECK(loadPhotoperiod(loaded));
+    CHECK_EQ(loaded.keyframes.size(), curve.keyframes.size());
+    for (size_t i = 0; i < curve.keyframes.size(); ++i) {
+        CHECK_EQ(loaded.keyframes[i].minute, curve.keyframes[i].minute);
+        // Percent with two decimals on disk: within 0.005% of 65535
+        for (size_t c = 0; c < PHOTOPERIOD_CHANNELS; ++c) {
+            CHECK(abs((int)loaded.keyframes[i].level[c] - curve.keyframes[i].level[c]) <= 4);
+        }
+    }
+}
+
+TEST(factory_reset_removes_the_curve) {
+    LittleFS.reset();
+    Configuration config;
+    config.setDefaults();
+    config.photoperiod = dayCurve(PHOTOPERIOD_LINEAR);
+    CHECK(savePhotoperiod(config.photoperiod));
+    uint32_t gen = config.gen.photoperiod;
+    CHECK(config.factoryReset());
+    CHECK(!config.photoperiod.enabled);
+    CHECK(config.photoperiod.keyframes.empty());
+    CHECK(config.gen.photoperiod != gen);
+    PhotoperiodConfig loaded;
+    CHECK(!loadPhotoperiod(loaded));
+    CHECK(!LittleFS.exists(PHOTOPERIOD_FILE));
+}
@@ -0,0 +1,186 @@
+#include "test.h"
+#include "config.h"
+#include "presets.h"
+#include "colors.h"
+#include <LittleFS.h>
+#include <cstdlib>
+#include <new>
+
+PresetStore presetStore;
+
+// Heap accounting for the whole test binary, as in test_config_store
+static size_t heapLive = 0;
+static size_t heapPeak = 0;
+
+void* operator new(size_t size) {
+    size_t* p = (size_t*)malloc(size + sizeof(max_align_t));
+    if (!p) throw std::bad_alloc();
+    *p = size;
+    heapLive += size;
+    if (heapLive > heapPeak) heapPeak = heapLive;
+    return (char*)p + sizeof(max_align_t);
+}
+
+void operator delete(void* ptr) noexcept {
+    if (!ptr) return;
+    size_t* p = (size_t*)((char*)ptr - sizeof(max_align_t));
+    heapLive -= *p;
+    free(p);
+}
+
+void operator delete(void* ptr, size_t) noexcept { operator delete(ptr); }
+
+static const size_t DEFAULT_PRESETS = 6;
+// Heap the cache may hold whatever the preset count: one name per entry.
+// A get() copies a few more names for a moment.
+static const size_t CACHE_HEAP = PRESET_CACHE_SIZE * (PRESET_NAME_MAX + 1);
+
+// Full-length names, so every cached preset holds the most heap it can
+static Preset makePreset(size_t id) {
+    Preset p;
+    p.id = (uint8_t)id;
+    char name[PRESET_NAME_MAX + 1];
+    snprintf(name, sizeof(name), "Preset %03u %s", (unsigned)id, "................................");
+    p.name = name;
+    p.effect = id % 8;
+    p.params.speed = id;
+    p.params.colorCount = 1;
+    p.params.colors[0] = 0x010203 * id;
+    return p;
+}
+
+struct Footprint {
+    size_t presets;        // presets in the store after the reboot
+    size_t fileBytes;
+    size_t bootPeak;       // heap while begin() scans the slot file
+    size_t walkPeak;       // heap while every preset is read through get()
+    size_t walkLive;       // heap still held afterwards (the cache)
+    uint32_t slotReads;    // file opens for one uncached get()
+};
+
+// Grows the built-in set to `requested` presets, then reboots and reads
+// every one back through a fresh store
+static Footprint grow(size_t requested) {
+    LittleFS.reset();
+    {
+        PresetStore store;
+        CHECK(store.begin());
+        CHECK_EQ(store.count(), DEFAULT_PRESETS);
+        // Ids are 8-bit, so anything past 255 cannot even be asked for; the
+        // store refuses 255 itself (MAX_PRESETS)
+        for (size_t id = DEFAULT_PRESETS; id < std::min<size_t>(requested, 256); ++id) {
+            CHECK_EQ(store.put(makePreset(id)), id < MAX_PRESETS);
+            if (id % PRESET_CACHE_SIZE == 0) CHECK(store.flush());
+        }
+        CHECK(store.flush());
+    }
+
+    Footprint f;
+    PresetStore store;
+    size_t base = heapLive;
+    heapPeak = heapLive;
+    CHECK(store.begin());
+    f.bootPeak = heapPeak - base;
+    f.presets = store.count();
+    f.fileBytes = LittleFS.data(PRESET_STORE_FILE)->size();
+
+    heapPeak = heapLive;
+    for (size_t id = 0; id < MAX_PRESETS; ++id) {
+        Preset p;
+        if (!store.get((uint8_t)id, p)) continue;
+        if (id >= DEFAULT_PRESETS) {
+            Preset expected = makePreset(id);
+            CHECK(p.name == expected.name.substring(0, PRESET_NAME_MAX));
+            CHECK_EQ(p.params.colors[0], expected.params.colors[0]);
+        }
+    }
+    f.walkPeak = heapPeak - base;
+    f.walkLive = heapLive - base;
+
+    uint32_t opens = LittleFS.opens;
+    Preset p;
+    CHECK(store.get(1, p));  // evicted by the walk
+    f.slotReads = LittleFS.opens - opens;
+    printf("  %zu requested: %zu presets, file %zu B, boot peak %zu B, walk peak %zu B, cached %zu B\n",
+           requested, f.presets, f.fileBytes, f.bootPeak, f.walkPeak, f.walkLive);
+    return f;
+}
+
+TEST(ram_does_not_grow_from_6_to_200_presets) {
+    Footprint small = grow(DEFAULT_PRESETS);
+    Footprint large = grow(200);
+    CHECK_EQ(small.presets, DEFAULT_PRESETS);
+    CHECK_EQ(large.presets, (size_t)200);
+    CHECK(large.fileBytes > small.fileBytes * 30);
+    CHECK_EQ(large.bootPeak, small.bootPeak);
+    CHECK(large.walkLive <= CACHE_HEAP);
+    CHECK(large.walkPeak <= 2 * CACHE_HEAP);
+    CHECK_EQ(large.slotReads, (uint32_t)1);
+}
+
+TEST(ram_does_not_grow_from_6_to_500_presets) {
+    Footprint small = grow(DEFAULT_PRESETS);
+    Footprint large = grow(500);
+    // Every id the 8-bit protocol can address, and nothing beyond it
+    CHECK_EQ(large.presets, (size_t)MAX_PRESETS);
+    CHECK(large.fileBytes > small.fileBytes * 40);
+    CHECK_EQ(large.bootPeak, small.bootPeak);
+    CHECK(large.walkLive <= CACHE_HEAP);
+    CHECK(large.walkPeak <= 2 * CACHE_HEAP);
+    CHECK_EQ(large.slotReads, (uint32_t)1);
+}
+
+TEST(json_edit_keeps_params_it_does_not_mention) {
+    Preset p = makePreset(7);
+    DynamicJsonDocument doc(512);
+    deserializeJson(doc, "{\"id\":3,\"name\":\"Moon\",\"effect\":2}");
+    presetFromJson(p, doc.as<JsonObjectConst>());
+    CHECK_EQ(p.id, (uint8_t)7);
+    CHECK(p.name == String("Moon"));
+    CHECK_EQ(p.effect, (uint8_t)2);
+    CHECK_EQ(p.params.speed, (uint8_t)7);
+    CHECK_EQ(p.params.colors[0], (uint32_t)0x010203 * 7);
+
+    deserializeJson(doc, "{\"name\":\"Sun\",\"params\":{\"speed\":100,\"colors\":[\"#FF8000\"]}}");
+    presetFromJson(p, doc.as<JsonObjectConst>());
+    CHECK_EQ(p.effect, (uint8_t)0);
+    CHECK_EQ(p.params.speed, (uint8_t)255);
+    CHECK_EQ(p.params.intensity, percentToHex(50));
+    CHECK_EQ(p.params.colorCount, (size_t)1);
+}
+
+TEST(unsaved_edits_are_never_evicted) {
+    LittleFS.reset();
+    PresetStore store;
+    CHECK(store.begin());
+    uint32_t written = LittleFS.bytesWritten;
+    // Every cache entry holds an edit: nothing is written behind flush()'s back
+    const size_t first = DEFAULT_PRESETS, extra = DEFAULT_PRESETS + PRESET_CACHE_SIZE;
+    for (size_t id = first; id < extra; ++id) CHECK(store.put(makePreset(id)));
+    CHECK(!store.put(makePreset(extra)));
+    CHECK(!store.exists(extra));
+    CHECK_EQ(LittleFS.bytesWritten, written);
+    // Reads still work, without taking a cache entry
+    Preset p;
+    CHECK(store.get(1, p));
+    for (size_t id = first; id < extra; ++id) {
+        CHECK(store.get((uint8_t)id, p));
+        CHECK(p.name == makePreset(id).name.substring(0, PRESET_NAME_MAX));
+    }
+
+    // Power cut while flushing: the edits stay dirty and are written later
+    LittleFS.failWritesAfter(0);
+    CHECK(!store.flush());
+    CHECK(!store.put(makePreset(extra)));
+    LittleFS.failWritesAfter(-1);
+    CHECK(store.flush());
+    CHECK(store.put(makePreset(extra)));
+    CHECK(store.flush());
+
+    PresetStore rebooted;
+    CHECK(rebooted.begin());
+    for (size_t id = first; id <= extra; ++id) {
+        CHECK(rebooted.get((uint8_t)id, p));
+        CHECK_EQ(p.params.colors[0], makePreset(id).params.colors[0]);
+    }
+}
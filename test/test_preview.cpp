@@ -0,0 +1,232 @@
+#include "test.h"
+#include "preview.h"
+#include "ws_protocol.h"
+#include <chrono>
+#include <string.h>
+
+// Client side of the preview stream, as the web UI applies it
+struct PreviewDecoder {
+    std::vector<uint8_t> pixels;
+    uint16_t lastSequence = 0;
+    bool synced = false;
+
+    bool apply(const uint8_t* msg, size_t len) {
+        if (len < PREVIEW_HEADER_SIZE || msg[0] != WS_PROTOCOL_VERSION || msg[1] != WS_MSG_PREVIEW) return false;
+        bool keyframe = msg[2] & PREVIEW_FLAG_KEYFRAME;
+        uint16_t count = msg[3] | (msg[4] << 8);
+        uint16_t sequence = msg[5] | (msg[6] << 8);
+        if (!keyframe && (!synced || sequence != (uint16_t)(lastSequence + 1))) return false;
+        pixels.resize((size_t)count * 3);
+        size_t pos = PREVIEW_HEADER_SIZE;
+        size_t p = 0;
+        while (pos + 5 <= len) {
+            p += msg[pos];
+            for (uint8_t i = 0; i < msg[pos + 1] && p < count; ++i, ++p) memcpy(&pixels[p * 3], &msg[pos + 2], 3);
+            pos += 5;
+        }
+        if (pos != len || p > count) return false;
+        if (keyframe && p != count) return false;  // keyframes paint everything
+        lastSequence = sequence;
+        synced = true;
+        return true;
+    }
+};
+
+static std::vector<uint32_t> strip;
+
+static void capture(PreviewEncoder& encoder) {
+    encoder.capture((uint16_t)strip.size(), [](uint16_t i) { return strip[i]; });
+}
+
+// Expected preview pixel p, computed the slow way
+static void expectedPixel(uint16_t p, uint16_t pixels, uint8_t out[3]) {
+    size_t start = (size_t)p * strip.size() / pixels;
+    size_t end = (size_t)(p + 1) * strip.size() / pixels;
+    uint32_t sum[3] = {0, 0, 0};
+    for (size_t i = start; i < end; ++i) {
+        uint8_t c[4];
+        unpack_rgbw(strip[i], c[0], c[1], c[2], c[3]);
+        for (int k = 0; k < 3; ++k) sum[k] += c[k] + (255 - c[k]) * c[3] / 255;
+    }
+    for (int k = 0; k < 3; ++k) out[k] = sum[k] / (end - start);
+}
+
+static bool decodedMatchesStrip(const PreviewDecoder& decoder, uint16_t pixels) {
+    if (decoder.pixels.size() != (size_t)pixels * 3) return false;
+    for (uint16_t p = 0; p < pixels; ++p) {
+        uint8_t expected[3];
+        expectedPixel(p, pixels, expected);
+        if (memcmp(expected, &decoder.pixels[p * 3], 3) != 0) return false;
+    }
+    return true;
+}
+
+TEST(keyframe_then_deltas_track_the_strip) {
+    strip.assign(300, 0);
+    for (size_t i = 0; i < strip.size(); ++i) strip[i] = pack_rgbw(i & 0xFF, 255 - (i & 0xFF), 40, i % 7 == 0 ? 128 : 0);
+    PreviewEncoder encoder;
+    PreviewDecoder decoder;
+    std::vector<uint8_t> out(encoder.maxMessageSize() + 64);
+
+    capture(encoder);
+    size_t n = encoder.encode(out.data(), out.size());
+    CHECK(n > 0);
+    CHECK(out[2] & PREVIEW_FLAG_KEYFRAME);
+    CHECK(decoder.apply(out.data(), n));
+    CHECK(decodedMatchesStrip(decoder, PREVIEW_PIXELS));
+
+    // Nothing changed: nothing to send
+    capture(encoder);
+    CHECK_EQ(encoder.encode(out.data(), out.size()), (size_t)0);
+
+    // One LED changes: one preview pixel is repainted, the rest skipped
+    strip[150] = pack_rgbw(255, 255, 255, 255);
+    capture(encoder);
+    n = encoder.encode(out.data(), out.size());
+    CHECK_EQ(n, (size_t)(PREVIEW_HEADER_SIZE + 5));
+    CHECK(!(out[2] & PREVIEW_FLAG_KEYFRAME));
+    CHECK(decoder.apply(out.data(), n));
+    CHECK(decodedMatchesStrip(decoder, PREVIEW_PIXELS));
+}
+
+TEST(keyframe_interval_and_requests) {
+    strip.assign(64, pack_rgbw(10, 20, 30, 0));
+    PreviewEncoder encoder;
+    PreviewDecoder decoder;
+    std::vector<uint8_t> out(encoder.maxMessageSize());
+    uint32_t keyframes = 0;
+    for (uint32_t frame = 0; frame < 3 * PREVIEW_KEYFRAME_INTERVAL; ++frame) {
+        strip[frame % strip.size()] = pack_rgbw(frame & 0xFF, 0, 0, 0);
+        capture(encoder);
+        size_t n = encoder.encode(out.data(), out.size());
+        CHECK(n > 0);
+        if (out[2] & PREVIEW_FLAG_KEYFRAME) ++keyframes;
+        CHECK(decoder.apply(out.data(), n));
+    }
+    CHECK_EQ(keyframes, (uint32_t)3);
+    CHECK(decodedMatchesStrip(decoder, 64));
+
+    // A new subscriber: the next frame is sent in full even if nothing changed
+    encoder.requestKeyframe();
+    capture(encoder);
+    size_t n = encoder.encode(out.data(), out.size());
+    CHECK(n > 0);
+    CHECK(out[2] & PREVIEW_FLAG_KEYFRAME);
+    PreviewDecoder late;
+    CHECK(late.apply(out.data(), n));
+    CHECK(decodedMatchesStrip(late, 64));
+}
+
+TEST(long_skips_and_runs) {
+    // More preview pixels than a u8 skip/run can express in one token
+    const uint16_t pixels = 600;
+    strip.assign(pixels, pack_rgbw(1, 2, 3, 0));
+    PreviewEncoder encoder(pixels);
+    PreviewDecoder decoder;
+    std::vector<uint8_t> out(encoder.maxMessageSize());
+    capture(encoder);
+    size_t n = encoder.encode(out.data(), out.size());
+    CHECK(decoder.apply(out.data(), n));
+    // Uniform keyframe: 600 pixels in runs of at most 255
+    CHECK_EQ(n, (size_t)(PREVIEW_HEADER_SIZE + 3 * 5));
+
+    strip[pixels - 1] = pack_rgbw(9, 9, 9, 0);
+    capture(encoder);
+    n = encoder.encode(out.data(), out.size());
+    CHECK(n > 0);
+    CHECK(decoder.apply(out.data(), n));
+    CHECK(decodedMatchesStrip(decoder, pixels));
+}
+
+TEST(short_buffer_keeps_keyframe_pending) {
+    strip.assign(64, 0);
+    for (size_t i = 0; i < strip.size(); ++i) strip[i] = pack_rgbw(i * 4, 0, 0, 0);
+    PreviewEncoder encoder;
+    std::vector<uint8_t> out(encoder.maxMessageSize());
+    capture(encoder);
+    CHECK_EQ(encoder.encode(out.data(), PREVIEW_HEADER_SIZE + 10), (size_t)0);
+    // The failed keyframe is not counted as sent; the retry is still one
+    size_t n = encoder.encode(out.data(), out.size());
+    CHECK(n > 0);
+    CHECK(out[2] & PREVIEW_FLAG_KEYFRAME);
+    CHECK_EQ(encoder.framesEncoded, (uint32_t)1);
+}
+
+TEST(shorter_strip_is_not_upsampled) {
+    strip.assign(10, pack_rgbw(0, 0, 0, 255));
+    PreviewEncoder encoder;
+    PreviewDecoder decoder;
+    std::vector<uint8_t> out(encoder.maxMessageSize());
+    capture(encoder);
+    CHECK_EQ(encoder.pixelCount(), (uint16_t)10);
+    size_t n = encoder.encode(out.data(), out.size());
+    CHECK(decoder.apply(out.data(), n));
+    CHECK(decodedMatchesStrip(decoder, 10));
+    CHECK_EQ(decoder.pixels[0], (uint8_t)255);  // white folded into RGB
+}
+
+// Encoder cost over typical strip content: bytes sent per frame against raw
+// 8-bit RGB of every preview pixel, and capture + encode time per frame
+struct Workload {
+    const char* name;
+    void (*frame)(uint32_t n);
+};
+
+static uint32_t noise = 1;
+static uint8_t nextNoise() {
+    noise = noise * 1103515245 + 12345;
+    return noise >> 16;
+}
+
+static const Workload WORKLOADS[] = {
+    {"static", [](uint32_t) {}},
+    // A sunrise ramp: the whole strip brightens one step every few frames
+    {"gradient", [](uint32_t n) {
+        for (size_t i = 0; i < strip.size(); ++i) {
+            uint8_t level = std::min<uint32_t>(255, n / 4 + i * 64 / strip.size());
+            strip[i] = pack_rgbw(level, level / 2, level / 4, 0);
+        }
+    }},
+    // Moonlight twinkle: a few LEDs change each frame
+    {"noisy", [](uint32_t) {
+        for (int k = 0; k < 4; ++k) strip[nextNoise() % strip.size()] = pack_rgbw(0, 0, nextNoise(), nextNoise() / 4);
+    }},
+    {"full-change", [](uint32_t) {
+        for (uint32_t& led : strip) led = pack_rgbw(nextNoise(), nextNoise(), nextNoise(), 0);
+    }},
+};
+
+TEST(bytes_and_time_per_frame) {
+    const uint32_t frames = 2000;
+    const double raw = PREVIEW_HEADER_SIZE + 3.0 * PREVIEW_PIXELS;
+    for (const Workload& w : WORKLOADS) {
+        strip.assign(300, 0);
+        for (size_t i = 0; i < strip.size(); ++i) strip[i] = pack_rgbw(20, 40, 80 + i % 100, 0);
+        PreviewEncoder encoder;
+        PreviewDecoder decoder;
+        std::vector<uint8_t> out(encoder.maxMessageSize());
+        uint64_t bytes = 0;
+        bool tracked = true;
+        double encodeUs = 0;
+        for (uint32_t n = 0; n < frames; ++n) {
+            w.frame(n);
+            auto start = std::chrono::steady_clock::now();
+            capture(encoder);
+            size_t len = encoder.encode(out.data(), out.size());
+            encodeUs += std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+            bytes += len;
+            if (len > 0) tracked = decoder.apply(out.data(), len) && tracked;
+        }
+        CHECK(tracked);
+        CHECK(decodedMatchesStrip(decoder, PREVIEW_PIXELS));
+        double perFrame = (double)bytes / frames;
+        printf("  %-12s %6.1f B/frame (raw RGB %.0f, %3.0f%%), %5.2f us/frame\n",
+               w.name, perFrame, raw, 100 * perFrame / raw, encodeUs / frames);
+        if (strcmp(w.name, "full-change") == 0) {
+            // Nothing repeats: every frame is painted in full, one token per pixel
+            CHECK(perFrame <= encoder.maxMessageSize());
+        } else {
+            CHECK(perFrame * 4 < raw);
+        }
+    }
+}
@@ -0,0 +1,323 @@
+#include "test.h"
+#include "bus_manager.h"
+#include "config.h"
+#include "effects.h"
+#include "frame_cache.h"
+#include "persistence.h"
+#include "presets.h"
+#include "scheduler.h"
+#include "sim_clock.h"
+#include "state.h"
+#include "timezone.h"
+#include "transition.h"
+#include "webserver.h"
+#include <LittleFS.h>
+#include <NeoPixelBus.h>
+#include <chrono>
+#include <map>
+#include <set>
+
+// Replays whole days of the control path on the simulated clock: the time
+// task (checkAndApplyScheduleAfterBoot, Scheduler::update/pollDue,
+// checkSchedule -> applyPreset) and the render task
+// (TransitionEngine::update, updateLEDs) against an in-memory strip. Every
+// rendered frame is recorded with the preset, brightness and a checksum of
+// the pixels the strip shows; the trace is written to replay_trace.csv.
+
+// The globals main.cpp defines
+BusManager busManager;
+Configuration config;
+Scheduler scheduler(&config);
+TransitionEngine transition;
+WebServerManager webServer(&config, &scheduler);
+PresetStore presetStore;
+Persistence persistence(&config);
+FrameCache frameCache;
+void* strip = nullptr;
+
+// The part of WebServerManager the control path uses (webserver.cpp needs
+// the network stack)
+static uint32_t broadcasts = 0;
+WebServerManager::WebServerManager(Configuration* config, Scheduler* scheduler) : _config(config), _scheduler(scheduler) {}
+void WebServerManager::broadcastState() { ++broadcasts; }
+bool WebServerManager::applyBrightnessLimit(uint8_t& brightness) {
+    if (brightness <= _config->safety.maxBrightness) return false;
+    brightness = _config->safety.maxBrightness;
+    return true;
+}
+bool WebServerManager::applyTransitionTimeLimit(uint32_t& transitionTime) {
+    if (transitionTime >= _config->safety.minTransitionTime) return false;
+    transitionTime = _config->safety.minTransitionTime;
+    return true;
+}
+
+typedef NeoPixelBus<NeoRgbwFeature, NeoSk6812Method> Strip;
+
+static Strip* shownStrip() {
+    BusNeoPixel* neo = busManager.getNeoPixelBus();
+    return neo ? (Strip*)neo->getStrip() : nullptr;
+}
+
+static uint32_t frameChecksum() {
+    uint32_t h = 2166136261u;  // FNV-1a
+    for (const RgbwColor& c : shownStrip()->shown) {
+        for (uint8_t b : {c.R, c.G, c.B, c.W}) h = (h ^ b) * 16777619u;
+    }
+    return h;
+}
+
+struct Sample {
+    uint32_t ms;         // controlMillis()
+    int64_t local;       // local epoch seconds
+    uint8_t preset;
+    bool power;
+    bool transitioning;
+    uint8_t brightness;  // TransitionEngine current brightness
+    uint32_t checksum;
+};
+
+static std::vector<Sample> trace;
+static uint32_t shows = 0;
+static uint32_t passes = 0;
+
+// One loop() pass of main.cpp's time and render tasks
+static void loopPass() {
+    ++passes;
+    checkAndApplyScheduleAfterBoot();
+    scheduler.update();
+    if (scheduler.pollDue()) checkSchedule();
+    transition.update();
+    updateLEDs();
+    Strip* s = shownStrip();
+    if (s->shows == shows) return;  // nothing shown (power off keeps the last frame)
+    shows = s->shows;
+    trace.push_back({controlMillis(), scheduler.clock().isSynced() ? scheduler.clock().localEpoch() : -1,
+                     state.preset, state.power, transition.isTransitioning(),
+                     transition.getCurrentBrightness(), frameChecksum()});
+}
+
+// Frames at FRAMES_PER_SECOND while a transition runs (sampled every 50 ms,
+// enough for the curve), otherwise one per second or up to the next timer
+static void replay(uint32_t ms) {
+    for (uint32_t end = controlMillis() + ms; (int32_t)(end - controlMillis()) > 0;) {
+        uint32_t step = transition.isTransitioning() ? 50 : std::min<uint32_t>(1000, scheduler.millisUntilDue());
+        step = std::max<uint32_t>(1, std::min<uint32_t>(step, end - controlMillis()));
+        advanceSimulatedMillis(step);
+        hostAdvanceMillis(step);
+        loopPass();
+    }
+}
+
+static uint32_t utcAt(int32_t y, uint8_t m, uint8_t d, int hour, int minute) {
+    return (uint32_t)((int64_t)daysFromCivil(y, m, d) * 86400 + hour * 3600 + minute * 60);
+}
+
+static int minuteOfDay(int64_t local) {
+    return (int)(((local % 86400) + 86400) % 86400 / 60);
+}
+
+static const Timer* timerFor(uint8_t presetId) {
+    for (const Timer& t : config.timers) {
+        if (t.enabled && t.presetId == presetId) return &t;
+    }
+    return nullptr;
+}
+
+static size_t bootSamples = 0;
+static const uint32_t START = utcAt(2025, 3, 14, 3, 0);  // Etc/UTC
+
+TEST(boot_before_time_keeps_last_state_then_recovers_schedule) {
+    LittleFS.reset();
+    config.setDefaults();
+    // The default day without its midnight "Off" timer: between midnight and
+    // 07:00 the schedule has to wrap back to yesterday's 22:00 moonlight
+    config.timers.erase(config.timers.begin());
+    ++config.gen.timers;
+    CHECK(presetStore.begin());
+    ++config.gen.presets;
+    CHECK_EQ(config.led.type, String("SK6812"));
+
+    // setup()
+    busManager.setupStrip(config.led.type, config.led.colorOrder, config.led.pin, config.led.count);
+    updatePixelCount();
+    transition.forceCurrentBrightness(state.brightness);
+    scheduler.begin();
+    scheduler.update();
+    setEffect(state.effect, state.params);
+    setBrightness(state.brightness);
+    setPower(true);
+    checkAndApplyScheduleAfterBoot();
+    CHECK(!scheduler.isTimeValid());
+
+    // No time yet: the lights show the last state, no timer is applied
+    replay(10000);
+    CHECK(!trace.empty());
+    for (const Sample& s : trace) CHECK_EQ(s.preset, (uint8_t)0);
+    bootSamples = trace.size();
+
+    // NTP answers at 03:00: the preset of yesterday's last timer fades in
+    // with the power-on transition time
+    scheduler.syncTime(START);
+    replay(50);
+    CHECK_EQ(state.preset, (uint8_t)4);
+    CHECK_EQ(state.transitionTime, config.transitionTimes.powerOn);
+    CHECK(transition.isTransitioning());
+    CHECK_EQ(transition.getTargetBrightness(), std::min(timerFor(4)->brightness, config.safety.maxBrightness));
+}
+
+TEST(two_days_of_timers_fire_in_order_and_once) {
+    const uint32_t simulated = 2 * 86400 * 1000u;
+    size_t frames = trace.size();
+    uint32_t passesBefore = passes;
+    auto start = std::chrono::steady_clock::now();
+    replay(simulated);
+    double wallMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    frames = trace.size() - frames;
+    printf("  %u simulated ms in %.1f wall ms: %.0f simulated ms per wall ms, %.0f frames/s, %.0f loop passes/s\n",
+           simulated, wallMs, simulated / wallMs, frames * 1000.0 / wallMs, (passes - passesBefore) * 1000.0 / wallMs);
+    // Loose, so a loaded machine does not fail it: a day replays in minutes at worst
+    CHECK(simulated / wallMs > 100);
+    // Preset changes after boot, with the local time they were first shown
+    std::vector<std::pair<int, uint8_t>> changes;
+    uint8_t last = 4;
+    for (size_t i = bootSamples; i < trace.size(); ++i) {
+        if (trace[i].preset != last) {
+            changes.push_back({minuteOfDay(trace[i].local), trace[i].preset});
+            last = trace[i].preset;
+        }
+    }
+    const std::pair<int, uint8_t> day[] = {{7 * 60, 1}, {11 * 60, 2}, {19 * 60, 3}, {22 * 60, 4}};
+    CHECK_EQ(changes.size(), (size_t)8);
+    for (size_t i = 0; i < changes.size() && i < 8; ++i) CHECK(changes[i] == day[i % 4]);
+    // Ends where it started: moonlight, wrapping past midnight
+    CHECK_EQ(state.preset, (uint8_t)4);
+    CHECK(state.power);
+}
+
+TEST(brightness_curves_are_monotone_and_end_on_target) {
+    // Split the trace into transitions (runs of transitioning samples)
+    size_t transitions = 0;
+    for (size_t i = bootSamples; i < trace.size();) {
+        if (!trace[i].transitioning) {
+            ++i;
+            continue;
+        }
+        size_t begin = i;
+        while (i < trace.size() && trace[i].transitioning) ++i;
+        if (i == trace.size()) break;
+        ++transitions;
+        uint8_t target = std::min(timerFor(trace[begin].preset)->brightness, config.safety.maxBrightness);
+        int direction = 0, reversals = 0;
+        for (size_t k = begin + 1; k <= i; ++k) {
+            int step = (int)trace[k].brightness - trace[k - 1].brightness;
+            if (step == 0) continue;
+            int d = step > 0 ? 1 : -1;
+            if (direction != 0 && d != direction) ++reversals;
+            direction = d;
+        }
+        CHECK_EQ(reversals, 0);
+        // Settled on the timer's brightness, after the schedule transition time
+        // (the first one after boot uses the power-on time)
+        CHECK_EQ(trace[i].brightness, target);
+        uint32_t took = trace[i].ms - trace[begin].ms;
+        uint32_t expected = transitions == 1 ? config.transitionTimes.powerOn : config.transitionTimes.schedule;
+        CHECK(took + 100 >= expected && took <= expected + 100);
+        for (size_t k = begin; k <= i; ++k) CHECK(trace[k].brightness <= config.safety.maxBrightness);
+    }
+    CHECK_EQ(transitions, (size_t)9);  // boot recovery + 4 timers a day
+}
+
+TEST(frames_repeat_day_to_day_and_match_the_preset) {
+    // Daylight is a static effect: once its fade has settled the strip shows
+    // one frame until 19:00, the same on both days
+    std::map<int, std::set<uint32_t>> daylightByDay;
+    std::map<uint8_t, std::set<uint32_t>> animated;
+    for (size_t i = bootSamples; i < trace.size(); ++i) {
+        const Sample& s = trace[i];
+        if (s.transitioning) continue;
+        if (s.preset == 2) daylightByDay[(int)(s.local / 86400)].insert(s.checksum);
+        else animated[s.preset].insert(s.checksum);
+    }
+    CHECK_EQ(daylightByDay.size(), (size_t)2);
+    for (auto& day : daylightByDay) CHECK_EQ(day.second.size(), (size_t)1);
+    CHECK(daylightByDay.begin()->second == daylightByDay.rbegin()->second);
+    // Sunrise, sunset and moonlight keep moving
+    for (uint8_t preset : {1, 3, 4}) CHECK(animated[preset].size() > 100);
+
+    // ...and that frame is the preset rendered on its own at the timer's brightness
+    Preset daylight;
+    CHECK(presetStore.get(2, daylight));
+    uint8_t brightness = std::min(timerFor(2)->brightness, config.safety.maxBrightness);
+    std::vector<uint32_t> expected(config.led.count);
+    renderEffectToBuffer(daylight.effect, daylight.params, expected, expected.size(), daylight.params.colors,
+                         daylight.params.colorCount, brightness);
+    // NTP steps forward into the afternoon of a later day: the missed 11:00
+    // timer catches up and the strip itself can be compared
+    scheduler.syncTime(utcAt(2025, 3, 17, 15, 0));
+    replay(config.transitionTimes.schedule + 60000);
+    CHECK_EQ(state.preset, (uint8_t)2);
+    CHECK(!transition.isTransitioning());
+    for (size_t i = 0; i < expected.size(); ++i) CHECK_EQ(busManager.getPixelColor(i), expected[i]);
+    CHECK_EQ(frameChecksum(), *daylightByDay.begin()->second.begin());
+
+    FILE* f = fopen("replay_trace.csv", "w");
+    if (f) {
+        fprintf(f, "ms,local,preset,power,transitioning,brightness,checksum\n");
+        for (const Sample& s : trace) {
+            fprintf(f, "%u,%lld,%u,%d,%d,%u,%08x\n", s.ms, (long long)s.local, s.preset, s.power, s.transitioning,
+                    s.brightness, s.checksum);
+        }
+        fclose(f);
+    }
+    printf("  %zu frames, %u broadcasts\n", trace.size(), broadcasts);
+}
+
+TEST(saved_state_comes_back_after_a_power_cut) {
+    // Daylight, settled: the persistence service saves it with the clock
+    Persistence saver(&config, &state);
+    saver.begin();
+    CHECK(!saver.pending());
+    setBrightness(config.safety.maxBrightness / 2);
+    replay(config.transitionTimes.manual + 1000);
+    uint32_t epoch = scheduler.clock().utcEpoch();
+    saver.update(0, epoch);
+    CHECK(saver.pending());
+    saver.update(PERSIST_DEBOUNCE - 1, epoch);
+    CHECK(saver.pending());
+    saver.update(PERSIST_DEBOUNCE, epoch);
+    CHECK(!saver.pending());
+    // ...and again once the saved clock is an interval old
+    saver.update(PERSIST_DEBOUNCE + 1000, epoch + PERSIST_EPOCH_INTERVAL);
+    CHECK(saver.pending());
+    saver.update(2 * PERSIST_DEBOUNCE + 1000, epoch + PERSIST_EPOCH_INTERVAL);
+    CHECK(!saver.pending());
+
+    SystemState saved;
+    uint32_t savedEpoch = 0;
+    CHECK(loadLastState(saved, savedEpoch));
+    CHECK_EQ(savedEpoch, epoch + PERSIST_EPOCH_INTERVAL);
+    CHECK(saved.power);
+    CHECK_EQ(saved.brightness, state.brightness);
+    CHECK_EQ(saved.preset, (uint8_t)2);
+    CHECK_EQ(saved.effect, state.effect);
+    CHECK(saved.params == state.params);
+    uint32_t lit = frameChecksum();
+
+    // Power cut: dark, then the boot path restores the saved state
+    setPower(false);
+    replay(config.transitionTimes.powerOn + 1000);
+    CHECK(!state.power);
+    size_t from = trace.size();
+    restoreState(saved);
+    CHECK(state.power);
+    replay(config.transitionTimes.powerOn + 1000);
+    int reversals = 0;
+    for (size_t i = from + 1; i < trace.size(); ++i) {
+        if (trace[i].brightness < trace[i - 1].brightness) ++reversals;
+    }
+    CHECK_EQ(reversals, 0);
+    CHECK(trace[from].brightness < saved.brightness / 4);
+    CHECK_EQ(transition.getCurrentBrightness(), saved.brightness);
+    CHECK_EQ(state.preset, (uint8_t)2);
+    CHECK_EQ(frameChecksum(), lit);
+}
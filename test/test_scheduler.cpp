@@ -0,0 +1,185 @@
+#include "test.h"
+#include "config.h"
+#include "presets.h"
+#include "scheduler.h"
+#include "sim_clock.h"
+#include "timezone.h"
+#include <map>
+#include <set>
+
+PresetStore presetStore;
+
+// Built with SIMULATED_CLOCK: the scheduler reads g_simMillis and takes the
+// wall clock only from syncTime()
+
+static uint32_t utcAt(int32_t y, uint8_t m, uint8_t d, int hour, int minute, int32_t offset) {
+    return (uint32_t)((int64_t)daysFromCivil(y, m, d) * 86400 + hour * 3600 + minute * 60 - offset);
+}
+
+static Timer timerAt(uint8_t hour, uint8_t minute, uint8_t presetId = 1, TimerType type = TIMER_REGULAR) {
+    Timer t;
+    t.enabled = true;
+    t.type = type;
+    t.hour = hour;
+    t.minute = minute;
+    t.presetId = presetId;
+    return t;
+}
+
+static void setZone(Configuration& config, const char* zone) {
+    config.time.timezone = zone;
+    config.time.dstEnabled = true;
+    config.time.ntpServer = "pool.ntp.org";
+    ++config.gen.time;
+}
+
+struct Firing {
+    int32_t day;
+    uint16_t minute;
+    uint32_t secondOfDay;
+};
+
+// Runs the scheduler in `stepMs` ticks for `ms` and records every firing
+static std::vector<Firing> run(Scheduler& s, uint32_t ms, uint32_t stepMs = 1000) {
+    std::vector<Firing> fired;
+    for (uint32_t t = 0; t < ms; t += stepMs) {
+        advanceSimulatedMillis(stepMs);
+        s.update();
+        while (s.pollDue()) fired.push_back({s.clock().dayNumber(), s.clock().minuteOfDay(), s.clock().secondOfDay()});
+    }
+    return fired;
+}
+
+static std::map<int32_t, std::multiset<uint16_t>> byDay(const std::vector<Firing>& fired) {
+    std::map<int32_t, std::multiset<uint16_t>> days;
+    for (const Firing& f : fired) days[f.day].insert(f.minute);
+    return days;
+}
+
+TEST(every_timer_fires_once_per_day_on_the_minute) {
+    Configuration config;
+    setZone(config, "Europe/Berlin");
+    config.time.latitude = 52.52;
+    config.time.longitude = 13.405;
+    config.timers = {timerAt(0, 0), timerAt(6, 0), timerAt(12, 30), timerAt(12, 30, 2), timerAt(23, 59),
+                     timerAt(0, 0, 3, TIMER_SUNRISE), timerAt(0, 0, 4, TIMER_SUNSET)};
+    Timer disabled = timerAt(9, 0);
+    disabled.enabled = false;
+    config.timers.push_back(disabled);
+    ++config.gen.timers;
+
+    Scheduler s(&config);
+    s.begin();
+    CHECK(!s.pollDue());  // no time yet
+    // Start just before local midnight so every day below is complete
+    s.syncTime(utcAt(2025, 5, 31, 23, 58, 7200) + 30);
+    std::vector<Firing> fired = run(s, 3 * 86400 * 1000u);
+
+    auto days = byDay(fired);
+    CHECK_EQ(days.size(), (size_t)4);
+    for (auto& day : days) {
+        if (day.first == days.begin()->first) {
+            CHECK(day.second == std::multiset<uint16_t>({23 * 60 + 59}));
+            continue;
+        }
+        if (day.first == days.rbegin()->first) continue;  // partial last day
+        // 00:00, 06:00, 12:30 (two timers, one firing), 23:59, sunrise, sunset
+        CHECK_EQ(day.second.size(), (size_t)6);
+        std::set<uint16_t> distinct(day.second.begin(), day.second.end());
+        CHECK_EQ(distinct.size(), day.second.size());
+        CHECK(distinct.count(6 * 60) && distinct.count(12 * 60 + 30) && !distinct.count(9 * 60));
+    }
+    // Deadlines are hit to the second
+    for (const Firing& f : fired) CHECK_EQ(f.secondOfDay % 60, (uint32_t)0);
+    // Sunrise in Berlin in early June is just before 05:00 CEST
+    CHECK(s.getSunriseTime() >= String("04:40") && s.getSunriseTime() <= String("05:00"));
+}
+
+TEST(millis_until_due_is_the_exact_sleep) {
+    Configuration config;
+    setZone(config, "Etc/UTC");
+    config.timers = {timerAt(7, 15), timerAt(19, 45)};
+    ++config.gen.timers;
+    Scheduler s(&config);
+    s.syncTime(utcAt(2025, 1, 10, 7, 0, 0) + 20);
+    s.update();
+    CHECK(!s.pollDue());
+    for (int i = 0; i < 6; ++i) {
+        uint32_t wait = s.millisUntilDue();
+        CHECK(wait > 0 && wait != UINT32_MAX);
+        // One millisecond early: not yet
+        advanceSimulatedMillis(wait - 1);
+        s.update();
+        CHECK(!s.pollDue());
+        advanceSimulatedMillis(1);
+        s.update();
+        CHECK(s.pollDue());
+        CHECK_EQ(s.clock().second(), (uint8_t)0);
+        CHECK(s.clock().minuteOfDay() == 7 * 60 + 15 || s.clock().minuteOfDay() == 19 * 60 + 45);
+    }
+}
+
+TEST(dst_changes_neither_skip_nor_repeat_timers) {
+    Configuration config;
+    setZone(config, "America/New_York");
+    // 02:30 does not exist on the spring day; 01:30 happens twice in the fall
+    config.timers = {timerAt(1, 30), timerAt(2, 30), timerAt(3, 0)};
+    ++config.gen.timers;
+    for (int month : {3, 11}) {
+        Scheduler s(&config);
+        int day = month == 3 ? 9 : 2;
+        s.syncTime(utcAt(2025, month, day - 1, 12, 0, month == 3 ? -5 * 3600 : -4 * 3600));
+        std::vector<Firing> fired = run(s, 2 * 86400 * 1000u);
+        auto days = byDay(fired);
+        for (auto& d : days) CHECK_EQ(d.second.size(), (size_t)3);
+        CHECK_EQ(fired.size(), (size_t)6);
+    }
+}
+
+TEST(timer_edits_rearm_without_refiring) {
+    Configuration config;
+    setZone(config, "Etc/UTC");
+    config.timers = {timerAt(10, 0)};
+    ++config.gen.timers;
+    Scheduler s(&config);
+    s.syncTime(utcAt(2025, 5, 5, 9, 58, 0));
+    std::vector<Firing> fired = run(s, 5 * 60 * 1000);
+    CHECK_EQ(fired.size(), (size_t)1);
+
+    // Now 10:03: a timer added for 10:05 fires, one for 09:00 waits for tomorrow
+    config.timers.push_back(timerAt(10, 5));
+    config.timers.push_back(timerAt(9, 0));
+    ++config.gen.timers;
+    fired = run(s, 10 * 60 * 1000);
+    CHECK_EQ(fired.size(), (size_t)1);
+    CHECK(!fired.empty() && fired[0].minute == 10 * 60 + 5);
+
+    // Editing the one that already ran today does not run it again
+    config.timers[0].brightness = 10;
+    ++config.gen.timers;
+    fired = run(s, 60 * 1000);
+    CHECK_EQ(fired.size(), (size_t)0);
+}
+
+TEST(clock_steps_fire_once_and_rearm) {
+    Configuration config;
+    setZone(config, "Etc/UTC");
+    config.timers = {timerAt(8, 0), timerAt(9, 0), timerAt(10, 0)};
+    ++config.gen.timers;
+    Scheduler s(&config);
+    s.syncTime(utcAt(2025, 8, 1, 7, 0, 0));
+    CHECK_EQ(run(s, 1000).size(), (size_t)0);
+
+    // NTP moves the clock forward past two deadlines: one catch-up firing
+    s.syncTime(utcAt(2025, 8, 1, 9, 30, 0));
+    CHECK_EQ(run(s, 1000).size(), (size_t)1);
+    std::vector<Firing> fired = run(s, 3600 * 1000);
+    CHECK_EQ(fired.size(), (size_t)1);
+    CHECK(!fired.empty() && fired[0].minute == 600);
+
+    // ...and back by two days: the armed deadline is re-armed, not waited out
+    s.syncTime(utcAt(2025, 7, 30, 7, 59, 0));
+    fired = run(s, 120 * 1000);
+    CHECK_EQ(fired.size(), (size_t)1);
+    CHECK(!fired.empty() && fired[0].minute == 480);
+}
@@ -0,0 +1,260 @@
+#include "test.h"
+#include "config.h"
+#include "presets.h"
+#include "rtc_time.h"
+#include "scheduler.h"
+#include "sntp.h"
+#include <WiFi.h>
+
+PresetStore presetStore;
+
+// A local NTP server stand-in: answers the requests SntpClient sends through
+// the loopback socket bound to its local port
+
+static const uint16_t CLIENT_PORT = 2390;
+static const uint32_t SEVENTY_YEARS = 2208988800UL;
+static const IPAddress SERVER(10, 0, 0, 123);
+
+struct Reply {
+    uint64_t unixMs = 0;     // server transmit time
+    uint8_t leap = 0;
+    uint8_t mode = 4;        // server
+    uint8_t stratum = 2;
+    bool echoNonce = true;   // originate timestamp = the request's transmit timestamp
+    size_t size = 48;
+};
+
+static std::vector<uint8_t> answer(const UdpPacket& request, const Reply& r) {
+    std::vector<uint8_t> packet(48, 0);
+    packet[0] = (r.leap << 6) | (4 << 3) | r.mode;
+    packet[1] = r.stratum;
+    for (int i = 0; i < 8; ++i) packet[24 + i] = r.echoNonce ? request.data[40 + i] : ~request.data[40 + i];
+    uint32_t seconds = (uint32_t)(r.unixMs / 1000) + SEVENTY_YEARS;
+    uint32_t fraction = (uint32_t)(((r.unixMs % 1000) << 32) / 1000);
+    for (int i = 0; i < 4; ++i) {
+        packet[40 + i] = seconds >> (24 - 8 * i);
+        packet[44 + i] = fraction >> (24 - 8 * i);
+    }
+    packet.resize(r.size);
+    return packet;
+}
+
+static std::ostream& operator<<(std::ostream& out, SntpClient::Status status) {
+    static const char* names[] = {"Idle", "Waiting", "Synced", "Failed"};
+    return out << names[(int)status];
+}
+
+static WiFiUDP& socket() {
+    WiFiUDP* udp = WiFiUDP::boundTo(CLIENT_PORT);
+    if (!udp) {
+        test::fail(__FILE__, __LINE__, "no socket bound to the NTP client port");
+        abort();
+    }
+    return *udp;
+}
+
+static void serve(const Reply& r) {
+    WiFiUDP& udp = socket();
+    udp.deliver(answer(udp.sent.back(), r));
+}
+
+static void resetNetwork() {
+    WiFi.reset();
+    WiFi.mode(WIFI_STA);
+    WiFi.hosts["pool.ntp.org"] = SERVER;
+}
+
+TEST(request_is_one_client_packet_to_port_123) {
+    resetNetwork();
+    SntpClient client;
+    CHECK(client.request("pool.ntp.org", 1000));
+    CHECK(client.busy());
+    WiFiUDP& udp = socket();
+    CHECK_EQ(udp.sent.size(), (size_t)1);
+    const UdpPacket& p = udp.sent[0];
+    CHECK_EQ((uint32_t)p.address, (uint32_t)SERVER);
+    CHECK_EQ(p.port, (uint16_t)123);
+    CHECK_EQ(p.data.size(), (size_t)48);
+    CHECK_EQ(p.data[0], (uint8_t)0x23);
+    CHECK_EQ(client.poll(1001), SntpClient::Status::Waiting);
+}
+
+TEST(reply_is_server_time_plus_half_the_round_trip) {
+    resetNetwork();
+    SntpClient client;
+    CHECK(client.request("pool.ntp.org", 5000));
+    serve({1700000000250ULL});
+    CHECK_EQ(client.poll(5040), SntpClient::Status::Synced);
+    CHECK_EQ(client.epoch(), (uint32_t)1700000000);
+    CHECK_EQ(client.epochMillis(), (uint16_t)270);
+    CHECK_EQ(client.atMillis(), (uint32_t)5040);
+    // Reported once, then idle until the next request
+    CHECK(!client.busy());
+    CHECK_EQ(client.poll(5041), SntpClient::Status::Idle);
+
+    // A carry from the round trip into the next second
+    CHECK(client.request("pool.ntp.org", 6000));
+    serve({1700000001990ULL});
+    CHECK_EQ(client.poll(6100), SntpClient::Status::Synced);
+    CHECK_EQ(client.epoch(), (uint32_t)1700000002);
+    CHECK_EQ(client.epochMillis(), (uint16_t)40);
+}
+
+TEST(unusable_replies_are_ignored) {
+    resetNetwork();
+    SntpClient client;
+    CHECK(client.request("pool.ntp.org", 0));
+    Reply bad[6];
+    bad[0].echoNonce = false;  // not an answer to this request
+    bad[1].mode = 3;           // another client
+    bad[2].leap = 3;           // unsynchronized server
+    bad[3].stratum = 0;        // kiss-o'-death
+    bad[4].stratum = 16;
+    bad[5].size = 47;          // truncated
+    uint32_t now = 10;
+    for (Reply& r : bad) {
+        r.unixMs = 1800000000000ULL;
+        serve(r);
+        CHECK_EQ(client.poll(now), SntpClient::Status::Waiting);
+        now += 10;
+    }
+    CHECK(socket().inbox.empty());
+    serve({1700000000000ULL});
+    CHECK_EQ(client.poll(now), SntpClient::Status::Synced);
+    CHECK_EQ(client.epoch(), (uint32_t)1700000000);
+}
+
+TEST(lost_request_times_out_and_resolves_again) {
+    resetNetwork();
+    SntpClient client;
+    CHECK(client.request("pool.ntp.org", 100));
+    CHECK_EQ(client.poll(100 + NTP_TIMEOUT - 1), SntpClient::Status::Waiting);
+    CHECK_EQ(client.poll(100 + NTP_TIMEOUT), SntpClient::Status::Failed);
+    CHECK_EQ(client.poll(100 + NTP_TIMEOUT + 1), SntpClient::Status::Idle);
+
+    // The reply arrives late; the name now points at another server
+    serve({1600000000000ULL});
+    IPAddress other(10, 0, 0, 124);
+    WiFi.hosts["pool.ntp.org"] = other;
+    CHECK(client.request("pool.ntp.org", 5000));
+    CHECK_EQ((uint32_t)socket().sent.back().address, (uint32_t)other);
+    // ...and is dropped instead of being taken as the answer
+    CHECK(socket().inbox.empty());
+    CHECK_EQ(client.poll(5010), SntpClient::Status::Waiting);
+
+    // Timeouts are measured across millis() wraparound
+    CHECK(client.request("pool.ntp.org", UINT32_MAX - 100));
+    CHECK_EQ(client.poll(NTP_TIMEOUT - 200), SntpClient::Status::Waiting);
+    CHECK_EQ(client.poll(NTP_TIMEOUT - 101), SntpClient::Status::Failed);
+}
+
+TEST(unresolvable_name_or_failed_send_sends_nothing) {
+    resetNetwork();
+    SntpClient client;
+    CHECK(!client.request("unknown.example", 0));
+    CHECK(!client.busy());
+    CHECK(socket().sent.empty());
+    socket().sendSucceeds = false;
+    CHECK(!client.request("pool.ntp.org", 0));
+    CHECK(!client.busy());
+    CHECK_EQ(client.poll(NTP_TIMEOUT * 2), SntpClient::Status::Idle);
+    socket().sendSucceeds = true;
+    CHECK(client.request("pool.ntp.org", 0));
+}
+
+// Scheduler::update() from the loop: never waits for the network, retries on
+// the first-sync interval, and keeps the time for the next boot
+static void tick(Scheduler& s, uint32_t ms) {
+    hostAdvanceMillis(ms);
+    s.update();
+}
+
+TEST(scheduler_retries_until_synced_and_boots_from_the_stored_time) {
+    resetNetwork();
+    Configuration config;
+    config.time.timezone = "Etc/UTC";
+    config.time.ntpServer = "pool.ntp.org";
+    ++config.gen.time;
+    Scheduler s(&config);
+    s.begin();
+    s.update();
+    CHECK(!s.isTimeValid());
+    // Nothing goes out until the link is up
+    CHECK(socket().sent.empty());
+    WiFi.connect();
+    tick(s, 10);
+    CHECK_EQ(socket().sent.size(), (size_t)1);
+
+    // Lost: retried on the first-sync interval, not before
+    tick(s, NTP_TIMEOUT);
+    for (uint32_t t = 0; t < NTP_FIRST_SYNC_INTERVAL - NTP_TIMEOUT - 100; t += 100) tick(s, 100);
+    CHECK_EQ(socket().sent.size(), (size_t)1);
+    tick(s, 200);
+    CHECK_EQ(socket().sent.size(), (size_t)2);
+    CHECK(!s.isTimeValid());
+
+    // Answered 30 ms later
+    tick(s, 30);
+    serve({1750000000000ULL});
+    tick(s, 0);
+    CHECK(s.isTimeValid());
+    CHECK_EQ(s.clock().utcEpoch(), (uint32_t)1750000000);
+    CHECK_EQ(s.clock().subSecond(), (uint16_t)15);
+
+    // No new request until the regular interval
+    size_t sent = socket().sent.size();
+    tick(s, NTP_RETRY_INTERVAL + 1000);
+    CHECK_EQ(socket().sent.size(), sent);
+    uint32_t stored;
+    CHECK(restoreRtcTime(stored));
+    CHECK_EQ(stored, s.clock().utcEpoch());
+
+    // A restart resumes from RTC memory before the network is up
+    WiFi.dropLink();
+    Scheduler rebooted(&config);
+    rebooted.begin();
+    rebooted.update();
+    CHECK(rebooted.isTimeValid());
+    CHECK(rebooted.clock().utcEpoch() >= stored + 1);
+}
+
+TEST(estimated_time_runs_the_schedule_until_ntp_replaces_it) {
+    resetNetwork();
+    Configuration config;
+    config.time.timezone = "Etc/UTC";
+    config.time.ntpServer = "pool.ntp.org";
+    ++config.gen.time;
+    Timer morning, evening;
+    morning.enabled = evening.enabled = true;
+    morning.hour = 8;
+    morning.presetId = 1;
+    evening.hour = 20;
+    evening.presetId = 2;
+    config.timers = {morning, evening};
+    ++config.gen.timers;
+
+    // Saved at 21:00 before the power cut; it is really 12:00 the next day
+    const uint32_t saved = 1748811600;  // 2025-06-01 21:00 UTC
+    Scheduler s(&config);
+    s.estimateTime(saved);
+    s.update();
+    CHECK(s.isTimeValid());
+    CHECK(s.getActiveTimer() && s.getActiveTimer()->presetId == 2);
+    CHECK(!s.pollDue());
+
+    WiFi.connect();
+    tick(s, 10);
+    tick(s, 20);
+    serve({(saved + 15 * 3600) * 1000ULL});
+    tick(s, 0);
+    CHECK_EQ(s.clock().hour(), (uint8_t)12);
+    // Reported once so the morning timer is applied now, then armed for 20:00
+    CHECK(s.pollDue());
+    CHECK(s.getActiveTimer() && s.getActiveTimer()->presetId == 1);
+    CHECK(!s.pollDue());
+    CHECK(s.millisUntilDue() > 8 * 3600 * 1000 - 1000 && s.millisUntilDue() <= 8 * 3600 * 1000);
+
+    // A clock that is already set is not overridden by an estimate
+    s.estimateTime(saved);
+    CHECK_EQ(s.clock().hour(), (uint8_t)12);
+}
@@ -0,0 +1,148 @@
+#include "test.h"
+#include "solar.h"
+#include "timezone.h"
+#include <math.h>
+
+// Almanac sunrise/sunset (local clock time, rounded to the minute)
+struct Reference {
+    const char* place;
+    double latitude, longitude;
+    int32_t year;
+    uint8_t month, day;
+    int32_t offset;  // seconds, in effect that day
+    int16_t sunrise, sunset;
+};
+
+#define HM(h, m) ((h) * 60 + (m))
+
+static const Reference REFERENCES[] = {
+    {"London", 51.5074, -0.1278, 2024, 6, 21, 3600, HM(4, 43), HM(21, 21)},
+    {"London", 51.5074, -0.1278, 2024, 12, 21, 0, HM(8, 3), HM(15, 53)},
+    {"New York", 40.7128, -74.0060, 2024, 6, 20, -4 * 3600, HM(5, 25), HM(20, 31)},
+    {"Sydney", -33.8688, 151.2093, 2024, 12, 21, 11 * 3600, HM(5, 41), HM(20, 5)},
+    {"Singapore", 1.3521, 103.8198, 2024, 3, 20, 8 * 3600, HM(7, 8), HM(19, 14)},
+    {"Reykjavik", 64.1466, -21.9426, 2024, 6, 21, 0, HM(2, 55), HM(0, 3)},  // sets after midnight
+};
+
+static int circularDiff(int a, int b) {
+    int d = abs(a - b) % 1440;
+    return std::min(d, 1440 - d);
+}
+
+TEST(almanac_reference_days) {
+    for (const Reference& r : REFERENCES) {
+        SolarDay sun;
+        computeSolarDay(r.year, r.month, r.day, r.latitude, r.longitude, r.offset, sun);
+        if (circularDiff(sun.sunrise, r.sunrise) > 2 || circularDiff(sun.sunset, r.sunset) > 2) {
+            char msg[128];
+            snprintf(msg, sizeof(msg), "%s %d-%02d-%02d: %d/%d vs almanac %d/%d", r.place, r.year, r.month, r.day,
+                     sun.sunrise, sun.sunset, r.sunrise, r.sunset);
+            test::fail(__FILE__, __LINE__, msg);
+        }
+        // Civil twilight brackets the day (it lasts all night in Reykjavik in
+        // June), solar noon is in the middle of it
+        if (sun.civilDawn != SOLAR_NO_EVENT) CHECK(circularDiff(sun.civilDawn, sun.sunrise) >= 20);
+        if (sun.civilDusk != SOLAR_NO_EVENT) CHECK(circularDiff(sun.civilDusk, sun.sunset) >= 20);
+        CHECK_EQ(sun.civilDawn == SOLAR_NO_EVENT, r.latitude > 60);
+        int dayLength = (sun.sunset - sun.sunrise + 1440) % 1440;
+        CHECK(circularDiff(sun.solarNoon, (sun.sunrise + dayLength / 2) % 1440) <= 2);
+    }
+}
+
+TEST(polar_day_and_night_have_no_events) {
+    SolarDay sun;
+    // Tromsø: midnight sun in June, polar night in December
+    computeSolarDay(2024, 6, 21, 69.6492, 18.9553, 7200, sun);
+    CHECK_EQ(sun.sunrise, (int16_t)SOLAR_NO_EVENT);
+    CHECK_EQ(sun.sunset, (int16_t)SOLAR_NO_EVENT);
+    CHECK(sun.solarNoon != SOLAR_NO_EVENT);
+    computeSolarDay(2024, 12, 21, 69.6492, 18.9553, 3600, sun);
+    CHECK_EQ(sun.sunrise, (int16_t)SOLAR_NO_EVENT);
+    CHECK_EQ(sun.sunset, (int16_t)SOLAR_NO_EVENT);
+    // ...but the sun still gets within 6 degrees of the horizon at noon
+    CHECK(sun.civilDawn != SOLAR_NO_EVENT && sun.civilDusk != SOLAR_NO_EVENT);
+}
+
+// NOAA "General Solar Position Calculations": the low-order Fourier series in
+// the fractional year, a different formulation from the Meeus series in
+// solar.cpp. Elevation (degrees) at `utcMinutes` after 0h UTC of `dayOfYear`
+// in a common year.
+static double noaaElevation(int dayOfYear, double utcMinutes, double latitude, double longitude) {
+    double g = 2 * M_PI / 365 * (dayOfYear - 1 + (utcMinutes / 60 - 12) / 24);
+    double eqTime = 229.18 * (0.000075 + 0.001868 * cos(g) - 0.032077 * sin(g) -
+                              0.014615 * cos(2 * g) - 0.040849 * sin(2 * g));
+    double decl = 0.006918 - 0.399912 * cos(g) + 0.070257 * sin(g) - 0.006758 * cos(2 * g) +
+                  0.000907 * sin(2 * g) - 0.002697 * cos(3 * g) + 0.00148 * sin(3 * g);
+    double trueSolar = utcMinutes + eqTime + 4 * longitude;
+    double hourAngle = (trueSolar / 4 - 180) * M_PI / 180;
+    double lat = latitude * M_PI / 180;
+    double cosZenith = sin(lat) * sin(decl) + cos(lat) * cos(decl) * cos(hourAngle);
+    return 90 - acos(std::max(-1.0, std::min(1.0, cosZenith))) * 180 / M_PI;
+}
+
+// UTC minute in the 24 h from `from` at which the elevation crosses
+// `threshold` in the given direction, interpolated on a one-minute scan; NAN
+// if it does not
+static double crossing(int doy, double lat, double lon, double threshold, bool rising, double from) {
+    double prev = noaaElevation(doy, from, lat, lon) - threshold;
+    for (double m = from + 1; m <= from + 1440; m += 1) {
+        double cur = noaaElevation(doy, m, lat, lon) - threshold;
+        if (rising ? (prev < 0 && cur >= 0) : (prev >= 0 && cur < 0)) return m - cur / (cur - prev);
+        prev = cur;
+    }
+    return NAN;
+}
+
+TEST(agrees_with_noaa_general_formulas_across_latitudes_and_seasons) {
+    int compared = 0;
+    int worst = 0;
+    for (double lat = -60; lat <= 60; lat += 7.5) {
+        for (double lon : {-150.0, -75.0, 0.0, 10.0, 120.0, 175.0}) {
+            // Local offset from the longitude, as a zone would have it
+            int32_t offset = (int32_t)lround(lon / 15) * 3600;
+            for (int32_t dayNumber = daysFromCivil(2025, 1, 3); dayNumber < daysFromCivil(2026, 1, 1); dayNumber += 11) {
+                int32_t y;
+                uint8_t m, d;
+                civilFromDays(dayNumber, y, m, d);
+                int doy = dayNumber - daysFromCivil(y, 1, 1) + 1;
+                SolarDay sun;
+                computeSolarDay(y, m, d, lat, lon, offset, sun);
+                // The local day in UTC minutes relative to 0h UTC of the date
+                double from = -offset / 60.0;
+                struct { int16_t got; double threshold; bool rising; } events[] = {
+                    {sun.sunrise, -0.833, true}, {sun.sunset, -0.833, false},
+                    {sun.civilDawn, -6, true}, {sun.civilDusk, -6, false}};
+                for (auto& e : events) {
+                    double ref = crossing(doy, lat, lon, e.threshold, e.rising, from);
+                    if (isnan(ref)) {
+                        CHECK_EQ(e.got, (int16_t)SOLAR_NO_EVENT);
+                        continue;
+                    }
+                    int expected = ((int)lround(ref + offset / 60.0) % 1440 + 1440) % 1440;
+                    int diff = circularDiff(e.got, expected);
+                    worst = std::max(worst, diff);
+                    ++compared;
+                    // The short series is good to a minute or two; at high latitude
+                    // the sun grazes the threshold and that becomes several
+                    if (diff > (fabs(lat) > 50 ? 8 : 3)) {
+                        char msg[128];
+                        snprintf(msg, sizeof(msg), "lat %.1f lon %.1f %d-%02d-%02d: %d vs %d",
+                                 lat, lon, y, m, d, e.got, expected);
+                        test::fail(__FILE__, __LINE__, msg);
+                    }
+                }
+            }
+        }
+    }
+    CHECK(compared > 10000);
+    printf("  %d events, worst difference %d min\n", compared, worst);
+}
+
+TEST(offset_shifts_the_local_day_only) {
+    SolarDay utc, local;
+    computeSolarDay(2025, 4, 15, 48.8566, 2.3522, 0, utc);
+    computeSolarDay(2025, 4, 15, 48.8566, 2.3522, 7200, local);
+    CHECK_EQ(local.sunrise, (int16_t)(utc.sunrise + 120));
+    CHECK_EQ(local.sunset, (int16_t)(utc.sunset + 120));
+    CHECK_EQ(local.solarNoon, (int16_t)(utc.solarNoon + 120));
+}
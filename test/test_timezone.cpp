@@ -0,0 +1,156 @@
+#include "test.h"
+#include "config.h"
+#include "presets.h"
+#include "timezone.h"
+#include <stdlib.h>
+#include <time.h>
+#include <fstream>
+#include <sstream>
+
+PresetStore presetStore;
+
+// The table is checked against the C library: every zone's POSIX rule string
+// (straight from timezones.json) over the whole uint32 epoch range, and the
+// named zone from the system zoneinfo for the years the rules have held.
+
+static long libcOffset(int64_t utc) {
+    time_t t = (time_t)utc;
+    struct tm local;
+    localtime_r(&t, &local);
+    return local.tm_gmtoff;
+}
+
+static void useTz(const char* tz) {
+    setenv("TZ", tz, 1);
+    tzset();
+}
+
+static std::vector<std::pair<std::string, std::string>> zonesFromJson() {
+    std::ifstream in(FIRMWARE_ASSETS_DIR "/timezones.json");
+    std::stringstream text;
+    text << in.rdbuf();
+    std::string json = text.str();
+    DynamicJsonDocument doc(16384);
+    std::vector<std::pair<std::string, std::string>> zones;
+    if (deserializeJson(doc, json.c_str(), json.size())) return zones;
+    for (JsonObjectConst zone : doc.as<JsonArrayConst>()) {
+        zones.emplace_back(zone["name"].as<const char*>(), zone["posix"].as<const char*>());
+    }
+    return zones;
+}
+
+TEST(calendar_matches_gmtime_including_leap_days) {
+    // 1900 and 2100 are not leap years, 2000 is
+    for (int64_t day = -25567; day < 49710; ++day) {
+        time_t t = (time_t)(day * 86400);
+        struct tm utc;
+        gmtime_r(&t, &utc);
+        int32_t y;
+        uint8_t m, d;
+        civilFromDays((int32_t)day, y, m, d);
+        if (y != utc.tm_year + 1900 || m != utc.tm_mon + 1 || d != utc.tm_mday || weekdayFromDays((int32_t)day) != utc.tm_wday) {
+            CHECK_EQ(day, (int64_t)-1);  // reports the first mismatch only
+            break;
+        }
+        if (daysFromCivil(y, m, d) != day) {
+            CHECK_EQ(daysFromCivil(y, m, d), (int32_t)day);
+            break;
+        }
+    }
+    CHECK_EQ(daysFromCivil(2000, 2, 29) + 1, daysFromCivil(2000, 3, 1));
+    CHECK_EQ(daysFromCivil(2100, 2, 28) + 1, daysFromCivil(2100, 3, 1));
+    CHECK_EQ(daysFromCivil(2024, 3, 1) - daysFromCivil(2024, 2, 1), (int32_t)29);
+}
+
+TEST(table_matches_json) {
+    auto zones = zonesFromJson();
+    CHECK_EQ(zones.size(), TIMEZONE_COUNT);
+    for (auto& zone : zones) CHECK(findTimezone(zone.first.c_str()) != nullptr);
+    CHECK(findTimezone("Mars/Olympus_Mons") == nullptr);
+}
+
+TEST(posix_rules_agree_with_libc_at_every_transition) {
+    for (auto& zone : zonesFromJson()) {
+        const TimezoneInfo* tz = findTimezone(zone.first.c_str());
+        if (!tz) continue;
+        useTz(zone.second.c_str());
+        uint32_t t = 0;
+        size_t transitions = 0;
+        int mismatches = 0;
+        for (;;) {
+            uint32_t until;
+            int32_t offset = timezoneOffsetAt(*tz, true, t, until);
+            // Constant over [t, until): check both ends and the middle
+            for (int64_t probe : {(int64_t)t, (int64_t)t + ((int64_t)until - t) / 2, (int64_t)until - 1}) {
+                if (libcOffset(probe) != offset && mismatches++ < 3) {
+                    test::fail(__FILE__, __LINE__, zone.first + " at " + std::to_string(probe) + ": " +
+                               std::to_string(offset) + " vs libc " + std::to_string(libcOffset(probe)));
+                }
+            }
+            if (until == UINT32_MAX) break;
+            // ...and it really changes at `until`
+            if (libcOffset(until) == offset && mismatches++ < 3) {
+                test::fail(__FILE__, __LINE__, zone.first + ": no transition at " + std::to_string(until));
+            }
+            ++transitions;
+            t = until;
+        }
+        // Two transitions a year for DST zones, none otherwise
+        CHECK_EQ(transitions == 0, !tz->hasDst);
+        if (tz->hasDst) CHECK(transitions > 2 * 135);
+        CHECK_EQ(mismatches, 0);
+    }
+}
+
+TEST(named_zones_agree_with_zoneinfo) {
+    std::ifstream probe("/usr/share/zoneinfo/Europe/Berlin");
+    if (!probe) {
+        printf("  (no system zoneinfo, skipped)\n");
+        return;
+    }
+    // Rules in the table are the current ones: compare 2024-2030 hour by hour
+    uint32_t from = (uint32_t)daysFromCivil(2024, 1, 1) * 86400;
+    uint32_t to = (uint32_t)daysFromCivil(2031, 1, 1) * 86400;
+    for (size_t i = 0; i < TIMEZONE_COUNT; ++i) {
+        const TimezoneInfo& tz = TIMEZONES[i];
+        useTz(tz.name);
+        int mismatches = 0;
+        for (uint32_t t = from; t < to; t += 3600) {
+            uint32_t until;
+            if (timezoneOffsetAt(tz, true, t, until) != libcOffset(t)) ++mismatches;
+        }
+        if (mismatches) test::fail(__FILE__, __LINE__, std::string(tz.name) + ": " + std::to_string(mismatches) + " hours differ from zoneinfo");
+    }
+}
+
+TEST(dst_disabled_keeps_standard_time) {
+    const TimezoneInfo* tz = findTimezone("Europe/Berlin");
+    CHECK(tz != nullptr);
+    if (!tz) return;
+    uint32_t until;
+    uint32_t july = (uint32_t)daysFromCivil(2025, 7, 1) * 86400;
+    CHECK_EQ(timezoneOffsetAt(*tz, true, july, until), (int32_t)7200);
+    CHECK_EQ(timezoneOffsetAt(*tz, false, july, until), (int32_t)3600);
+    CHECK_EQ(until, UINT32_MAX);
+}
+
+TEST(configuration_cache_follows_the_clock_both_ways) {
+    Configuration config;
+    config.time.timezone = "America/New_York";
+    config.time.dstEnabled = true;
+    ++config.gen.time;
+    const TimezoneInfo* tz = findTimezone("America/New_York");
+    CHECK(tz != nullptr);
+    if (!tz) return;
+    // 2024-03-10 07:00 UTC: clocks go forward
+    uint32_t change = (uint32_t)daysFromCivil(2024, 3, 10) * 86400 + 7 * 3600;
+    uint32_t probes[] = {change - 1, change, change + 86400 * 200, change - 1, change - 86400 * 30, change + 5};
+    for (uint32_t t : probes) {
+        uint32_t until;
+        CHECK_EQ(config.getTimezoneOffsetSeconds(t), timezoneOffsetAt(*tz, true, t, until));
+    }
+    // Zone change is picked up through the generation
+    config.time.timezone = "Asia/Kolkata";
+    ++config.gen.time;
+    CHECK_EQ(config.getTimezoneOffsetSeconds(change), 19800);
+}
@@ -0,0 +1,188 @@
+#include "test.h"
+#include "config.h"
+#include "loop_scheduler.h"
+#include "wifi_manager.h"
+#include <DNSServer.h>
+#include <WiFi.h>
+
+extern DNSServer captiveDnsServer;
+
+typedef WiFiManager::State State;
+
+static std::ostream& operator<<(std::ostream& out, State state) {
+    static const char* names[] = {"Idle", "Connecting", "Connected", "Backoff"};
+    return out << names[(int)state];
+}
+
+static Configuration network(const char* ssid) {
+    WiFi.reset();
+    captiveDnsServer = DNSServer();
+    Configuration config;
+    config.network.ssid = ssid;
+    config.network.password = "secret";
+    config.network.hostname = "AquariumLED";
+    return config;
+}
+
+// Runs update() every `stepMs` for `ms`; the host clock only moves here, so
+// any delay() inside update() would show up as extra time
+static int blockedCalls = 0;
+static void run(WiFiManager& wifi, uint32_t ms, uint32_t stepMs = 10) {
+    for (uint32_t t = 0; t < ms; t += stepMs) {
+        hostAdvanceMillis(stepMs);
+        uint32_t before = millis();
+        wifi.update(millis());
+        if (millis() != before) ++blockedCalls;
+    }
+}
+
+TEST(no_credentials_opens_the_setup_portal_only) {
+    Configuration config = network("");
+    WiFiManager wifi(&config);
+    wifi.begin(millis());
+    CHECK_EQ(wifi.state(), State::Idle);
+    CHECK(wifi.isAccessPoint());
+    CHECK_EQ(WiFi.getMode(), WIFI_MODE_AP);
+    CHECK_EQ(WiFi.apName, std::string("AquariumLED"));
+    CHECK(captiveDnsServer.running);
+    CHECK_EQ((uint32_t)captiveDnsServer.ip, (uint32_t)IPAddress(192, 168, 4, 1));
+    CHECK_EQ((uint32_t)wifi.ip(), (uint32_t)IPAddress(192, 168, 4, 1));
+    run(wifi, 120000);
+    CHECK_EQ(WiFi.beginCalls, 0);
+    CHECK_EQ(wifi.state(), State::Idle);
+}
+
+TEST(got_ip_event_completes_the_attempt) {
+    Configuration config = network("Tank");
+    WiFiManager wifi(&config);
+    wifi.begin(millis());
+    CHECK_EQ(wifi.state(), State::Connecting);
+    CHECK_EQ(WiFi.getMode(), WIFI_MODE_STA);
+    CHECK(!WiFi.autoReconnect);  // retries are ours
+    CHECK_EQ(WiFi.beginCalls, 1);
+    CHECK_EQ(WiFi.ssid, std::string("Tank"));
+    CHECK_EQ(WiFi.hostname, std::string("AquariumLED"));
+    // The SDK's own disconnect events during an attempt do not end it
+    run(wifi, 5000);
+    WiFi.raise(ARDUINO_EVENT_WIFI_STA_DISCONNECTED);
+    run(wifi, 5000);
+    CHECK_EQ(wifi.state(), State::Connecting);
+    WiFi.connect();
+    CHECK_EQ(wifi.state(), State::Connecting);  // the event only sets a flag
+    run(wifi, 10);
+    CHECK(wifi.isConnected());
+    CHECK(!wifi.isAccessPoint());
+    CHECK_EQ((uint32_t)wifi.ip(), (uint32_t)IPAddress(192, 168, 1, 50));
+    CHECK_EQ(WiFi.beginCalls, 1);
+}
+
+TEST(failed_attempts_back_off_exponentially_then_open_the_portal) {
+    Configuration config = network("Tank");
+    WiFiManager wifi(&config);
+    uint32_t start = millis();
+    wifi.begin(start);
+    // Times at which each attempt started
+    std::vector<uint32_t> attempts = {0};
+    for (uint32_t t = 0; t < 3600000; t += 10) {
+        int before = WiFi.beginCalls;
+        run(wifi, 10);
+        if (WiFi.beginCalls != before) attempts.push_back(millis() - start);
+        if (attempts.size() == 3) {
+            CHECK(wifi.isAccessPoint());
+            CHECK(captiveDnsServer.running);
+            CHECK_EQ(WiFi.getMode(), WIFI_MODE_APSTA);  // the station keeps trying
+        }
+    }
+    CHECK(attempts.size() > 8);
+    uint32_t backoff = WIFI_BACKOFF_MIN;
+    for (size_t i = 1; i < attempts.size(); ++i) {
+        // Timeout, then a wait that doubles from the second failure, capped
+        if (i > 1) backoff = std::min<uint32_t>(backoff * 2, WIFI_BACKOFF_MAX);
+        uint32_t gap = attempts[i] - attempts[i - 1];
+        CHECK(gap >= WIFI_CONNECT_TIMEOUT + backoff && gap <= WIFI_CONNECT_TIMEOUT + backoff + 20);
+    }
+    CHECK_EQ(WiFi.disconnectCalls, (int)attempts.size() - 1 + (wifi.state() == State::Backoff ? 1 : 0));
+
+    // The router comes back: the portal closes, the next loss starts from the minimum
+    while (wifi.state() != State::Connecting) run(wifi, 10);
+    WiFi.connect();
+    run(wifi, 10);
+    CHECK(wifi.isConnected());
+    CHECK(!wifi.isAccessPoint());
+    CHECK(!captiveDnsServer.running);
+    CHECK_EQ(WiFi.getMode(), WIFI_MODE_STA);
+    int before = WiFi.beginCalls;
+    WiFi.dropLink();
+    run(wifi, 10);
+    CHECK_EQ(wifi.state(), State::Backoff);
+    CHECK_EQ(wifi.reconnects(), (uint32_t)1);
+    run(wifi, WIFI_BACKOFF_MIN - 20);
+    CHECK_EQ(WiFi.beginCalls, before);
+    run(wifi, 20);
+    CHECK_EQ(WiFi.beginCalls, before + 1);
+    CHECK_EQ(blockedCalls, 0);
+}
+
+TEST(stale_disconnect_does_not_drop_a_live_link) {
+    Configuration config = network("Tank");
+    WiFiManager wifi(&config);
+    wifi.begin(millis());
+    WiFi.connect();
+    run(wifi, 10);
+    CHECK(wifi.isConnected());
+    // Disconnected event, but the link is up again by the time update() runs
+    WiFi.raise(ARDUINO_EVENT_WIFI_STA_DISCONNECTED);
+    run(wifi, 10);
+    CHECK(wifi.isConnected());
+    CHECK_EQ(wifi.reconnects(), (uint32_t)0);
+}
+
+// Reconnect storm under the loop scheduler: the link flaps every few tens of
+// milliseconds for ten minutes while the frame task runs at FRAMES_PER_SECOND
+static WiFiManager* stormWifi = nullptr;
+static std::vector<uint32_t> frameTimes;
+
+TEST(reconnect_storm_never_delays_a_frame) {
+    Configuration config = network("Tank");
+    WiFiManager wifi(&config);
+    stormWifi = &wifi;
+    LoopScheduler loop;
+    loop.setFrameTask("render", []() { frameTimes.push_back(millis()); }, 1000 / FRAMES_PER_SECOND, 8000);
+    loop.addTask("network", []() {
+        uint32_t before = millis();
+        stormWifi->update(millis());
+        if (millis() != before) ++blockedCalls;
+    }, 50, 2, 500);
+    wifi.begin(millis());
+
+    uint32_t seed = 12345;
+    uint32_t start = millis();
+    int events = 0;
+    while (millis() - start < 600000) {
+        seed = seed * 1103515245 + 12345;
+        if ((seed >> 16) % 40 == 0) {
+            switch ((seed >> 8) % 3) {
+                case 0: WiFi.connect(); break;
+                case 1: WiFi.dropLink(); break;
+                default: WiFi.raise(ARDUINO_EVENT_WIFI_STA_DISCONNECTED); break;
+            }
+            ++events;
+        }
+        loop.runOnce();
+        hostAdvanceMillis(1);
+    }
+    CHECK(events > 10000);
+    CHECK(wifi.reconnects() > 100);
+    CHECK_EQ(blockedCalls, 0);
+    // Every frame on its deadline
+    uint32_t interval = 1000 / FRAMES_PER_SECOND;
+    int late = 0;
+    for (size_t i = 1; i < frameTimes.size(); ++i) {
+        if (frameTimes[i] - frameTimes[i - 1] != interval) ++late;
+    }
+    CHECK_EQ(late, 0);
+    CHECK_EQ(frameTimes.size(), (size_t)((600000 + interval - 1) / interval));
+    DynamicJsonDocument doc(2048);
+    loop.writeStats(doc.to<JsonObject>());
+    CHECK_EQ(doc["lateFrames"].as<uint32_t>(), (uint32_t)0);
+}